@@ -498,6 +498,9 @@ static void at_cgdcont_test_cb(gboolean ok, GAtResult *result,
 
 	ofono_gprs_set_cid_range(gprs, min, max);
 
+	/* Most modems handle one PDP context activation at a time */
+	ofono_gprs_set_max_pending_activations(gprs, 1);
+
 	g_at_chat_send(gd->chat, "AT+CGREG=?", cgreg_prefix,
 			at_cgreg_test_cb, gprs, NULL);
 
@@ -737,6 +737,12 @@ static void at_sms_initialized(struct ofono_sms *sms)
 	else
 		at_cmgl_set_cpms(sms, data->incoming);
 
+	/*
+	 * GAtChat queues commands in order, so further +CMGS can be
+	 * handed over while the network acknowledges the first one.
+	 */
+	ofono_sms_set_max_pending_submits(sms, 4);
+
 	ofono_sms_register(sms);
 }
 
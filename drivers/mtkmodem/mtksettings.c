@@ -192,6 +192,8 @@ static const GDBusMethodTable mtk_settings_methods[] = {
 static const GDBusSignalTable mtk_settings_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -33,9 +33,22 @@
 
 #include <glib.h>
 
+#include "ringbuffer.h"
 #include "qmi.h"
 #include "ctl.h"
 
+/* Large enough to hold two maximum sized QMUX frames */
+#define QMI_BUFFER_SIZE 131072
+
+/*
+ * Seconds to wait for a response to a service request.  This has to cover
+ * the slowest operations, i.e. network scans.
+ */
+#define QMI_SERVICE_TIMEOUT 180
+
+/* Releasing a client id has no timer of its own */
+#define QMI_RELEASE_TIMEOUT 5
+
 typedef void (*qmi_message_func_t)(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data);
 
@@ -46,9 +59,11 @@ struct qmi_device {
 	bool close_on_unref;
 	guint read_watch;
 	guint write_watch;
+	struct ring_buffer *buf;
+	unsigned char *frame;
 	GQueue *req_queue;
-	GQueue *control_queue;
-	GQueue *service_queue;
+	GHashTable *control_table;	/* Sent control requests by tid */
+	GHashTable *service_table;	/* Sent service requests by tid */
 	uint8_t next_control_tid;
 	uint16_t next_service_tid;
 	qmi_debug_func_t debug_func;
@@ -72,26 +87,42 @@ struct qmi_service {
 	uint8_t client_id;
 	uint16_t next_notify_id;
 	GList *notify_list;
+	GHashTable *notify_table;
 };
 
+#define QMI_PARAM_MIN_SIZE 64
+
 struct qmi_param {
 	void *data;
 	uint16_t length;
+	size_t size;
 };
 
+/*
+ * TLV offsets are indexed lazily by type, the first lookup of a type not
+ * seen yet continues the scan from where the previous one stopped.  An
+ * offset of zero marks a type that has not been found (yet).
+ */
 struct qmi_result {
 	uint16_t message;
 	uint16_t result;
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint16_t scanned;
+	uint16_t index[256];
 };
 
 struct qmi_request {
+	struct qmi_device *device;
 	uint16_t tid;
+	uint8_t service;
 	uint8_t client;
 	void *buf;
 	size_t len;
+	unsigned int timeout;
+	guint timeout_source;
 	qmi_message_func_t callback;
 	void *user_data;
 };
@@ -166,6 +197,7 @@ static struct qmi_request *__request_alloc(uint8_t service,
 		return NULL;
 	}
 
+	req->service = service;
 	req->client = client;
 
 	hdr = req->buf;
@@ -197,6 +229,9 @@ static void __request_free(gpointer data, gpointer user_data)
 {
 	struct qmi_request *req = data;
 
+	if (req->timeout_source > 0)
+		g_source_remove(req->timeout_source);
+
 	g_free(req->buf);
 	g_free(req);
 }
@@ -209,6 +244,12 @@ static gint __request_compare(gconstpointer a, gconstpointer b)
 	return req->tid - tid;
 }
 
+static void __request_table_free(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	__request_free(value, NULL);
+}
+
 static void __notify_free(gpointer data, gpointer user_data)
 {
 	struct qmi_notify *notify = data;
@@ -590,12 +631,84 @@ static void __debug_device(struct qmi_device *device,
 	device->debug_func(strbuf, device->debug_data);
 }
 
+static GHashTable *request_table(struct qmi_device *device,
+						struct qmi_request *req)
+{
+	if (req->service == QMI_SERVICE_CONTROL)
+		return device->control_table;
+
+	return device->service_table;
+}
+
+/*
+ * The transaction ids wrap, skip the ones of requests still waiting for
+ * their response.  At most every sent request needs to be skipped.
+ */
+static uint8_t control_tid_alloc(struct qmi_device *device)
+{
+	guint busy = g_hash_table_size(device->control_table);
+	guint i;
+
+	for (i = 0; i <= busy; i++) {
+		if (device->next_control_tid < 1)
+			device->next_control_tid = 1;
+
+		if (!g_hash_table_lookup(device->control_table,
+				GUINT_TO_POINTER(device->next_control_tid)))
+			break;
+
+		device->next_control_tid++;
+	}
+
+	return device->next_control_tid++;
+}
+
+static uint16_t service_tid_alloc(struct qmi_device *device)
+{
+	guint busy = g_hash_table_size(device->service_table);
+	guint i;
+
+	for (i = 0; i <= busy; i++) {
+		if (device->next_service_tid < 256)
+			device->next_service_tid = 256;
+
+		if (!g_hash_table_lookup(device->service_table,
+				GUINT_TO_POINTER(device->next_service_tid)))
+			break;
+
+		device->next_service_tid++;
+	}
+
+	return device->next_service_tid++;
+}
+
+static gboolean request_timeout(gpointer user_data)
+{
+	struct qmi_request *req = user_data;
+	struct qmi_device *device = req->device;
+
+	req->timeout_source = 0;
+
+	__debug_device(device, "request timed out [service=%d,tid=%d]",
+						req->service, req->tid);
+
+	g_hash_table_steal(request_table(device, req),
+					GUINT_TO_POINTER(req->tid));
+
+	if (req->callback)
+		req->callback(0x0000, 0x0000, NULL, req->user_data);
+
+	__request_free(req, NULL);
+
+	return FALSE;
+}
+
 static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
 	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
-	struct qmi_request *req;
+	struct qmi_request *req, *old;
+	GHashTable *table;
 	ssize_t bytes_written;
 
 	req = g_queue_pop_head(device->req_queue);
@@ -612,12 +725,32 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 	__debug_msg(' ', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
 
-	hdr = req->buf;
+	table = request_table(device, req);
 
-	if (hdr->service == QMI_SERVICE_CONTROL)
-		g_queue_push_tail(device->control_queue, req);
-	else
-		g_queue_push_tail(device->service_queue, req);
+	/*
+	 * Only possible if every tid was busy when this one was allocated,
+	 * the response can no longer be told apart so fail the old request.
+	 */
+	old = g_hash_table_lookup(table, GUINT_TO_POINTER(req->tid));
+	if (old) {
+		__debug_device(device, "request superseded [service=%d,tid=%d]",
+						old->service, old->tid);
+
+		g_hash_table_steal(table, GUINT_TO_POINTER(old->tid));
+	}
+
+	g_hash_table_insert(table, GUINT_TO_POINTER(req->tid), req);
+
+	if (old) {
+		if (old->callback)
+			old->callback(0x0000, 0x0000, NULL, old->user_data);
+
+		__request_free(old, NULL);
+	}
+
+	if (req->timeout > 0)
+		req->timeout_source = g_timeout_add_seconds(req->timeout,
+							request_timeout, req);
 
 	g_free(req->buf);
 	req->buf = NULL;
@@ -646,9 +779,12 @@ static void wakeup_writer(struct qmi_device *device)
 }
 
 static void __request_submit(struct qmi_device *device,
-				struct qmi_request *req, uint16_t transaction)
+				struct qmi_request *req, uint16_t transaction,
+				unsigned int timeout)
 {
+	req->device = device;
 	req->tid = transaction;
+	req->timeout = timeout;
 
 	g_queue_push_tail(device->req_queue, req);
 
@@ -659,14 +795,20 @@ static void service_notify(gpointer key, gpointer value, gpointer user_data)
 {
 	struct qmi_service *service = value;
 	struct qmi_result *result = user_data;
-	GList *list;
+	GList *list, *next;
 
-	for (list = g_list_first(service->notify_list); list;
-						list = g_list_next(list)) {
+	if (!service->notify_table)
+		return;
+
+	list = g_hash_table_lookup(service->notify_table,
+					GUINT_TO_POINTER(result->message));
+
+	for (; list; list = next) {
 		struct qmi_notify *notify = list->data;
 
-		if (notify->message == result->message)
-			notify->callback(result, notify->user_data);
+		next = g_list_next(list);
+
+		notify->callback(result, notify->user_data);
 	}
 }
 
@@ -686,6 +828,7 @@ static void handle_indication(struct qmi_device *device,
 	result.message = message;
 	result.data = data;
 	result.length = length;
+	result.indexed = false;
 
 	if (client_id == 0xff) {
 		g_hash_table_foreach(device->service_list,
@@ -714,7 +857,6 @@ static void handle_packet(struct qmi_device *device,
 		const struct qmi_control_hdr *control = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		/* Ignore control messages with client identifier */
 		if (hdr->client != 0x00)
@@ -735,19 +877,17 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = g_hash_table_lookup(device->control_table,
+						GUINT_TO_POINTER(tid));
+		if (!req)
 			return;
 
-		req = list->data;
-
-		g_queue_delete_link(device->control_queue, list);
+		g_hash_table_steal(device->control_table,
+						GUINT_TO_POINTER(tid));
 	} else {
 		const struct qmi_service_hdr *service = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		msg = buf + QMI_SERVICE_HDR_SIZE;
 
@@ -764,14 +904,13 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = g_hash_table_lookup(device->service_table,
+						GUINT_TO_POINTER(tid));
+		if (!req)
 			return;
 
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
+		g_hash_table_steal(device->service_table,
+						GUINT_TO_POINTER(tid));
 	}
 
 	if (req->callback)
@@ -780,53 +919,89 @@ static void handle_packet(struct qmi_device *device,
 	__request_free(req, NULL);
 }
 
-static gboolean received_data(GIOChannel *channel, GIOCondition cond,
-							gpointer user_data)
+static const unsigned char *peek_frame(struct qmi_device *device,
+							unsigned int len)
 {
-	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
-	unsigned char buf[2048];
-	ssize_t bytes_read;
-	uint16_t offset;
+	unsigned int no_wrap = ring_buffer_len_no_wrap(device->buf);
 
-	if (cond & G_IO_NVAL)
-		return FALSE;
+	if (no_wrap >= len)
+		return ring_buffer_read_ptr(device->buf, 0);
 
-	bytes_read = read(device->fd, buf, sizeof(buf));
-	if (bytes_read < 0)
-		return TRUE;
+	/* The frame wraps around the end of the buffer, linearize it */
+	memcpy(device->frame, ring_buffer_read_ptr(device->buf, 0), no_wrap);
+	memcpy(device->frame + no_wrap,
+			ring_buffer_read_ptr(device->buf, no_wrap),
+			len - no_wrap);
 
-	__hexdump('<', buf, bytes_read,
-				device->debug_func, device->debug_data);
+	return device->frame;
+}
 
-	offset = 0;
+static void process_frames(struct qmi_device *device)
+{
+	unsigned int len;
 
-	while (offset < bytes_read) {
-		uint16_t len;
+	while ((len = ring_buffer_len(device->buf)) >= QMI_MUX_HDR_SIZE) {
+		const struct qmi_mux_hdr *hdr;
+		const unsigned char *frame;
+		unsigned int frame_len;
 
-		/* Check if QMI mux header fits into packet */
-		if (bytes_read - offset < QMI_MUX_HDR_SIZE)
-			break;
+		hdr = (const void *) peek_frame(device, QMI_MUX_HDR_SIZE);
 
-		hdr = (void *) (buf + offset);
+		/* Check for fixed frame and flags value, resync if not */
+		if (hdr->frame != 0x01 || hdr->flags != 0x80) {
+			ring_buffer_drain(device->buf, 1);
+			continue;
+		}
 
-		/* Check for fixed frame and flags value */
-		if (hdr->frame != 0x01 || hdr->flags != 0x80)
-			break;
+		frame_len = GUINT16_FROM_LE(hdr->length) + 1;
 
-		len = GUINT16_FROM_LE(hdr->length) + 1;
+		if (frame_len < QMI_MUX_HDR_SIZE) {
+			ring_buffer_drain(device->buf, 1);
+			continue;
+		}
 
-		/* Check that packet size matches frame size */
-		if (bytes_read - offset < len)
+		/* Wait for the rest of the frame */
+		if (len < frame_len)
 			break;
 
-		__debug_msg(' ', buf + offset, len,
+		frame = peek_frame(device, frame_len);
+
+		__debug_msg(' ', frame, frame_len,
 				device->debug_func, device->debug_data);
 
-		handle_packet(device, hdr, buf + offset + QMI_MUX_HDR_SIZE);
+		handle_packet(device, (const void *) frame,
+						frame + QMI_MUX_HDR_SIZE);
 
-		offset += len;
+		ring_buffer_drain(device->buf, frame_len);
 	}
+}
+
+static gboolean received_data(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct qmi_device *device = user_data;
+	unsigned char *buf;
+	ssize_t bytes_read;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	buf = ring_buffer_write_ptr(device->buf, 0);
+
+	bytes_read = read(device->fd, buf,
+				ring_buffer_avail_no_wrap(device->buf));
+	if (bytes_read < 0)
+		return TRUE;
+
+	__hexdump('<', buf, bytes_read,
+				device->debug_func, device->debug_data);
+
+	ring_buffer_write_advance(device->buf, bytes_read);
+
+	/* Callbacks might drop the last reference to the device */
+	qmi_device_ref(device);
+	process_frames(device);
+	qmi_device_unref(device);
 
 	return TRUE;
 }
@@ -888,9 +1063,14 @@ struct qmi_device *qmi_device_new(int fd)
 
 	g_io_channel_unref(device->io);
 
+	device->buf = ring_buffer_new(QMI_BUFFER_SIZE);
+	device->frame = g_malloc(QMI_BUFFER_SIZE / 2);
+
 	device->req_queue = g_queue_new();
-	device->control_queue = g_queue_new();
-	device->service_queue = g_queue_new();
+	device->control_table = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+	device->service_table = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
 
 	device->service_list = g_hash_table_new_full(g_direct_hash,
 					g_direct_equal, NULL, service_destroy);
@@ -918,11 +1098,13 @@ void qmi_device_unref(struct qmi_device *device)
 
 	__debug_device(device, "device %p free", device);
 
-	g_queue_foreach(device->control_queue, __request_free, NULL);
-	g_queue_free(device->control_queue);
+	g_hash_table_foreach(device->control_table,
+					__request_table_free, NULL);
+	g_hash_table_destroy(device->control_table);
 
-	g_queue_foreach(device->service_queue, __request_free, NULL);
-	g_queue_free(device->service_queue);
+	g_hash_table_foreach(device->service_table,
+					__request_table_free, NULL);
+	g_hash_table_destroy(device->service_table);
 
 	g_queue_foreach(device->req_queue, __request_free, NULL);
 	g_queue_free(device->req_queue);
@@ -941,6 +1123,9 @@ void qmi_device_unref(struct qmi_device *device)
 	g_free(device->version_str);
 	g_free(device->version_list);
 
+	ring_buffer_free(device->buf);
+	g_free(device->frame);
+
 	g_free(device);
 }
 
@@ -992,8 +1177,45 @@ struct discover_data {
 	void *user_data;
 	qmi_destroy_func_t destroy;
 	guint timeout;
+	uint16_t tid;
 };
 
+/*
+ * Drop a control request whose originator gave up waiting for the
+ * response, so that a late response does not reach freed data
+ */
+static void control_request_cancel(struct qmi_device *device, uint16_t tid)
+{
+	struct qmi_request *req;
+	GList *list;
+
+	if (!tid)
+		return;
+
+	req = g_hash_table_lookup(device->control_table,
+						GUINT_TO_POINTER(tid));
+	if (req) {
+		g_hash_table_steal(device->control_table,
+						GUINT_TO_POINTER(tid));
+		__request_free(req, NULL);
+		return;
+	}
+
+	list = g_queue_find_custom(device->req_queue,
+				GUINT_TO_POINTER(tid), __request_compare);
+	if (!list)
+		return;
+
+	req = list->data;
+
+	/* Service requests can not have a tid below 256 */
+	if (req->service != QMI_SERVICE_CONTROL)
+		return;
+
+	g_queue_delete_link(device->req_queue, list);
+	__request_free(req, NULL);
+}
+
 static void discover_callback(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data)
 {
@@ -1092,6 +1314,8 @@ static gboolean discover_reply(gpointer user_data)
 
 	data->timeout = 0;
 
+	control_request_cancel(device, data->tid);
+
 	if (data->func)
 		data->func(device->version_count,
 				device->version_list, data->user_data);
@@ -1138,13 +1362,12 @@ bool qmi_device_discover(struct qmi_device *device, qmi_discover_func_t func,
 		return false;
 	}
 
-	if (device->next_control_tid < 1)
-		device->next_control_tid = 1;
-
 	hdr->type = 0x00;
-	hdr->transaction = device->next_control_tid++;
+	hdr->transaction = control_tid_alloc(device);
+
+	data->tid = hdr->transaction;
 
-	__request_submit(device, req, hdr->transaction);
+	__request_submit(device, req, hdr->transaction, 0);
 
 	data->timeout = g_timeout_add_seconds(5, discover_reply, data);
 
@@ -1168,13 +1391,10 @@ static void release_client(struct qmi_device *device,
 		return;
 	}
 
-	if (device->next_control_tid < 1)
-		device->next_control_tid = 1;
-
 	hdr->type = 0x00;
-	hdr->transaction = device->next_control_tid++;
+	hdr->transaction = control_tid_alloc(device);
 
-	__request_submit(device, req, hdr->transaction);
+	__request_submit(device, req, hdr->transaction, QMI_RELEASE_TIMEOUT);
 }
 
 struct shutdown_data {
@@ -1254,10 +1474,49 @@ void qmi_param_free(struct qmi_param *param)
 	g_free(param);
 }
 
+void *qmi_param_reserve(struct qmi_param *param, uint8_t type,
+							uint16_t length)
+{
+	struct qmi_tlv_hdr *tlv;
+	size_t needed;
+
+	if (!param || !type || !length)
+		return NULL;
+
+	needed = param->length + QMI_TLV_HDR_SIZE + length;
+
+	/* The whole message length has to fit into the 16 bit header */
+	if (needed > 0xffff)
+		return NULL;
+
+	if (needed > param->size) {
+		size_t size = param->size ? param->size : QMI_PARAM_MIN_SIZE;
+		void *ptr;
+
+		while (size < needed)
+			size *= 2;
+
+		ptr = g_try_realloc(param->data, size);
+		if (!ptr)
+			return NULL;
+
+		param->data = ptr;
+		param->size = size;
+	}
+
+	tlv = param->data + param->length;
+
+	tlv->type = type;
+	tlv->length = GUINT16_TO_LE(length);
+
+	param->length = needed;
+
+	return tlv->value;
+}
+
 bool qmi_param_append(struct qmi_param *param, uint8_t type,
 					uint16_t length, const void *data)
 {
-	struct qmi_tlv_hdr *tlv;
 	void *ptr;
 
 	if (!param || !type)
@@ -1269,23 +1528,11 @@ bool qmi_param_append(struct qmi_param *param, uint8_t type,
 	if (!data)
 		return false;
 
-	if (param->data)
-		ptr = g_try_realloc(param->data,
-				param->length + QMI_TLV_HDR_SIZE + length);
-	else
-		ptr = g_try_malloc(QMI_TLV_HDR_SIZE + length);
-
+	ptr = qmi_param_reserve(param, type, length);
 	if (!ptr)
 		return false;
 
-	tlv = ptr + param->length;
-
-	tlv->type = type;
-	tlv->length = GUINT16_TO_LE(length);
-	memcpy(tlv->value, data, length);
-
-	param->data = ptr;
-	param->length += QMI_TLV_HDR_SIZE + length;
+	memcpy(ptr, data, length);
 
 	return true;
 }
@@ -1293,27 +1540,47 @@ bool qmi_param_append(struct qmi_param *param, uint8_t type,
 bool qmi_param_append_uint8(struct qmi_param *param, uint8_t type,
 							uint8_t value)
 {
-	unsigned char buf[1] = { value };
+	unsigned char *ptr;
+
+	ptr = qmi_param_reserve(param, type, 1);
+	if (!ptr)
+		return false;
+
+	ptr[0] = value;
 
-	return qmi_param_append(param, type, sizeof(buf), buf);
+	return true;
 }
 
 bool qmi_param_append_uint16(struct qmi_param *param, uint8_t type,
 							uint16_t value)
 {
-	unsigned char buf[2] = { value & 0xff, (value & 0xff00) >> 8 };
+	unsigned char *ptr;
 
-	return qmi_param_append(param, type, sizeof(buf), buf);
+	ptr = qmi_param_reserve(param, type, 2);
+	if (!ptr)
+		return false;
+
+	ptr[0] = value & 0xff;
+	ptr[1] = (value & 0xff00) >> 8;
+
+	return true;
 }
 
 bool qmi_param_append_uint32(struct qmi_param *param, uint8_t type,
 							uint32_t value)
 {
-	unsigned char buf[4] = { value & 0xff, (value & 0xff00) >> 8,
-					(value & 0xff0000) >> 16,
-					(value & 0xff000000) >> 24 };
+	unsigned char *ptr;
+
+	ptr = qmi_param_reserve(param, type, 4);
+	if (!ptr)
+		return false;
 
-	return qmi_param_append(param, type, sizeof(buf), buf);
+	ptr[0] = value & 0xff;
+	ptr[1] = (value & 0xff00) >> 8;
+	ptr[2] = (value & 0xff0000) >> 16;
+	ptr[3] = (value & 0xff000000) >> 24;
+
+	return true;
 }
 
 struct qmi_param *qmi_param_new_uint8(uint8_t type, uint8_t value)
@@ -1392,13 +1659,61 @@ const char *qmi_result_get_error(struct qmi_result *result)
 	return __error_to_string(result->error);
 }
 
+static const void *result_tlv_get(struct qmi_result *result, uint8_t type,
+							uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+	uint16_t offset;
+
+	if (!result->indexed) {
+		memset(result->index, 0, sizeof(result->index));
+		result->scanned = 0;
+		result->indexed = true;
+	}
+
+	offset = result->index[type];
+
+	while (!offset && result->scanned + QMI_TLV_HDR_SIZE <
+							result->length) {
+		uint16_t tlv_length;
+		uint16_t next;
+
+		tlv = result->data + result->scanned;
+		tlv_length = GUINT16_FROM_LE(tlv->length);
+
+		next = result->scanned + QMI_TLV_HDR_SIZE + tlv_length;
+		if (next > result->length || next < result->scanned) {
+			/* Truncated TLV, nothing behind it can be trusted */
+			result->scanned = result->length;
+			break;
+		}
+
+		/* Keep the first occurrence, like a linear lookup would */
+		if (!result->index[tlv->type])
+			result->index[tlv->type] = result->scanned + 1;
+
+		result->scanned = next;
+		offset = result->index[type];
+	}
+
+	if (!offset)
+		return NULL;
+
+	tlv = result->data + offset - 1;
+
+	if (length)
+		*length = GUINT16_FROM_LE(tlv->length);
+
+	return tlv->value;
+}
+
 const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 							uint16_t *length)
 {
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -1409,7 +1724,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -1425,7 +1740,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1444,7 +1759,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1466,7 +1781,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1488,7 +1803,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1510,12 +1825,15 @@ struct service_create_data {
 	void *user_data;
 	qmi_destroy_func_t destroy;
 	guint timeout;
+	uint16_t tid;
 };
 
 static gboolean service_create_reply(gpointer user_data)
 {
 	struct service_create_data *data = user_data;
 
+	control_request_cancel(data->device, data->tid);
+
 	data->func(NULL, data->user_data);
 
 	if (data->destroy)
@@ -1621,13 +1939,12 @@ static void service_create_discover(uint8_t count,
 		return;
 	}
 
-	if (device->next_control_tid < 1)
-		device->next_control_tid = 1;
-
 	hdr->type = 0x00;
-	hdr->transaction = device->next_control_tid++;
+	hdr->transaction = control_tid_alloc(device);
 
-	__request_submit(device, req, hdr->transaction);
+	data->tid = hdr->transaction;
+
+	__request_submit(device, req, hdr->transaction, 0);
 }
 
 static bool service_create(struct qmi_device *device, bool shared,
@@ -1770,6 +2087,7 @@ void qmi_service_unref(struct qmi_service *service)
 		return;
 
 	if (!service->device) {
+		qmi_service_unregister_all(service);
 		g_free(service);
 		return;
 	}
@@ -1837,11 +2155,21 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	uint16_t len;
 	struct qmi_result result;
 
+	/* Request timed out, report it like a failed request */
+	if (!buffer) {
+		if (data->func)
+			data->func(NULL, data->user_data);
+
+		service_send_free(data);
+		return;
+	}
+
 	result.message = message;
 	result.data = buffer;
 	result.length = length;
+	result.indexed = false;
 
-	result_code = tlv_get(buffer, length, 0x02, &len);
+	result_code = qmi_result_get(&result, 0x02, &len);
 	if (!result_code)
 		goto done;
 
@@ -1898,13 +2226,10 @@ uint16_t qmi_service_send(struct qmi_service *service,
 		return 0;
 	}
 
-	if (device->next_service_tid < 256)
-		device->next_service_tid = 256;
-
 	hdr->type = 0x00;
-	hdr->transaction = device->next_service_tid++;
+	hdr->transaction = service_tid_alloc(device);
 
-	__request_submit(device, req, hdr->transaction);
+	__request_submit(device, req, hdr->transaction, QMI_SERVICE_TIMEOUT);
 
 	return hdr->transaction;
 }
@@ -1933,14 +2258,13 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 
 		g_queue_delete_link(device->req_queue, list);
 	} else {
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = g_hash_table_lookup(device->service_table,
+						GUINT_TO_POINTER(tid));
+		if (!req)
 			return false;
 
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
+		g_hash_table_steal(device->service_table,
+						GUINT_TO_POINTER(tid));
 	}
 
 	service_send_free(req->user_data);
@@ -1981,6 +2305,22 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 	return new_queue;
 }
 
+static gboolean remove_client_request(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	struct qmi_request *req = value;
+	uint8_t client = GPOINTER_TO_UINT(user_data);
+
+	if (!req->client || req->client != client)
+		return FALSE;
+
+	service_send_free(req->user_data);
+
+	__request_free(req, NULL);
+
+	return TRUE;
+}
+
 bool qmi_service_cancel_all(struct qmi_service *service)
 {
 	struct qmi_device *device;
@@ -1998,8 +2338,9 @@ bool qmi_service_cancel_all(struct qmi_service *service)
 	device->req_queue = remove_client(device->req_queue,
 						service->client_id);
 
-	device->service_queue = remove_client(device->service_queue,
-							service->client_id);
+	g_hash_table_foreach_steal(device->service_table,
+					remove_client_request,
+					GUINT_TO_POINTER(service->client_id));
 
 	return true;
 }
@@ -2009,6 +2350,7 @@ uint16_t qmi_service_register(struct qmi_service *service,
 				void *user_data, qmi_destroy_func_t destroy)
 {
 	struct qmi_notify *notify;
+	GList *list;
 
 	if (!service || !func)
 		return 0;
@@ -2028,6 +2370,16 @@ uint16_t qmi_service_register(struct qmi_service *service,
 
 	service->notify_list = g_list_append(service->notify_list, notify);
 
+	if (!service->notify_table)
+		service->notify_table = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	list = g_hash_table_lookup(service->notify_table,
+					GUINT_TO_POINTER(message));
+	list = g_list_append(list, notify);
+	g_hash_table_replace(service->notify_table,
+					GUINT_TO_POINTER(message), list);
+
 	return notify->id;
 }
 
@@ -2049,16 +2401,40 @@ bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 
 	service->notify_list = g_list_delete_link(service->notify_list, list);
 
+	list = g_hash_table_lookup(service->notify_table,
+					GUINT_TO_POINTER(notify->message));
+	list = g_list_remove(list, notify);
+
+	if (list)
+		g_hash_table_replace(service->notify_table,
+				GUINT_TO_POINTER(notify->message), list);
+	else
+		g_hash_table_remove(service->notify_table,
+				GUINT_TO_POINTER(notify->message));
+
 	__notify_free(notify, NULL);
 
 	return true;
 }
 
+static void free_notify_bucket(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	g_list_free(value);
+}
+
 bool qmi_service_unregister_all(struct qmi_service *service)
 {
 	if (!service)
 		return false;
 
+	if (service->notify_table) {
+		g_hash_table_foreach(service->notify_table,
+						free_notify_bucket, NULL);
+		g_hash_table_destroy(service->notify_table);
+		service->notify_table = NULL;
+	}
+
 	g_list_foreach(service->notify_list, __notify_free, NULL);
 	g_list_free(service->notify_list);
 
@@ -366,6 +366,9 @@ static void ril_data_reg_cb(struct ril_msg *message, gpointer user_data)
 		DBG("Setting max cids to %d", gd->max_cids);
 		ofono_gprs_set_cid_range(gprs, 1, gd->max_cids);
 
+		/* Most rild implementations set up one data call at a time */
+		ofono_gprs_set_max_pending_activations(gprs, 1);
+
 		/*
 		 * This callback is a result of the inital call
 		 * to probe(), so should return after registration.
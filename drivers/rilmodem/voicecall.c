@@ -49,8 +49,11 @@
 #include "rilmodem.h"
 #include "voicecall.h"
 
-/* Amount of ms we wait between CLCC calls */
-#define POLL_CLCC_INTERVAL 300
+/*
+ * Amount of ms we wait before re-polling CLCC when call state changes
+ * arrived while a previous poll was still in flight
+ */
+#define POLL_CLCC_DEBOUNCE 50
 
 #define FLAG_NEED_CLIP 1
 
@@ -91,6 +94,7 @@ struct hold_before_dial_req {
 
 static void send_one_dtmf(struct ril_voicecall_data *vd);
 static void clear_dtmf_queue(struct ril_voicecall_data *vd);
+static void request_clcc(struct ofono_voicecall *vc);
 
 static void lastcause_cb(struct ril_msg *message, gpointer user_data)
 {
@@ -156,6 +160,20 @@ static void clcc_poll_cb(struct ril_msg *message, gpointer user_data)
 	GSList *n, *o;
 	struct ofono_call *nc, *oc;
 
+	vd->clcc_pending = FALSE;
+
+	/*
+	 * Call state changes reported while this poll was in flight may not
+	 * be reflected in this reply: coalesce them all into one more poll.
+	 */
+	if (vd->clcc_repoll) {
+		vd->clcc_repoll = FALSE;
+
+		if (vd->clcc_source == 0)
+			vd->clcc_source = g_timeout_add(POLL_CLCC_DEBOUNCE,
+							ril_poll_clcc, vc);
+	}
+
 	/*
 	 * We consider all calls have been dropped if there is no radio, which
 	 * happens, for instance, when flight mode is set whilst in a call.
@@ -167,6 +185,30 @@ static void clcc_poll_cb(struct ril_msg *message, gpointer user_data)
 		return;
 	}
 
+	/*
+	 * Most polls are triggered by changes of other RIL clients or report
+	 * what we have already seen: if the reply is byte-for-byte the same
+	 * as the last one, there is nothing to parse nor to notify.
+	 */
+	if (message->error == RIL_E_SUCCESS && vd->clcc_last != NULL &&
+			!(vd->flags & FLAG_NEED_CLIP) &&
+			message->buf_len == vd->clcc_last_len &&
+			memcmp(message->buf, vd->clcc_last,
+						message->buf_len) == 0) {
+		DBG("call list unchanged");
+		vd->local_release = 0;
+		return;
+	}
+
+	g_free(vd->clcc_last);
+	vd->clcc_last = NULL;
+	vd->clcc_last_len = 0;
+
+	if (message->error == RIL_E_SUCCESS && message->buf_len > 0) {
+		vd->clcc_last = g_memdup(message->buf, message->buf_len);
+		vd->clcc_last_len = message->buf_len;
+	}
+
 	calls = g_ril_reply_parse_get_calls(vd->ril, message);
 
 	n = calls;
@@ -282,14 +324,36 @@ gboolean ril_poll_clcc(gpointer user_data)
 	struct ofono_voicecall *vc = user_data;
 	struct ril_voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
-			clcc_poll_cb, vc, NULL);
-
 	vd->clcc_source = 0;
 
+	request_clcc(vc);
+
 	return FALSE;
 }
 
+/*
+ * Refresh the call list. The first request after a quiet period is sent
+ * right away so that dial/answer/hangup are reported without delay; any
+ * further request while a GET_CURRENT_CALLS is outstanding or a re-poll
+ * is already scheduled is merged into that one.
+ */
+static void request_clcc(struct ofono_voicecall *vc)
+{
+	struct ril_voicecall_data *vd = ofono_voicecall_get_data(vc);
+
+	if (vd->clcc_pending) {
+		vd->clcc_repoll = TRUE;
+		return;
+	}
+
+	if (vd->clcc_source)
+		return;
+
+	if (g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
+			clcc_poll_cb, vc, NULL) > 0)
+		vd->clcc_pending = TRUE;
+}
+
 static void generic_cb(struct ril_msg *message, gpointer user_data)
 {
 	struct change_state_req *req = user_data;
@@ -318,8 +382,7 @@ static void generic_cb(struct ril_msg *message, gpointer user_data)
 	}
 
 out:
-	g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
-			clcc_poll_cb, req->vc, NULL);
+	request_clcc(req->vc);
 
 	/* We have to callback after we schedule a poll if required */
 	if (req->cb)
@@ -383,9 +446,9 @@ static void rild_cb(struct ril_msg *message, gpointer user_data)
 	 * UNSOL_RESPONSE_CALL_STATE_CHANGED has been issued and the CLCC
 	 * has been called already. So, there's no need to trigger another CLCC.
 	 */
-	if (!vd->clcc_source && vd->cb)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						ril_poll_clcc, vc);
+	if (vd->cb)
+		request_clcc(vc);
+
 	return;
 
 out:
@@ -565,7 +628,7 @@ void ril_call_state_notify(struct ril_msg *message, gpointer user_data)
 	g_ril_print_unsol_no_args(vd->ril, message);
 
 	/* Just need to request the call list again */
-	ril_poll_clcc(vc);
+	request_clcc(vc);
 
 	return;
 }
@@ -749,7 +812,7 @@ static gboolean ril_delayed_register(gpointer user_data)
 	ofono_voicecall_register(vc);
 
 	/* Initialize call list */
-	ril_poll_clcc(vc);
+	request_clcc(vc);
 
 	/* Unsol when call state changes */
 	g_ril_register(vd->ril, RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
@@ -819,6 +882,7 @@ void ril_voicecall_remove(struct ofono_voicecall *vc)
 	ofono_voicecall_set_data(vc, NULL);
 
 	g_ril_unref(vd->ril);
+	g_free(vd->clcc_last);
 	g_free(vd->tone_queue);
 	g_free(vd);
 }
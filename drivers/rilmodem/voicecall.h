@@ -24,6 +24,12 @@ struct ril_voicecall_data {
 	/* Call local hangup indicator, one bit per call (1 << call_id) */
 	unsigned int local_release;
 	unsigned int clcc_source;
+	/* GET_CURRENT_CALLS in flight, and whether to poll again after it */
+	gboolean clcc_pending;
+	gboolean clcc_repoll;
+	/* Payload of the last GET_CURRENT_CALLS reply */
+	gchar *clcc_last;
+	gsize clcc_last_len;
 	GRil *ril;
 	struct ofono_modem *modem;
 	unsigned int vendor;
@@ -0,0 +1,865 @@
+/*
+ *
+ *  AT chat library with GLib integration
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A scriptable AT modem simulator on a pty.  Without options it prints the
+ * pty name and answers whoever opens it.  With --benchmark it forks, keeps
+ * the simulator in the child and runs the command, listing and unsolicited
+ * patterns of the atmodem drivers against it through GAtChat, reporting
+ * per command latency, lines per second and allocations per line.
+ *
+ * The script is a key file; the built-in default below documents the
+ * format.  In Lines, $i is replaced by the repetition number, starting
+ * at 1.  A Command ending in '*' matches any command with that prefix.
+ * AT*SIMBURST=<name> plays the named burst and then answers OK.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <pty.h>
+
+#include "gatchat.h"
+#include "gattty.h"
+
+#define BURST_COMMAND	"AT*SIMBURST="
+
+/* Give up on a benchmark step after this long */
+#define STEP_TIMEOUT	30
+
+static const char *default_script =
+	"[General]\n"
+	"Unknown=OK\n"
+	"\n"
+	"[Command cgmi]\nCommand=AT+CGMI\nLines=oFono\n"
+	"[Command cgmm]\nCommand=AT+CGMM\nLines=AT simulator\n"
+	"[Command cgmr]\nCommand=AT+CGMR\nLines=1.0\n"
+	"[Command cgsn]\nCommand=AT+CGSN\nLines=123456789012347\n"
+	"[Command cpin]\nCommand=AT+CPIN?\nLines=+CPIN: READY\n"
+	"[Command csq]\nCommand=AT+CSQ\nLines=+CSQ: 20,99\n"
+	"[Command creg]\nCommand=AT+CREG?\n"
+	"Lines=+CREG: 2,1,\"1F40\",\"0000D1FF\",7\n"
+	"[Command cops]\nCommand=AT+COPS=3,2;+COPS?\n"
+	"Lines=+COPS: 0,2,\"00101\",7\n"
+	"[Command clcc]\nCommand=AT+CLCC\n"
+	"Lines=+CLCC: 1,0,0,0,0,\"+15551234\",145\n"
+	"\n"
+	"[Command cops-list]\nCommand=AT+COPS=?\nCount=100\n"
+	"Lines=+COPS: (2,\"Operator $i\",\"Op$i\",\"00101\",7)\n"
+	"[Command cpbr]\nCommand=AT+CPBR=*\nCount=500\n"
+	"Lines=+CPBR: $i,\"+1555000$i\",145,\"Contact $i\"\n"
+	"[Command cmgl]\nCommand=AT+CMGL=*\nCount=200\n"
+	"Lines=+CMGL: $i,1,,30;07911326040000F0040B911346610089F6000020"
+	"8062917314480CC8F71D14969741F977FD07\n"
+	"[Command cmgs]\nCommand=AT+CMGS=*\nPrompt=true\nLines=+CMGS: 1\n"
+	"\n"
+	"[Burst creg]\nCount=5000\n"
+	"Lines=+CREG: 1,\"1F40\",\"0000D1FF\",7\n"
+	"[Burst cmt]\nCount=1000\n"
+	"Lines=+CMT: ,30;07911326040000F0040B911346610089F6000020"
+	"8062917314480CC8F71D14969741F977FD07\n";
+
+struct sim_command {
+	char *command;
+	gboolean prefix;
+	gboolean prompt;
+	char **lines;
+	unsigned int count;
+	unsigned int delay;
+	char *final;
+};
+
+struct sim_burst {
+	char *name;
+	char **lines;
+	unsigned int count;
+	unsigned int interval;
+	unsigned int sent;
+};
+
+struct bench_stat {
+	const char *cmd;
+	const char **prefix;
+	unsigned int samples;
+	gint64 min;
+	gint64 max;
+	gint64 total;
+};
+
+static const char *none_prefix[] = { NULL };
+static const char *cpin_prefix[] = { "+CPIN:", NULL };
+static const char *csq_prefix[] = { "+CSQ:", NULL };
+static const char *creg_prefix[] = { "+CREG:", NULL };
+static const char *cops_prefix[] = { "+COPS:", NULL };
+static const char *clcc_prefix[] = { "+CLCC:", NULL };
+static const char *cpbr_prefix[] = { "+CPBR:", NULL };
+static const char *cmgl_prefix[] = { "+CMGL:", NULL };
+
+static gchar *option_script = NULL;
+static gboolean option_benchmark = FALSE;
+static gint option_rounds = 100;
+static gboolean option_debug = FALSE;
+
+/* Simulator */
+static GSList *commands;
+static GSList *bursts;
+static char *unknown_final;
+static int sim_fd = -1;
+static GString *sim_rx;
+static struct sim_command *prompt_command;
+static GMainLoop *main_loop;
+
+/* Benchmark */
+static unsigned long alloc_count;
+static unsigned int lines_parsed;
+static gboolean step_done;
+static gboolean step_ok;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/*
+ * Count every heap allocation in the benchmark process, GLib's included.
+ * Only the benchmark side lives in this process, the simulator is forked.
+ */
+void *malloc(size_t size)
+{
+	alloc_count += 1;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count += 1;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count += 1;
+	return __libc_realloc(ptr, size);
+}
+
+static gboolean alloc_counting = TRUE;
+#else
+static gboolean alloc_counting = FALSE;
+#endif
+
+static void sim_command_free(gpointer data)
+{
+	struct sim_command *cmd = data;
+
+	g_free(cmd->command);
+	g_strfreev(cmd->lines);
+	g_free(cmd->final);
+	g_free(cmd);
+}
+
+static void sim_burst_free(gpointer data)
+{
+	struct sim_burst *burst = data;
+
+	g_free(burst->name);
+	g_strfreev(burst->lines);
+	g_free(burst);
+}
+
+static unsigned int get_uint(GKeyFile *keyfile, const char *group,
+				const char *key, unsigned int dflt)
+{
+	if (g_key_file_has_key(keyfile, group, key, NULL) == FALSE)
+		return dflt;
+
+	return g_key_file_get_integer(keyfile, group, key, NULL);
+}
+
+static void load_command(GKeyFile *keyfile, const char *group)
+{
+	struct sim_command *cmd;
+	char *command;
+	size_t len;
+
+	command = g_key_file_get_string(keyfile, group, "Command", NULL);
+	if (command == NULL) {
+		g_printerr("No Command in [%s]\n", group);
+		return;
+	}
+
+	cmd = g_new0(struct sim_command, 1);
+	cmd->command = command;
+
+	len = strlen(command);
+	if (len > 0 && command[len - 1] == '*') {
+		command[len - 1] = '\0';
+		cmd->prefix = TRUE;
+	}
+
+	cmd->prompt = g_key_file_get_boolean(keyfile, group, "Prompt", NULL);
+	cmd->lines = g_key_file_get_string_list(keyfile, group, "Lines",
+								NULL, NULL);
+	cmd->count = get_uint(keyfile, group, "Count", 1);
+	cmd->delay = get_uint(keyfile, group, "Delay", 0);
+	cmd->final = g_key_file_get_string(keyfile, group, "Final", NULL);
+
+	if (cmd->final == NULL)
+		cmd->final = g_strdup("OK");
+
+	commands = g_slist_append(commands, cmd);
+}
+
+static void load_burst(GKeyFile *keyfile, const char *group)
+{
+	struct sim_burst *burst = g_new0(struct sim_burst, 1);
+
+	burst->name = g_strdup(group + strlen("Burst "));
+	burst->lines = g_key_file_get_string_list(keyfile, group, "Lines",
+								NULL, NULL);
+	burst->count = get_uint(keyfile, group, "Count", 1);
+	burst->interval = get_uint(keyfile, group, "Interval", 0);
+
+	bursts = g_slist_append(bursts, burst);
+}
+
+static gboolean load_script(const char *filename)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	char **groups;
+	char **group;
+	gboolean ret;
+
+	keyfile = g_key_file_new();
+
+	if (filename)
+		ret = g_key_file_load_from_file(keyfile, filename, 0, &error);
+	else
+		ret = g_key_file_load_from_data(keyfile, default_script, -1,
+								0, &error);
+
+	if (ret == FALSE) {
+		g_printerr("%s: %s\n", filename ? filename : "default script",
+							error->message);
+		g_error_free(error);
+		g_key_file_free(keyfile);
+		return FALSE;
+	}
+
+	unknown_final = g_key_file_get_string(keyfile, "General", "Unknown",
+									NULL);
+	if (unknown_final == NULL)
+		unknown_final = g_strdup("ERROR");
+
+	groups = g_key_file_get_groups(keyfile, NULL);
+
+	for (group = groups; *group; group++) {
+		if (g_str_has_prefix(*group, "Command "))
+			load_command(keyfile, *group);
+		else if (g_str_has_prefix(*group, "Burst "))
+			load_burst(keyfile, *group);
+	}
+
+	g_strfreev(groups);
+	g_key_file_free(keyfile);
+
+	return TRUE;
+}
+
+static void sim_write(const char *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t written = write(sim_fd, data, len);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		data += written;
+		len -= written;
+	}
+}
+
+static void append_lines(GString *out, char **lines, unsigned int i)
+{
+	char index[16];
+
+	snprintf(index, sizeof(index), "%u", i);
+
+	for (; lines && *lines; lines++) {
+		char **parts = g_strsplit(*lines, "$i", -1);
+		char *line = g_strjoinv(index, parts);
+
+		g_string_append_printf(out, "\r\n%s\r\n", line);
+
+		g_free(line);
+		g_strfreev(parts);
+	}
+}
+
+static void send_final(const char *final)
+{
+	char *buf = g_strdup_printf("\r\n%s\r\n", final);
+
+	sim_write(buf, strlen(buf));
+	g_free(buf);
+}
+
+static void send_response(struct sim_command *cmd)
+{
+	GString *out = g_string_new(NULL);
+	unsigned int i;
+
+	for (i = 1; i <= cmd->count; i++)
+		append_lines(out, cmd->lines, i);
+
+	g_string_append_printf(out, "\r\n%s\r\n", cmd->final);
+
+	sim_write(out->str, out->len);
+	g_string_free(out, TRUE);
+}
+
+static gboolean delayed_response(gpointer user_data)
+{
+	send_response(user_data);
+
+	return FALSE;
+}
+
+static void respond(struct sim_command *cmd)
+{
+	if (cmd->delay == 0)
+		send_response(cmd);
+	else
+		g_timeout_add(cmd->delay, delayed_response, cmd);
+}
+
+static gboolean burst_step(gpointer user_data)
+{
+	struct sim_burst *burst = user_data;
+	GString *out = g_string_new(NULL);
+
+	/* Without an interval the whole burst goes out in one write */
+	do {
+		burst->sent += 1;
+		append_lines(out, burst->lines, burst->sent);
+	} while (burst->interval == 0 && burst->sent < burst->count);
+
+	sim_write(out->str, out->len);
+	g_string_free(out, TRUE);
+
+	if (burst->sent < burst->count)
+		return TRUE;
+
+	send_final("OK");
+
+	return FALSE;
+}
+
+static void start_burst(const char *name)
+{
+	GSList *l;
+
+	for (l = bursts; l; l = l->next) {
+		struct sim_burst *burst = l->data;
+
+		if (g_str_equal(burst->name, name) == FALSE)
+			continue;
+
+		burst->sent = 0;
+
+		if (burst->count == 0)
+			send_final("OK");
+		else if (burst->interval == 0)
+			burst_step(burst);
+		else
+			g_timeout_add(burst->interval, burst_step, burst);
+
+		return;
+	}
+
+	send_final("ERROR");
+}
+
+static struct sim_command *find_command(const char *line)
+{
+	GSList *l;
+
+	for (l = commands; l; l = l->next) {
+		struct sim_command *cmd = l->data;
+
+		if (cmd->prefix == FALSE &&
+				g_ascii_strcasecmp(cmd->command, line) == 0)
+			return cmd;
+
+		if (cmd->prefix == TRUE && g_ascii_strncasecmp(cmd->command,
+					line, strlen(cmd->command)) == 0)
+			return cmd;
+	}
+
+	return NULL;
+}
+
+static void handle_command(const char *line)
+{
+	struct sim_command *cmd;
+
+	if (g_ascii_strncasecmp(line, BURST_COMMAND,
+					strlen(BURST_COMMAND)) == 0) {
+		start_burst(line + strlen(BURST_COMMAND));
+		return;
+	}
+
+	cmd = find_command(line);
+	if (cmd == NULL) {
+		send_final(unknown_final);
+		return;
+	}
+
+	if (cmd->prompt) {
+		prompt_command = cmd;
+		sim_write("\r\n> ", 4);
+		return;
+	}
+
+	respond(cmd);
+}
+
+static void process_input(void)
+{
+	char *end;
+
+	while (sim_rx->len > 0) {
+		if (prompt_command != NULL) {
+			struct sim_command *cmd = prompt_command;
+			size_t len = strcspn(sim_rx->str, "\032\033");
+
+			if (len == sim_rx->len)
+				return;
+
+			prompt_command = NULL;
+
+			/* ESC cancels the input, Ctrl-Z submits it */
+			if (sim_rx->str[len] == '\032')
+				respond(cmd);
+			else
+				send_final("OK");
+
+			g_string_erase(sim_rx, 0, len + 1);
+			continue;
+		}
+
+		end = memchr(sim_rx->str, '\r', sim_rx->len);
+		if (end == NULL)
+			return;
+
+		*end = '\0';
+
+		if (sim_rx->str[strspn(sim_rx->str, "\n")] != '\0')
+			handle_command(sim_rx->str + strspn(sim_rx->str, "\n"));
+
+		g_string_erase(sim_rx, 0, end - sim_rx->str + 1);
+	}
+}
+
+static gboolean sim_event(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	char buf[4096];
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR))
+		goto error;
+
+	len = read(sim_fd, buf, sizeof(buf));
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	/* EIO just means nobody has the slave side open at the moment */
+	if (len <= 0) {
+		if (len < 0 && errno == EIO && option_benchmark == FALSE) {
+			g_usleep(100000);
+			return TRUE;
+		}
+
+		goto error;
+	}
+
+	g_string_append_len(sim_rx, buf, len);
+	process_input();
+
+	return TRUE;
+
+error:
+	g_main_loop_quit(main_loop);
+
+	return FALSE;
+}
+
+static void run_simulator(int fd)
+{
+	GIOChannel *io;
+
+	sim_fd = fd;
+	sim_rx = g_string_new(NULL);
+
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	io = g_io_channel_unix_new(fd);
+	g_io_add_watch(io, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							sim_event, NULL);
+	g_io_channel_unref(io);
+
+	g_main_loop_run(main_loop);
+
+	g_main_loop_unref(main_loop);
+	g_string_free(sim_rx, TRUE);
+}
+
+static void set_raw_mode(int fd)
+{
+	struct termios ti;
+
+	memset(&ti, 0, sizeof(ti));
+	tcgetattr(fd, &ti);
+	tcflush(fd, TCIOFLUSH);
+	cfmakeraw(&ti);
+	tcsetattr(fd, TCSANOW, &ti);
+}
+
+static gboolean step_timeout(gpointer user_data)
+{
+	g_printerr("Timed out waiting for %s\n", (const char *) user_data);
+	exit(1);
+
+	return FALSE;
+}
+
+static void run_step(const char *what)
+{
+	guint timeout = g_timeout_add_seconds(STEP_TIMEOUT, step_timeout,
+							(gpointer) what);
+
+	while (step_done == FALSE)
+		g_main_context_iteration(NULL, TRUE);
+
+	g_source_remove(timeout);
+	step_done = FALSE;
+}
+
+/* Walk every token of every line, the way the driver parsers do */
+static void parse_result(GAtResult *result)
+{
+	GAtResultIter iter;
+
+	g_at_result_iter_init(&iter, result);
+
+	while (g_at_result_iter_next(&iter, NULL)) {
+		lines_parsed += 1;
+
+		while (g_at_result_iter_skip_next(&iter))
+			;
+	}
+}
+
+static void parse_pdu_result(GAtResult *result)
+{
+	parse_result(result);
+
+	if (g_at_result_pdu(result) != NULL)
+		lines_parsed += 1;
+}
+
+static void step_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	parse_result(result);
+
+	step_ok = ok;
+	step_done = TRUE;
+}
+
+static void notify_cb(GAtResult *result, gpointer user_data)
+{
+	parse_result(result);
+}
+
+static void pdu_notify_cb(GAtResult *result, gpointer user_data)
+{
+	parse_pdu_result(result);
+}
+
+static void bench_commands(GAtChat *chat)
+{
+	struct bench_stat stats[] = {
+		{ "AT+CGMI", NULL },
+		{ "AT+CPIN?", cpin_prefix },
+		{ "AT+CSQ", csq_prefix },
+		{ "AT+CREG?", creg_prefix },
+		{ "AT+COPS=3,2;+COPS?", cops_prefix },
+		{ "AT+CLCC", clcc_prefix },
+		{ "AT+CMEE=1", none_prefix },
+	};
+	unsigned int i;
+	int round;
+
+	for (round = 0; round < option_rounds; round++) {
+		for (i = 0; i < G_N_ELEMENTS(stats); i++) {
+			struct bench_stat *stat = &stats[i];
+			gint64 start = g_get_monotonic_time();
+			gint64 elapsed;
+
+			g_at_chat_send(chat, stat->cmd, stat->prefix,
+						step_cb, NULL, NULL);
+			run_step(stat->cmd);
+
+			elapsed = g_get_monotonic_time() - start;
+
+			if (stat->samples == 0 || elapsed < stat->min)
+				stat->min = elapsed;
+
+			if (elapsed > stat->max)
+				stat->max = elapsed;
+
+			stat->total += elapsed;
+			stat->samples += 1;
+		}
+	}
+
+	g_print("%-20s %10s %10s %10s\n", "Command",
+					"min (us)", "avg (us)", "max (us)");
+
+	for (i = 0; i < G_N_ELEMENTS(stats); i++)
+		g_print("%-20s %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+				" %10" G_GINT64_FORMAT "\n", stats[i].cmd,
+				stats[i].min, stats[i].total / stats[i].samples,
+				stats[i].max);
+
+	g_print("\n");
+}
+
+static void report_throughput(const char *what, gint64 start,
+						unsigned long allocs)
+{
+	gint64 elapsed = g_get_monotonic_time() - start;
+
+	if (lines_parsed == 0 || step_ok == FALSE) {
+		g_print("%-20s failed\n", what);
+		return;
+	}
+
+	g_print("%-20s %8u lines %10.0f lines/s", what, lines_parsed,
+					lines_parsed * 1000000.0 / elapsed);
+
+	if (alloc_counting)
+		g_print(" %6.1f allocs/line",
+				(double) allocs / lines_parsed);
+
+	g_print("\n");
+}
+
+static void bench_listing(GAtChat *chat, const char *what, const char *cmd,
+				const char **prefix, GAtNotifyFunc listing,
+				gboolean pdu)
+{
+	unsigned long allocs = alloc_count;
+	gint64 start = g_get_monotonic_time();
+
+	lines_parsed = 0;
+
+	if (listing == NULL)
+		g_at_chat_send(chat, cmd, prefix, step_cb, NULL, NULL);
+	else if (pdu)
+		g_at_chat_send_pdu_listing(chat, cmd, prefix, listing,
+						step_cb, NULL, NULL);
+	else
+		g_at_chat_send_listing(chat, cmd, prefix, listing,
+						step_cb, NULL, NULL);
+
+	run_step(cmd);
+
+	report_throughput(what, start, alloc_count - allocs);
+}
+
+static void bench_burst(GAtChat *chat, const char *name)
+{
+	char *cmd = g_strconcat(BURST_COMMAND, name, NULL);
+	char *what = g_strconcat("unsolicited ", name, NULL);
+	unsigned long allocs;
+	gint64 start;
+
+	lines_parsed = 0;
+	allocs = alloc_count;
+	start = g_get_monotonic_time();
+
+	g_at_chat_send(chat, cmd, none_prefix, step_cb, NULL, NULL);
+	run_step(cmd);
+
+	/* The final OK is not an unsolicited line */
+	report_throughput(what, start, alloc_count - allocs);
+
+	g_free(what);
+	g_free(cmd);
+}
+
+static int run_benchmark(const char *tty)
+{
+	GIOChannel *io;
+	GAtSyntax *syntax;
+	GAtChat *chat;
+
+	io = g_at_tty_open(tty, NULL);
+	if (io == NULL) {
+		g_printerr("Can't open %s\n", tty);
+		return 1;
+	}
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+
+	if (chat == NULL)
+		return 1;
+
+	if (option_debug)
+		g_at_chat_set_debug(chat, (GAtDebugFunc) g_print, "AT: ");
+
+	g_at_chat_send(chat, "ATE0", none_prefix, step_cb, NULL, NULL);
+	run_step("ATE0");
+
+	bench_commands(chat);
+
+	bench_listing(chat, "+COPS=? result", "AT+COPS=?", cops_prefix,
+						NULL, FALSE);
+	bench_listing(chat, "+CPBR listing", "AT+CPBR=1,500", cpbr_prefix,
+						notify_cb, FALSE);
+	bench_listing(chat, "+CMGL PDU listing", "AT+CMGL=4", cmgl_prefix,
+						pdu_notify_cb, TRUE);
+
+	g_at_chat_register(chat, "+CREG:", notify_cb, FALSE, NULL, NULL);
+	g_at_chat_register(chat, "+CMT:", pdu_notify_cb, TRUE, NULL, NULL);
+
+	bench_burst(chat, "creg");
+	bench_burst(chat, "cmt");
+
+	g_at_chat_unref(chat);
+
+	return 0;
+}
+
+static GOptionEntry options[] = {
+	{ "script", 's', 0, G_OPTION_ARG_FILENAME, &option_script,
+				"Specify the simulator script" },
+	{ "benchmark", 'b', 0, G_OPTION_ARG_NONE, &option_benchmark,
+				"Run the GAtChat benchmark against it" },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &option_rounds,
+				"Specify rounds of the command benchmark" },
+	{ "debug", 'd', 0, G_OPTION_ARG_NONE, &option_debug,
+				"Enable GAtChat debugging" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	char pty_name[256];
+	int master, slave;
+	pid_t pid;
+	int ret;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+		} else
+			g_printerr("An unknown error occurred\n");
+		exit(1);
+	}
+
+	g_option_context_free(context);
+
+	if (option_rounds <= 0)
+		option_rounds = 1;
+
+	if (load_script(option_script) == FALSE)
+		exit(1);
+
+	if (openpty(&master, &slave, pty_name, NULL, NULL) < 0) {
+		perror("Can't create pty");
+		exit(1);
+	}
+
+	set_raw_mode(slave);
+
+	if (option_benchmark == FALSE) {
+		g_print("Simulating a modem on %s\n", pty_name);
+
+		close(slave);
+		run_simulator(master);
+		close(master);
+		ret = 0;
+		goto done;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("Can't fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		close(slave);
+		run_simulator(master);
+		_exit(0);
+	}
+
+	close(master);
+
+	ret = run_benchmark(pty_name);
+
+	close(slave);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+done:
+	g_slist_free_full(commands, sim_command_free);
+	g_slist_free_full(bursts, sim_burst_free);
+	g_free(unknown_final);
+	g_free(option_script);
+
+	return ret;
+}
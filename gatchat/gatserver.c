@@ -106,6 +106,18 @@ struct at_command {
 	GDestroyNotify destroy_notify;
 };
 
+/*
+ * Commands are kept in a trie keyed on the prefix, one character per
+ * level.  Siblings are few enough that a linked list beats hashing the
+ * whole prefix on every lookup.
+ */
+struct command_node {
+	char c;
+	struct command_node *child;
+	struct command_node *next;
+	struct at_command *command;
+};
+
 struct _GAtServer {
 	gint ref_count;				/* Ref count */
 	struct v250_settings v250;		/* V.250 command setting */
@@ -115,12 +127,14 @@ struct _GAtServer {
 	gpointer user_disconnect_data;		/* User disconnect data */
 	GAtDebugFunc debugf;			/* Debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
-	GHashTable *command_list;		/* List of AT commands */
+	struct command_node *commands;		/* Trie of AT commands */
 	GQueue *write_queue;			/* Write buffer queue */
+	struct ring_buffer *spare_buf;		/* Drained write buffer */
 	guint max_read_attempts;		/* Max reads per select */
 	enum ParserState parser_state;
 	gboolean destroyed;			/* Re-entrancy guard */
 	char *last_line;			/* Last read line */
+	unsigned int line_size;			/* Size of last_line */
 	unsigned int cur_pos;			/* Where we are on the line */
 	GAtServerResult last_result;
 	gboolean final_sent;
@@ -135,7 +149,12 @@ static void server_parse_line(GAtServer *server);
 
 static struct ring_buffer *allocate_next(GAtServer *server)
 {
-	struct ring_buffer *buf = ring_buffer_new(BUF_SIZE);
+	struct ring_buffer *buf = server->spare_buf;
+
+	if (buf != NULL)
+		server->spare_buf = NULL;
+	else
+		buf = ring_buffer_new(BUF_SIZE);
 
 	if (buf == NULL)
 		return NULL;
@@ -145,7 +164,7 @@ static struct ring_buffer *allocate_next(GAtServer *server)
 	return buf;
 }
 
-static void send_common(GAtServer *server, const char *buf, unsigned int len)
+static void write_common(GAtServer *server, const char *buf, unsigned int len)
 {
 	gsize towrite = len;
 	gsize bytes_written = 0;
@@ -169,34 +188,41 @@ static void send_common(GAtServer *server, const char *buf, unsigned int len)
 				bytes_written < towrite)
 			write_buf = allocate_next(server);
 	}
+}
 
+static void send_common(GAtServer *server, const char *buf, unsigned int len)
+{
+	write_common(server, buf, len);
 	server_wakeup_writer(server);
 }
 
 static void send_result_common(GAtServer *server, const char *result)
 
 {
-	struct v250_settings v250 = server->v250;
-	char buf[MAX_TEXT_SIZE + 1];
-	char t = v250.s3;
-	char r = v250.s4;
+	char tr[2] = { server->v250.s3, server->v250.s4 };
 	unsigned int len;
 
-	if (v250.quiet)
+	if (server->v250.quiet)
 		return;
 
 	if (result == NULL)
 		return;
 
-	if (strlen(result) > 2048)
+	len = strlen(result);
+	if (len > 2048)
 		return;
 
-	if (v250.is_v1)
-		len = sprintf(buf, "%c%c%s%c%c", t, r, result, t, r);
-	else
-		len = sprintf(buf, "%s%c", result, t);
+	/* Write straight into the ring buffer, no need to format first */
+	if (server->v250.is_v1) {
+		write_common(server, tr, 2);
+		write_common(server, result, len);
+		write_common(server, tr, 2);
+	} else {
+		write_common(server, result, len);
+		write_common(server, tr, 1);
+	}
 
-	send_common(server, buf, len);
+	server_wakeup_writer(server);
 }
 
 static inline void send_final_common(GAtServer *server, const char *result)
@@ -260,20 +286,19 @@ void g_at_server_send_unsolicited(GAtServer *server, const char *result)
 
 void g_at_server_send_info(GAtServer *server, const char *line, gboolean last)
 {
-	char buf[MAX_TEXT_SIZE + 1];
-	char t = server->v250.s3;
-	char r = server->v250.s4;
-	unsigned int len;
+	char tr[2] = { server->v250.s3, server->v250.s4 };
+	unsigned int len = strlen(line);
 
-	if (strlen(line) > 2048)
+	if (len > 2048)
 		return;
 
+	write_common(server, tr, 2);
+	write_common(server, line, len);
+
 	if (last)
-		len = sprintf(buf, "%c%c%s%c%c", t, r, line, t, r);
-	else
-		len = sprintf(buf, "%c%c%s", t, r, line);
+		write_common(server, tr, 2);
 
-	send_common(server, buf, len);
+	server_wakeup_writer(server);
 }
 
 static gboolean get_result_value(GAtServer *server, GAtResult *result,
@@ -585,13 +610,66 @@ static inline gboolean is_extended_command_prefix(const char c)
 	}
 }
 
+static struct command_node *command_lookup(struct command_node *root,
+						const char *prefix,
+						gboolean create)
+{
+	struct command_node *node = root;
+	struct command_node *child;
+
+	for (; *prefix; prefix++) {
+		for (child = node->child; child; child = child->next)
+			if (child->c == *prefix)
+				break;
+
+		if (child == NULL) {
+			if (create == FALSE)
+				return NULL;
+
+			child = g_try_new0(struct command_node, 1);
+			if (child == NULL)
+				return NULL;
+
+			child->c = *prefix;
+			child->next = node->child;
+			node->child = child;
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+static void at_notify_node_destroy(gpointer data);
+
+static void command_trie_free(struct command_node *node)
+{
+	struct command_node *next;
+
+	while (node) {
+		next = node->next;
+
+		command_trie_free(node->child);
+
+		if (node->command)
+			at_notify_node_destroy(node->command);
+
+		g_free(node);
+		node = next;
+	}
+}
+
 static void at_command_notify(GAtServer *server, char *command,
 				char *prefix, GAtServerRequestType type)
 {
-	struct at_command *node;
+	struct command_node *trie_node;
+	struct at_command *node = NULL;
 	GAtResult result;
 
-	node = g_hash_table_lookup(server->command_list, prefix);
+	trie_node = command_lookup(server->commands, prefix, FALSE);
+	if (trie_node)
+		node = trie_node->command;
 
 	if (node == NULL) {
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
@@ -935,54 +1013,47 @@ out:
 	return res;
 }
 
-static char *extract_line(GAtServer *p, struct ring_buffer *rbuf)
+/*
+ * Copies the command line out of the ring buffer into last_line in a
+ * single pass, stripping the AT prefix, S3 and whitespace outside of
+ * strings and applying S5.  The line buffer is reused between commands.
+ */
+static gboolean extract_line(GAtServer *p, struct ring_buffer *rbuf)
 {
 	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
 	unsigned int pos = 0;
 	unsigned char *buf = ring_buffer_read_ptr(rbuf, pos);
-	int strip_front = 0;
-	int line_length = 0;
+	unsigned int prefix = 0;
 	gboolean in_string = FALSE;
 	char s3 = p->v250.s3;
 	char s5 = p->v250.s5;
 	char *line;
-	int i;
+	int i = 0;
 
-	while (pos < p->read_so_far) {
-		if (*buf == '"')
-			in_string = !in_string;
+	if (p->line_size < p->read_so_far + 1) {
+		g_free(p->last_line);
 
-		if (in_string == FALSE && (*buf == ' ' || *buf == '\t')) {
-			if (line_length == 0)
-				strip_front += 1;
-		} else
-			line_length += 1;
+		p->line_size = MAX(p->read_so_far + 1, MAX_TEXT_SIZE);
+		p->last_line = g_try_new(char, p->line_size);
 
-		buf += 1;
-		pos += 1;
-
-		if (pos == wrap)
-			buf = ring_buffer_read_ptr(rbuf, pos);
+		if (p->last_line == NULL) {
+			p->line_size = 0;
+			ring_buffer_drain(rbuf, p->read_so_far);
+			return FALSE;
+		}
 	}
 
-	/* We will strip AT and S3 */
-	line_length -= 3;
+	line = p->last_line;
 
-	line = g_try_new(char, line_length + 1);
-	if (line == NULL) {
-		ring_buffer_drain(rbuf, p->read_so_far);
-		return NULL;
-	}
-
-	/* Strip leading whitespace + AT */
-	ring_buffer_drain(rbuf, strip_front + 2);
+	while (pos < p->read_so_far) {
+		/* Strip leading whitespace + AT */
+		if (prefix < 2) {
+			if (*buf != ' ' && *buf != '\t')
+				prefix += 1;
 
-	pos = 0;
-	i = 0;
-	wrap = ring_buffer_len_no_wrap(rbuf);
-	buf = ring_buffer_read_ptr(rbuf, pos);
+			goto next;
+		}
 
-	while (pos < (p->read_so_far - strip_front - 2)) {
 		if (*buf == '"')
 			in_string = !in_string;
 
@@ -994,6 +1065,7 @@ static char *extract_line(GAtServer *p, struct ring_buffer *rbuf)
 		else if (*buf != s3)
 			line[i++] = *buf;
 
+next:
 		buf += 1;
 		pos += 1;
 
@@ -1001,12 +1073,11 @@ static char *extract_line(GAtServer *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	/* Strip S3 */
-	ring_buffer_drain(rbuf, p->read_so_far - strip_front - 2);
+	ring_buffer_drain(rbuf, p->read_so_far);
 
 	line[i] = '\0';
 
-	return line;
+	return TRUE;
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
@@ -1055,12 +1126,9 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 		case PARSER_RESULT_COMMAND:
 		{
-			g_free(p->last_line);
-
-			p->last_line = extract_line(p, rbuf);
 			p->cur_pos = 0;
 
-			if (p->last_line)
+			if (extract_line(p, rbuf))
 				server_parse_line(p);
 			else
 				g_at_server_send_final(p,
@@ -1155,7 +1223,14 @@ static gboolean can_write_data(gpointer data)
 	if ((ring_buffer_len(write_buf) == 0) &&
 			(g_queue_get_length(server->write_queue) > 1)) {
 		write_buf = g_queue_pop_head(server->write_queue);
-		ring_buffer_free(write_buf);
+
+		/* Keep one drained buffer around for the next response */
+		if (server->spare_buf == NULL) {
+			ring_buffer_reset(write_buf);
+			server->spare_buf = write_buf;
+		} else
+			ring_buffer_free(write_buf);
+
 		write_buf = g_queue_peek_head(server->write_queue);
 	}
 
@@ -1180,8 +1255,13 @@ static void g_at_server_cleanup(GAtServer *server)
 	/* Cleanup pending data to write */
 	write_queue_free(server->write_queue);
 
-	g_hash_table_destroy(server->command_list);
-	server->command_list = NULL;
+	if (server->spare_buf) {
+		ring_buffer_free(server->spare_buf);
+		server->spare_buf = NULL;
+	}
+
+	command_trie_free(server->commands);
+	server->commands = NULL;
 
 	g_free(server->last_line);
 
@@ -1257,9 +1337,9 @@ GAtServer *g_at_server_new(GIOChannel *io)
 
 	g_at_io_set_disconnect_function(server->io, io_disconnect, server);
 
-	server->command_list = g_hash_table_new_full(g_str_hash, g_str_equal,
-							g_free,
-							at_notify_node_destroy);
+	server->commands = g_try_new0(struct command_node, 1);
+	if (server->commands == NULL)
+		goto error;
 
 	server->write_queue = g_queue_new();
 	if (!server->write_queue)
@@ -1279,8 +1359,7 @@ GAtServer *g_at_server_new(GIOChannel *io)
 error:
 	g_at_io_unref(server->io);
 
-	if (server->command_list)
-		g_hash_table_destroy(server->command_list);
+	command_trie_free(server->commands);
 
 	if (server->write_queue)
 		write_queue_free(server->write_queue);
@@ -1431,9 +1510,10 @@ gboolean g_at_server_register(GAtServer *server, const char *prefix,
 					gpointer user_data,
 					GDestroyNotify destroy_notify)
 {
+	struct command_node *trie_node;
 	struct at_command *node;
 
-	if (server == NULL || server->command_list == NULL)
+	if (server == NULL || server->commands == NULL)
 		return FALSE;
 
 	if (notify == NULL)
@@ -1450,26 +1530,38 @@ gboolean g_at_server_register(GAtServer *server, const char *prefix,
 	node->user_data = user_data;
 	node->destroy_notify = destroy_notify;
 
-	g_hash_table_replace(server->command_list, g_strdup(prefix), node);
+	trie_node = command_lookup(server->commands, prefix, TRUE);
+	if (trie_node == NULL) {
+		g_free(node);
+		return FALSE;
+	}
+
+	if (trie_node->command)
+		at_notify_node_destroy(trie_node->command);
+
+	trie_node->command = node;
 
 	return TRUE;
 }
 
 gboolean g_at_server_unregister(GAtServer *server, const char *prefix)
 {
+	struct command_node *trie_node;
 	struct at_command *node;
 
-	if (server == NULL || server->command_list == NULL)
+	if (server == NULL || server->commands == NULL)
 		return FALSE;
 
 	if (prefix == NULL || strlen(prefix) == 0)
 		return FALSE;
 
-	node = g_hash_table_lookup(server->command_list, prefix);
-	if (node == NULL)
+	trie_node = command_lookup(server->commands, prefix, FALSE);
+	if (trie_node == NULL || trie_node->command == NULL)
 		return FALSE;
 
-	g_hash_table_remove(server->command_list, prefix);
+	node = trie_node->command;
+	trie_node->command = NULL;
+	at_notify_node_destroy(node);
 
 	return TRUE;
 }
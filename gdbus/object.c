@@ -58,14 +58,26 @@ struct generic_data {
 	guint process_id;
 	gboolean pending_prop;
 	char *introspect;
+	char *children;
 	struct generic_data *parent;
 };
 
+/* Introspection fragment shared by all users of the same tables */
+struct interface_xml {
+	const GDBusMethodTable *methods;
+	const GDBusSignalTable *signals;
+	const GDBusPropertyTable *properties;
+	unsigned int refcount;
+	int flags;
+	char *xml;
+};
+
 struct interface_data {
 	char *name;
 	const GDBusMethodTable *methods;
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
+	struct interface_xml *xml;
 	GSList *pending_prop;
 	void *user_data;
 	GDBusDestroyFunction destroy;
@@ -87,6 +99,9 @@ struct property_data {
 static int global_flags = 0;
 static struct generic_data *root;
 static GSList *pending = NULL;
+static GHashTable *interface_xml_cache = NULL;
+static GDBusWatchFunction flush_function = NULL;
+static void *flush_data = NULL;
 
 static gboolean process_changes(gpointer user_data);
 static void process_properties_from_interface(struct generic_data *data,
@@ -128,7 +143,7 @@ static gboolean check_experimental(int flags, int flag)
 	return !(global_flags & G_DBUS_FLAG_ENABLE_EXPERIMENTAL);
 }
 
-static void generate_interface_xml(GString *gstr, struct interface_data *iface)
+static void generate_interface_xml(GString *gstr, struct interface_xml *iface)
 {
 	const GDBusMethodTable *method;
 	const GDBusSignalTable *signal;
@@ -190,14 +205,116 @@ static void generate_interface_xml(GString *gstr, struct interface_data *iface)
 	}
 }
 
-static void generate_introspection_xml(DBusConnection *conn,
+static guint interface_xml_hash(gconstpointer key)
+{
+	const struct interface_xml *iface = key;
+
+	return g_direct_hash(iface->methods) ^
+			(g_direct_hash(iface->signals) << 1) ^
+			(g_direct_hash(iface->properties) << 2);
+}
+
+static gboolean interface_xml_equal(gconstpointer a, gconstpointer b)
+{
+	const struct interface_xml *ia = a;
+	const struct interface_xml *ib = b;
+
+	return ia->methods == ib->methods && ia->signals == ib->signals &&
+					ia->properties == ib->properties;
+}
+
+static struct interface_xml *interface_xml_ref(
+					const GDBusMethodTable *methods,
+					const GDBusSignalTable *signals,
+					const GDBusPropertyTable *properties)
+{
+	struct interface_xml key = { methods, signals, properties };
+	struct interface_xml *iface;
+
+	if (interface_xml_cache == NULL)
+		interface_xml_cache = g_hash_table_new(interface_xml_hash,
+							interface_xml_equal);
+
+	iface = g_hash_table_lookup(interface_xml_cache, &key);
+	if (iface != NULL) {
+		iface->refcount++;
+		return iface;
+	}
+
+	iface = g_new0(struct interface_xml, 1);
+	iface->methods = methods;
+	iface->signals = signals;
+	iface->properties = properties;
+	iface->refcount = 1;
+
+	g_hash_table_insert(interface_xml_cache, iface, iface);
+
+	return iface;
+}
+
+static void interface_xml_unref(struct interface_xml *iface)
+{
+	if (--iface->refcount > 0)
+		return;
+
+	g_hash_table_remove(interface_xml_cache, iface);
+
+	if (g_hash_table_size(interface_xml_cache) == 0) {
+		g_hash_table_destroy(interface_xml_cache);
+		interface_xml_cache = NULL;
+	}
+
+	g_free(iface->xml);
+	g_free(iface);
+}
+
+static const char *interface_xml_get(struct interface_xml *iface)
+{
+	GString *gstr;
+
+	/* The experimental flag decides which members are visible */
+	if (iface->xml != NULL && iface->flags == global_flags)
+		return iface->xml;
+
+	g_free(iface->xml);
+
+	gstr = g_string_new(NULL);
+	generate_interface_xml(gstr, iface);
+
+	iface->flags = global_flags;
+	iface->xml = g_string_free(gstr, FALSE);
+
+	return iface->xml;
+}
+
+static void generate_children_xml(DBusConnection *conn,
 				struct generic_data *data, const char *path)
 {
-	GSList *list;
 	GString *gstr;
 	char **children;
 	int i;
 
+	gstr = g_string_new(NULL);
+
+	if (!dbus_connection_list_registered(conn, path, &children))
+		goto done;
+
+	for (i = 0; children[i]; i++)
+		g_string_append_printf(gstr, "<node name=\"%s\"/>",
+								children[i]);
+
+	dbus_free_string_array(children);
+
+done:
+	data->children = g_string_free(gstr, FALSE);
+}
+
+static void generate_introspection_xml(DBusConnection *conn,
+				struct generic_data *data, const char *path)
+{
+	GSList *list;
+	GString *gstr;
+
 	g_free(data->introspect);
 
 	gstr = g_string_new(DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE);
@@ -210,21 +327,16 @@ static void generate_introspection_xml(DBusConnection *conn,
 		g_string_append_printf(gstr, "<interface name=\"%s\">",
 								iface->name);
 
-		generate_interface_xml(gstr, iface);
+		g_string_append(gstr, interface_xml_get(iface->xml));
 
 		g_string_append_printf(gstr, "</interface>");
 	}
 
-	if (!dbus_connection_list_registered(conn, path, &children))
-		goto done;
-
-	for (i = 0; children[i]; i++)
-		g_string_append_printf(gstr, "<node name=\"%s\"/>",
-								children[i]);
+	if (data->children == NULL)
+		generate_children_xml(conn, data, path);
 
-	dbus_free_string_array(children);
+	g_string_append(gstr, data->children);
 
-done:
 	g_string_append_printf(gstr, "</node>");
 
 	data->introspect = g_string_free(gstr, FALSE);
@@ -653,6 +765,7 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 	process_properties_from_interface(data, iface);
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
+	interface_xml_unref(iface->xml);
 
 	if (iface->destroy) {
 		iface->destroy(iface->user_data);
@@ -684,7 +797,7 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 	return TRUE;
 }
 
-static struct generic_data *invalidate_parent_data(DBusConnection *conn,
+static struct generic_data *link_parent_data(DBusConnection *conn,
 						const char *child_path)
 {
 	struct generic_data *data = NULL, *child = NULL, *parent = NULL;
@@ -708,7 +821,7 @@ static struct generic_data *invalidate_parent_data(DBusConnection *conn,
 		goto done;
 	}
 
-	parent = invalidate_parent_data(conn, parent_path);
+	parent = link_parent_data(conn, parent_path);
 
 	if (data == NULL) {
 		data = parent;
@@ -716,9 +829,6 @@ static struct generic_data *invalidate_parent_data(DBusConnection *conn,
 			goto done;
 	}
 
-	g_free(data->introspect);
-	data->introspect = NULL;
-
 	if (!dbus_connection_get_object_path_data(conn, child_path,
 							(void *) &child))
 		goto done;
@@ -734,6 +844,29 @@ done:
 	return data;
 }
 
+static struct generic_data *invalidate_parent_data(DBusConnection *conn,
+						const char *child_path)
+{
+	struct generic_data *parent;
+
+	parent = link_parent_data(conn, child_path);
+	if (parent == NULL)
+		return NULL;
+
+	/*
+	 * Only the closest registered ancestor can see its list of child
+	 * nodes change, anything further up already lists the path leading
+	 * to it.
+	 */
+	g_free(parent->children);
+	parent->children = NULL;
+
+	g_free(parent->introspect);
+	parent->introspect = NULL;
+
+	return parent;
+}
+
 static inline const GDBusPropertyTable *find_property(const GDBusPropertyTable *properties,
 							const char *name)
 {
@@ -1030,6 +1163,7 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 
 	dbus_connection_unref(data->conn);
 	g_free(data->introspect);
+	g_free(data->children);
 	g_free(data->path);
 	g_free(data);
 }
@@ -1211,6 +1345,7 @@ done:
 	iface->methods = methods;
 	iface->signals = signals;
 	iface->properties = properties;
+	iface->xml = interface_xml_ref(methods, signals, properties);
 	iface->user_data = user_data;
 	iface->destroy = destroy;
 
@@ -1479,6 +1614,10 @@ static void g_dbus_flush(DBusConnection *connection)
 
 		process_changes(data);
 	}
+
+	/* Anything the application held back must go out first as well */
+	if (flush_function != NULL)
+		flush_function(connection, flush_data);
 }
 
 gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
@@ -1821,3 +1960,9 @@ int g_dbus_get_flags(void)
 {
 	return global_flags;
 }
+
+void g_dbus_set_flush_function(GDBusWatchFunction function, void *user_data)
+{
+	flush_function = function;
+	flush_data = user_data;
+}
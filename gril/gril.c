@@ -45,7 +45,7 @@
 
 #define RIL_TRACE(ril, fmt, arg...) do {	\
 	if (ril->trace == TRUE)			\
-		ofono_debug(fmt, ## arg);	\
+		ofono_trace(fmt, ## arg);	\
 } while (0)
 
 #define COMMAND_FLAG_EXPECT_PDU			0x1
@@ -64,12 +64,12 @@ typedef const char *(*GRilMsgIdToStrFunc)(int msg_id);
  * @fmt: format string
  * @arg...: list of arguments
  *
- * Simple macro around ofono_debug() used for tracing RIL messages
+ * Simple macro around ofono_trace() used for tracing RIL messages
  * name it is called in.
  */
 #define G_RIL_TRACE(gril, fmt, arg...) do {	\
 	if (gril && g_ril_get_trace(gril))	\
-		ofono_debug(fmt, ## arg);	\
+		ofono_trace(fmt, ## arg);	\
 } while (0)
 
 extern char print_buf[];
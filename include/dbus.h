@@ -32,6 +32,7 @@ extern "C" {
 #define OFONO_SERVICE	"org.ofono"
 #define OFONO_MANAGER_INTERFACE "org.ofono.Manager"
 #define OFONO_MANAGER_PATH "/"
+#define OFONO_DEBUG_INTERFACE OFONO_SERVICE ".Debug"
 #define OFONO_MODEM_INTERFACE "org.ofono.Modem"
 #define OFONO_CALL_BARRING_INTERFACE "org.ofono.CallBarring"
 #define OFONO_CALL_FORWARDING_INTERFACE "org.ofono.CallForwarding"
@@ -54,6 +55,7 @@ extern "C" {
 #define OFONO_SIM_MANAGER_INTERFACE "org.ofono.SimManager"
 #define OFONO_VOICECALL_INTERFACE "org.ofono.VoiceCall"
 #define OFONO_VOICECALL_MANAGER_INTERFACE "org.ofono.VoiceCallManager"
+#define OFONO_VOICECALL_TRACE_INTERFACE "org.ofono.VoiceCallTrace"
 #define OFONO_STK_INTERFACE OFONO_SERVICE ".SimToolkit"
 #define OFONO_SIM_APP_INTERFACE OFONO_SERVICE ".SimToolkitAgent"
 #define OFONO_LOCATION_REPORTING_INTERFACE OFONO_SERVICE ".LocationReporting"
@@ -76,6 +76,8 @@ void *ofono_gprs_get_data(struct ofono_gprs *gprs);
 
 void ofono_gprs_set_cid_range(struct ofono_gprs *gprs,
 				unsigned int min, unsigned int max);
+void ofono_gprs_set_max_pending_activations(struct ofono_gprs *gprs,
+						unsigned int count);
 void ofono_gprs_add_context(struct ofono_gprs *gprs,
 				struct ofono_gprs_context *gc);
 const struct ofono_gprs_primary_context *ofono_gprs_get_ia_apn(
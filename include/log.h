@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+#include <ofono/types.h>
+
 /**
  * SECTION:log
  * @title: Logging premitives
@@ -46,27 +48,72 @@ struct ofono_debug_desc {
 	const char *file;
 #define OFONO_DEBUG_FLAG_DEFAULT (0)
 #define OFONO_DEBUG_FLAG_PRINT   (1 << 0)
+#define OFONO_DEBUG_FLAG_TRACE   (1 << 1)
+#define OFONO_DEBUG_FLAG_OUTPUT  (OFONO_DEBUG_FLAG_PRINT | \
+					OFONO_DEBUG_FLAG_TRACE)
 	unsigned int flags;
 } __attribute__((aligned(8)));
 
+extern void ofono_debug_desc_log(const struct ofono_debug_desc *desc,
+					const char *format, ...)
+				__attribute__((format(printf, 2, 3)));
+
+enum ofono_debug_channel {
+	OFONO_DEBUG_CHANNEL_RIL,	/* decoded RIL requests and events */
+	OFONO_DEBUG_CHANNEL_RIL_HEX,	/* raw RIL parcels */
+	OFONO_DEBUG_CHANNEL_AT,		/* AT command chat */
+	OFONO_DEBUG_CHANNEL_QMI,	/* raw QMI messages */
+};
+
+typedef void (*ofono_debug_channel_cb_t)(ofono_bool_t enable, void *data);
+
+/*
+ * Lets the transport debug output of a modem be switched at runtime.
+ * The callback is invoked right away if the channel starts enabled.
+ */
+extern unsigned int ofono_debug_channel_add(enum ofono_debug_channel channel,
+					const char *owner,
+					ofono_debug_channel_cb_t cb,
+					void *data);
+extern void ofono_debug_channel_remove(unsigned int id);
+
 /**
  * DBG:
  * @fmt: format string
  * @arg...: list of arguments
  *
  * Simple macro around ofono_debug() which also include the function
- * name it is called in.
+ * name it is called in.  Depending on the descriptor flags the message
+ * goes to syslog, the trace ring or both.
  */
 #define DBG(fmt, arg...) do { \
 	static struct ofono_debug_desc __ofono_debug_desc \
 	__attribute__((used, section("__debug"), aligned(8))) = { \
 		.file = __FILE__, .flags = OFONO_DEBUG_FLAG_DEFAULT, \
 	}; \
-	if (__ofono_debug_desc.flags & OFONO_DEBUG_FLAG_PRINT) \
-		ofono_debug("%s:%s() " fmt, \
+	if (__ofono_debug_desc.flags & OFONO_DEBUG_FLAG_OUTPUT) \
+		ofono_debug_desc_log(&__ofono_debug_desc, "%s:%s() " fmt, \
 					__FILE__, __FUNCTION__ , ## arg); \
 } while (0)
 
+/**
+ * ofono_trace:
+ * @fmt: format string, must be a string literal
+ * @arg...: list of arguments
+ *
+ * Output high volume debug message, like the RIL traces.  Unlike DBG()
+ * it is printed by default, but every call site has its own descriptor
+ * so the output can be moved to the trace ring per source file.
+ */
+#define ofono_trace(fmt, arg...) do { \
+	static struct ofono_debug_desc __ofono_trace_desc \
+	__attribute__((used, section("__debug"), aligned(8))) = { \
+		.file = __FILE__, .flags = OFONO_DEBUG_FLAG_PRINT, \
+	}; \
+	if (__ofono_trace_desc.flags & OFONO_DEBUG_FLAG_OUTPUT) \
+		ofono_debug_desc_log(&__ofono_trace_desc, fmt, ## arg); \
+} while (0)
+
 #define PRINTABLE_STR(s) ((s) ? (s) : "(null)")
 
 #ifdef __cplusplus
@@ -94,6 +94,17 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 void ofono_netreg_time_notify(struct ofono_netreg *netreg,
 				struct ofono_network_time *info);
 
+/*
+ * Limits applied to strength and location notifications before they are
+ * published, intervals in ms and the strength delta in percent.  Zero
+ * disables the respective limit.
+ */
+void ofono_netreg_set_strength_limits(struct ofono_netreg *netreg,
+					unsigned int min_interval,
+					unsigned int min_delta);
+void ofono_netreg_set_location_limits(struct ofono_netreg *netreg,
+					unsigned int min_interval);
+
 int ofono_netreg_driver_register(const struct ofono_netreg_driver *d);
 void ofono_netreg_driver_unregister(const struct ofono_netreg_driver *d);
 
@@ -38,6 +38,9 @@ understanding that oFono hasn't reached a stable API."
 #define OFONO_PLUGIN_PRIORITY_DEFAULT     0
 #define OFONO_PLUGIN_PRIORITY_HIGH      100
 
+/* Initialize when the first modem is registered instead of at startup */
+#define OFONO_PLUGIN_FLAG_LAZY		(1 << 0)
+
 /**
  * SECTION:plugin
  * @title: Plugin premitives
@@ -53,25 +56,30 @@ struct ofono_plugin_desc {
 	void (*exit) (void);
 	void *debug_start;
 	void *debug_stop;
+	unsigned int flags;
 };
 
 /**
- * OFONO_PLUGIN_DEFINE:
+ * OFONO_PLUGIN_DEFINE_FLAGS:
  * @name: plugin name
  * @description: plugin description
  * @version: plugin version string
+ * @flags: OFONO_PLUGIN_FLAG_* bits
  * @init: init function called on plugin loading
  * @exit: exit function called on plugin removal
  *
- * Macro for defining a plugin descriptor
+ * Macro for defining a plugin descriptor with flags
  */
 #ifdef OFONO_PLUGIN_BUILTIN
-#define OFONO_PLUGIN_DEFINE(name, description, version, priority, init, exit) \
+#define OFONO_PLUGIN_DEFINE_FLAGS(name, description, version, priority, \
+							flags, init, exit) \
 		struct ofono_plugin_desc __ofono_builtin_ ## name = { \
-			#name, description, version, priority, init, exit \
+			#name, description, version, priority, init, exit, \
+			NULL, NULL, flags \
 		};
 #else
-#define OFONO_PLUGIN_DEFINE(name, description, version, priority, init, exit) \
+#define OFONO_PLUGIN_DEFINE_FLAGS(name, description, version, priority, \
+							flags, init, exit) \
 		extern struct ofono_debug_desc __start___debug[] \
 				__attribute__ ((weak, visibility("hidden"))); \
 		extern struct ofono_debug_desc __stop___debug[] \
@@ -80,10 +88,24 @@ struct ofono_plugin_desc {
 				__attribute__ ((visibility("default"))); \
 		struct ofono_plugin_desc ofono_plugin_desc = { \
 			#name, description, version, priority, init, exit, \
-			__start___debug, __stop___debug \
+			__start___debug, __stop___debug, flags \
 		};
 #endif
 
+/**
+ * OFONO_PLUGIN_DEFINE:
+ * @name: plugin name
+ * @description: plugin description
+ * @version: plugin version string
+ * @init: init function called on plugin loading
+ * @exit: exit function called on plugin removal
+ *
+ * Macro for defining a plugin descriptor
+ */
+#define OFONO_PLUGIN_DEFINE(name, description, version, priority, init, exit) \
+		OFONO_PLUGIN_DEFINE_FLAGS(name, description, version, \
+						priority, 0, init, exit)
+
 #ifdef __cplusplus
 }
 #endif
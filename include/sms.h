@@ -78,6 +78,9 @@ void ofono_sms_remove(struct ofono_sms *sms);
 void ofono_sms_set_data(struct ofono_sms *sms, void *data);
 void *ofono_sms_get_data(struct ofono_sms *sms);
 
+void ofono_sms_set_max_pending_submits(struct ofono_sms *sms,
+					unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
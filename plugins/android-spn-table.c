@@ -212,6 +212,7 @@ static void android_spn_table_exit(void)
 	g_hash_table_destroy(android_spn_table);
 }
 
-OFONO_PLUGIN_DEFINE(androidspntable, "Android SPN table Plugin", VERSION,
-			OFONO_PLUGIN_PRIORITY_DEFAULT,
+OFONO_PLUGIN_DEFINE_FLAGS(androidspntable,
+			"Android SPN table Plugin", VERSION,
+			OFONO_PLUGIN_PRIORITY_DEFAULT, OFONO_PLUGIN_FLAG_LAZY,
 			android_spn_table_init, android_spn_table_exit)
@@ -66,6 +66,8 @@ struct gobi_data {
 	unsigned long features;
 	unsigned int discover_attempts;
 	uint8_t oper_mode;
+	unsigned int debug_channel;
+	bool debug;
 };
 
 static void gobi_debug(const char *str, void *user_data)
@@ -75,6 +77,18 @@ static void gobi_debug(const char *str, void *user_data)
 	ofono_info("%s%s", prefix, str);
 }
 
+static void gobi_debug_channel(ofono_bool_t enable, void *user_data)
+{
+	struct gobi_data *data = user_data;
+
+	data->debug = enable;
+
+	if (enable)
+		qmi_device_set_debug(data->device, gobi_debug, "QMI: ");
+	else
+		qmi_device_set_debug(data->device, NULL, NULL);
+}
+
 static int gobi_probe(struct ofono_modem *modem)
 {
 	struct gobi_data *data;
@@ -87,6 +101,10 @@ static int gobi_probe(struct ofono_modem *modem)
 
 	ofono_modem_set_data(modem, data);
 
+	data->debug_channel = ofono_debug_channel_add(OFONO_DEBUG_CHANNEL_QMI,
+						ofono_modem_get_path(modem),
+						gobi_debug_channel, data);
+
 	return 0;
 }
 
@@ -98,6 +116,8 @@ static void gobi_remove(struct ofono_modem *modem)
 
 	ofono_modem_set_data(modem, NULL);
 
+	ofono_debug_channel_remove(data->debug_channel);
+
 	qmi_service_unref(data->dms);
 
 	qmi_device_unref(data->device);
@@ -323,7 +343,7 @@ static int gobi_enable(struct ofono_modem *modem)
 		return -ENOMEM;
 	}
 
-	if (getenv("OFONO_QMI_DEBUG"))
+	if (data->debug)
 		qmi_device_set_debug(data->device, gobi_debug, "QMI: ");
 
 	qmi_device_set_close_on_unref(data->device, true);
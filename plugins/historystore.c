@@ -0,0 +1,567 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+#include <gdbus.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/plugin.h>
+#include <ofono/log.h>
+#include <ofono/modem.h>
+#include <ofono/history.h>
+#include <ofono/types.h>
+#include <ofono/dbus.h>
+
+#include "ofono.h"
+#include "common.h"
+#include "util.h"
+#include "historylog.h"
+
+#define HISTORY_STORE_INTERFACE "org.ofono.History"
+
+#define HISTORY_STORE_PATH STORAGEDIR "/history%s"
+#define HISTORY_STORE_CAPACITY (1024 * 1024)
+#define HISTORY_STORE_MAX_RECORDS 100
+
+struct history_store {
+	struct ofono_modem *modem;
+	struct history_log *log;
+};
+
+static const char *type_names[] = {
+	[HISTORY_LOG_TYPE_CALL] = "call",
+	[HISTORY_LOG_TYPE_MISSED_CALL] = "missed-call",
+	[HISTORY_LOG_TYPE_INCOMING_MESSAGE] = "incoming-message",
+	[HISTORY_LOG_TYPE_OUTGOING_MESSAGE] = "outgoing-message",
+};
+
+static const char *type_to_string(unsigned int type)
+{
+	if (type >= G_N_ELEMENTS(type_names) || type_names[type] == NULL)
+		return "unknown";
+
+	return type_names[type];
+}
+
+static const char *sms_status_to_string(enum ofono_history_sms_status status)
+{
+	switch (status) {
+	case OFONO_HISTORY_SMS_STATUS_PENDING:
+		return "pending";
+	case OFONO_HISTORY_SMS_STATUS_SUBMITTED:
+		return "submitted";
+	case OFONO_HISTORY_SMS_STATUS_SUBMIT_FAILED:
+		return "submit-failed";
+	case OFONO_HISTORY_SMS_STATUS_SUBMIT_CANCELLED:
+		return "submit-cancelled";
+	case OFONO_HISTORY_SMS_STATUS_DELIVERED:
+		return "delivered";
+	case OFONO_HISTORY_SMS_STATUS_DELIVER_FAILED:
+		return "deliver-failed";
+	}
+
+	return "unknown";
+}
+
+static int type_from_string(const char *str)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(type_names); i++)
+		if (type_names[i] && g_str_equal(type_names[i], str))
+			return i;
+
+	return -1;
+}
+
+static void append_record(DBusMessageIter *iter,
+				const struct history_log_record *record)
+{
+	DBusMessageIter dict;
+	const char *str;
+	dbus_int64_t time = record->time;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	if (record->uuid) {
+		str = encode_hex(record->uuid, HISTORY_LOG_UUID_LEN, 0);
+		ofono_dbus_dict_append(&dict, "Id", DBUS_TYPE_STRING, &str);
+		g_free((char *) str);
+	}
+
+	str = type_to_string(record->type);
+	ofono_dbus_dict_append(&dict, "Type", DBUS_TYPE_STRING, &str);
+	ofono_dbus_dict_append(&dict, "Peer", DBUS_TYPE_STRING, &record->peer);
+	ofono_dbus_dict_append(&dict, "Time", DBUS_TYPE_INT64, &time);
+
+	switch (record->type) {
+	case HISTORY_LOG_TYPE_CALL:
+		ofono_dbus_dict_append(&dict, "Duration", DBUS_TYPE_UINT32,
+					&record->duration);
+		/* fall through */
+	case HISTORY_LOG_TYPE_MISSED_CALL:
+		if (record->status == CALL_DIRECTION_MOBILE_ORIGINATED)
+			str = "outgoing";
+		else
+			str = "incoming";
+
+		ofono_dbus_dict_append(&dict, "Direction", DBUS_TYPE_STRING,
+					&str);
+		break;
+	case HISTORY_LOG_TYPE_OUTGOING_MESSAGE:
+		str = sms_status_to_string(record->status);
+		ofono_dbus_dict_append(&dict, "Status", DBUS_TYPE_STRING,
+					&str);
+		/* fall through */
+	case HISTORY_LOG_TYPE_INCOMING_MESSAGE:
+		ofono_dbus_dict_append(&dict, "Text", DBUS_TYPE_STRING,
+					&record->text);
+		break;
+	}
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+static DBusMessage *history_get_properties(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct history_store *store = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_uint32_t value;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = history_log_count(store->log);
+	ofono_dbus_dict_append(&dict, "Count", DBUS_TYPE_UINT32, &value);
+
+	value = history_log_used(store->log);
+	ofono_dbus_dict_append(&dict, "Size", DBUS_TYPE_UINT32, &value);
+
+	value = history_log_capacity(store->log);
+	ofono_dbus_dict_append(&dict, "Capacity", DBUS_TYPE_UINT32, &value);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static gboolean parse_id(const char *id, unsigned char *uuid)
+{
+	long len;
+
+	if (strlen(id) != HISTORY_LOG_UUID_LEN * 2)
+		return FALSE;
+
+	if (decode_hex_own_buf(id, -1, &len, 0, uuid) == NULL)
+		return FALSE;
+
+	return len == HISTORY_LOG_UUID_LEN;
+}
+
+static DBusMessage *history_get_record(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct history_store *store = data;
+	unsigned char uuid[HISTORY_LOG_UUID_LEN];
+	struct history_log_record record;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	const char *id;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &id,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (!parse_id(id, uuid))
+		return __ofono_error_invalid_format(msg);
+
+	if (!history_log_find(store->log, uuid, &record))
+		return __ofono_error_not_found(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	append_record(&iter, &record);
+
+	return reply;
+}
+
+static gboolean parse_filter(DBusMessageIter *iter,
+				struct history_log_filter *filter)
+{
+	DBusMessageIter array;
+
+	memset(filter, 0, sizeof(*filter));
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return FALSE;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+		int type;
+
+		dbus_message_iter_recurse(&array, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		type = dbus_message_iter_get_arg_type(&value);
+
+		if (g_str_equal(key, "Peer")) {
+			if (type != DBUS_TYPE_STRING)
+				return FALSE;
+
+			dbus_message_iter_get_basic(&value, &filter->peer);
+		} else if (g_str_equal(key, "Since")) {
+			if (type != DBUS_TYPE_INT64)
+				return FALSE;
+
+			dbus_message_iter_get_basic(&value, &filter->since);
+		} else if (g_str_equal(key, "Until")) {
+			if (type != DBUS_TYPE_INT64)
+				return FALSE;
+
+			dbus_message_iter_get_basic(&value, &filter->until);
+		} else if (g_str_equal(key, "Type")) {
+			const char *str;
+			int t;
+
+			if (type != DBUS_TYPE_STRING)
+				return FALSE;
+
+			dbus_message_iter_get_basic(&value, &str);
+
+			t = type_from_string(str);
+			if (t < 0)
+				return FALSE;
+
+			filter->types |= HISTORY_LOG_TYPE_MASK(t);
+		} else
+			return FALSE;
+
+		dbus_message_iter_next(&array);
+	}
+
+	return TRUE;
+}
+
+static gboolean parse_cursor(const char *str,
+				struct history_log_cursor *cursor)
+{
+	char *end;
+
+	memset(cursor, 0, sizeof(*cursor));
+
+	if (*str == '\0')
+		return TRUE;
+
+	cursor->time = g_ascii_strtoll(str, &end, 10);
+	if (*end != ':')
+		return FALSE;
+
+	cursor->seq = g_ascii_strtoull(end + 1, &end, 10);
+
+	return *end == '\0' && cursor->seq != 0;
+}
+
+static void query_cb(const struct history_log_record *record, void *data)
+{
+	append_record(data, record);
+}
+
+static DBusMessage *history_get_records(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct history_store *store = data;
+	struct history_log_filter filter;
+	struct history_log_cursor cursor;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	const char *str;
+	dbus_uint32_t count;
+	gboolean more;
+	char *next;
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	if (!parse_filter(&iter, &filter))
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_get_basic(&iter, &str);
+
+	if (!parse_cursor(str, &cursor))
+		return __ofono_error_invalid_format(msg);
+
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_UINT32)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_get_basic(&iter, &count);
+
+	if (count == 0 || count > HISTORY_STORE_MAX_RECORDS)
+		count = HISTORY_STORE_MAX_RECORDS;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&array);
+
+	history_log_query(store->log, &filter, &cursor, count, &more,
+				query_cb, &array);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	if (more)
+		next = g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GUINT64_FORMAT,
+					cursor.time, cursor.seq);
+	else
+		next = g_strdup("");
+
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &next);
+	g_free(next);
+
+	return reply;
+}
+
+static const GDBusMethodTable history_methods[] = {
+	{ GDBUS_METHOD("GetProperties",
+			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
+			history_get_properties) },
+	{ GDBUS_METHOD("GetRecord",
+			GDBUS_ARGS({ "id", "s" }),
+			GDBUS_ARGS({ "record", "a{sv}" }),
+			history_get_record) },
+	{ GDBUS_METHOD("GetRecords",
+			GDBUS_ARGS({ "filter", "a{sv}" }, { "cursor", "s" },
+					{ "count", "u" }),
+			GDBUS_ARGS({ "records", "aa{sv}" },
+					{ "next_cursor", "s" }),
+			history_get_records) },
+	{ }
+};
+
+static int history_store_probe(struct ofono_history_context *context)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = ofono_modem_get_path(context->modem);
+	struct history_store *store;
+	char *filename;
+
+	store = g_try_new0(struct history_store, 1);
+	if (store == NULL)
+		return -ENOMEM;
+
+	filename = g_strdup_printf(HISTORY_STORE_PATH, path);
+	store->log = history_log_open(filename, HISTORY_STORE_CAPACITY);
+
+	if (store->log == NULL) {
+		ofono_error("Unable to open history log %s", filename);
+		g_free(filename);
+		g_free(store);
+		return -EIO;
+	}
+
+	g_free(filename);
+
+	store->modem = context->modem;
+
+	if (!g_dbus_register_interface(conn, path, HISTORY_STORE_INTERFACE,
+					history_methods, NULL, NULL,
+					store, NULL)) {
+		ofono_error("Could not create %s interface",
+				HISTORY_STORE_INTERFACE);
+		history_log_close(store->log);
+		g_free(store);
+		return -EIO;
+	}
+
+	ofono_modem_add_interface(context->modem, HISTORY_STORE_INTERFACE);
+
+	context->data = store;
+
+	return 0;
+}
+
+static void history_store_remove(struct ofono_history_context *context)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct history_store *store = context->data;
+
+	ofono_modem_remove_interface(store->modem, HISTORY_STORE_INTERFACE);
+	g_dbus_unregister_interface(conn, ofono_modem_get_path(store->modem),
+					HISTORY_STORE_INTERFACE);
+
+	history_log_close(store->log);
+	g_free(store);
+}
+
+static void history_store_append(struct ofono_history_context *context,
+					struct history_log_record *record)
+{
+	struct history_store *store = context->data;
+
+	if (!history_log_append(store->log, record))
+		ofono_error("Unable to store %s history record",
+				type_to_string(record->type));
+}
+
+static void history_store_call_ended(struct ofono_history_context *context,
+					const struct ofono_call *call,
+					time_t start, time_t end)
+{
+	struct history_log_record record;
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_CALL;
+	record.status = call->direction;
+	record.time = start;
+	record.duration = end > start ? end - start : 0;
+	record.peer = phone_number_to_string(&call->phone_number);
+
+	history_store_append(context, &record);
+}
+
+static void history_store_call_missed(struct ofono_history_context *context,
+					const struct ofono_call *call,
+					time_t when)
+{
+	struct history_log_record record;
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_MISSED_CALL;
+	record.status = call->direction;
+	record.time = when;
+	record.peer = phone_number_to_string(&call->phone_number);
+
+	history_store_append(context, &record);
+}
+
+static void history_store_sms_received(struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					const char *from,
+					const struct tm *remote,
+					const struct tm *local,
+					const char *text)
+{
+	struct history_log_record record;
+	struct tm when = *local;
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_INCOMING_MESSAGE;
+	record.time = mktime(&when);
+	record.uuid = uuid->uuid;
+	record.peer = from;
+	record.text = text;
+
+	history_store_append(context, &record);
+}
+
+static void history_store_sms_send_pending(
+					struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					const char *to, time_t when,
+					const char *text)
+{
+	struct history_log_record record;
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_OUTGOING_MESSAGE;
+	record.status = OFONO_HISTORY_SMS_STATUS_PENDING;
+	record.time = when;
+	record.uuid = uuid->uuid;
+	record.peer = to;
+	record.text = text;
+
+	history_store_append(context, &record);
+}
+
+static void history_store_sms_send_status(
+					struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					time_t when,
+					enum ofono_history_sms_status s)
+{
+	struct history_store *store = context->data;
+
+	history_log_set_status(store->log, uuid->uuid, s);
+}
+
+static struct ofono_history_driver history_store_driver = {
+	.name = "History Store",
+	.probe = history_store_probe,
+	.remove = history_store_remove,
+	.call_ended = history_store_call_ended,
+	.call_missed = history_store_call_missed,
+	.sms_received = history_store_sms_received,
+	.sms_send_pending = history_store_sms_send_pending,
+	.sms_send_status = history_store_sms_send_status,
+};
+
+static int history_store_init(void)
+{
+	DBG("");
+	return ofono_history_driver_register(&history_store_driver);
+}
+
+static void history_store_exit(void)
+{
+	DBG("");
+	ofono_history_driver_unregister(&history_store_driver);
+}
+
+OFONO_PLUGIN_DEFINE(historystore, "Persistent History Store Plugin",
+			VERSION, OFONO_PLUGIN_PRIORITY_DEFAULT,
+			history_store_init, history_store_exit)
@@ -374,6 +374,6 @@ static void mnclength_exit(void)
 	ofono_sim_mnclength_driver_unregister(&mnclength_driver);
 }
 
-OFONO_PLUGIN_DEFINE(mnclength, "MNC length Plugin", VERSION,
-			OFONO_PLUGIN_PRIORITY_DEFAULT,
+OFONO_PLUGIN_DEFINE_FLAGS(mnclength, "MNC length Plugin", VERSION,
+			OFONO_PLUGIN_PRIORITY_DEFAULT, OFONO_PLUGIN_FLAG_LAZY,
 			mnclength_init, mnclength_exit)
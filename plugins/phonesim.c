@@ -87,6 +87,8 @@ struct phonesim_data {
 	unsigned int hfp_watch;
 	int batt_level;
 	struct ofono_sim *sim;
+	unsigned int debug_channel;
+	gboolean debug;
 };
 
 struct gprs_context_data {
@@ -437,6 +439,25 @@ static struct ofono_ctm_driver ctm_driver = {
 	.set_tty		= phonesim_ctm_set,
 };
 
+static void phonesim_debug(const char *str, void *prefix)
+{
+	ofono_info("%s%s", (const char *) prefix, str);
+}
+
+static void phonesim_debug_channel(ofono_bool_t enable, void *user_data)
+{
+	struct phonesim_data *data = user_data;
+	GAtDebugFunc func = enable ? phonesim_debug : NULL;
+
+	data->debug = enable;
+
+	if (data->mux)
+		g_at_mux_set_debug(data->mux, func, "");
+
+	if (data->chat)
+		g_at_chat_set_debug(data->chat, func, "");
+}
+
 static int phonesim_probe(struct ofono_modem *modem)
 {
 	struct phonesim_data *data;
@@ -449,6 +470,10 @@ static int phonesim_probe(struct ofono_modem *modem)
 
 	ofono_modem_set_data(modem, data);
 
+	data->debug_channel = ofono_debug_channel_add(OFONO_DEBUG_CHANNEL_AT,
+						ofono_modem_get_path(modem),
+						phonesim_debug_channel, data);
+
 	return 0;
 }
 
@@ -458,15 +483,12 @@ static void phonesim_remove(struct ofono_modem *modem)
 
 	DBG("%p", modem);
 
+	ofono_debug_channel_remove(data->debug_channel);
+
 	g_free(data);
 	ofono_modem_set_data(modem, NULL);
 }
 
-static void phonesim_debug(const char *str, void *prefix)
-{
-	ofono_info("%s%s", (const char *) prefix, str);
-}
-
 static void simstate_query(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct ofono_modem *modem = user_data;
@@ -617,7 +639,7 @@ static void mux_setup(GAtMux *mux, gpointer user_data)
 
 	data->mux = mux;
 
-	if (getenv("OFONO_AT_DEBUG"))
+	if (data->debug)
 		g_at_mux_set_debug(data->mux, phonesim_debug, "");
 
 	g_at_mux_start(mux);
@@ -632,7 +654,7 @@ static void mux_setup(GAtMux *mux, gpointer user_data)
 	g_at_syntax_unref(syntax);
 	g_io_channel_unref(io);
 
-	if (getenv("OFONO_AT_DEBUG"))
+	if (data->debug)
 		g_at_chat_set_debug(data->chat, phonesim_debug, "");
 
 	if (data->calypso)
@@ -729,7 +751,7 @@ static int phonesim_enable(struct ofono_modem *modem)
 	if (data->chat == NULL)
 		return -ENOMEM;
 
-	if (getenv("OFONO_AT_DEBUG"))
+	if (data->debug)
 		g_at_chat_set_debug(data->chat, phonesim_debug, "");
 
 	g_at_chat_set_disconnect_function(data->chat,
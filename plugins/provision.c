@@ -138,6 +138,6 @@ static void provision_exit(void)
 	ofono_gprs_provision_driver_unregister(&provision_driver);
 }
 
-OFONO_PLUGIN_DEFINE(provision, "Provisioning Plugin", VERSION,
-			OFONO_PLUGIN_PRIORITY_DEFAULT,
+OFONO_PLUGIN_DEFINE_FLAGS(provision, "Provisioning Plugin", VERSION,
+			OFONO_PLUGIN_PRIORITY_DEFAULT, OFONO_PLUGIN_FLAG_LAZY,
 			provision_init, provision_exit)
@@ -90,6 +90,8 @@ struct ril_data {
 	GRilMsgIdToStrFunc unsol_request_to_string;
 	ril_get_driver_type_func get_driver_type;
 	struct cb_data *set_online_cbd;
+	unsigned int trace_channel;
+	unsigned int hex_channel;
 };
 
 /*
@@ -119,6 +121,20 @@ static void ril_debug(const char *str, void *user_data)
 	ofono_info("Device %d: %s", g_ril_get_slot(rd->ril), str);
 }
 
+static void ril_trace_channel(ofono_bool_t enable, void *user_data)
+{
+	struct ril_data *rd = user_data;
+
+	g_ril_set_trace(rd->ril, enable);
+}
+
+static void ril_hex_channel(ofono_bool_t enable, void *user_data)
+{
+	struct ril_data *rd = user_data;
+
+	g_ril_set_debugf(rd->ril, enable ? ril_debug : NULL, rd);
+}
+
 static const char *get_driver_type(struct ril_data *rd,
 					enum ofono_atom_type atom)
 {
@@ -305,6 +321,9 @@ void ril_remove(struct ofono_modem *modem)
 	if (!rd)
 		return;
 
+	ofono_debug_channel_remove(rd->trace_channel);
+	ofono_debug_channel_remove(rd->hex_channel);
+
 	g_ril_unref(rd->ril);
 
 	g_free(rd);
@@ -514,11 +533,15 @@ static int create_gril(struct ofono_modem *modem)
 						rd->request_id_to_string,
 						rd->unsol_request_to_string);
 
-	if (getenv("OFONO_RIL_TRACE"))
-		g_ril_set_trace(rd->ril, TRUE);
+	ofono_debug_channel_remove(rd->trace_channel);
+	rd->trace_channel = ofono_debug_channel_add(OFONO_DEBUG_CHANNEL_RIL,
+						ofono_modem_get_path(modem),
+						ril_trace_channel, rd);
 
-	if (getenv("OFONO_RIL_HEX_TRACE"))
-		g_ril_set_debugf(rd->ril, ril_debug, rd);
+	ofono_debug_channel_remove(rd->hex_channel);
+	rd->hex_channel = ofono_debug_channel_add(OFONO_DEBUG_CHANNEL_RIL_HEX,
+						ofono_modem_get_path(modem),
+						ril_hex_channel, rd);
 
 	g_ril_register(rd->ril, RIL_UNSOL_RIL_CONNECTED,
 			ril_connected, modem);
@@ -144,7 +144,7 @@ static void ubuntu_provision_exit(void)
 	ofono_gprs_provision_driver_unregister(&ubuntu_provision_driver);
 }
 
-OFONO_PLUGIN_DEFINE(ubuntu_provision,
+OFONO_PLUGIN_DEFINE_FLAGS(ubuntu_provision,
 			"Ubuntu APN database Provisioning Plugin", VERSION,
-			OFONO_PLUGIN_PRIORITY_DEFAULT,
+			OFONO_PLUGIN_PRIORITY_DEFAULT, OFONO_PLUGIN_FLAG_LAZY,
 			ubuntu_provision_init, ubuntu_provision_exit)
@@ -37,6 +37,22 @@
 #include <ofono/modem.h>
 #include <ofono/log.h>
 
+/*
+ * Once the setup function finds every interface it knows of, the modem is
+ * created after SETTLE_DELAY of quiet, leaving the rest of the burst of
+ * events for the same device a chance to arrive.  While only optional
+ * interfaces are missing, the modem is created after OPTIONAL_DELAY of
+ * quiet, as not every model has all of them.  Before the required ones are
+ * present the check adapts to the largest gap seen between events for that
+ * device, and the devices gathered so far are only dropped after
+ * DISCARD_DELAY of quiet.
+ */
+#define SETTLE_DELAY		50
+#define OPTIONAL_DELAY		1000
+#define MIN_FALLBACK_DELAY	100
+#define MAX_FALLBACK_DELAY	1000
+#define DISCARD_DELAY		1000
+
 struct modem_info {
 	char *syspath;
 	char *devname;
@@ -46,6 +62,12 @@ struct modem_info {
 	GSList *devices;
 	struct ofono_modem *modem;
 	const char *sysattr;
+	gboolean (*setup)(struct modem_info *modem);
+	gboolean complete;
+	gint64 discovered;
+	gint64 last_event;
+	unsigned int max_gap;
+	guint timeout;
 };
 
 struct device_info {
@@ -57,6 +79,18 @@ struct device_info {
 	char *sysattr;
 };
 
+/*
+ * Called by the setup functions while modem->modem is still NULL, once the
+ * interfaces they require are present.  complete tells whether all the
+ * optional interfaces they know of are present as well.
+ */
+static gboolean setup_probed(struct modem_info *modem, gboolean complete)
+{
+	modem->complete = complete;
+
+	return TRUE;
+}
+
 static gboolean setup_isi(struct modem_info *modem)
 {
 	const char *node = NULL;
@@ -82,6 +116,9 @@ static gboolean setup_isi(struct modem_info *modem)
 	if (node == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("interface=%s address=%d", node, addr);
 
 	ofono_modem_set_string(modem->modem, "Interface", node);
@@ -128,6 +165,9 @@ static gboolean setup_mbm(struct modem_info *modem)
 	if (mdm == NULL || app == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, network != NULL && gps != NULL);
+
 	DBG("modem=%s data=%s network=%s gps=%s", mdm, app, network, gps);
 
 	ofono_modem_set_string(modem->modem, "ModemDevice", mdm);
@@ -165,6 +205,9 @@ static gboolean setup_hso(struct modem_info *modem)
 	if (ctl == NULL || app == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, mdm != NULL && net != NULL);
+
 	DBG("control=%s application=%s modem=%s network=%s",
 						ctl, app, mdm, net);
 
@@ -207,6 +250,9 @@ static gboolean setup_gobi(struct modem_info *modem)
 	if (qmi == NULL || mdm == NULL || net == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, gps != NULL && diag != NULL);
+
 	DBG("qmi=%s net=%s mdm=%s gps=%s diag=%s", qmi, net, mdm, gps, diag);
 
 	ofono_modem_set_string(modem->modem, "Device", qmi);
@@ -245,6 +291,9 @@ static gboolean setup_sierra(struct modem_info *modem)
 	if (mdm == NULL || net == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, app != NULL && diag != NULL);
+
 	DBG("modem=%s app=%s net=%s diag=%s", mdm, app, net, diag);
 
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
@@ -282,6 +331,9 @@ static gboolean setup_option(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, diag != NULL);
+
 	DBG("aux=%s modem=%s diag=%s", aux, mdm, diag);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -341,6 +393,10 @@ static gboolean setup_huawei(struct modem_info *modem)
 	}
 
 	if (qmi != NULL && net != NULL) {
+		if (modem->modem == NULL)
+			return setup_probed(modem, mdm != NULL &&
+						pcui != NULL && diag != NULL);
+
 		ofono_modem_set_driver(modem->modem, "gobi");
 		goto done;
 	}
@@ -348,6 +404,10 @@ static gboolean setup_huawei(struct modem_info *modem)
 	if (mdm == NULL || pcui == NULL)
 		return FALSE;
 
+	/* The QMI and network interfaces may still be on their way */
+	if (modem->modem == NULL)
+		return setup_probed(modem, FALSE);
+
 done:
 	DBG("mdm=%s pcui=%s diag=%s qmi=%s net=%s", mdm, pcui, diag, qmi, net);
 
@@ -387,6 +447,9 @@ static gboolean setup_speedup(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -419,6 +482,9 @@ static gboolean setup_linktop(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -462,6 +528,9 @@ static gboolean setup_icera(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, net != NULL);
+
 	DBG("aux=%s modem=%s net=%s", aux, mdm, net);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -503,6 +572,9 @@ static gboolean setup_alcatel(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -543,6 +615,9 @@ static gboolean setup_novatel(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -583,6 +658,9 @@ static gboolean setup_nokia(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -627,6 +705,9 @@ static gboolean setup_telit(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, gps != NULL && diag != NULL);
+
 	DBG("modem=%s aux=%s gps=%s diag=%s", mdm, aux, gps, diag);
 
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
@@ -662,6 +743,9 @@ static gboolean setup_he910(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, gps != NULL);
+
 	DBG("modem=%s aux=%s gps=%s", mdm, aux, gps);
 
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
@@ -707,6 +791,9 @@ static gboolean setup_simcom(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, gps != NULL && diag != NULL);
+
 	DBG("modem=%s aux=%s gps=%s diag=%s", mdm, aux, gps, diag);
 
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
@@ -758,6 +845,9 @@ static gboolean setup_zte(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, qcdm != NULL);
+
 	DBG("aux=%s modem=%s qcdm=%s", aux, mdm, qcdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -788,6 +878,9 @@ static gboolean setup_samsung(struct modem_info *modem)
 	if (control == NULL && network == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, control != NULL && network != NULL);
+
 	DBG("control=%s network=%s", control, network);
 
 	ofono_modem_set_string(modem->modem, "ControlPort", control);
@@ -828,6 +921,9 @@ static gboolean setup_quectel(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -868,6 +964,9 @@ static gboolean setup_ublox(struct modem_info *modem)
 	if (aux == NULL || mdm == NULL)
 		return FALSE;
 
+	if (modem->modem == NULL)
+		return setup_probed(modem, TRUE);
+
 	DBG("aux=%s modem=%s", aux, mdm);
 
 	ofono_modem_set_string(modem->modem, "Aux", aux);
@@ -876,6 +975,12 @@ static gboolean setup_ublox(struct modem_info *modem)
 	return TRUE;
 }
 
+/*
+ * Setup functions double as readiness checks: called while modem->modem
+ * is still NULL they only report whether the interfaces they require are
+ * present, and through setup_probed whether the optional ones are as well,
+ * without touching anything.
+ */
 static struct {
 	const char *name;
 	gboolean (*setup)(struct modem_info *modem);
@@ -907,16 +1012,17 @@ static struct {
 
 static GHashTable *modem_list;
 
-static const char *get_sysattr(const char *driver)
+static void get_driver(const char *driver, struct modem_info *modem)
 {
 	unsigned int i;
 
 	for (i = 0; driver_list[i].name; i++) {
-		if (g_str_equal(driver_list[i].name, driver) == TRUE)
-			return driver_list[i].sysattr;
+		if (g_str_equal(driver_list[i].name, driver) == TRUE) {
+			modem->sysattr = driver_list[i].sysattr;
+			modem->setup = driver_list[i].setup;
+			return;
+		}
 	}
-
-	return NULL;
 }
 
 static void destroy_modem(gpointer data)
@@ -926,6 +1032,9 @@ static void destroy_modem(gpointer data)
 
 	DBG("%s", modem->syspath);
 
+	if (modem->timeout > 0)
+		g_source_remove(modem->timeout);
+
 	ofono_modem_remove(modem->modem);
 
 	for (list = modem->devices; list; list = list->next) {
@@ -992,48 +1101,60 @@ static gint compare_device(gconstpointer a, gconstpointer b)
 	return g_strcmp0(info1->number, info2->number);
 }
 
-static void add_device(const char *syspath, const char *devname,
-			const char *driver, const char *vendor,
-			const char *model, struct udev_device *device)
+static struct modem_info *add_device(const char *syspath,
+			const char *devname, const char *driver,
+			const char *vendor, const char *model,
+			struct udev_device *device)
 {
 	struct udev_device *intf;
 	const char *devpath, *devnode, *interface, *number, *label, *sysattr;
 	struct modem_info *modem;
 	struct device_info *info;
+	gint64 now;
 
 	devpath = udev_device_get_syspath(device);
 	if (devpath == NULL)
-		return;
+		return NULL;
 
 	devnode = udev_device_get_devnode(device);
 	if (devnode == NULL) {
 		devnode = udev_device_get_property_value(device, "INTERFACE");
 		if (devnode == NULL)
-			return;
+			return NULL;
 	}
 
 	intf = udev_device_get_parent_with_subsystem_devtype(device,
 						"usb", "usb_interface");
 	if (intf == NULL)
-		return;
+		return NULL;
+
+	now = g_get_monotonic_time();
 
 	modem = g_hash_table_lookup(modem_list, syspath);
 	if (modem == NULL) {
 		modem = g_try_new0(struct modem_info, 1);
 		if (modem == NULL)
-			return;
+			return NULL;
 
 		modem->syspath = g_strdup(syspath);
 		modem->devname = g_strdup(devname);
 		modem->driver = g_strdup(driver);
 		modem->vendor = g_strdup(vendor);
 		modem->model = g_strdup(model);
+		modem->discovered = now;
 
-		modem->sysattr = get_sysattr(driver);
+		get_driver(driver, modem);
 
 		g_hash_table_replace(modem_list, modem->syspath, modem);
+	} else {
+		unsigned int gap = (now - modem->last_event) / 1000;
+
+		if (gap > modem->max_gap)
+			modem->max_gap = gap;
 	}
 
+	modem->last_event = now;
+
 	interface = udev_device_get_property_value(intf, "INTERFACE");
 	number = udev_device_get_property_value(device, "ID_USB_INTERFACE_NUM");
 
@@ -1051,7 +1172,7 @@ static void add_device(const char *syspath, const char *devname,
 
 	info = g_try_new0(struct device_info, 1);
 	if (info == NULL)
-		return;
+		return modem;
 
 	info->devpath = g_strdup(devpath);
 	info->devnode = g_strdup(devnode);
@@ -1062,6 +1183,8 @@ static void add_device(const char *syspath, const char *devname,
 
 	modem->devices = g_slist_insert_sorted(modem->devices, info,
 							compare_device);
+
+	return modem;
 }
 
 static struct {
@@ -1123,7 +1246,7 @@ static struct {
 	{ }
 };
 
-static void check_usb_device(struct udev_device *device)
+static struct modem_info *check_usb_device(struct udev_device *device)
 {
 	struct udev_device *usb_device;
 	const char *syspath, *devname, *driver;
@@ -1132,15 +1255,15 @@ static void check_usb_device(struct udev_device *device)
 	usb_device = udev_device_get_parent_with_subsystem_devtype(device,
 							"usb", "usb_device");
 	if (usb_device == NULL)
-		return;
+		return NULL;
 
 	syspath = udev_device_get_syspath(usb_device);
 	if (syspath == NULL)
-		return;
+		return NULL;
 
 	devname = udev_device_get_devnode(usb_device);
 	if (devname == NULL)
-		return;
+		return NULL;
 
 	driver = udev_device_get_property_value(usb_device, "OFONO_DRIVER");
 	if (driver == NULL) {
@@ -1155,11 +1278,11 @@ static void check_usb_device(struct udev_device *device)
 
 				parent = udev_device_get_parent(device);
 				if (parent == NULL)
-					return;
+					return NULL;
 
 				drv = udev_device_get_driver(parent);
 				if (drv == NULL)
-					return;
+					return NULL;
 			}
 		}
 
@@ -1200,13 +1323,13 @@ static void check_usb_device(struct udev_device *device)
 		}
 
 		if (driver == NULL)
-			return;
+			return NULL;
 	}
 
-	add_device(syspath, devname, driver, vendor, model, device);
+	return add_device(syspath, devname, driver, vendor, model, device);
 }
 
-static void check_device(struct udev_device *device)
+static struct modem_info *check_device(struct udev_device *device)
 {
 	const char *bus;
 
@@ -1214,18 +1337,19 @@ static void check_device(struct udev_device *device)
 	if (bus == NULL) {
 		bus = udev_device_get_subsystem(device);
 		if (bus == NULL)
-			return;
+			return NULL;
 	}
 
 	if (g_str_equal(bus, "usb") == TRUE)
-		check_usb_device(device);
+		return check_usb_device(device);
+
+	return NULL;
 }
 
 static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
 {
 	struct modem_info *modem = value;
 	const char *syspath = key;
-	unsigned int i;
 
 	if (modem->modem != NULL)
 		return FALSE;
@@ -1237,21 +1361,23 @@ static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
 
 	DBG("driver=%s", modem->driver);
 
+	if (modem->setup == NULL)
+		return TRUE;
+
 	modem->modem = ofono_modem_create(NULL, modem->driver);
 	if (modem->modem == NULL)
 		return TRUE;
 
-	for (i = 0; driver_list[i].name; i++) {
-		if (g_str_equal(driver_list[i].name, modem->driver) == FALSE)
-			continue;
+	if (modem->setup(modem) == FALSE)
+		return TRUE;
 
-		if (driver_list[i].setup(modem) == TRUE) {
-			ofono_modem_register(modem->modem);
-			return FALSE;
-		}
-	}
+	ofono_modem_register(modem->modem);
 
-	return TRUE;
+	DBG("%s registered %" G_GINT64_FORMAT " ms after discovery",
+			ofono_modem_get_path(modem->modem),
+			(g_get_monotonic_time() - modem->discovered) / 1000);
+
+	return FALSE;
 }
 
 static void enumerate_devices(struct udev *context)
@@ -1293,19 +1419,57 @@ static void enumerate_devices(struct udev *context)
 static struct udev *udev_ctx;
 static struct udev_monitor *udev_mon;
 static guint udev_watch = 0;
-static guint udev_delay = 0;
 
-static gboolean check_modem_list(gpointer user_data)
+static gboolean check_modem(gpointer user_data)
 {
-	udev_delay = 0;
+	struct modem_info *modem = user_data;
+	unsigned int quiet;
 
-	DBG("");
+	modem->timeout = 0;
 
-	g_hash_table_foreach_remove(modem_list, create_modem, NULL);
+	if (modem->modem != NULL)
+		return FALSE;
+
+	quiet = (g_get_monotonic_time() - modem->last_event) / 1000;
+
+	/* Not ready yet, the missing interfaces may still be on their way */
+	if ((modem->setup == NULL || modem->setup(modem) == FALSE) &&
+						quiet < DISCARD_DELAY) {
+		DBG("%s not ready, check again in %u ms", modem->syspath,
+						DISCARD_DELAY - quiet);
+
+		modem->timeout = g_timeout_add(DISCARD_DELAY - quiet,
+							check_modem, modem);
+		return FALSE;
+	}
+
+	if (create_modem(modem->syspath, modem, NULL) == TRUE)
+		g_hash_table_remove(modem_list, modem->syspath);
 
 	return FALSE;
 }
 
+static void schedule_modem(struct modem_info *modem)
+{
+	guint delay;
+
+	if (modem->modem != NULL)
+		return;
+
+	if (modem->setup != NULL && modem->setup(modem) == TRUE)
+		delay = modem->complete ? SETTLE_DELAY : OPTIONAL_DELAY;
+	else
+		delay = CLAMP(modem->max_gap * 2, MIN_FALLBACK_DELAY,
+						MAX_FALLBACK_DELAY);
+
+	DBG("%s check in %u ms", modem->syspath, delay);
+
+	if (modem->timeout > 0)
+		g_source_remove(modem->timeout);
+
+	modem->timeout = g_timeout_add(delay, check_modem, modem);
+}
+
 static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
@@ -1327,12 +1491,10 @@ static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 		return TRUE;
 
 	if (g_str_equal(action, "add") == TRUE) {
-		if (udev_delay > 0)
-			g_source_remove(udev_delay);
-
-		check_device(device);
+		struct modem_info *modem = check_device(device);
 
-		udev_delay = g_timeout_add_seconds(1, check_modem_list, NULL);
+		if (modem != NULL)
+			schedule_modem(modem);
 	} else if (g_str_equal(action, "remove") == TRUE)
 		remove_device(device);
 
@@ -1400,9 +1562,6 @@ static int detect_init(void)
 
 static void detect_exit(void)
 {
-	if (udev_delay > 0)
-		g_source_remove(udev_delay);
-
 	if (udev_watch > 0)
 		g_source_remove(udev_watch);
 
@@ -127,6 +127,8 @@ static const GDBusMethodTable audio_methods[] = {
 static const GDBusSignalTable audio_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
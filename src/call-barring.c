@@ -993,6 +993,8 @@ static const GDBusMethodTable cb_methods[] = {
 static const GDBusSignalTable cb_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -897,6 +897,8 @@ static const GDBusMethodTable cf_methods[] = {
 static const GDBusSignalTable cf_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
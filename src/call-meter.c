@@ -663,6 +663,8 @@ static const GDBusMethodTable cm_methods[] = {
 static const GDBusSignalTable cm_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("NearMaximumWarning", NULL) },
 	{ }
 };
@@ -68,6 +68,7 @@ struct ofono_cbs {
 	GSList *efcbmir_contents;
 	unsigned short efcbmid_length;
 	GSList *efcbmid_contents;
+	struct cbs_topic_bitmap *efcbmid_filter;
 	gboolean efcbmid_update;
 	guint reset_source;
 	int lac;
@@ -191,7 +192,7 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 		return;
 	}
 
-	if (cbs_topic_in_range(c.message_identifier, cbs->efcbmid_contents)) {
+	if (cbs_topic_bitmap_test(cbs->efcbmid_filter, c.message_identifier)) {
 		if (cbs->sim == NULL)
 			return;
 
@@ -553,6 +554,8 @@ static const GDBusMethodTable cbs_methods[] = {
 static const GDBusSignalTable cbs_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("IncomingBroadcast",
 			GDBUS_ARGS({ "message", "s" }, { "channel", "q" })) },
 	{ GDBUS_SIGNAL("EmergencyBroadcast",
@@ -606,6 +609,8 @@ static void cbs_unregister(struct ofono_atom *atom)
 		g_slist_foreach(cbs->efcbmid_contents, (GFunc) g_free, NULL);
 		g_slist_free(cbs->efcbmid_contents);
 		cbs->efcbmid_contents = NULL;
+		g_free(cbs->efcbmid_filter);
+		cbs->efcbmid_filter = NULL;
 	}
 
 	if (cbs->sim_context) {
@@ -882,6 +887,7 @@ static void sim_cbmid_read_cb(int ok, int length, int record,
 		goto done;
 
 	cbs->efcbmid_contents = g_slist_reverse(contents);
+	cbs->efcbmid_filter = cbs_topic_bitmap_new(cbs->efcbmid_contents);
 
 	str = cbs_topic_ranges_to_string(cbs->efcbmid_contents);
 	DBG("Got cbmid: %s", str);
@@ -910,6 +916,8 @@ static void cbs_efcbmid_changed(int id, void *userdata)
 		g_slist_foreach(cbs->efcbmid_contents, (GFunc) g_free, NULL);
 		g_slist_free(cbs->efcbmid_contents);
 		cbs->efcbmid_contents = NULL;
+		g_free(cbs->efcbmid_filter);
+		cbs->efcbmid_filter = NULL;
 	}
 
 	cbs->efcbmid_update = TRUE;
@@ -530,6 +530,8 @@ static const GDBusMethodTable cdma_connman_methods[] = {
 static const GDBusSignalTable cdma_connman_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
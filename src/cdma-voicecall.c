@@ -427,6 +427,8 @@ static const GDBusMethodTable manager_methods[] = {
 static const GDBusSignalTable manager_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("DisconnectReason",
 			GDBUS_ARGS({ "reason", "s" })) },
 	{ }
@@ -32,6 +32,34 @@
 
 static DBusConnection *g_connection;
 
+/*
+ * When batching is enabled, PropertyChanged signals are not sent.  The
+ * changes emitted within one main loop iteration are collected and sent
+ * as a single PropertiesChanged(a{sv}) signal per object path and
+ * interface instead.  A batch is flushed from an idle callback or right
+ * before any other message is sent, so the relative order of property
+ * changes and other messages is preserved.
+ */
+struct property_batch {
+	char *key;
+	char *path;
+	char *interface;
+	GSList *changes;	/* PropertyChanged signals, oldest first */
+};
+
+static gboolean batch_enabled;
+static GQueue *batch_queue;
+static GHashTable *batch_table;
+static guint batch_source;
+static gboolean batch_hold;	/* flushing, don't flush again */
+
+static struct {
+	unsigned int changes;	/* PropertyChanged signals queued */
+	unsigned int superseded;	/* values replaced before sending */
+	unsigned int signals;	/* PropertiesChanged signals sent */
+	unsigned int failed;	/* PropertiesChanged signals not sent */
+} batch_stats;
+
 struct error_mapping_entry {
 	int error;
 	DBusMessage *(*ofono_error_func)(DBusMessage *);
@@ -198,6 +226,230 @@ void ofono_dbus_dict_append_dict(DBusMessageIter *dict, const char *key,
 	dbus_message_iter_close_container(dict, &entry);
 }
 
+static const char *property_changed_name(DBusMessage *signal)
+{
+	DBusMessageIter iter;
+	const char *name;
+
+	dbus_message_iter_init(signal, &iter);
+	dbus_message_iter_get_basic(&iter, &name);
+
+	return name;
+}
+
+static void copy_iter(DBusMessageIter *from, DBusMessageIter *to)
+{
+	int type;
+
+	while ((type = dbus_message_iter_get_arg_type(from)) !=
+							DBUS_TYPE_INVALID) {
+		DBusMessageIter from_sub, to_sub;
+		char *sig = NULL;
+
+		if (dbus_type_is_basic(type)) {
+			union {
+				dbus_uint64_t u64;
+				double dbl;
+				const char *str;
+			} value;
+
+			dbus_message_iter_get_basic(from, &value);
+			dbus_message_iter_append_basic(to, type, &value);
+			dbus_message_iter_next(from);
+			continue;
+		}
+
+		dbus_message_iter_recurse(from, &from_sub);
+
+		if (type == DBUS_TYPE_VARIANT)
+			sig = dbus_message_iter_get_signature(&from_sub);
+		else if (type == DBUS_TYPE_ARRAY)
+			sig = dbus_message_iter_get_signature(from);
+
+		/* Arrays take the element type, i.e. skip the 'a' */
+		dbus_message_iter_open_container(to, type,
+				sig && type == DBUS_TYPE_ARRAY ? sig + 1 : sig,
+				&to_sub);
+		copy_iter(&from_sub, &to_sub);
+		dbus_message_iter_close_container(to, &to_sub);
+
+		dbus_free(sig);
+		dbus_message_iter_next(from);
+	}
+}
+
+static void property_batch_free(gpointer data)
+{
+	struct property_batch *batch = data;
+
+	g_slist_free_full(batch->changes,
+				(GDestroyNotify) dbus_message_unref);
+	g_free(batch->key);
+	g_free(batch->path);
+	g_free(batch->interface);
+	g_free(batch);
+}
+
+static void property_batch_send(DBusConnection *conn,
+				struct property_batch *batch)
+{
+	DBusMessage *signal;
+	DBusMessageIter iter, dict;
+	GSList *l;
+
+	signal = dbus_message_new_signal(batch->path, batch->interface,
+						"PropertiesChanged");
+	if (signal == NULL) {
+		ofono_error("Unable to allocate new %s.PropertiesChanged"
+				" signal", batch->interface);
+		return;
+	}
+
+	dbus_message_iter_init_append(signal, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	for (l = batch->changes; l; l = l->next) {
+		DBusMessageIter changed, entry;
+
+		/* The PropertyChanged arguments form a complete dict entry */
+		dbus_message_iter_init(l->data, &changed);
+
+		dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+							NULL, &entry);
+		copy_iter(&changed, &entry);
+		dbus_message_iter_close_container(&dict, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	if (g_dbus_send_message(conn, signal))
+		batch_stats.signals += 1;
+	else
+		batch_stats.failed += 1;
+}
+
+static void property_batch_flush(DBusConnection *conn, void *user_data)
+{
+	struct property_batch *batch;
+
+	/* g_dbus_send_message flushes again, the batches are in order */
+	if (batch_queue == NULL || batch_hold)
+		return;
+
+	batch_hold = TRUE;
+
+	while ((batch = g_queue_pop_head(batch_queue))) {
+		g_hash_table_remove(batch_table, batch->key);
+		property_batch_send(conn, batch);
+		property_batch_free(batch);
+	}
+
+	batch_hold = FALSE;
+}
+
+static gboolean property_batch_idle(gpointer user_data)
+{
+	batch_source = 0;
+
+	property_batch_flush(g_connection, NULL);
+
+	return FALSE;
+}
+
+static int property_changed_send(DBusConnection *conn, DBusMessage *signal)
+{
+	const char *path = dbus_message_get_path(signal);
+	const char *interface = dbus_message_get_interface(signal);
+	const char *name = property_changed_name(signal);
+	struct property_batch *batch;
+	char *key;
+	GSList *l;
+
+	if (!batch_enabled || conn != g_connection)
+		return g_dbus_send_message(conn, signal);
+
+	/* Only the arguments are used, the signal itself is never sent */
+	key = g_strconcat(path, " ", interface, NULL);
+	batch = g_hash_table_lookup(batch_table, key);
+
+	if (batch == NULL) {
+		batch = g_new0(struct property_batch, 1);
+		batch->key = key;
+		batch->path = g_strdup(path);
+		batch->interface = g_strdup(interface);
+
+		g_hash_table_insert(batch_table, batch->key, batch);
+		g_queue_push_tail(batch_queue, batch);
+	} else
+		g_free(key);
+
+	batch_stats.changes += 1;
+
+	/* Only the latest value of a property is of interest */
+	for (l = batch->changes; l; l = l->next) {
+		if (g_str_equal(property_changed_name(l->data), name) == FALSE)
+			continue;
+
+		dbus_message_unref(l->data);
+		l->data = signal;
+		batch_stats.superseded += 1;
+		goto done;
+	}
+
+	batch->changes = g_slist_append(batch->changes, signal);
+
+done:
+	if (batch_source == 0)
+		batch_source = g_idle_add(property_batch_idle, NULL);
+
+	return TRUE;
+}
+
+void __ofono_dbus_set_property_batching(ofono_bool_t enable)
+{
+	if (batch_enabled == enable)
+		return;
+
+	if (enable == FALSE) {
+		property_batch_flush(g_connection, NULL);
+
+		if (batch_source) {
+			g_source_remove(batch_source);
+			batch_source = 0;
+		}
+
+		g_dbus_set_flush_function(NULL, NULL);
+
+		g_hash_table_destroy(batch_table);
+		batch_table = NULL;
+		g_queue_free(batch_queue);
+		batch_queue = NULL;
+	} else {
+		batch_queue = g_queue_new();
+		batch_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+		g_dbus_set_flush_function(property_batch_flush, NULL);
+	}
+
+	batch_enabled = enable;
+}
+
+ofono_bool_t __ofono_dbus_get_property_batching(unsigned int *changes,
+						unsigned int *superseded,
+						unsigned int *signals,
+						unsigned int *failed)
+{
+	*changes = batch_stats.changes;
+	*superseded = batch_stats.superseded;
+	*signals = batch_stats.signals;
+	*failed = batch_stats.failed;
+
+	return batch_enabled;
+}
+
 int ofono_dbus_signal_property_changed(DBusConnection *conn,
 					const char *path,
 					const char *interface,
@@ -220,7 +472,7 @@ int ofono_dbus_signal_property_changed(DBusConnection *conn,
 
 	append_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
@@ -246,7 +498,7 @@ int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
 
 	append_array_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
@@ -272,7 +524,7 @@ int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
 
 	append_dict_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 DBusMessage *__ofono_error_invalid_args(DBusMessage *msg)
@@ -524,6 +776,8 @@ void __ofono_dbus_cleanup(void)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 
+	__ofono_dbus_set_property_batching(FALSE);
+
 	if (conn == NULL || !dbus_connection_get_is_connected(conn))
 		return;
 
@@ -0,0 +1,499 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+
+struct channel_info {
+	const char *name;
+	const char *env;	/* enables the channel at startup */
+};
+
+static const struct channel_info channel_info[] = {
+	[OFONO_DEBUG_CHANNEL_RIL] = { "ril", "OFONO_RIL_TRACE" },
+	[OFONO_DEBUG_CHANNEL_RIL_HEX] = { "ril-hex", "OFONO_RIL_HEX_TRACE" },
+	[OFONO_DEBUG_CHANNEL_AT] = { "at", "OFONO_AT_DEBUG" },
+	[OFONO_DEBUG_CHANNEL_QMI] = { "qmi", "OFONO_QMI_DEBUG" },
+};
+
+struct debug_channel {
+	unsigned int id;
+	enum ofono_debug_channel type;
+	char *owner;
+	ofono_debug_channel_cb_t cb;
+	void *data;
+	ofono_bool_t enabled;
+};
+
+/* Like the debug descriptor rules, replayed for channels added later */
+struct channel_rule {
+	enum ofono_debug_channel type;
+	char *pattern;
+	GPatternSpec *spec;
+	ofono_bool_t enable;
+};
+
+static GSList *channels;
+static GSList *channel_rules;
+static unsigned int next_channel_id;
+
+static void channel_rule_free(gpointer data)
+{
+	struct channel_rule *rule = data;
+
+	g_pattern_spec_free(rule->spec);
+	g_free(rule->pattern);
+	g_free(rule);
+}
+
+/*
+ * Drops the earlier requests a new one overrides, a request for "*"
+ * overrides every earlier one for the same channel.
+ */
+static void channel_rules_prune(enum ofono_debug_channel type,
+					const char *pattern)
+{
+	gboolean all = g_str_equal(pattern, "*");
+	GSList *l = channel_rules;
+
+	while (l) {
+		struct channel_rule *rule = l->data;
+		GSList *next = l->next;
+
+		if (rule->type == type &&
+				(all || g_str_equal(rule->pattern, pattern))) {
+			channel_rules = g_slist_delete_link(channel_rules, l);
+			channel_rule_free(rule);
+		}
+
+		l = next;
+	}
+}
+
+static void channel_set(struct debug_channel *channel, ofono_bool_t enable)
+{
+	if (channel->enabled == enable)
+		return;
+
+	channel->enabled = enable;
+	channel->cb(enable, channel->data);
+}
+
+static ofono_bool_t channel_rule_matches(struct channel_rule *rule,
+					struct debug_channel *channel)
+{
+	if (rule->type != channel->type)
+		return FALSE;
+
+	return g_pattern_match_string(rule->spec, channel->owner);
+}
+
+unsigned int ofono_debug_channel_add(enum ofono_debug_channel type,
+					const char *owner,
+					ofono_debug_channel_cb_t cb,
+					void *data)
+{
+	struct debug_channel *channel;
+	ofono_bool_t enable;
+	GSList *l;
+
+	if (type >= G_N_ELEMENTS(channel_info) || owner == NULL || cb == NULL)
+		return 0;
+
+	channel = g_new0(struct debug_channel, 1);
+
+	if (++next_channel_id == 0)
+		next_channel_id = 1;
+
+	channel->id = next_channel_id;
+	channel->type = type;
+	channel->owner = g_strdup(owner);
+	channel->cb = cb;
+	channel->data = data;
+
+	enable = getenv(channel_info[type].env) != NULL;
+
+	for (l = channel_rules; l; l = l->next) {
+		struct channel_rule *rule = l->data;
+
+		if (channel_rule_matches(rule, channel))
+			enable = rule->enable;
+	}
+
+	channels = g_slist_prepend(channels, channel);
+	channel_set(channel, enable);
+
+	return channel->id;
+}
+
+void ofono_debug_channel_remove(unsigned int id)
+{
+	GSList *l;
+
+	for (l = channels; l; l = l->next) {
+		struct debug_channel *channel = l->data;
+
+		if (channel->id != id)
+			continue;
+
+		channels = g_slist_delete_link(channels, l);
+		g_free(channel->owner);
+		g_free(channel);
+		return;
+	}
+}
+
+static int channel_lookup(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(channel_info); i++)
+		if (g_str_equal(channel_info[i].name, name))
+			return i;
+
+	return -1;
+}
+
+static DBusMessage *set_debug(DBusMessage *msg, ofono_bool_t enable)
+{
+	const char *pattern;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &pattern,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (__ofono_log_set_flags(pattern, OFONO_DEBUG_FLAG_PRINT,
+					enable) == 0)
+		return __ofono_error_not_found(msg);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *debug_enable_debug(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_debug(msg, TRUE);
+}
+
+static DBusMessage *debug_disable_debug(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_debug(msg, FALSE);
+}
+
+static DBusMessage *set_channel(DBusMessage *msg, ofono_bool_t enable)
+{
+	const char *name;
+	const char *owner;
+	struct channel_rule *rule;
+	int type;
+	GSList *l;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name,
+					DBUS_TYPE_STRING, &owner,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	type = channel_lookup(name);
+	if (type < 0)
+		return __ofono_error_invalid_args(msg);
+
+	channel_rules_prune(type, owner);
+
+	rule = g_new0(struct channel_rule, 1);
+	rule->type = type;
+	rule->pattern = g_strdup(owner);
+	rule->spec = g_pattern_spec_new(owner);
+	rule->enable = enable;
+
+	channel_rules = g_slist_append(channel_rules, rule);
+
+	for (l = channels; l; l = l->next) {
+		struct debug_channel *channel = l->data;
+
+		if (channel_rule_matches(rule, channel))
+			channel_set(channel, enable);
+	}
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *debug_enable_channel(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_channel(msg, TRUE);
+}
+
+static DBusMessage *debug_disable_channel(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_channel(msg, FALSE);
+}
+
+static DBusMessage *debug_get_channels(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GSList *l;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_BOOLEAN_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+
+	for (l = channels; l; l = l->next) {
+		struct debug_channel *channel = l->data;
+		const char *name = channel_info[channel->type].name;
+		dbus_bool_t enabled = channel->enabled;
+		DBusMessageIter entry;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+							&name);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+							&channel->owner);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN,
+							&enabled);
+		dbus_message_iter_close_container(&array, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *set_trace(DBusMessage *msg, ofono_bool_t enable)
+{
+	const char *pattern;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &pattern,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (enable && __ofono_trace_init(0) < 0)
+		return __ofono_error_failed(msg);
+
+	if (__ofono_log_set_flags(pattern, OFONO_DEBUG_FLAG_TRACE,
+					enable) == 0)
+		return __ofono_error_not_found(msg);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *debug_enable_trace(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_trace(msg, TRUE);
+}
+
+static DBusMessage *debug_disable_trace(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_trace(msg, FALSE);
+}
+
+static void append_line(gint64 time, const char *line, void *data)
+{
+	DBusMessageIter *array = data;
+	time_t secs = time / G_USEC_PER_SEC;
+	char stamp[16];
+	char *str;
+	struct tm tm;
+
+	localtime_r(&secs, &tm);
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+
+	str = g_strdup_printf("%s.%06d %s", stamp,
+				(int) (time % G_USEC_PER_SEC), line);
+
+	/* D-Bus refuses invalid UTF-8, traces may contain anything */
+	if (!g_utf8_validate(str, -1, NULL)) {
+		char *valid = g_strescape(str, NULL);
+
+		g_free(str);
+		str = valid;
+	}
+
+	dbus_message_iter_append_basic(array, DBUS_TYPE_STRING, &str);
+	g_free(str);
+}
+
+static DBusMessage *debug_dump_trace(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	int err;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_STRING_AS_STRING, &array);
+
+	err = __ofono_trace_dump(append_line, &array);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	if (err == -EBUSY) {
+		dbus_message_unref(reply);
+		return __ofono_error_busy(msg);
+	}
+
+	return reply;
+}
+
+static DBusMessage *debug_set_trace_drain(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	dbus_bool_t enable;
+	int err;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_BOOLEAN, &enable,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (enable && __ofono_trace_init(0) < 0)
+		return __ofono_error_failed(msg);
+
+	err = __ofono_trace_set_drain(enable);
+
+	if (err == -ENOTSUP)
+		return __ofono_error_not_supported(msg);
+
+	if (err < 0 && err != -ENOENT)
+		return __ofono_error_failed(msg);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *debug_get_batch_statistics(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	unsigned int changes, superseded, signals, failed;
+	dbus_bool_t enabled;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	enabled = __ofono_dbus_get_property_batching(&changes, &superseded,
+							&signals, &failed);
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	ofono_dbus_dict_append(&dict, "Enabled", DBUS_TYPE_BOOLEAN, &enabled);
+	ofono_dbus_dict_append(&dict, "Changes", DBUS_TYPE_UINT32, &changes);
+	ofono_dbus_dict_append(&dict, "Superseded", DBUS_TYPE_UINT32,
+					&superseded);
+	ofono_dbus_dict_append(&dict, "Signals", DBUS_TYPE_UINT32, &signals);
+	ofono_dbus_dict_append(&dict, "Failed", DBUS_TYPE_UINT32, &failed);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static const GDBusMethodTable debug_methods[] = {
+	{ GDBUS_METHOD("EnableDebug", GDBUS_ARGS({ "pattern", "s" }), NULL,
+			debug_enable_debug) },
+	{ GDBUS_METHOD("DisableDebug", GDBUS_ARGS({ "pattern", "s" }), NULL,
+			debug_disable_debug) },
+	{ GDBUS_METHOD("EnableChannel",
+			GDBUS_ARGS({ "channel", "s" }, { "owner", "s" }), NULL,
+			debug_enable_channel) },
+	{ GDBUS_METHOD("DisableChannel",
+			GDBUS_ARGS({ "channel", "s" }, { "owner", "s" }), NULL,
+			debug_disable_channel) },
+	{ GDBUS_METHOD("GetChannels", NULL,
+			GDBUS_ARGS({ "channels", "a(ssb)" }),
+			debug_get_channels) },
+	{ GDBUS_METHOD("EnableTrace", GDBUS_ARGS({ "pattern", "s" }), NULL,
+			debug_enable_trace) },
+	{ GDBUS_METHOD("DisableTrace", GDBUS_ARGS({ "pattern", "s" }), NULL,
+			debug_disable_trace) },
+	{ GDBUS_METHOD("DumpTrace", NULL, GDBUS_ARGS({ "lines", "as" }),
+			debug_dump_trace) },
+	{ GDBUS_METHOD("SetTraceDrain", GDBUS_ARGS({ "enable", "b" }), NULL,
+			debug_set_trace_drain) },
+	{ GDBUS_METHOD("GetBatchStatistics", NULL,
+			GDBUS_ARGS({ "statistics", "a{sv}" }),
+			debug_get_batch_statistics) },
+	{ }
+};
+
+int __ofono_debug_init(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	if (!g_dbus_register_interface(conn, OFONO_MANAGER_PATH,
+					OFONO_DEBUG_INTERFACE,
+					debug_methods, NULL, NULL,
+					NULL, NULL))
+		return -EIO;
+
+	return 0;
+}
+
+void __ofono_debug_cleanup(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	/*
+	 * Records may point at format strings of plugins that are about
+	 * to be unloaded, flush them while they are still around.
+	 */
+	__ofono_trace_set_drain(FALSE);
+
+	g_dbus_unregister_interface(conn, OFONO_MANAGER_PATH,
+					OFONO_DEBUG_INTERFACE);
+
+	g_slist_free_full(channel_rules, channel_rule_free);
+	channel_rules = NULL;
+}
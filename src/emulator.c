@@ -66,6 +66,7 @@ struct ofono_emulator {
 	int l_features;
 	int r_features;
 	GSList *indicators;
+	char *cind_support;	/* Preformatted AT+CIND=? response */
 	guint callsetup_source;
 	int pns_id;
 	struct ofono_handsfree_card *card;
@@ -97,6 +98,49 @@ struct indicator {
 	gboolean mandatory;
 };
 
+/* HFP indicators, in the order reported by AT+CIND */
+static const struct {
+	const char *name;
+	int min;
+	int max;
+	int dflt;
+	gboolean mandatory;
+} hfp_indicators[] = {
+	{ OFONO_EMULATOR_IND_SERVICE,	0, 1, 0, FALSE },
+	{ OFONO_EMULATOR_IND_CALL,	0, 1, 0, TRUE },
+	{ OFONO_EMULATOR_IND_CALLSETUP,	0, 3, 0, TRUE },
+	{ OFONO_EMULATOR_IND_CALLHELD,	0, 2, 0, TRUE },
+	{ OFONO_EMULATOR_IND_SIGNAL,	0, 5, 0, FALSE },
+	{ OFONO_EMULATOR_IND_ROAMING,	0, 1, 0, FALSE },
+	{ OFONO_EMULATOR_IND_BATTERY,	0, 5, 5, FALSE },
+};
+
+#define HFP_INDICATOR_COUNT G_N_ELEMENTS(hfp_indicators)
+
+/*
+ * Indicator state of a modem, shared by all HFP emulators attached to
+ * it.  Each update is validated and encoded once, then fanned out to the
+ * clients.  The version is bumped on every change; a client whose
+ * version matches has seen every change and can be skipped when a value
+ * is merely re-sent.
+ */
+struct indicator_snapshot {
+	struct ofono_modem *modem;
+	unsigned int version;
+	guint32 valid;
+	int value[HFP_INDICATOR_COUNT];
+	char ciev[HFP_INDICATOR_COUNT][16];
+	GSList *clients;
+};
+
+struct snapshot_client {
+	struct ofono_emulator *em;
+	struct ofono_atom *atom;
+	unsigned int version;
+};
+
+static GSList *g_snapshots;
+
 static void emulator_debug(const char *str, void *data)
 {
 	ofono_info("%s: %s\n", (char *)data, str);
@@ -546,6 +590,16 @@ static void cind_cb(GAtServer *server, GAtServerRequestType type,
 		break;
 
 	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
+		/*
+		 * The indicator ranges never change once registered, so the
+		 * response is built on first use and reused afterwards.
+		 */
+		if (em->cind_support) {
+			g_at_server_send_info(server, em->cind_support, TRUE);
+			g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+			break;
+		}
+
 		/*
 		 * '+CIND: ' + terminating null + number of indicators *
 		 * ( indicator name + '("",(000,000))' + separator)
@@ -574,8 +628,8 @@ static void cind_cb(GAtServer *server, GAtServerRequestType type,
 			tmp = tmp + len;
 		}
 
+		em->cind_support = buf;
 		g_at_server_send_info(server, buf, TRUE);
-		g_free(buf);
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
 		break;
 
@@ -1161,6 +1215,9 @@ static void emulator_add_indicator(struct ofono_emulator *em, const char* name,
 	ind->mandatory = mandatory;
 
 	em->indicators = g_slist_append(em->indicators, ind);
+
+	g_free(em->cind_support);
+	em->cind_support = NULL;
 }
 
 static void free_atom_callback(gpointer data)
@@ -1180,6 +1237,104 @@ static void atom_cbs_destroy(gpointer key, gpointer value, gpointer user_data)
 	g_slist_free_full(atom_cbs, free_atom_callback);
 }
 
+static struct indicator_snapshot *snapshot_find(struct ofono_modem *modem)
+{
+	GSList *l;
+
+	for (l = g_snapshots; l; l = l->next) {
+		struct indicator_snapshot *snap = l->data;
+
+		if (snap->modem == modem)
+			return snap;
+	}
+
+	return NULL;
+}
+
+static struct snapshot_client *snapshot_find_client(
+					struct indicator_snapshot *snap,
+					struct ofono_atom *atom)
+{
+	GSList *l;
+
+	for (l = snap->clients; l; l = l->next) {
+		struct snapshot_client *client = l->data;
+
+		if (client->atom == atom)
+			return client;
+	}
+
+	return NULL;
+}
+
+static void snapshot_attach(struct ofono_emulator *em,
+				struct ofono_atom *atom)
+{
+	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
+	struct indicator_snapshot *snap = snapshot_find(modem);
+	struct snapshot_client *client;
+	unsigned int i;
+
+	if (snap == NULL) {
+		snap = g_new0(struct indicator_snapshot, 1);
+		snap->modem = modem;
+		snap->version = 1;
+
+		for (i = 0; i < HFP_INDICATOR_COUNT; i++)
+			snap->value[i] = hfp_indicators[i].dflt;
+
+		g_snapshots = g_slist_prepend(g_snapshots, snap);
+	}
+
+	/* Version 0 is never current, the first update syncs the client */
+	client = g_new0(struct snapshot_client, 1);
+	client->em = em;
+	client->atom = atom;
+
+	snap->clients = g_slist_append(snap->clients, client);
+}
+
+static void snapshot_detach(struct ofono_atom *atom)
+{
+	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
+	struct indicator_snapshot *snap = snapshot_find(modem);
+	struct snapshot_client *client;
+
+	if (snap == NULL)
+		return;
+
+	client = snapshot_find_client(snap, atom);
+	if (client == NULL)
+		return;
+
+	snap->clients = g_slist_remove(snap->clients, client);
+	g_free(client);
+
+	if (snap->clients != NULL)
+		return;
+
+	g_snapshots = g_slist_remove(g_snapshots, snap);
+	g_free(snap);
+}
+
+/*
+ * Called when an indicator of a single atom is set outside of the
+ * snapshot, the next update has to compare every indicator again.
+ */
+static void snapshot_client_dirty(struct ofono_atom *atom)
+{
+	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
+	struct indicator_snapshot *snap = snapshot_find(modem);
+	struct snapshot_client *client;
+
+	if (snap == NULL)
+		return;
+
+	client = snapshot_find_client(snap, atom);
+	if (client)
+		client->version = 0;
+}
+
 static void emulator_unregister(struct ofono_atom *atom)
 {
 	struct ofono_emulator *em = __ofono_atom_get_data(atom);
@@ -1187,6 +1342,8 @@ static void emulator_unregister(struct ofono_atom *atom)
 
 	DBG("%p %p", em, atom);
 
+	snapshot_detach(atom);
+
 	/* Do the clean up when this is the last remaining atom */
 	if (em->atoms != NULL && em->atoms->next != NULL)
 		return;
@@ -1208,6 +1365,9 @@ static void emulator_unregister(struct ofono_atom *atom)
 	g_slist_free(em->indicators);
 	em->indicators = NULL;
 
+	g_free(em->cind_support);
+	em->cind_support = NULL;
+
 	g_at_ppp_unref(em->ppp);
 	em->ppp = NULL;
 
@@ -1231,6 +1391,7 @@ void ofono_emulator_register(struct ofono_emulator *em, int fd)
 {
 	GIOChannel *io;
 	GSList *l;
+	unsigned int i;
 
 	DBG("%p, %d", em, fd);
 
@@ -1254,20 +1415,12 @@ void ofono_emulator_register(struct ofono_emulator *em, int fd)
 	if (em->type == OFONO_EMULATOR_TYPE_HFP) {
 		em->ddr_active = true;
 
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_SERVICE, 0, 1, 0,
-									FALSE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_CALL, 0, 1, 0,
-									TRUE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_CALLSETUP, 0, 3,
-								0, TRUE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_CALLHELD, 0, 2,
-								0, TRUE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_SIGNAL, 0, 5, 0,
-									FALSE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_ROAMING, 0, 1, 0,
-									FALSE);
-		emulator_add_indicator(em, OFONO_EMULATOR_IND_BATTERY, 0, 5, 5,
-									FALSE);
+		for (i = 0; i < HFP_INDICATOR_COUNT; i++)
+			emulator_add_indicator(em, hfp_indicators[i].name,
+						hfp_indicators[i].min,
+						hfp_indicators[i].max,
+						hfp_indicators[i].dflt,
+						hfp_indicators[i].mandatory);
 
 		g_at_server_register(em->server, "+BRSF", brsf_cb, em, NULL);
 		g_at_server_register(em->server, "+CIND", cind_cb, em, NULL);
@@ -1286,6 +1439,9 @@ void ofono_emulator_register(struct ofono_emulator *em, int fd)
 	for (l = em->atoms; l; l = l->next) {
 		struct ofono_atom *atom = l->data;
 
+		if (em->type == OFONO_EMULATOR_TYPE_HFP)
+			snapshot_attach(em, atom);
+
 		__ofono_atom_register(atom, emulator_unregister);
 	}
 
@@ -1718,18 +1874,41 @@ static gboolean valid_indication(struct ofono_emulator *em,
 		return FALSE;
 }
 
-void ofono_emulator_set_indicator(struct ofono_atom *atom,
-						const char *name, int value)
+static void emulator_send_ciev(struct ofono_emulator *em,
+				struct indicator *ind, int i,
+				const char *ciev)
 {
-	int i;
 	char buf[20];
+
+	if (em->events_mode != 3 || !em->events_ind || !em->slc ||
+			!ind->active)
+		return;
+
+	if (g_at_server_command_pending(em->server)) {
+		ind->deferred = TRUE;
+		return;
+	}
+
+	if (ciev == NULL) {
+		sprintf(buf, "+CIEV: %d,%d", i, ind->value);
+		ciev = buf;
+	}
+
+	g_at_server_send_unsolicited(em->server, ciev);
+}
+
+static void emulator_set_indicator(struct ofono_emulator *em,
+					struct ofono_atom *atom,
+					const char *name, int value,
+					const char *ciev)
+{
+	int i;
 	struct indicator *ind;
 	struct indicator *call_ind;
 	struct indicator *cs_ind;
 	gboolean call;
 	gboolean callsetup;
 	gboolean waiting;
-	struct ofono_emulator *em = __ofono_atom_get_data(atom);
 
 	if (!valid_indication(em, atom, name))
 		return;
@@ -1772,13 +1951,7 @@ void ofono_emulator_set_indicator(struct ofono_atom *atom,
 	if (waiting)
 		notify_ccwa(em);
 
-	if (em->events_mode == 3 && em->events_ind && em->slc && ind->active) {
-		if (!g_at_server_command_pending(em->server)) {
-			sprintf(buf, "+CIEV: %d,%d", i, ind->value);
-			g_at_server_send_unsolicited(em->server, buf);
-		} else
-			ind->deferred = TRUE;
-	}
+	emulator_send_ciev(em, ind, i, ciev);
 
 	/*
 	 * Ring timer should be started when:
@@ -1815,13 +1988,13 @@ start_ring:
 							notify_ring, em);
 }
 
-void __ofono_emulator_set_indicator_forced(struct ofono_atom *atom,
-						const char *name, int value)
+static void emulator_set_indicator_forced(struct ofono_emulator *em,
+						struct ofono_atom *atom,
+						const char *name, int value,
+						const char *ciev)
 {
 	int i;
 	struct indicator *ind;
-	char buf[20];
-	struct ofono_emulator *em = __ofono_atom_get_data(atom);
 
 	if (!valid_indication(em, atom, name))
 		return;
@@ -1833,12 +2006,92 @@ void __ofono_emulator_set_indicator_forced(struct ofono_atom *atom,
 
 	ind->value = value;
 
-	if (em->events_mode == 3 && em->events_ind && em->slc && ind->active) {
-		if (!g_at_server_command_pending(em->server)) {
-			sprintf(buf, "+CIEV: %d,%d", i, ind->value);
-			g_at_server_send_unsolicited(em->server, buf);
-		} else
-			ind->deferred = TRUE;
+	emulator_send_ciev(em, ind, i, ciev);
+}
+
+void ofono_emulator_set_indicator(struct ofono_atom *atom,
+						const char *name, int value)
+{
+	struct ofono_emulator *em = __ofono_atom_get_data(atom);
+
+	snapshot_client_dirty(atom);
+	emulator_set_indicator(em, atom, name, value, NULL);
+}
+
+static void snapshot_client_sync(struct indicator_snapshot *snap,
+					struct snapshot_client *client)
+{
+	unsigned int i;
+
+	for (i = 0; i < HFP_INDICATOR_COUNT; i++) {
+		if (!(snap->valid & (1 << i)))
+			continue;
+
+		emulator_set_indicator(client->em, client->atom,
+					hfp_indicators[i].name,
+					snap->value[i], snap->ciev[i]);
+	}
+
+	client->version = snap->version;
+}
+
+void __ofono_emulator_update_indicator(struct ofono_modem *modem,
+					const char *name, int value,
+					ofono_bool_t forced)
+{
+	struct indicator_snapshot *snap = snapshot_find(modem);
+	unsigned int idx;
+	gboolean changed;
+	GSList *l;
+
+	if (snap == NULL)
+		return;
+
+	for (idx = 0; idx < HFP_INDICATOR_COUNT; idx++)
+		if (g_str_equal(hfp_indicators[idx].name, name))
+			break;
+
+	if (idx == HFP_INDICATOR_COUNT)
+		return;
+
+	if (value < hfp_indicators[idx].min ||
+			value > hfp_indicators[idx].max)
+		return;
+
+	changed = forced || !(snap->valid & (1 << idx)) ||
+			snap->value[idx] != value;
+
+	if (changed) {
+		snap->value[idx] = value;
+		snap->valid |= 1 << idx;
+		snprintf(snap->ciev[idx], sizeof(snap->ciev[idx]),
+				"+CIEV: %u,%d", idx + 1, value);
+		snap->version += 1;
+	}
+
+	for (l = snap->clients; l; l = l->next) {
+		struct snapshot_client *client = l->data;
+
+		if (client->version == snap->version)
+			continue;
+
+		/* Missed an earlier update, bring it up to date first */
+		if (client->version != snap->version - 1 || !changed) {
+			snapshot_client_sync(snap, client);
+
+			if (!forced)
+				continue;
+		}
+
+		if (forced)
+			emulator_set_indicator_forced(client->em, client->atom,
+							name, value,
+							snap->ciev[idx]);
+		else
+			emulator_set_indicator(client->em, client->atom,
+						name, value, snap->ciev[idx]);
+
+		client->version = snap->version;
 	}
 }
 
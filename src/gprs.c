@@ -29,10 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
-#include <net/if.h>
-#include <net/route.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <resolv.h>
@@ -92,6 +89,11 @@ struct ofono_gprs {
 	struct ofono_sim *sim;
 	struct ofono_sim_context *sim_context;
 	char *gid1;
+	GQueue *activation_queue;
+	unsigned int activations;
+	unsigned int max_activations;
+	unsigned int deactivations;
+	gboolean deactivate_failed;
 };
 
 struct ipv4_settings {
@@ -127,8 +129,37 @@ struct ofono_gprs_context {
 	struct ofono_atom *atom;
 };
 
+/*
+ * Operation a context is going through, Active only changes once the
+ * operation has completed.  Activations wait in QUEUED until a slot is
+ * free, ACTIVATING covers the driver and CONFIGURING the interface.
+ */
+enum pri_context_op {
+	PRI_CONTEXT_OP_NONE = 0,
+	PRI_CONTEXT_OP_QUEUED,
+	PRI_CONTEXT_OP_ACTIVATING,
+	PRI_CONTEXT_OP_CONFIGURING,
+	PRI_CONTEXT_OP_DEACTIVATING,
+};
+
+struct activation_batch {
+	DBusMessage *msg;
+	GSList *results;
+	unsigned int remaining;
+};
+
+struct activation_result {
+	char *path;
+	gboolean success;
+	guint32 msecs;
+};
+
 struct pri_context {
 	ofono_bool_t active;
+	enum pri_context_op op;
+	gboolean aborted;	/* activation given up, driver call pending */
+	gint64 op_start;
+	struct activation_batch *batch;
 	enum ofono_gprs_context_type type;
 	gboolean preferred;
 	char name[MAX_CONTEXT_NAME_LENGTH + 1];
@@ -144,10 +175,11 @@ struct pri_context {
 	struct ofono_gprs_context *context_driver;
 	struct ofono_gprs *gprs;
 	ofono_dns_client_request_t lookup_req;
+	char *proxy_lookup;
+	unsigned int rtnl_id;
 };
 
 static void gprs_netreg_update(struct ofono_gprs *gprs);
-static void gprs_deactivate_next(struct ofono_gprs *gprs);
 
 static GSList *g_drivers = NULL;
 static GSList *g_context_drivers = NULL;
@@ -568,53 +600,99 @@ static void pri_context_signal_settings(struct pri_context *ctx,
 				context_settings_append_ipv6);
 }
 
-static void set_route(const struct context_settings *settings,
-					const char *ipstr, gboolean create)
+static void activation_batch_reply(struct activation_batch *batch)
 {
-	struct rtentry rt;
-	struct sockaddr_in addr;
-	int sk;
-	const char *debug_str = create ? "create" : "remove";
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GSList *l;
 
-	/* TODO Handle IPv6 case */
+	reply = dbus_message_new_method_return(batch->msg);
+	if (reply == NULL)
+		goto done;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_OBJECT_PATH_AS_STRING
+					DBUS_TYPE_BOOLEAN_AS_STRING
+					DBUS_TYPE_UINT32_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
 
-	DBG("%s for %s", ipstr, debug_str);
+	for (l = batch->results; l; l = l->next) {
+		struct activation_result *result = l->data;
+		dbus_bool_t success = result->success;
+		DBusMessageIter entry;
 
-	if (settings->interface == NULL)
-		return;
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_OBJECT_PATH,
+							&result->path);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN,
+							&success);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32,
+							&result->msecs);
+		dbus_message_iter_close_container(&array, &entry);
+	}
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
+	dbus_message_iter_close_container(&iter, &array);
 
-	memset(&rt, 0, sizeof(rt));
-	rt.rt_dev = (char *) settings->interface;
-	rt.rt_flags = RTF_HOST;
+done:
+	__ofono_dbus_pending_reply(&batch->msg, reply);
+}
 
-	if (create)
-		rt.rt_flags |= RTF_UP;
+static void activation_result_free(gpointer data)
+{
+	struct activation_result *result = data;
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr(ipstr);
-	if (addr.sin_addr.s_addr == INADDR_NONE) {
-		ofono_error("Cannot %s route for invalid IP %s",
-							debug_str, ipstr);
-		return;
+	g_free(result->path);
+	g_free(result);
+}
+
+static void activation_batch_add(struct activation_batch *batch,
+					const char *path, gboolean success,
+					guint32 msecs)
+{
+	struct activation_result *result;
+
+	if (path != NULL) {
+		result = g_new0(struct activation_result, 1);
+		result->path = g_strdup(path);
+		result->success = success;
+		result->msecs = msecs;
+
+		batch->results = g_slist_append(batch->results, result);
 	}
-	memcpy(&rt.rt_dst, &addr, sizeof(rt.rt_dst));
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	memcpy(&rt.rt_gateway, &addr, sizeof(rt.rt_gateway));
-	memcpy(&rt.rt_genmask, &addr, sizeof(rt.rt_genmask));
+	if (--batch->remaining > 0)
+		return;
 
-	if (ioctl(sk, create ? SIOCADDRT : SIOCDELRT, &rt) < 0)
-		ofono_error("Failed to %s proxy host route: %s (%d)",
-					debug_str, strerror(errno), errno);
+	activation_batch_reply(batch);
 
-	close(sk);
+	g_slist_free_full(batch->results, activation_result_free);
+	g_free(batch);
+}
+
+/* Answers whoever asked for the activation of ctx */
+static void pri_activate_done(struct pri_context *ctx, gboolean success)
+{
+	guint32 msecs = (g_get_monotonic_time() - ctx->op_start) / 1000;
+	struct activation_batch *batch = ctx->batch;
+
+	DBG("%s %s after %u ms", ctx->path,
+			success ? "activated" : "not activated", msecs);
+
+	ctx->op = PRI_CONTEXT_OP_NONE;
+	ctx->batch = NULL;
+
+	if (ctx->pending)
+		__ofono_dbus_pending_reply(&ctx->pending, success ?
+				dbus_message_new_method_return(ctx->pending) :
+				__ofono_error_failed(ctx->pending));
+
+	if (batch)
+		activation_batch_add(batch, ctx->path, success, msecs);
 }
 
 static void pri_activate_finish(struct pri_context *ctx)
@@ -630,14 +708,10 @@ static void pri_activate_finish(struct pri_context *ctx)
 	if (ctx->proxy_host) {
 		settings->ipv4->proxy = g_strdup(ctx->proxy_host);
 		settings->ipv4->proxy_port = ctx->proxy_port;
-
-		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-			set_route(settings, ctx->proxy_host, TRUE);
 	}
 
 	ctx->active = TRUE;
-	__ofono_dbus_pending_reply(&ctx->pending,
-				dbus_message_new_method_return(ctx->pending));
+	pri_activate_done(ctx, TRUE);
 
 	if (gc->settings->interface != NULL)
 		pri_context_signal_settings(ctx, settings->ipv4 != NULL,
@@ -649,6 +723,8 @@ static void pri_activate_finish(struct pri_context *ctx)
 					"Active", DBUS_TYPE_BOOLEAN, &value);
 }
 
+static void pri_interface_configured(int error, void *data);
+
 static void lookup_address_cb(void *data, ofono_dns_client_status_t status,
 						struct sockaddr *ip_addr)
 {
@@ -679,6 +755,20 @@ static void lookup_address_cb(void *data, ofono_dns_client_status_t status,
 
 	ctx->lookup_req = NULL;
 
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS && ctx->proxy_host) {
+		struct context_settings *settings =
+					ctx->context_driver->settings;
+		struct rtnl_request *req;
+
+		req = __ofono_rtnl_request_new(settings->interface);
+		__ofono_rtnl_host_route(req, TRUE, ctx->proxy_host);
+
+		ctx->rtnl_id = __ofono_rtnl_submit(req,
+					pri_interface_configured, ctx);
+		if (ctx->rtnl_id > 0)
+			return;
+	}
+
 	pri_activate_finish(ctx);
 }
 
@@ -713,7 +803,8 @@ static void get_proxy_ip(struct pri_context *ctx, const char *host)
 		return;
 	}
 
-	lookup_address(ctx, host);
+	/* Looked up once the interface is up */
+	ctx->proxy_lookup = g_strdup(host);
 }
 
 static void pri_parse_proxy(struct pri_context *ctx)
@@ -772,89 +863,104 @@ static void pri_parse_proxy(struct pri_context *ctx)
 	g_free(scheme);
 }
 
-static void pri_ifupdown(const char *interface, ofono_bool_t active)
+static void pri_interface_configured(int error, void *data)
 {
-	struct ifreq ifr;
-	int sk;
-
-	if (interface == NULL)
-		return;
+	struct pri_context *ctx = data;
+	char *host = ctx->proxy_lookup;
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
+	ctx->rtnl_id = 0;
 
-	memset(&ifr, 0, sizeof(ifr));
-	strncpy(ifr.ifr_name, interface, IFNAMSIZ);
+	if (error < 0)
+		ofono_error("Failed to configure context interface: %s (%d)",
+						strerror(-error), -error);
 
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
+	if (host != NULL) {
+		ctx->proxy_lookup = NULL;
+		lookup_address(ctx, host);
+		g_free(host);
 
-	if (active == TRUE) {
-		if (ifr.ifr_flags & IFF_UP)
-			goto done;
-		ifr.ifr_flags |= IFF_UP;
-	} else {
-		if (!(ifr.ifr_flags & IFF_UP))
-			goto done;
-		ifr.ifr_flags &= ~IFF_UP;
+		/* Not answer yet if waiting for DNS lookup */
+		if (ctx->lookup_req != NULL)
+			return;
 	}
 
-	if (ioctl(sk, SIOCSIFFLAGS, &ifr) < 0)
-		ofono_error("Failed to change interface flags");
-
-done:
-	close(sk);
+	pri_activate_finish(ctx);
 }
 
-static void pri_set_ipv4_addr(const char *interface, const char *address)
+/*
+ * Brings the interface up and, for MMS contexts, assigns the addresses
+ * and the proxy host route, all in a single rtnetlink request.
+ */
+static void pri_configure_interface(struct pri_context *ctx)
 {
-	struct ifreq ifr;
-	struct sockaddr_in addr;
-	int sk;
+	struct context_settings *settings = ctx->context_driver->settings;
+	gboolean mms = ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS;
+	struct rtnl_request *req;
 
-	if (interface == NULL)
-		return;
+	req = __ofono_rtnl_request_new(settings->interface);
+	__ofono_rtnl_set_link(req, TRUE);
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
+	if (mms && settings->ipv4)
+		__ofono_rtnl_address(req, TRUE, settings->ipv4->ip, 32);
 
-	memset(&ifr, 0, sizeof(ifr));
-	strncpy(ifr.ifr_name, interface, IFNAMSIZ);
+	if (mms && settings->ipv6)
+		__ofono_rtnl_address(req, TRUE, settings->ipv6->ip,
+					settings->ipv6->prefix_len);
 
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = address ? inet_addr(address) : INADDR_ANY;
-	memcpy(&ifr.ifr_addr, &addr, sizeof(ifr.ifr_addr));
+	if (settings->ipv4) {
+		pri_parse_proxy(ctx);
 
-	if (ioctl(sk, SIOCSIFADDR, &ifr) < 0) {
-		ofono_error("Failed to set interface address");
-		goto done;
+		if (mms && ctx->proxy_host)
+			__ofono_rtnl_host_route(req, TRUE, ctx->proxy_host);
 	}
 
-	if (address == NULL)
-		goto done;
+	ctx->rtnl_id = __ofono_rtnl_submit(req, pri_interface_configured, ctx);
+	if (ctx->rtnl_id == 0)
+		pri_interface_configured(-EIO, ctx);
+}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr("255.255.255.255");
-	memcpy(&ifr.ifr_netmask, &addr, sizeof(ifr.ifr_netmask));
+static void pri_deconfigure_interface(struct pri_context *ctx,
+					struct context_settings *settings)
+{
+	gboolean mms = ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS;
+	struct rtnl_request *req;
 
-	if (ioctl(sk, SIOCSIFNETMASK, &ifr) < 0)
-		ofono_error("Failed to set interface netmask");
+	req = __ofono_rtnl_request_new(settings->interface);
 
-done:
-	close(sk);
+	if (mms && ctx->proxy_host)
+		__ofono_rtnl_host_route(req, FALSE, ctx->proxy_host);
+
+	if (mms && settings->ipv4)
+		__ofono_rtnl_address(req, FALSE, settings->ipv4->ip, 32);
+
+	if (mms && settings->ipv6)
+		__ofono_rtnl_address(req, FALSE, settings->ipv6->ip,
+					settings->ipv6->prefix_len);
+
+	__ofono_rtnl_set_link(req, FALSE);
+	__ofono_rtnl_submit(req, NULL, NULL);
+}
+
+/* Stops an activation that is still configuring the interface */
+static void pri_cancel_configure(struct pri_context *ctx)
+{
+	if (ctx->rtnl_id > 0) {
+		__ofono_rtnl_cancel(ctx->rtnl_id);
+		ctx->rtnl_id = 0;
+	}
+
+	if (ctx->lookup_req != NULL) {
+		__ofono_dns_client_cancel_request(ctx->lookup_req);
+		ctx->lookup_req = NULL;
+	}
+
+	g_free(ctx->proxy_lookup);
+	ctx->proxy_lookup = NULL;
 }
 
 static void pri_reset_context_settings(struct pri_context *ctx)
 {
 	struct context_settings *settings;
-	char *interface;
 	gboolean signal_ipv4;
 	gboolean signal_ipv6;
 
@@ -863,8 +969,8 @@ static void pri_reset_context_settings(struct pri_context *ctx)
 
 	settings = ctx->context_driver->settings;
 
-	interface = settings->interface;
-	settings->interface = NULL;
+	pri_cancel_configure(ctx);
+	pri_deconfigure_interface(ctx, settings);
 
 	signal_ipv4 = settings->ipv4 != NULL;
 	signal_ipv6 = settings->ipv6 != NULL;
@@ -873,18 +979,11 @@ static void pri_reset_context_settings(struct pri_context *ctx)
 
 	pri_context_signal_settings(ctx, signal_ipv4, signal_ipv6);
 
-	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-		pri_set_ipv4_addr(interface, NULL);
-
 	if (ctx->proxy_host != NULL) {
 		g_free(ctx->proxy_host);
 		ctx->proxy_host = NULL;
 		ctx->proxy_port = 0;
 	}
-
-	pri_ifupdown(interface, FALSE);
-
-	g_free(interface);
 }
 
 static void append_context_properties(struct pri_context *ctx,
@@ -969,6 +1068,19 @@ static DBusMessage *pri_get_properties(DBusConnection *conn,
 	return reply;
 }
 
+static void gprs_schedule_activations(struct ofono_gprs *gprs);
+
+static void pri_abort_deactivate_callback(const struct ofono_error *error,
+						void *data)
+{
+	struct pri_context *ctx = data;
+
+	DBG("%p", ctx);
+
+	release_context(ctx);
+	ctx->op = PRI_CONTEXT_OP_NONE;
+}
+
 static void pri_activate_callback(const struct ofono_error *error, void *data)
 {
 	struct pri_context *ctx = data;
@@ -976,33 +1088,136 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 
 	DBG("%p", ctx);
 
+	/* Dropped together with its context driver */
+	if (ctx->op != PRI_CONTEXT_OP_ACTIVATING)
+		return;
+
+	/* The modem is done with it, let the next one go */
+	ctx->gprs->activations -= 1;
+	gprs_schedule_activations(ctx->gprs);
+
+	if (ctx->aborted) {
+		ctx->aborted = FALSE;
+		context_settings_free(gc->settings);
+
+		if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+			release_context(ctx);
+			ctx->op = PRI_CONTEXT_OP_NONE;
+			return;
+		}
+
+		/* Too late, the context is up in the modem, take it down */
+		ctx->op = PRI_CONTEXT_OP_DEACTIVATING;
+		gc->driver->deactivate_primary(gc, ctx->context.cid,
+					pri_abort_deactivate_callback, ctx);
+		return;
+	}
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Activating context failed with error: %s",
 				telephony_error_to_str(error));
-		__ofono_dbus_pending_reply(&ctx->pending,
-					__ofono_error_failed(ctx->pending));
 		context_settings_free(ctx->context_driver->settings);
 		release_context(ctx);
+		pri_activate_done(ctx, FALSE);
 		return;
 	}
 
 	if (gc->settings->interface != NULL) {
-		pri_ifupdown(gc->settings->interface, TRUE);
+		/* Answered once the interface is configured */
+		ctx->op = PRI_CONTEXT_OP_CONFIGURING;
+		pri_configure_interface(ctx);
+		return;
+	}
+
+	pri_activate_finish(ctx);
+}
+
+static void pri_activate_start(struct pri_context *ctx)
+{
+	struct ofono_gprs_context *gc = ctx->context_driver;
 
-		if (gc->settings->ipv4) {
-			if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-				pri_set_ipv4_addr(gc->settings->interface,
-							gc->settings->ipv4->ip);
+	DBG("%s waited %u ms", ctx->path, (guint32)
+			((g_get_monotonic_time() - ctx->op_start) / 1000));
 
-			pri_parse_proxy(ctx);
+	ctx->op = PRI_CONTEXT_OP_ACTIVATING;
+	ctx->gprs->activations += 1;
 
-			/* Not answer yet if waiting for DNS lookup */
-			if (ctx->lookup_req != NULL)
-				return;
-		}
+	gc->driver->activate_primary(gc, &ctx->context,
+					pri_activate_callback, ctx);
+}
+
+/*
+ * Independent contexts are activated concurrently, up to the limit the
+ * driver advertised.  A limit of 0 only leaves the number of context
+ * drivers as a bound.
+ */
+static void gprs_schedule_activations(struct ofono_gprs *gprs)
+{
+	struct pri_context *ctx;
+
+	while (gprs->max_activations == 0 ||
+			gprs->activations < gprs->max_activations) {
+		ctx = g_queue_pop_head(gprs->activation_queue);
+		if (ctx == NULL)
+			return;
+
+		pri_activate_start(ctx);
 	}
+}
 
-	pri_activate_finish(ctx);
+/* Expects assign_context() to have succeeded */
+static void pri_activate(struct pri_context *ctx)
+{
+	ctx->op = PRI_CONTEXT_OP_QUEUED;
+	ctx->op_start = g_get_monotonic_time();
+
+	g_queue_push_tail(ctx->gprs->activation_queue, ctx);
+	gprs_schedule_activations(ctx->gprs);
+}
+
+/*
+ * Gives up on an activation that has not completed yet.  When the driver
+ * is already working on it, the context stays busy until
+ * pri_activate_callback cleans up, unless pri_drop_activation is used
+ * because no callback is going to come.
+ */
+static void pri_abort_activation(struct pri_context *ctx)
+{
+	switch (ctx->op) {
+	case PRI_CONTEXT_OP_QUEUED:
+		g_queue_remove(ctx->gprs->activation_queue, ctx);
+		context_settings_free(ctx->context_driver->settings);
+		break;
+	case PRI_CONTEXT_OP_ACTIVATING:
+		if (ctx->aborted)
+			return;
+
+		ctx->aborted = TRUE;
+		pri_activate_done(ctx, FALSE);
+		ctx->op = PRI_CONTEXT_OP_ACTIVATING;
+		return;
+	case PRI_CONTEXT_OP_CONFIGURING:
+		pri_reset_context_settings(ctx);
+		break;
+	default:
+		return;
+	}
+
+	release_context(ctx);
+	pri_activate_done(ctx, FALSE);
+}
+
+/* Finishes an aborted activation whose driver will not call back */
+static void pri_drop_activation(struct pri_context *ctx)
+{
+	if (!ctx->aborted)
+		return;
+
+	ctx->aborted = FALSE;
+	ctx->gprs->activations -= 1;
+	context_settings_free(ctx->context_driver->settings);
+	release_context(ctx);
+	ctx->op = PRI_CONTEXT_OP_NONE;
 }
 
 static void pri_deactivate_callback(const struct ofono_error *error, void *data)
@@ -1011,6 +1226,8 @@ static void pri_deactivate_callback(const struct ofono_error *error, void *data)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	dbus_bool_t value;
 
+	ctx->op = PRI_CONTEXT_OP_NONE;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Deactivating context failed with error: %s",
 				telephony_error_to_str(error));
@@ -1359,7 +1576,7 @@ static DBusMessage *pri_set_property(DBusConnection *conn,
 		if (ctx->gprs->pending)
 			return __ofono_error_busy(msg);
 
-		if (ctx->pending)
+		if (ctx->op != PRI_CONTEXT_OP_NONE)
 			return __ofono_error_busy(msg);
 
 		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_BOOLEAN)
@@ -1383,11 +1600,13 @@ static DBusMessage *pri_set_property(DBusConnection *conn,
 
 		ctx->pending = dbus_message_ref(msg);
 
-		if (value)
-			gc->driver->activate_primary(gc, &ctx->context,
-						pri_activate_callback, ctx);
-		else
-			gc->driver->deactivate_primary(gc, ctx->context.cid,
+		if (value) {
+			pri_activate(ctx);
+			return NULL;
+		}
+
+		ctx->op = PRI_CONTEXT_OP_DEACTIVATING;
+		gc->driver->deactivate_primary(gc, ctx->context.cid,
 						pri_deactivate_callback, ctx);
 
 		return NULL;
@@ -1495,6 +1714,8 @@ static const GDBusMethodTable context_methods[] = {
 static const GDBusSignalTable context_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -1563,15 +1784,12 @@ static gboolean context_dbus_unregister(struct pri_context *ctx)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	char path[256];
 
-	if (ctx->active == TRUE) {
-		const char *interface =
-			ctx->context_driver->settings->interface;
-
-		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-			pri_set_ipv4_addr(interface, NULL);
+	/* The context is about to be freed, finish any abort right away */
+	pri_abort_activation(ctx);
+	pri_drop_activation(ctx);
 
-		pri_ifupdown(interface, FALSE);
-	}
+	if (ctx->active == TRUE)
+		pri_deconfigure_interface(ctx, ctx->context_driver->settings);
 
 	strcpy(path, ctx->path);
 	idmap_put(ctx->gprs->pid_map, ctx->id);
@@ -1669,7 +1887,7 @@ static void release_active_contexts(struct ofono_gprs *gprs)
 			continue;
 
 		/* This context is already being messed with */
-		if (ctx->pending)
+		if (ctx->op != PRI_CONTEXT_OP_NONE)
 			continue;
 
 		gc = ctx->context_driver;
@@ -2162,6 +2380,8 @@ static void gprs_deactivate_for_remove(const struct ofono_error *error,
 	const char *atompath;
 	dbus_bool_t value;
 
+	ctx->op = PRI_CONTEXT_OP_NONE;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Removing context failed with error: %s",
 				telephony_error_to_str(error));
@@ -2222,13 +2442,14 @@ static DBusMessage *gprs_remove_context(DBusConnection *conn,
 	if (ctx == NULL)
 		return __ofono_error_not_found(msg);
 
+	/* This context is already being messed with */
+	if (ctx->op != PRI_CONTEXT_OP_NONE)
+		return __ofono_error_busy(msg);
+
 	if (ctx->active) {
 		struct ofono_gprs_context *gc = ctx->context_driver;
 
-		/* This context is already being messed with */
-		if (ctx->pending)
-			return __ofono_error_busy(msg);
-
+		ctx->op = PRI_CONTEXT_OP_DEACTIVATING;
 		gprs->pending = dbus_message_ref(msg);
 		gc->driver->deactivate_primary(gc, ctx->context.cid,
 					gprs_deactivate_for_remove, ctx);
@@ -2254,6 +2475,19 @@ static DBusMessage *gprs_remove_context(DBusConnection *conn,
 	return NULL;
 }
 
+static void gprs_deactivate_all_done(struct ofono_gprs *gprs)
+{
+	if (--gprs->deactivations > 0)
+		return;
+
+	if (gprs->deactivate_failed)
+		__ofono_dbus_pending_reply(&gprs->pending,
+					__ofono_error_failed(gprs->pending));
+	else
+		__ofono_dbus_pending_reply(&gprs->pending,
+				dbus_message_new_method_return(gprs->pending));
+}
+
 static void gprs_deactivate_for_all(const struct ofono_error *error,
 					void *data)
 {
@@ -2262,9 +2496,11 @@ static void gprs_deactivate_for_all(const struct ofono_error *error,
 	DBusConnection *conn;
 	dbus_bool_t value;
 
+	ctx->op = PRI_CONTEXT_OP_NONE;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		__ofono_dbus_pending_reply(&gprs->pending,
-					__ofono_error_failed(gprs->pending));
+		gprs->deactivate_failed = TRUE;
+		gprs_deactivate_all_done(gprs);
 		return;
 	}
 
@@ -2277,55 +2513,146 @@ static void gprs_deactivate_for_all(const struct ofono_error *error,
 					OFONO_CONNECTION_CONTEXT_INTERFACE,
 					"Active", DBUS_TYPE_BOOLEAN, &value);
 
-	gprs_deactivate_next(gprs);
+	gprs_deactivate_all_done(gprs);
 }
 
-static void gprs_deactivate_next(struct ofono_gprs *gprs)
+static DBusMessage *gprs_deactivate_all(DBusConnection *conn,
+					DBusMessage *msg, void *data)
 {
+	struct ofono_gprs *gprs = data;
 	GSList *l;
 	struct pri_context *ctx;
-	struct ofono_gprs_context *gc;
+
+	if (gprs->pending)
+		return __ofono_error_busy(msg);
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INVALID))
+		return __ofono_error_invalid_args(msg);
 
 	for (l = gprs->contexts; l; l = l->next) {
 		ctx = l->data;
 
+		/* Queued activations are simply dropped below */
+		if (ctx->op != PRI_CONTEXT_OP_NONE &&
+				ctx->op != PRI_CONTEXT_OP_QUEUED)
+			return __ofono_error_busy(msg);
+	}
+
+	gprs->pending = dbus_message_ref(msg);
+	gprs->deactivate_failed = FALSE;
+
+	/* Held until all deactivations have been issued */
+	gprs->deactivations = 1;
+
+	for (l = gprs->contexts; l; l = l->next) {
+		struct ofono_gprs_context *gc;
+
+		ctx = l->data;
+
+		if (ctx->op == PRI_CONTEXT_OP_QUEUED) {
+			pri_abort_activation(ctx);
+			continue;
+		}
+
 		if (ctx->active == FALSE)
 			continue;
 
 		gc = ctx->context_driver;
+		ctx->op = PRI_CONTEXT_OP_DEACTIVATING;
+		gprs->deactivations += 1;
+
 		gc->driver->deactivate_primary(gc, ctx->context.cid,
 					gprs_deactivate_for_all, ctx);
-
-		return;
 	}
 
-	__ofono_dbus_pending_reply(&gprs->pending,
-				dbus_message_new_method_return(gprs->pending));
+	gprs_deactivate_all_done(gprs);
+
+	return NULL;
 }
 
-static DBusMessage *gprs_deactivate_all(DBusConnection *conn,
+static DBusMessage *gprs_activate_contexts(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
 	struct ofono_gprs *gprs = data;
+	struct activation_batch *batch;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GSList *contexts = NULL;
 	GSList *l;
-	struct pri_context *ctx;
 
 	if (gprs->pending)
 		return __ofono_error_busy(msg);
 
-	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INVALID))
+	if (!dbus_message_iter_init(msg, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) !=
+							DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(&iter) !=
+							DBUS_TYPE_OBJECT_PATH)
 		return __ofono_error_invalid_args(msg);
 
-	for (l = gprs->contexts; l; l = l->next) {
-		ctx = l->data;
+	if (!gprs->attached)
+		return __ofono_error_not_attached(msg);
+
+	if (gprs->flags & GPRS_FLAG_ATTACHING)
+		return __ofono_error_attach_in_progress(msg);
+
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		struct pri_context *ctx;
+		const char *path;
 
-		if (ctx->pending)
+		dbus_message_iter_get_basic(&array, &path);
+		dbus_message_iter_next(&array);
+
+		ctx = gprs_context_by_path(gprs, path);
+		if (ctx == NULL) {
+			g_slist_free(contexts);
+			return __ofono_error_not_found(msg);
+		}
+
+		if (g_slist_find(contexts, ctx)) {
+			g_slist_free(contexts);
+			return __ofono_error_invalid_args(msg);
+		}
+
+		if (ctx->op != PRI_CONTEXT_OP_NONE) {
+			g_slist_free(contexts);
 			return __ofono_error_busy(msg);
+		}
+
+		contexts = g_slist_append(contexts, ctx);
 	}
 
-	gprs->pending = dbus_message_ref(msg);
+	batch = g_new0(struct activation_batch, 1);
+	batch->msg = dbus_message_ref(msg);
 
-	gprs_deactivate_next(gprs);
+	/* Held until all activations have been queued */
+	batch->remaining = 1;
+
+	for (l = contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
+
+		batch->remaining += 1;
+
+		if (ctx->active) {
+			activation_batch_add(batch, ctx->path, TRUE, 0);
+			continue;
+		}
+
+		if (assign_context(ctx) == FALSE) {
+			activation_batch_add(batch, ctx->path, FALSE, 0);
+			continue;
+		}
+
+		ctx->batch = batch;
+		pri_activate(ctx);
+	}
+
+	g_slist_free(contexts);
+
+	activation_batch_add(batch, NULL, FALSE, 0);
 
 	return NULL;
 }
@@ -2529,7 +2856,7 @@ static DBusMessage *gprs_reset_contexts(DBusConnection *conn,
 	for (l = gprs->contexts; l; l = l->next) {
 		struct pri_context *ctx = l->data;
 
-		if (ctx->pending)
+		if (ctx->op != PRI_CONTEXT_OP_NONE)
 			return __ofono_error_busy(msg);
 	}
 
@@ -2590,6 +2917,10 @@ static const GDBusMethodTable manager_methods[] = {
 			gprs_remove_context) },
 	{ GDBUS_ASYNC_METHOD("DeactivateAll", NULL, NULL,
 			gprs_deactivate_all) },
+	{ GDBUS_ASYNC_METHOD("ActivateContexts",
+			GDBUS_ARGS({ "contexts", "ao" }),
+			GDBUS_ARGS({ "results", "a(obu)" }),
+			gprs_activate_contexts) },
 	{ GDBUS_METHOD("GetContexts", NULL,
 			GDBUS_ARGS({ "contexts_with_properties", "a(oa{sv})" }),
 			gprs_get_contexts) },
@@ -2601,6 +2932,8 @@ static const GDBusMethodTable manager_methods[] = {
 static const GDBusSignalTable manager_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("ContextAdded",
 			GDBUS_ARGS({ "path", "o" }, { "properties", "v" })) },
 	{ GDBUS_SIGNAL("ContextRemoved", GDBUS_ARGS({ "path", "o" })) },
@@ -2666,6 +2999,12 @@ detach:
 	gprs->driver->set_attached(gprs, FALSE, gprs_attach_callback, gprs);
 }
 
+void ofono_gprs_set_max_pending_activations(struct ofono_gprs *gprs,
+						unsigned int count)
+{
+	gprs->max_activations = count;
+}
+
 void ofono_gprs_set_cid_range(struct ofono_gprs *gprs,
 				unsigned int min, unsigned int max)
 {
@@ -2697,12 +3036,25 @@ static void gprs_context_unregister(struct ofono_atom *atom)
 		if (ctx->context_driver != gc)
 			continue;
 
-		if (ctx->pending != NULL)
-			__ofono_dbus_pending_reply(&ctx->pending,
+		if (ctx->op == PRI_CONTEXT_OP_NONE ||
+				ctx->op == PRI_CONTEXT_OP_DEACTIVATING) {
+			ctx->op = PRI_CONTEXT_OP_NONE;
+
+			if (ctx->pending != NULL)
+				__ofono_dbus_pending_reply(&ctx->pending,
 					__ofono_error_failed(ctx->pending));
+		} else {
+			/* Its driver goes away, and its callback with it */
+			pri_abort_activation(ctx);
+			pri_drop_activation(ctx);
+			break;
+		}
 
-		if (ctx->active == FALSE)
+		/* Possibly still held while taking down an aborted one */
+		if (ctx->active == FALSE) {
+			release_context(ctx);
 			break;
+		}
 
 		pri_reset_context_settings(ctx);
 		release_context(ctx);
@@ -2713,6 +3065,9 @@ static void gprs_context_unregister(struct ofono_atom *atom)
 					"Active", DBUS_TYPE_BOOLEAN, &value);
 	}
 
+	/* Aborted activations may have freed up slots */
+	gprs_schedule_activations(gc->gprs);
+
 	gc->gprs->context_drivers = g_slist_remove(gc->gprs->context_drivers,
 							gc);
 	gc->gprs = NULL;
@@ -3112,6 +3467,8 @@ static void gprs_remove(struct ofono_atom *atom)
 
 	g_free(gprs->gid1);
 
+	g_queue_free(gprs->activation_queue);
+
 	g_slist_free(gprs->context_drivers);
 
 	if (gprs->driver && gprs->driver->remove)
@@ -3153,6 +3510,7 @@ struct ofono_gprs *ofono_gprs_create(struct ofono_modem *modem,
 	gprs->status = NETWORK_REGISTRATION_STATUS_UNKNOWN;
 	gprs->netreg_status = NETWORK_REGISTRATION_STATUS_UNKNOWN;
 	gprs->pid_map = idmap_new(MAX_CONTEXTS);
+	gprs->activation_queue = g_queue_new();
 
 	return gprs;
 }
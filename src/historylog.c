@@ -0,0 +1,531 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "historylog.h"
+
+/*
+ * The log is a single file mapped into memory: a header followed by
+ * records appended back to back.  A record only becomes visible once
+ * the header tail has been moved past it, so a torn append is simply
+ * dropped on the next open.  When the file is full the oldest records
+ * are discarded until half of it is free, and the survivors are moved
+ * to the front.
+ */
+
+#define LOG_MAGIC 0x4f484c47	/* OHLG */
+#define LOG_VERSION 1
+#define RECORD_MAGIC 0x52454331	/* REC1 */
+#define MIN_CAPACITY 4096
+
+#define RECORD_ALIGN(x) (((x) + 7) & ~((size_t) 7))
+
+struct log_header {
+	guint32 magic;
+	guint32 version;
+	guint32 tail;
+	guint32 reserved;
+	guint64 next_seq;
+};
+
+/* Followed by the peer and the text, each NUL terminated */
+struct log_record {
+	guint32 magic;
+	guint32 size;
+	guint64 seq;
+	gint64 time;
+	guint32 duration;
+	guint16 peer_len;
+	guint16 text_len;
+	guint8 type;
+	guint8 status;
+	guint8 uuid[HISTORY_LOG_UUID_LEN];
+	guint8 pad[2];
+};
+
+struct log_ref {
+	gint64 time;
+	guint64 seq;
+	guint32 offset;
+};
+
+struct history_log {
+	int fd;
+	unsigned char *map;
+	size_t capacity;
+	struct log_header *header;
+	GArray *by_time;	/* log_refs ordered by time, then seq */
+	GHashTable *by_peer;	/* peer -> GArray of log_refs, same order */
+	GHashTable *by_uuid;	/* uuid -> record offset */
+};
+
+static const guint8 null_uuid[HISTORY_LOG_UUID_LEN];
+
+static guint uuid_hash(gconstpointer key)
+{
+	const guint8 *uuid = key;
+
+	/* The UUIDs are SHA1 digests, any four bytes will do */
+	return uuid[0] | uuid[1] << 8 | uuid[2] << 16 | uuid[3] << 24;
+}
+
+static gboolean uuid_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, HISTORY_LOG_UUID_LEN) == 0;
+}
+
+static void free_peer_index(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+static inline struct log_record *log_record_at(struct history_log *log,
+						guint32 offset)
+{
+	return (struct log_record *) (log->map + offset);
+}
+
+static inline int ref_compare(const struct log_ref *a,
+				const struct log_ref *b)
+{
+	if (a->time != b->time)
+		return a->time < b->time ? -1 : 1;
+
+	if (a->seq != b->seq)
+		return a->seq < b->seq ? -1 : 1;
+
+	return 0;
+}
+
+/* Number of entries ordered strictly before bound */
+static unsigned int index_lower_bound(GArray *index,
+					const struct log_ref *bound)
+{
+	unsigned int lo = 0;
+	unsigned int hi = index->len;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (ref_compare(&g_array_index(index, struct log_ref, mid),
+					bound) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void index_insert(GArray *index, const struct log_ref *ref)
+{
+	unsigned int pos;
+
+	/* Records nearly always arrive in order */
+	if (index->len == 0 || ref_compare(&g_array_index(index,
+						struct log_ref,
+						index->len - 1), ref) < 0) {
+		g_array_append_val(index, *ref);
+		return;
+	}
+
+	pos = index_lower_bound(index, ref);
+	g_array_insert_val(index, pos, *ref);
+}
+
+static void index_record(struct history_log *log, guint32 offset)
+{
+	struct log_record *rec = log_record_at(log, offset);
+	const char *peer = (const char *) (rec + 1);
+	struct log_ref ref = { rec->time, rec->seq, offset };
+	GArray *peer_index;
+
+	index_insert(log->by_time, &ref);
+
+	peer_index = g_hash_table_lookup(log->by_peer, peer);
+	if (peer_index == NULL) {
+		peer_index = g_array_new(FALSE, FALSE, sizeof(struct log_ref));
+		g_hash_table_insert(log->by_peer, (gpointer) peer, peer_index);
+	}
+
+	index_insert(peer_index, &ref);
+
+	if (memcmp(rec->uuid, null_uuid, HISTORY_LOG_UUID_LEN))
+		g_hash_table_insert(log->by_uuid, rec->uuid,
+					GUINT_TO_POINTER(offset));
+}
+
+static gboolean log_type_valid(guint8 type)
+{
+	switch (type) {
+	case HISTORY_LOG_TYPE_CALL:
+	case HISTORY_LOG_TYPE_MISSED_CALL:
+	case HISTORY_LOG_TYPE_INCOMING_MESSAGE:
+	case HISTORY_LOG_TYPE_OUTGOING_MESSAGE:
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean log_record_valid(struct history_log *log, guint32 offset)
+{
+	struct log_record *rec;
+	const char *peer;
+	guint32 tail = log->header->tail;
+
+	if (offset + sizeof(struct log_record) > tail)
+		return FALSE;
+
+	rec = log_record_at(log, offset);
+
+	if (rec->magic != RECORD_MAGIC || rec->size % 8 ||
+			rec->size > tail - offset)
+		return FALSE;
+
+	if (!log_type_valid(rec->type))
+		return FALSE;
+
+	if (sizeof(struct log_record) + rec->peer_len + rec->text_len + 2 >
+			rec->size)
+		return FALSE;
+
+	peer = (const char *) (rec + 1);
+
+	return peer[rec->peer_len] == '\0' &&
+		peer[rec->peer_len + 1 + rec->text_len] == '\0';
+}
+
+/*
+ * Rebuilds all indexes from the mapped records.  Anything after the
+ * first invalid record is cut off.
+ */
+static void log_rebuild(struct history_log *log)
+{
+	guint32 offset = sizeof(struct log_header);
+
+	g_array_set_size(log->by_time, 0);
+	g_hash_table_remove_all(log->by_peer);
+	g_hash_table_remove_all(log->by_uuid);
+
+	while (offset < log->header->tail) {
+		struct log_record *rec;
+
+		if (!log_record_valid(log, offset)) {
+			log->header->tail = offset;
+			break;
+		}
+
+		rec = log_record_at(log, offset);
+
+		if (rec->seq >= log->header->next_seq)
+			log->header->next_seq = rec->seq + 1;
+
+		index_record(log, offset);
+		offset += rec->size;
+	}
+}
+
+static void log_compact(struct history_log *log, size_t needed)
+{
+	guint32 start = sizeof(struct log_header);
+	size_t target = (log->capacity - start) / 2;
+	guint32 tail = log->header->tail;
+	guint32 offset = start;
+
+	while (offset < tail && tail - offset + needed > target)
+		offset += log_record_at(log, offset)->size;
+
+	memmove(log->map + start, log->map + offset, tail - offset);
+	log->header->tail = start + tail - offset;
+
+	msync(log->map, log->capacity, MS_ASYNC);
+
+	log_rebuild(log);
+}
+
+static void log_to_record(struct log_record *rec,
+				struct history_log_record *record)
+{
+	const char *peer = (const char *) (rec + 1);
+
+	record->seq = rec->seq;
+	record->time = rec->time;
+	record->duration = rec->duration;
+	record->type = rec->type;
+	record->status = rec->status;
+	record->peer = peer;
+	record->text = peer + rec->peer_len + 1;
+
+	if (memcmp(rec->uuid, null_uuid, HISTORY_LOG_UUID_LEN))
+		record->uuid = rec->uuid;
+	else
+		record->uuid = NULL;
+}
+
+struct history_log *history_log_open(const char *path, size_t capacity)
+{
+	struct history_log *log;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return NULL;
+
+	fd = TFR(open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600));
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0)
+		goto error;
+
+	capacity = MAX(capacity, MIN_CAPACITY);
+
+	/* Never shrink an existing log, that would drop records */
+	if ((size_t) st.st_size > capacity)
+		capacity = st.st_size;
+	else if ((size_t) st.st_size < capacity &&
+			ftruncate(fd, capacity) < 0)
+		goto error;
+
+	map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+
+	log = g_new0(struct history_log, 1);
+	log->fd = fd;
+	log->map = map;
+	log->capacity = capacity;
+	log->header = map;
+	log->by_time = g_array_new(FALSE, FALSE, sizeof(struct log_ref));
+	log->by_peer = g_hash_table_new_full(g_str_hash, g_str_equal,
+						NULL, free_peer_index);
+	log->by_uuid = g_hash_table_new(uuid_hash, uuid_equal);
+
+	if (log->header->magic != LOG_MAGIC ||
+			log->header->version != LOG_VERSION ||
+			log->header->tail < sizeof(struct log_header) ||
+			log->header->tail > capacity) {
+		log->header->magic = LOG_MAGIC;
+		log->header->version = LOG_VERSION;
+		log->header->tail = sizeof(struct log_header);
+		log->header->next_seq = 1;
+	}
+
+	log_rebuild(log);
+
+	return log;
+
+error:
+	close(fd);
+	return NULL;
+}
+
+void history_log_close(struct history_log *log)
+{
+	if (log == NULL)
+		return;
+
+	msync(log->map, log->capacity, MS_SYNC);
+	munmap(log->map, log->capacity);
+	close(log->fd);
+
+	g_hash_table_destroy(log->by_uuid);
+	g_hash_table_destroy(log->by_peer);
+	g_array_free(log->by_time, TRUE);
+	g_free(log);
+}
+
+gboolean history_log_append(struct history_log *log,
+				struct history_log_record *record)
+{
+	const char *peer = record->peer ? record->peer : "";
+	const char *text = record->text ? record->text : "";
+	size_t peer_len = strlen(peer);
+	size_t text_len = strlen(text);
+	struct log_record *rec;
+	guint32 offset;
+	size_t size;
+	char *data;
+
+	if (peer_len > G_MAXUINT16 || text_len > G_MAXUINT16)
+		return FALSE;
+
+	if (!log_type_valid(record->type))
+		return FALSE;
+
+	size = RECORD_ALIGN(sizeof(struct log_record) + peer_len +
+				text_len + 2);
+
+	/* Compaction frees half of the log, a record must fit in there */
+	if (size > (log->capacity - sizeof(struct log_header)) / 2)
+		return FALSE;
+
+	if (log->header->tail + size > log->capacity)
+		log_compact(log, size);
+
+	offset = log->header->tail;
+	rec = log_record_at(log, offset);
+	memset(rec, 0, size);
+
+	rec->magic = RECORD_MAGIC;
+	rec->size = size;
+	rec->seq = log->header->next_seq;
+	rec->time = record->time;
+	rec->duration = record->duration;
+	rec->peer_len = peer_len;
+	rec->text_len = text_len;
+	rec->type = record->type;
+	rec->status = record->status;
+
+	if (record->uuid)
+		memcpy(rec->uuid, record->uuid, HISTORY_LOG_UUID_LEN);
+
+	data = (char *) (rec + 1);
+	memcpy(data, peer, peer_len);
+	memcpy(data + peer_len + 1, text, text_len);
+
+	/* Publish the record only once it is complete */
+	log->header->next_seq += 1;
+	log->header->tail = offset + size;
+
+	record->seq = rec->seq;
+	index_record(log, offset);
+
+	return TRUE;
+}
+
+gboolean history_log_set_status(struct history_log *log,
+				const unsigned char *uuid, guint8 status)
+{
+	gpointer offset;
+
+	if (!g_hash_table_lookup_extended(log->by_uuid, uuid, NULL, &offset))
+		return FALSE;
+
+	log_record_at(log, GPOINTER_TO_UINT(offset))->status = status;
+
+	return TRUE;
+}
+
+/*
+ * The strings in record point into the log and are only valid until
+ * the next append.
+ */
+gboolean history_log_find(struct history_log *log,
+				const unsigned char *uuid,
+				struct history_log_record *record)
+{
+	gpointer offset;
+
+	if (!g_hash_table_lookup_extended(log->by_uuid, uuid, NULL, &offset))
+		return FALSE;
+
+	log_to_record(log_record_at(log, GPOINTER_TO_UINT(offset)), record);
+
+	return TRUE;
+}
+
+unsigned int history_log_query(struct history_log *log,
+				const struct history_log_filter *filter,
+				struct history_log_cursor *cursor,
+				unsigned int limit, gboolean *more,
+				history_log_record_cb_t cb, void *data)
+{
+	GArray *index = log->by_time;
+	struct log_ref bound = { G_MAXINT64, G_MAXUINT64, 0 };
+	unsigned int count = 0;
+	unsigned int pos;
+
+	*more = FALSE;
+
+	if (filter->peer) {
+		index = g_hash_table_lookup(log->by_peer, filter->peer);
+		if (index == NULL)
+			return 0;
+	}
+
+	if (cursor->seq != 0) {
+		bound.time = cursor->time;
+		bound.seq = cursor->seq;
+	}
+
+	if (filter->until != 0 && filter->until < bound.time) {
+		bound.time = filter->until;
+		bound.seq = G_MAXUINT64;
+	}
+
+	for (pos = index_lower_bound(index, &bound); pos > 0; pos--) {
+		struct log_ref *ref = &g_array_index(index, struct log_ref,
+							pos - 1);
+		struct log_record *rec;
+		struct history_log_record record;
+
+		if (filter->since != 0 && ref->time < filter->since)
+			break;
+
+		rec = log_record_at(log, ref->offset);
+
+		if (filter->types != 0 &&
+				!(filter->types & HISTORY_LOG_TYPE_MASK(rec->type)))
+			continue;
+
+		if (count == limit) {
+			*more = TRUE;
+			break;
+		}
+
+		log_to_record(rec, &record);
+		cb(&record, data);
+
+		cursor->time = ref->time;
+		cursor->seq = ref->seq;
+		count += 1;
+	}
+
+	return count;
+}
+
+unsigned int history_log_count(struct history_log *log)
+{
+	return log->by_time->len;
+}
+
+size_t history_log_used(struct history_log *log)
+{
+	return log->header->tail - sizeof(struct log_header);
+}
+
+size_t history_log_capacity(struct history_log *log)
+{
+	return log->capacity - sizeof(struct log_header);
+}
@@ -0,0 +1,83 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define HISTORY_LOG_UUID_LEN 20
+
+enum history_log_type {
+	HISTORY_LOG_TYPE_CALL = 1,
+	HISTORY_LOG_TYPE_MISSED_CALL = 2,
+	HISTORY_LOG_TYPE_INCOMING_MESSAGE = 3,
+	HISTORY_LOG_TYPE_OUTGOING_MESSAGE = 4,
+};
+
+#define HISTORY_LOG_TYPE_MASK(type) (1 << (type))
+
+struct history_log_record {
+	guint64 seq;
+	gint64 time;
+	guint32 duration;
+	guint8 type;
+	guint8 status;
+	const unsigned char *uuid;
+	const char *peer;
+	const char *text;
+};
+
+/*
+ * Position in a query, records are returned newest first.  A zeroed
+ * cursor starts at the newest record.
+ */
+struct history_log_cursor {
+	gint64 time;
+	guint64 seq;
+};
+
+struct history_log_filter {
+	const char *peer;
+	gint64 since;
+	gint64 until;
+	guint32 types;
+};
+
+typedef void (*history_log_record_cb_t)(
+				const struct history_log_record *record,
+				void *data);
+
+struct history_log;
+
+struct history_log *history_log_open(const char *path, size_t capacity);
+void history_log_close(struct history_log *log);
+
+gboolean history_log_append(struct history_log *log,
+				struct history_log_record *record);
+gboolean history_log_set_status(struct history_log *log,
+				const unsigned char *uuid, guint8 status);
+gboolean history_log_find(struct history_log *log,
+				const unsigned char *uuid,
+				struct history_log_record *record);
+
+unsigned int history_log_query(struct history_log *log,
+				const struct history_log_filter *filter,
+				struct history_log_cursor *cursor,
+				unsigned int limit, gboolean *more,
+				history_log_record_cb_t cb, void *data);
+
+unsigned int history_log_count(struct history_log *log);
+size_t history_log_used(struct history_log *log);
+size_t history_log_capacity(struct history_log *log);
@@ -254,6 +254,8 @@ static const GDBusMethodTable location_reporting_methods[] = {
 static const GDBusSignalTable location_reporting_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
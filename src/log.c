@@ -115,6 +115,35 @@ void ofono_debug(const char *format, ...)
 	va_end(ap);
 }
 
+/**
+ * ofono_debug_desc_log:
+ * @desc: debug descriptor of the call site
+ * @format: format string, must be a string literal
+ * @varargs: list of arguments
+ *
+ * Output debug message to wherever the descriptor flags select
+ */
+void ofono_debug_desc_log(const struct ofono_debug_desc *desc,
+					const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+
+	if (desc->flags & OFONO_DEBUG_FLAG_TRACE) {
+		va_list aq;
+
+		va_copy(aq, ap);
+		__ofono_trace_vrecord(format, aq);
+		va_end(aq);
+	}
+
+	if (desc->flags & OFONO_DEBUG_FLAG_PRINT)
+		vsyslog(LOG_DEBUG, format, ap);
+
+	va_end(ap);
+}
+
 #ifdef __GLIBC__
 static void print_backtrace(unsigned int offset)
 {
@@ -248,36 +277,146 @@ static void signal_setup(sighandler_t handler)
 extern struct ofono_debug_desc __start___debug[];
 extern struct ofono_debug_desc __stop___debug[];
 
-static gchar **enabled = NULL;
+struct debug_section {
+	struct ofono_debug_desc *start;
+	struct ofono_debug_desc *stop;
+};
 
-static ofono_bool_t is_enabled(struct ofono_debug_desc *desc)
+/*
+ * Enable and disable requests, in the order they were made.  They are
+ * replayed against the descriptors of plugins loaded later on.
+ */
+struct debug_rule {
+	char *pattern;
+	GPatternSpec *spec;
+	unsigned int flags;
+	ofono_bool_t enable;
+};
+
+static GSList *rules = NULL;
+static GSList *sections = NULL;
+
+static void debug_rule_free(gpointer data)
 {
-	int i;
+	struct debug_rule *rule = data;
 
-	if (enabled == NULL)
-		return FALSE;
+	g_pattern_spec_free(rule->spec);
+	g_free(rule->pattern);
+	g_free(rule);
+}
 
-	for (i = 0; enabled[i] != NULL; i++) {
-		if (desc->name != NULL && g_pattern_match_simple(enabled[i],
+static ofono_bool_t rule_matches(struct debug_rule *rule,
+					struct ofono_debug_desc *desc)
+{
+	if (desc->name != NULL && g_pattern_match_string(rule->spec,
 							desc->name) == TRUE)
-			return TRUE;
-		if (desc->file != NULL && g_pattern_match_simple(enabled[i],
+		return TRUE;
+
+	if (desc->file != NULL && g_pattern_match_string(rule->spec,
 							desc->file) == TRUE)
-			return TRUE;
-	}
+		return TRUE;
 
 	return FALSE;
 }
 
+static unsigned int rule_apply(struct debug_rule *rule,
+				struct ofono_debug_desc *start,
+				struct ofono_debug_desc *stop)
+{
+	struct ofono_debug_desc *desc;
+	unsigned int count = 0;
+
+	for (desc = start; desc < stop; desc++) {
+		if (rule_matches(rule, desc) == FALSE)
+			continue;
+
+		if (rule->enable)
+			desc->flags |= rule->flags;
+		else
+			desc->flags &= ~rule->flags;
+
+		count += 1;
+	}
+
+	return count;
+}
+
+/*
+ * A newer request takes over its flags from older rules with the same
+ * pattern, or from every older rule when the pattern is "*".  Rules left
+ * without flags are dropped, so repeated requests don't pile up.
+ */
+static void rules_prune(const char *pattern, unsigned int flags)
+{
+	gboolean all = g_str_equal(pattern, "*");
+	GSList *l = rules;
+
+	while (l) {
+		struct debug_rule *rule = l->data;
+		GSList *next = l->next;
+
+		if (all || g_str_equal(rule->pattern, pattern))
+			rule->flags &= ~flags;
+
+		if (rule->flags == 0) {
+			rules = g_slist_delete_link(rules, l);
+			debug_rule_free(rule);
+		}
+
+		l = next;
+	}
+}
+
+static struct debug_rule *rule_add(const char *pattern, unsigned int flags,
+					ofono_bool_t enable)
+{
+	struct debug_rule *rule;
+
+	rules_prune(pattern, flags);
+
+	rule = g_new0(struct debug_rule, 1);
+	rule->pattern = g_strdup(pattern);
+	rule->spec = g_pattern_spec_new(pattern);
+	rule->flags = flags;
+	rule->enable = enable;
+
+	rules = g_slist_append(rules, rule);
+
+	return rule;
+}
+
+static void rules_add(const char *patterns, unsigned int flags)
+{
+	gchar **list = g_strsplit_set(patterns, ":, ", 0);
+	int i;
+
+	for (i = 0; list[i] != NULL; i++) {
+		if (*list[i] == '\0')
+			continue;
+
+		__ofono_log_set_flags(list[i], flags, TRUE);
+	}
+
+	g_strfreev(list);
+}
+
 void __ofono_log_enable(struct ofono_debug_desc *start,
 					struct ofono_debug_desc *stop)
 {
 	struct ofono_debug_desc *desc;
 	const char *name = NULL, *file = NULL;
+	struct debug_section *section;
+	GSList *l;
 
 	if (start == NULL || stop == NULL)
 		return;
 
+	/* Remembered so that the flags can be changed at runtime */
+	section = g_new0(struct debug_section, 1);
+	section->start = start;
+	section->stop = stop;
+	sections = g_slist_prepend(sections, section);
+
 	for (desc = start; desc < stop; desc++) {
 		if (file != NULL || name != NULL) {
 			if (g_strcmp0(desc->file, file) == 0) {
@@ -286,10 +425,54 @@ void __ofono_log_enable(struct ofono_debug_desc *start,
 			} else
 				file = NULL;
 		}
+	}
 
-		if (is_enabled(desc) == TRUE)
-			desc->flags |= OFONO_DEBUG_FLAG_PRINT;
+	for (l = rules; l; l = l->next)
+		rule_apply(l->data, start, stop);
+}
+
+/*
+ * Sets or clears flags on every debug descriptor whose name or file
+ * matches pattern, returns the number of descriptors matched.  The
+ * request also applies to descriptors registered later on.
+ *
+ * The pattern is compiled once here, DBG() itself only ever tests the
+ * descriptor flags.
+ */
+unsigned int __ofono_log_set_flags(const char *pattern, unsigned int flags,
+					ofono_bool_t enable)
+{
+	struct debug_rule *rule = rule_add(pattern, flags, enable);
+	unsigned int count = 0;
+	GSList *l;
+
+	for (l = sections; l; l = l->next) {
+		struct debug_section *section = l->data;
+
+		count += rule_apply(rule, section->start, section->stop);
 	}
+
+	return count;
+}
+
+/*
+ * Records the debug descriptors matching any of the patterns in trace
+ * to the trace ring rather than syslog.
+ */
+int __ofono_log_trace_init(const char *trace)
+{
+	int err;
+
+	if (trace == NULL)
+		return 0;
+
+	err = __ofono_trace_init(0);
+	if (err < 0)
+		return err;
+
+	rules_add(trace, OFONO_DEBUG_FLAG_TRACE);
+
+	return 0;
 }
 
 int __ofono_log_init(const char *program, const char *debug,
@@ -301,11 +484,11 @@ int __ofono_log_init(const char *program, const char *debug,
 	program_exec = program;
 	program_path = getcwd(path, sizeof(path));
 
-	if (debug != NULL)
-		enabled = g_strsplit_set(debug, ":, ", 0);
-
 	__ofono_log_enable(__start___debug, __stop___debug);
 
+	if (debug != NULL)
+		rules_add(debug, OFONO_DEBUG_FLAG_PRINT);
+
 	if (detach == FALSE)
 		option |= LOG_PERROR;
 
@@ -330,5 +513,11 @@ void __ofono_log_cleanup(void)
 	signal_setup(SIG_DFL);
 #endif
 
-	g_strfreev(enabled);
+	g_slist_free_full(rules, debug_rule_free);
+	rules = NULL;
+
+	g_slist_free_full(sections, g_free);
+	sections = NULL;
+
+	__ofono_trace_cleanup();
 }
@@ -24,6 +24,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -129,10 +130,87 @@ static void system_bus_disconnected(DBusConnection *conn, void *user_data)
 }
 
 static gchar *option_debug = NULL;
+static gchar *option_trace = NULL;
 static gchar *option_plugin = NULL;
 static gchar *option_noplugin = NULL;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
+static gboolean option_batch = FALSE;
+static gboolean option_profile = FALSE;
+
+struct startup_mark {
+	gint64 offset;
+	char *event;
+};
+
+static gint64 startup_time;
+static GSList *startup_marks = NULL;
+static gboolean startup_done = FALSE;
+
+static void log_startup_mark(gint64 offset, const char *event)
+{
+	ofono_info("startup %4u.%03u ms %s", (unsigned int) (offset / 1000),
+				(unsigned int) (offset % 1000), event);
+}
+
+void __ofono_startup_mark(const char *format, ...)
+{
+	struct startup_mark *mark;
+	gint64 offset;
+	va_list ap;
+	char *event;
+
+	if (option_profile == FALSE)
+		return;
+
+	offset = g_get_monotonic_time() - startup_time;
+
+	va_start(ap, format);
+	event = g_strdup_vprintf(format, ap);
+	va_end(ap);
+
+	/* Anything after startup, like lazy plugins, is logged right away */
+	if (startup_done == TRUE) {
+		log_startup_mark(offset, event);
+		g_free(event);
+		return;
+	}
+
+	mark = g_new0(struct startup_mark, 1);
+	mark->offset = offset;
+	mark->event = event;
+
+	startup_marks = g_slist_prepend(startup_marks, mark);
+}
+
+static void startup_mark_free(gpointer data)
+{
+	struct startup_mark *mark = data;
+
+	g_free(mark->event);
+	g_free(mark);
+}
+
+static gboolean startup_complete(gpointer user_data)
+{
+	GSList *l;
+
+	__ofono_startup_mark("main loop running");
+
+	startup_done = TRUE;
+	startup_marks = g_slist_reverse(startup_marks);
+
+	for (l = startup_marks; l; l = l->next) {
+		struct startup_mark *mark = l->data;
+
+		log_startup_mark(mark->offset, mark->event);
+	}
+
+	g_slist_free_full(startup_marks, startup_mark_free);
+	startup_marks = NULL;
+
+	return FALSE;
+}
 
 static gboolean parse_debug(const char *key, const char *value,
 					gpointer user_data, GError **error)
@@ -149,6 +227,9 @@ static GOptionEntry options[] = {
 	{ "debug", 'd', G_OPTION_FLAG_OPTIONAL_ARG,
 				G_OPTION_ARG_CALLBACK, parse_debug,
 				"Specify debug options to enable", "DEBUG" },
+	{ "trace", 't', 0, G_OPTION_ARG_STRING, &option_trace,
+				"Specify debug options to record in the"
+				" trace ring", "DEBUG" },
 	{ "plugin", 'p', 0, G_OPTION_ARG_STRING, &option_plugin,
 				"Specify plugins to load", "NAME,..," },
 	{ "noplugin", 'P', 0, G_OPTION_ARG_STRING, &option_noplugin,
@@ -158,6 +239,11 @@ static GOptionEntry options[] = {
 				"Don't run as daemon in background" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
+	{ "batch-properties", 0, 0, G_OPTION_ARG_NONE, &option_batch,
+				"Send coalesced property changes as"
+				" PropertiesChanged signals" },
+	{ "startup-profile", 0, 0, G_OPTION_ARG_NONE, &option_profile,
+				"Log a timeline of the startup sequence" },
 	{ NULL },
 };
 
@@ -169,6 +255,8 @@ int main(int argc, char **argv)
 	DBusError error;
 	guint signal;
 
+	startup_time = g_get_monotonic_time();
+
 #ifdef NEED_THREADS
 	if (g_thread_supported() == FALSE)
 		g_thread_init(NULL);
@@ -214,6 +302,9 @@ int main(int argc, char **argv)
 	signal = setup_signalfd();
 
 	__ofono_log_init(argv[0], option_debug, option_detach);
+	__ofono_log_trace_init(option_trace);
+
+	__ofono_startup_mark("logging initialized");
 
 	dbus_error_init(&error);
 
@@ -234,28 +325,45 @@ int main(int argc, char **argv)
 					NULL, NULL);
 
 	__ofono_dbus_init(conn);
+	__ofono_dbus_set_property_batching(option_batch);
+
+	__ofono_startup_mark("system bus connected");
 
 	__ofono_modemwatch_init();
 
 	__ofono_manager_init();
 
+	__ofono_debug_init();
+
+	__ofono_startup_mark("core initialized");
+
 	__ofono_plugin_init(option_plugin, option_noplugin);
 
+	__ofono_startup_mark("plugins initialized");
+
 	g_free(option_plugin);
+	g_free(option_trace);
 	g_free(option_noplugin);
 
 	__ofono_wakelock_init();
 
+	if (option_profile == TRUE)
+		g_idle_add(startup_complete, NULL);
+
 	g_main_loop_run(event_loop);
 
 	__ofono_wakelock_cleanup();
 
+	__ofono_debug_cleanup();
+
 	__ofono_plugin_cleanup();
 
 	__ofono_manager_cleanup();
 
 	__ofono_modemwatch_cleanup();
 
+	__ofono_rtnl_cleanup();
+
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
@@ -264,6 +372,8 @@ cleanup:
 
 	g_main_loop_unref(event_loop);
 
+	g_slist_free_full(startup_marks, startup_mark_free);
+
 	__ofono_log_cleanup();
 
 	return 0;
@@ -381,6 +381,8 @@ static const GDBusMethodTable message_waiting_methods[] = {
 static const GDBusSignalTable message_waiting_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -62,7 +62,9 @@ struct ofono_modem {
 	char			*path;
 	enum modem_state	modem_state;
 	GSList			*atoms;
-	struct ofono_watchlist	*atom_watches;
+	GSList			*atoms_by_type[OFONO_ATOM_TYPE_COUNT];
+	struct ofono_watchlist	*atom_watches[OFONO_ATOM_TYPE_COUNT];
+	unsigned int		atom_watch_id;
 	GSList			*interface_list;
 	GSList			*feature_list;
 	unsigned int		call_ids;
@@ -203,6 +205,8 @@ struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
 	atom->modem = modem;
 
 	modem->atoms = g_slist_prepend(modem->atoms, atom);
+	modem->atoms_by_type[type] = g_slist_prepend(modem->atoms_by_type[type],
+							atom);
 
 	return atom;
 }
@@ -239,21 +243,23 @@ struct ofono_modem *__ofono_atom_get_modem(struct ofono_atom *atom)
 static void call_watches(struct ofono_atom *atom,
 				enum ofono_atom_watch_condition cond)
 {
-	struct ofono_modem *modem = atom->modem;
-	GSList *atom_watches = modem->atom_watches->items;
-	GSList *l;
-	struct atom_watch *watch;
+	struct ofono_watchlist *watches = atom->modem->atom_watches[atom->type];
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 	ofono_atom_watch_func notify;
 
-	for (l = atom_watches; l; l = l->next) {
-		watch = l->data;
+	if (watches == NULL)
+		return;
 
-		if (watch->type != atom->type)
-			continue;
+	/* The notify functions are allowed to add and remove watches */
+	__ofono_watchlist_iter_init(watches, &iter);
 
-		notify = watch->item.notify;
-		notify(atom, cond, watch->item.notify_data);
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		notify = item->notify;
+		notify(atom, cond, item->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 void __ofono_atom_register(struct ofono_atom *atom,
@@ -296,6 +302,9 @@ unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 	if (notify == NULL)
 		return 0;
 
+	if (modem->atom_watches[type] == NULL)
+		modem->atom_watches[type] = __ofono_watchlist_new(g_free);
+
 	watch = g_new0(struct atom_watch, 1);
 
 	watch->type = type;
@@ -303,13 +312,16 @@ unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 	watch->item.destroy = destroy;
 	watch->item.notify_data = data;
 
-	id = __ofono_watchlist_add_item(modem->atom_watches,
+	/* Ids are shared by the lists of all types, keep them unique */
+	modem->atom_watches[type]->next_id = modem->atom_watch_id;
+	id = __ofono_watchlist_add_item(modem->atom_watches[type],
 					(struct ofono_watchlist_item *)watch);
+	modem->atom_watch_id = id;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type != type || atom->unregister == NULL)
+		if (atom->unregister == NULL)
 			continue;
 
 		notify(atom, OFONO_ATOM_WATCH_CONDITION_REGISTERED, data);
@@ -321,7 +333,19 @@ unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
 						unsigned int id)
 {
-	return __ofono_watchlist_remove_item(modem->atom_watches, id);
+	int i;
+
+	for (i = 0; i < OFONO_ATOM_TYPE_COUNT; i++) {
+		struct ofono_watchlist *watches = modem->atom_watches[i];
+
+		if (watches == NULL)
+			continue;
+
+		if (__ofono_watchlist_remove_item(watches, id))
+			return TRUE;
+	}
+
+	return FALSE;
 }
 
 struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
@@ -333,10 +357,10 @@ struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
 	if (modem == NULL)
 		return NULL;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type == type && atom->unregister != NULL)
+		if (atom->unregister != NULL)
 			return atom;
 	}
 
@@ -353,12 +377,9 @@ void __ofono_modem_foreach_atom(struct ofono_modem *modem,
 	if (modem == NULL)
 		return;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type != type)
-			continue;
-
 		callback(atom, data);
 	}
 }
@@ -374,12 +395,9 @@ void __ofono_modem_foreach_registered_atom(struct ofono_modem *modem,
 	if (modem == NULL)
 		return;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type != type)
-			continue;
-
 		if (atom->unregister == NULL)
 			continue;
 
@@ -392,6 +410,8 @@ void __ofono_atom_free(struct ofono_atom *atom)
 	struct ofono_modem *modem = atom->modem;
 
 	modem->atoms = g_slist_remove(modem->atoms, atom);
+	modem->atoms_by_type[atom->type] =
+		g_slist_remove(modem->atoms_by_type[atom->type], atom);
 
 	__ofono_atom_unregister(atom);
 
@@ -421,6 +441,9 @@ static void flush_atoms(struct ofono_modem *modem, enum modem_state new_state)
 			continue;
 		}
 
+		modem->atoms_by_type[atom->type] =
+			g_slist_remove(modem->atoms_by_type[atom->type], atom);
+
 		__ofono_atom_unregister(atom);
 
 		if (atom->destruct)
@@ -441,34 +464,40 @@ static void flush_atoms(struct ofono_modem *modem, enum modem_state new_state)
 
 static void notify_online_watches(struct ofono_modem *modem)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_modem_online_notify_func notify;
 
 	if (modem->online_watches == NULL)
 		return;
 
-	for (l = modem->online_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(modem->online_watches, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 		notify(modem, modem->online, item->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 static void notify_powered_watches(struct ofono_modem *modem)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_modem_powered_notify_func notify;
 
 	if (modem->powered_watches == NULL)
 		return;
 
-	for (l = modem->powered_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(modem->powered_watches, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 		notify(modem, modem->powered, item->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 static void set_online(struct ofono_modem *modem, ofono_bool_t new_online)
@@ -583,17 +612,7 @@ void __ofono_modem_remove_powered_watch(struct ofono_modem *modem,
 
 static gboolean modem_has_sim(struct ofono_modem *modem)
 {
-	GSList *l;
-	struct ofono_atom *atom;
-
-	for (l = modem->atoms; l; l = l->next) {
-		atom = l->data;
-
-		if (atom->type == OFONO_ATOM_TYPE_SIM)
-			return TRUE;
-	}
-
-	return FALSE;
+	return modem->atoms_by_type[OFONO_ATOM_TYPE_SIM] != NULL;
 }
 
 static gboolean modem_is_always_online(struct ofono_modem *modem)
@@ -1152,6 +1171,8 @@ static const GDBusMethodTable modem_methods[] = {
 static const GDBusSignalTable modem_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -1912,18 +1933,20 @@ gboolean __ofono_modemwatch_remove(unsigned int id)
 
 static void call_modemwatches(struct ofono_modem *modem, gboolean added)
 {
-	GSList *l;
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *watch;
 	ofono_modemwatch_cb_t notify;
 
 	DBG("%p added:%d", modem, added);
 
-	for (l = g_modemwatches->items; l; l = l->next) {
-		watch = l->data;
+	__ofono_watchlist_iter_init(g_modemwatches, &iter);
 
+	while ((watch = __ofono_watchlist_iter_next(&iter))) {
 		notify = watch->notify;
 		notify(modem, added, watch->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 static void emit_modem_added(struct ofono_modem *modem)
@@ -1998,6 +2021,8 @@ int ofono_modem_register(struct ofono_modem *modem)
 	if (modem->driver == NULL)
 		return -ENODEV;
 
+	__ofono_plugin_init_lazy();
+
 	if (!g_dbus_register_interface(conn, modem->path,
 					OFONO_MODEM_INTERFACE,
 					modem_methods, modem_signals, NULL,
@@ -2015,7 +2040,6 @@ int ofono_modem_register(struct ofono_modem *modem)
 	g_free(modem->driver_type);
 	modem->driver_type = NULL;
 
-	modem->atom_watches = __ofono_watchlist_new(g_free);
 	modem->online_watches = __ofono_watchlist_new(g_free);
 	modem->powered_watches = __ofono_watchlist_new(g_free);
 
@@ -2041,6 +2065,19 @@ static void emit_modem_removed(struct ofono_modem *modem)
 				DBUS_TYPE_INVALID);
 }
 
+static void atom_watches_free(struct ofono_modem *modem)
+{
+	int i;
+
+	for (i = 0; i < OFONO_ATOM_TYPE_COUNT; i++) {
+		if (modem->atom_watches[i] == NULL)
+			continue;
+
+		__ofono_watchlist_free(modem->atom_watches[i]);
+		modem->atom_watches[i] = NULL;
+	}
+}
+
 static void modem_unregister(struct ofono_modem *modem)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
@@ -2050,8 +2087,7 @@ static void modem_unregister(struct ofono_modem *modem)
 	if (modem->powered == TRUE)
 		set_powered(modem, FALSE);
 
-	__ofono_watchlist_free(modem->atom_watches);
-	modem->atom_watches = NULL;
+	atom_watches_free(modem);
 
 	__ofono_watchlist_free(modem->online_watches);
 	modem->online_watches = NULL;
@@ -2118,6 +2154,9 @@ void ofono_modem_remove(struct ofono_modem *modem)
 	if (modem->driver)
 		modem_unregister(modem);
 
+	/* Watches can still be added once the modem is unregistered */
+	atom_watches_free(modem);
+
 	g_modem_list = g_slist_remove(g_modem_list, modem);
 
 	g_free(modem->driver_type);
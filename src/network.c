@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
@@ -40,6 +41,20 @@
 #define SETTINGS_STORE "netreg"
 #define SETTINGS_GROUP "Settings"
 
+/*
+ * Default notification limits.  Signal strength changes smaller than the
+ * delta that do not change the number of bars are dropped, and strength,
+ * location, cell and technology updates are published at most once per
+ * interval, the latest value at the end of it.  Registration status
+ * changes are never delayed.
+ */
+#define STRENGTH_MIN_INTERVAL	1000	/* ms */
+#define STRENGTH_MIN_DELTA	5	/* percent */
+#define LOCATION_MIN_INTERVAL	1000	/* ms */
+
+/* MCC and MNC concatenated, the key of the operator registry */
+#define OPERATOR_KEY_LENGTH (OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 1)
+
 #define NETWORK_REGISTRATION_FLAG_HOME_SHOW_PLMN	0x1
 #define NETWORK_REGISTRATION_FLAG_ROAMING_SHOW_SPN	0x2
 #define NETWORK_REGISTRATION_FLAG_READING_PNN		0x4
@@ -59,6 +74,7 @@ struct ofono_netreg {
 	char *base_station;
 	struct network_operator_data *current_operator;
 	GSList *operator_list;
+	GHashTable *operators;
 	struct ofono_network_registration_ops *ops;
 	int flags;
 	DBusMessage *pending;
@@ -75,6 +91,17 @@ struct ofono_netreg {
 	struct ofono_atom *atom;
 	unsigned int hfp_watch;
 	unsigned int spn_watch;
+	unsigned int strength_interval;
+	unsigned int strength_delta;
+	int pending_strength;
+	gint64 strength_time;
+	guint strength_timeout;
+	unsigned int strength_suppressed;
+	unsigned int location_interval;
+	int pending_location[3];
+	gint64 location_time;
+	guint location_timeout;
+	unsigned int location_suppressed;
 };
 
 struct network_operator_data {
@@ -84,11 +111,67 @@ struct network_operator_data {
 	int status;
 	unsigned int techs;
 	const struct sim_eons_operator_info *eons_info;
+	int spdi;
+	gboolean listed;
 	struct ofono_netreg *netreg;
 };
 
 static GSList *g_drivers = NULL;
 
+/*
+ * The SPDI membership of an operator only changes when EFspdi does, so it
+ * is looked up once and cached, -1 meaning not looked up yet.
+ */
+static gboolean network_operator_in_spdi(struct ofono_netreg *netreg,
+					struct network_operator_data *opd)
+{
+	if (opd->spdi < 0)
+		opd->spdi = sim_spdi_lookup(netreg->spdi, opd->mcc, opd->mnc);
+
+	return opd->spdi;
+}
+
+static void reset_spdi_cache(struct ofono_netreg *netreg)
+{
+	GSList *l;
+
+	for (l = netreg->operator_list; l; l = l->next) {
+		struct network_operator_data *opd = l->data;
+
+		opd->spdi = -1;
+	}
+}
+
+static struct network_operator_data *network_operator_lookup(
+						struct ofono_netreg *netreg,
+						const char *mcc,
+						const char *mnc)
+{
+	char key[OPERATOR_KEY_LENGTH];
+
+	snprintf(key, sizeof(key), "%s%s", mcc, mnc);
+
+	return g_hash_table_lookup(netreg->operators, key);
+}
+
+static void network_operator_add(struct ofono_netreg *netreg,
+					struct network_operator_data *opd)
+{
+	g_hash_table_replace(netreg->operators,
+				g_strconcat(opd->mcc, opd->mnc, NULL), opd);
+}
+
+static void network_operator_remove(struct ofono_netreg *netreg,
+					struct network_operator_data *opd)
+{
+	char key[OPERATOR_KEY_LENGTH];
+
+	snprintf(key, sizeof(key), "%s%s", opd->mcc, opd->mnc);
+
+	if (g_hash_table_lookup(netreg->operators, key) == opd)
+		g_hash_table_remove(netreg->operators, key);
+}
+
 static const char *registration_mode_to_string(int mode)
 {
 	switch (mode) {
@@ -134,7 +217,7 @@ static int get_display_status(struct ofono_netreg *netreg, int status)
 	 * (EF_OPL stores the index for the EF_PNN entry for a PLMN).
 	 */
 	if (status == NETWORK_REGISTRATION_STATUS_ROAMING && opd != NULL &&
-			(sim_spdi_lookup(netreg->spdi, opd->mcc, opd->mnc) ||
+			(network_operator_in_spdi(netreg, opd) ||
 			sim_eons_lookup(netreg->eons, opd->mcc, opd->mnc))) {
 		DBG("mcc+mnc found in SPDI or OPL, roaming -> registered");
 		status = NETWORK_REGISTRATION_STATUS_REGISTERED;
@@ -272,6 +355,7 @@ static struct network_operator_data *
 	memcpy(&opd->mnc, op->mnc, sizeof(opd->mnc));
 
 	opd->status = op->status;
+	opd->spdi = -1;
 
 	if (op->tech != -1)
 		opd->techs |= 1 << op->tech;
@@ -300,20 +384,6 @@ static gint network_operator_compare(gconstpointer a, gconstpointer b)
 	return comp1 != 0 ? comp1 : comp2;
 }
 
-static gint network_operator_data_compare(gconstpointer a, gconstpointer b)
-{
-	const struct network_operator_data *opa = a;
-	const struct network_operator_data *opb = b;
-
-	int comp1;
-	int comp2;
-
-	comp1 = strcmp(opa->mcc, opb->mcc);
-	comp2 = strcmp(opa->mnc, opb->mnc);
-
-	return comp1 != 0 ? comp1 : comp2;
-}
-
 static const char *network_operator_build_path(struct ofono_netreg *netreg,
 							const char *mcc,
 							const char *mnc)
@@ -420,8 +490,7 @@ static char *get_operator_display_name(struct ofono_netreg *netreg)
 	if (netreg->status == NETWORK_REGISTRATION_STATUS_REGISTERED)
 		home_or_spdi = TRUE;
 	else
-		home_or_spdi = sim_spdi_lookup(netreg->spdi,
-							opd->mcc, opd->mnc);
+		home_or_spdi = network_operator_in_spdi(netreg, opd);
 
 	if (home_or_spdi)
 		if (netreg->flags & NETWORK_REGISTRATION_FLAG_HOME_SHOW_PLMN)
@@ -653,6 +722,8 @@ static const GDBusMethodTable network_operator_methods[] = {
 static const GDBusSignalTable network_operator_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -700,29 +771,32 @@ static GSList *compress_operator_list(const struct ofono_network_operator *list,
 					int total)
 {
 	GSList *oplist = 0;
-	GSList *o;
+	GHashTable *seen;
 	int i;
 	struct network_operator_data *opd;
 
+	/* Scans list each operator once per technology, merge them */
+	seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
 	for (i = 0; i < total; i++) {
-		o = NULL;
+		char key[OPERATOR_KEY_LENGTH];
 
 		if (list[i].mcc[0] == '\0' || list[i].mnc[0] == '\0')
 			continue;
 
-		if (oplist)
-			o = g_slist_find_custom(oplist, &list[i],
-						network_operator_compare);
+		snprintf(key, sizeof(key), "%s%s", list[i].mcc, list[i].mnc);
+		opd = g_hash_table_lookup(seen, key);
 
-		if (o == NULL) {
+		if (opd == NULL) {
 			opd = network_operator_create(&list[i]);
 			oplist = g_slist_prepend(oplist, opd);
-		} else if (o && list[i].tech != -1) {
-			opd = o->data;
+			g_hash_table_insert(seen, g_strdup(key), opd);
+		} else if (list[i].tech != -1)
 			opd->techs |= 1 << list[i].tech;
-		}
 	}
 
+	g_hash_table_destroy(seen);
+
 	if (oplist)
 		oplist = g_slist_reverse(oplist);
 
@@ -740,24 +814,22 @@ static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 
 	compressed = compress_operator_list(list, total);
 
+	/*
+	 * Operators already known keep their D-Bus object and their
+	 * resolved EONS / SPDI information, only what changed is emitted
+	 */
 	for (c = compressed; c; c = c->next) {
 		struct network_operator_data *copd = c->data;
+		struct network_operator_data *opd;
 
-		o = g_slist_find_custom(netreg->operator_list, copd,
-					network_operator_data_compare);
-
-		if (o) { /* Update and move to a new list */
-			set_network_operator_status(o->data, copd->status);
-			set_network_operator_techs(o->data, copd->techs);
-			set_network_operator_name(o->data, copd->name);
+		opd = network_operator_lookup(netreg, copd->mcc, copd->mnc);
 
-			n = g_slist_prepend(n, o->data);
-			netreg->operator_list =
-				g_slist_remove(netreg->operator_list, o->data);
+		if (opd) { /* Update and move to a new list */
+			set_network_operator_status(opd, copd->status);
+			set_network_operator_techs(opd, copd->techs);
+			set_network_operator_name(opd, copd->name);
 		} else {
 			/* New operator */
-			struct network_operator_data *opd;
-
 			opd = g_memdup(copd,
 					sizeof(struct network_operator_data));
 
@@ -766,9 +838,12 @@ static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 				continue;
 			}
 
-			n = g_slist_prepend(n, opd);
+			network_operator_add(netreg, opd);
 			changed = TRUE;
 		}
+
+		opd->listed = TRUE;
+		n = g_slist_prepend(n, opd);
 	}
 
 	g_slist_foreach(compressed, (GFunc)g_free, NULL);
@@ -777,11 +852,22 @@ static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
 	if (n)
 		n = g_slist_reverse(n);
 
-	if (netreg->operator_list)
+	for (o = netreg->operator_list; o; o = o->next) {
+		struct network_operator_data *opd = o->data;
+
+		if (opd->listed)
+			continue;
+
 		changed = TRUE;
+		network_operator_remove(netreg, opd);
+		network_operator_dbus_unregister(netreg, opd);
+	}
+
+	for (o = n; o; o = o->next) {
+		struct network_operator_data *opd = o->data;
 
-	for (o = netreg->operator_list; o; o = o->next)
-		network_operator_dbus_unregister(netreg, o->data);
+		opd->listed = FALSE;
+	}
 
 	g_slist_free(netreg->operator_list);
 
@@ -913,19 +999,8 @@ static void append_operator_struct(struct ofono_netreg *netreg,
 static void append_operator_struct_list(struct ofono_netreg *netreg,
 					DBusMessageIter *array)
 {
-	DBusConnection *conn = ofono_dbus_get_connection();
-	char **children;
-	char path[256];
 	GSList *l;
 
-	snprintf(path, sizeof(path), "%s/operator",
-			__ofono_atom_get_path(netreg->atom));
-
-	if (!dbus_connection_list_registered(conn, path, &children)) {
-		DBG("Unable to obtain registered NetworkOperator(s)");
-		return;
-	}
-
 	/*
 	 * Quoting 27.007: "The list of operators shall be in order: home
 	 * network, networks referenced in SIM or active application in the
@@ -937,19 +1012,13 @@ static void append_operator_struct_list(struct ofono_netreg *netreg,
 	 */
 	for (l = netreg->operator_list; l; l = l->next) {
 		struct network_operator_data *opd = l->data;
-		char mnc[OFONO_MAX_MNC_LENGTH + 1];
-		char mcc[OFONO_MAX_MCC_LENGTH + 1];
-		int j;
 
-		for (j = 0; children[j]; j++) {
-			sscanf(children[j], "%3[0-9]%[0-9]", mcc, mnc);
+		/* Only operators with an MCC and MNC have an object */
+		if (opd->mcc[0] == '\0' || opd->mnc[0] == '\0')
+			continue;
 
-			if (!strcmp(opd->mcc, mcc) && !strcmp(opd->mnc, mnc))
-				append_operator_struct(netreg, opd, array);
-		}
+		append_operator_struct(netreg, opd, array);
 	}
-
-	dbus_free_string_array(children);
 }
 
 static void operator_list_callback(const struct ofono_error *error, int total,
@@ -1059,6 +1128,8 @@ static const GDBusMethodTable network_registration_methods[] = {
 static const GDBusSignalTable network_registration_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -1198,8 +1269,8 @@ gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
 
 static void notify_status_watches(struct ofono_netreg *netreg)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_netreg_status_notify_cb_t notify;
 	const char *mcc = NULL;
 	const char *mnc = NULL;
@@ -1209,13 +1280,16 @@ static void notify_status_watches(struct ofono_netreg *netreg)
 		mnc = netreg->current_operator->mnc;
 	}
 
-	for (l = netreg->status_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(netreg->status_watches, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 
 		notify(netreg->status, netreg->location, netreg->cellid,
 			netreg->technology, mcc, mnc, item->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 static void reset_available(struct network_operator_data *old,
@@ -1235,7 +1309,7 @@ static void current_operator_callback(const struct ofono_error *error,
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_netreg *netreg = data;
 	const char *path = __ofono_atom_get_path(netreg->atom);
-	GSList *op = NULL;
+	struct network_operator_data *opd = NULL;
 
 	DBG("%p, %p", netreg, netreg->current_operator);
 
@@ -1261,11 +1335,10 @@ static void current_operator_callback(const struct ofono_error *error,
 	reset_available(netreg->current_operator, current);
 
 	if (current)
-		op = g_slist_find_custom(netreg->operator_list, current,
-					network_operator_compare);
+		opd = network_operator_lookup(netreg, current->mcc,
+							current->mnc);
 
-	if (op) {
-		struct network_operator_data *opd = op->data;
+	if (opd) {
 		unsigned int techs = opd->techs;
 
 		if (current->tech != -1) {
@@ -1276,16 +1349,14 @@ static void current_operator_callback(const struct ofono_error *error,
 		set_network_operator_status(opd, OPERATOR_STATUS_CURRENT);
 		set_network_operator_name(opd, current->name);
 
-		if (netreg->current_operator == op->data)
+		if (netreg->current_operator == opd)
 			return;
 
-		netreg->current_operator = op->data;
+		netreg->current_operator = opd;
 		goto emit;
 	}
 
 	if (current) {
-		struct network_operator_data *opd;
-
 		opd = network_operator_create(current);
 
 		if (opd->mcc[0] != '\0' && opd->mnc[0] != '\0' &&
@@ -1298,6 +1369,7 @@ static void current_operator_callback(const struct ofono_error *error,
 		netreg->current_operator = opd;
 		netreg->operator_list = g_slist_append(netreg->operator_list,
 							opd);
+		network_operator_add(netreg, opd);
 	} else {
 		/* We don't free this here because operator is registered */
 		/* Taken care of elsewhere */
@@ -1344,37 +1416,37 @@ static void signal_strength_callback(const struct ofono_error *error,
 	ofono_netreg_strength_notify(netreg, strength);
 }
 
-static void notify_emulator_status(struct ofono_atom *atom, void *data)
+static int emulator_service(int status)
 {
-	switch (GPOINTER_TO_INT(data)) {
-	case NETWORK_REGISTRATION_STATUS_REGISTERED:
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_SERVICE, 1);
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_ROAMING, 0);
-		break;
-	case NETWORK_REGISTRATION_STATUS_ROAMING:
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_SERVICE, 1);
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_ROAMING, 1);
-		break;
-	default:
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_SERVICE, 0);
-		ofono_emulator_set_indicator(atom,
-						OFONO_EMULATOR_IND_ROAMING, 0);
-	}
+	return status == NETWORK_REGISTRATION_STATUS_REGISTERED ||
+		status == NETWORK_REGISTRATION_STATUS_ROAMING;
 }
 
-void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
-			int lac, int ci, int tech)
+static int emulator_roaming(int status)
 {
-	if (netreg == NULL)
-		return;
+	return status == NETWORK_REGISTRATION_STATUS_ROAMING;
+}
 
-	DBG("%s status %d tech %d", __ofono_atom_get_path(netreg->atom),
-							status, tech);
+static int emulator_signal(int strength)
+{
+	if (strength > 0)
+		return (strength - 1) / 20 + 1;
+
+	return 0;
+}
+
+static void notify_emulator_status(struct ofono_modem *modem, int status)
+{
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_SERVICE,
+					emulator_service(status), FALSE);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_ROAMING,
+					emulator_roaming(status), FALSE);
+}
+
+static void netreg_publish_status(struct ofono_netreg *netreg, int status,
+					int lac, int ci, int tech)
+{
+	netreg->location_time = g_get_monotonic_time();
 
 	if (netreg->status != status) {
 		struct ofono_modem *modem;
@@ -1382,10 +1454,7 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 		set_registration_status(netreg, status);
 
 		modem = __ofono_atom_get_modem(netreg->atom);
-		__ofono_modem_foreach_registered_atom(modem,
-					OFONO_ATOM_TYPE_EMULATOR_HFP,
-					notify_emulator_status,
-					GINT_TO_POINTER(netreg->status));
+		notify_emulator_status(modem, netreg->status);
 	}
 
 	if (netreg->technology != tech)
@@ -1416,11 +1485,81 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 		__ofono_netreg_set_base_station_name(netreg, NULL);
 
 		netreg->signal_strength = -1;
+
+		if (netreg->strength_timeout) {
+			g_source_remove(netreg->strength_timeout);
+			netreg->strength_timeout = 0;
+		}
 	}
 
 	notify_status_watches(netreg);
 }
 
+static gboolean location_timeout_cb(gpointer user_data)
+{
+	struct ofono_netreg *netreg = user_data;
+	int *pending = netreg->pending_location;
+
+	netreg->location_timeout = 0;
+
+	DBG("lac %d ci %d tech %d, %u updates suppressed so far",
+				pending[0], pending[1], pending[2],
+				netreg->location_suppressed);
+
+	netreg_publish_status(netreg, netreg->status, pending[0],
+						pending[1], pending[2]);
+
+	return FALSE;
+}
+
+void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
+			int lac, int ci, int tech)
+{
+	gint64 elapsed;
+
+	if (netreg == NULL)
+		return;
+
+	DBG("%s status %d tech %d", __ofono_atom_get_path(netreg->atom),
+							status, tech);
+
+	/* Registration transitions go out right away */
+	if (netreg->status != status || netreg->location_interval == 0) {
+		if (netreg->location_timeout) {
+			g_source_remove(netreg->location_timeout);
+			netreg->location_timeout = 0;
+		}
+
+		netreg_publish_status(netreg, status, lac, ci, tech);
+		return;
+	}
+
+	netreg->pending_location[0] = lac;
+	netreg->pending_location[1] = ci;
+	netreg->pending_location[2] = tech;
+
+	/*
+	 * Coalesced into the update already scheduled.  Repeats of the
+	 * published values are not dropped, some drivers rely on them to
+	 * have the current operator queried again.
+	 */
+	if (netreg->location_timeout) {
+		netreg->location_suppressed += 1;
+		return;
+	}
+
+	elapsed = (g_get_monotonic_time() - netreg->location_time) / 1000;
+
+	if (elapsed >= netreg->location_interval) {
+		netreg_publish_status(netreg, status, lac, ci, tech);
+		return;
+	}
+
+	netreg->location_timeout = g_timeout_add(
+				netreg->location_interval - elapsed,
+				location_timeout_cb, netreg);
+}
+
 void ofono_netreg_time_notify(struct ofono_netreg *netreg,
 				struct ofono_network_time *info)
 {
@@ -1534,23 +1673,69 @@ static void init_registration_status(const struct ofono_error *error,
 	}
 }
 
-static void notify_emulator_strength(struct ofono_atom *atom, void *data)
+static void netreg_publish_strength(struct ofono_netreg *netreg,
+							int strength)
 {
-	int val = 0;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct ofono_modem *modem;
+
+	DBG("strength %d, %u updates suppressed so far", strength,
+					netreg->strength_suppressed);
+
+	netreg->signal_strength = strength;
+	netreg->strength_time = g_get_monotonic_time();
+
+	if (strength != -1) {
+		const char *path = __ofono_atom_get_path(netreg->atom);
+		unsigned char strength_byte = netreg->signal_strength;
 
-	if (GPOINTER_TO_INT(data) > 0)
-		val = (GPOINTER_TO_INT(data) - 1) / 20 + 1;
+		ofono_dbus_signal_property_changed(conn, path,
+					OFONO_NETWORK_REGISTRATION_INTERFACE,
+					"Strength", DBUS_TYPE_BYTE,
+					&strength_byte);
+	}
 
-	ofono_emulator_set_indicator(atom, OFONO_EMULATOR_IND_SIGNAL, val);
+	modem = __ofono_atom_get_modem(netreg->atom);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_SIGNAL,
+				emulator_signal(netreg->signal_strength),
+				FALSE);
 }
 
-void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
+static gboolean strength_significant(struct ofono_netreg *netreg,
+							int strength)
 {
-	DBusConnection *conn = ofono_dbus_get_connection();
-	struct ofono_modem *modem;
+	int published = netreg->signal_strength;
 
-	if (netreg->signal_strength == strength)
-		return;
+	if (strength == published)
+		return FALSE;
+
+	if (strength == -1 || published == -1)
+		return TRUE;
+
+	if (emulator_signal(strength) != emulator_signal(published))
+		return TRUE;
+
+	return (unsigned int) abs(strength - published) >=
+						netreg->strength_delta;
+}
+
+static gboolean strength_timeout_cb(gpointer user_data)
+{
+	struct ofono_netreg *netreg = user_data;
+
+	netreg->strength_timeout = 0;
+
+	if (strength_significant(netreg, netreg->pending_strength))
+		netreg_publish_strength(netreg, netreg->pending_strength);
+	else
+		netreg->strength_suppressed += 1;
+
+	return FALSE;
+}
+
+void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
+{
+	gint64 elapsed;
 
 	/*
 	 * Theoretically we can get signal strength even when not registered
@@ -1560,25 +1745,71 @@ void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 			netreg->status != NETWORK_REGISTRATION_STATUS_ROAMING)
 		return;
 
-	DBG("strength %d", strength);
+	/* The scheduled update publishes whatever came in last */
+	if (netreg->strength_timeout) {
+		netreg->pending_strength = strength;
+		netreg->strength_suppressed += 1;
+		return;
+	}
 
-	netreg->signal_strength = strength;
+	if (netreg->signal_strength == strength)
+		return;
 
-	if (strength != -1) {
-		const char *path = __ofono_atom_get_path(netreg->atom);
-		unsigned char strength_byte = netreg->signal_strength;
+	if (!strength_significant(netreg, strength)) {
+		netreg->strength_suppressed += 1;
+		return;
+	}
 
-		ofono_dbus_signal_property_changed(conn, path,
-					OFONO_NETWORK_REGISTRATION_INTERFACE,
-					"Strength", DBUS_TYPE_BYTE,
-					&strength_byte);
+	elapsed = (g_get_monotonic_time() - netreg->strength_time) / 1000;
+
+	/* The first value after registration is never held back */
+	if (netreg->signal_strength == -1 ||
+			elapsed >= netreg->strength_interval) {
+		netreg_publish_strength(netreg, strength);
+		return;
 	}
 
-	modem = __ofono_atom_get_modem(netreg->atom);
-	__ofono_modem_foreach_registered_atom(modem,
-				OFONO_ATOM_TYPE_EMULATOR_HFP,
-				notify_emulator_strength,
-				GINT_TO_POINTER(netreg->signal_strength));
+	netreg->pending_strength = strength;
+	netreg->strength_timeout = g_timeout_add(
+				netreg->strength_interval - elapsed,
+				strength_timeout_cb, netreg);
+}
+
+void ofono_netreg_set_strength_limits(struct ofono_netreg *netreg,
+					unsigned int min_interval,
+					unsigned int min_delta)
+{
+	if (netreg == NULL)
+		return;
+
+	netreg->strength_interval = min_interval;
+	netreg->strength_delta = min_delta;
+}
+
+void ofono_netreg_set_location_limits(struct ofono_netreg *netreg,
+					unsigned int min_interval)
+{
+	if (netreg == NULL)
+		return;
+
+	netreg->location_interval = min_interval;
+}
+
+static void netreg_cancel_limits(struct ofono_netreg *netreg)
+{
+	if (netreg->strength_timeout) {
+		g_source_remove(netreg->strength_timeout);
+		netreg->strength_timeout = 0;
+	}
+
+	if (netreg->location_timeout) {
+		g_source_remove(netreg->location_timeout);
+		netreg->location_timeout = 0;
+	}
+
+	DBG("%u strength and %u location updates suppressed",
+				netreg->strength_suppressed,
+				netreg->location_suppressed);
 }
 
 static void sim_opl_read_cb(int ok, int length, int record,
@@ -1672,6 +1903,7 @@ static void sim_spdi_read_cb(int ok, int length, int record,
 		return;
 
 	netreg->spdi = sim_spdi_new(data, length);
+	reset_spdi_cache(netreg);
 
 	if (netreg->current_operator == NULL)
 		return;
@@ -1679,8 +1911,7 @@ static void sim_spdi_read_cb(int ok, int length, int record,
 	if (netreg->status != NETWORK_REGISTRATION_STATUS_ROAMING)
 		return;
 
-	if (!sim_spdi_lookup(netreg->spdi, netreg->current_operator->mcc,
-				netreg->current_operator->mnc))
+	if (!network_operator_in_spdi(netreg, netreg->current_operator))
 		return;
 
 	/*
@@ -1806,14 +2037,9 @@ static void netreg_unregister(struct ofono_atom *atom)
 	const char *path = __ofono_atom_get_path(atom);
 	GSList *l;
 
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						notify_emulator_status,
-						GINT_TO_POINTER(0));
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						notify_emulator_strength,
-						GINT_TO_POINTER(0));
+	notify_emulator_status(modem, 0);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_SIGNAL,
+						0, FALSE);
 
 	__ofono_modem_foreach_registered_atom(modem,
 						OFONO_ATOM_TYPE_EMULATOR_HFP,
@@ -1825,6 +2051,10 @@ static void netreg_unregister(struct ofono_atom *atom)
 	__ofono_watchlist_free(netreg->status_watches);
 	netreg->status_watches = NULL;
 
+	netreg_cancel_limits(netreg);
+
+	g_hash_table_remove_all(netreg->operators);
+
 	for (l = netreg->operator_list; l; l = l->next) {
 		struct network_operator_data *opd = l->data;
 
@@ -1881,8 +2111,11 @@ static void netreg_remove(struct ofono_atom *atom)
 	if (netreg->driver != NULL && netreg->driver->remove != NULL)
 		netreg->driver->remove(netreg);
 
+	netreg_cancel_limits(netreg);
+
 	sim_eons_free(netreg->eons);
 	sim_spdi_free(netreg->spdi);
+	g_hash_table_destroy(netreg->operators);
 
 	g_free(netreg);
 }
@@ -1908,6 +2141,11 @@ struct ofono_netreg *ofono_netreg_create(struct ofono_modem *modem,
 	netreg->cellid = -1;
 	netreg->technology = -1;
 	netreg->signal_strength = -1;
+	netreg->strength_interval = STRENGTH_MIN_INTERVAL;
+	netreg->strength_delta = STRENGTH_MIN_DELTA;
+	netreg->location_interval = LOCATION_MIN_INTERVAL;
+	netreg->operators = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
 
 	netreg->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_NETREG,
 						netreg_remove, netreg);
@@ -2018,6 +2256,7 @@ static void sim_spdi_changed(int id, void *userdata)
 
 	sim_spdi_free(netreg->spdi);
 	netreg->spdi = NULL;
+	reset_spdi_cache(netreg);
 
 	if (netreg->current_operator &&
 			netreg->status == NETWORK_REGISTRATION_STATUS_ROAMING)
@@ -2072,10 +2311,13 @@ fail:
 static void emulator_hfp_init(struct ofono_atom *atom, void *data)
 {
 	struct ofono_netreg *netreg = data;
+	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 
-	notify_emulator_status(atom, GINT_TO_POINTER(netreg->status));
-	notify_emulator_strength(atom,
-				GINT_TO_POINTER(netreg->signal_strength));
+	/* The new emulator is brought up to date from the modem snapshot */
+	notify_emulator_status(modem, netreg->status);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_SIGNAL,
+				emulator_signal(netreg->signal_strength),
+				FALSE);
 
 	ofono_emulator_add_handler(atom, "+COPS", emulator_cops_cb, data, NULL);
 }
@@ -27,6 +27,9 @@
 
 void __ofono_exit(void);
 
+void __ofono_startup_mark(const char *format, ...)
+				__attribute__((format(printf, 1, 2)));
+
 int __ofono_manager_init(void);
 void __ofono_manager_cleanup(void);
 
@@ -42,11 +45,33 @@ int __ofono_log_init(const char *program, const char *debug,
 void __ofono_log_cleanup(void);
 void __ofono_log_enable(struct ofono_debug_desc *start,
 					struct ofono_debug_desc *stop);
+int __ofono_log_trace_init(const char *trace);
+unsigned int __ofono_log_set_flags(const char *pattern, unsigned int flags,
+					ofono_bool_t enable);
+
+typedef void (*ofono_trace_dump_cb_t)(gint64 time, const char *line,
+					void *data);
+
+int __ofono_trace_init(unsigned int size);
+void __ofono_trace_cleanup(void);
+void __ofono_trace_vrecord(const char *format, va_list ap);
+void __ofono_trace_record(const char *format, ...)
+				__attribute__((format(printf, 1, 2)));
+int __ofono_trace_dump(ofono_trace_dump_cb_t cb, void *data);
+int __ofono_trace_set_drain(ofono_bool_t enable);
+
+int __ofono_debug_init(void);
+void __ofono_debug_cleanup(void);
 
 #include <ofono/dbus.h>
 
 int __ofono_dbus_init(DBusConnection *conn);
 void __ofono_dbus_cleanup(void);
+void __ofono_dbus_set_property_batching(ofono_bool_t enable);
+ofono_bool_t __ofono_dbus_get_property_batching(unsigned int *changes,
+						unsigned int *superseded,
+						unsigned int *signals,
+						unsigned int *failed);
 
 DBusMessage *__ofono_error_invalid_args(DBusMessage *msg);
 DBusMessage *__ofono_error_invalid_format(DBusMessage *msg);
@@ -85,12 +110,27 @@ struct ofono_watchlist_item {
 	ofono_destroy_func destroy;
 };
 
+/*
+ * Items live in a slot array ordered by insertion and are looked up by id
+ * through the index.  Removals during a walk only clear the slot, the
+ * array is compacted once the outermost walk has finished.
+ */
 struct ofono_watchlist {
 	int next_id;
-	GSList *items;
+	struct ofono_watchlist_item **slots;
+	unsigned int n_slots;
+	unsigned int alloc;
+	unsigned int holes;
+	unsigned int walking;
+	GHashTable *index;
 	ofono_destroy_func destroy;
 };
 
+struct ofono_watchlist_iter {
+	struct ofono_watchlist *watchlist;
+	unsigned int pos;
+};
+
 struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy);
 unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item);
@@ -98,9 +138,16 @@ gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id);
 void __ofono_watchlist_free(struct ofono_watchlist *watchlist);
 
+void __ofono_watchlist_iter_init(struct ofono_watchlist *watchlist,
+					struct ofono_watchlist_iter *iter);
+struct ofono_watchlist_item *__ofono_watchlist_iter_next(
+					struct ofono_watchlist_iter *iter);
+void __ofono_watchlist_iter_end(struct ofono_watchlist_iter *iter);
+
 #include <ofono/plugin.h>
 
 int __ofono_plugin_init(const char *pattern, const char *exclude);
+void __ofono_plugin_init_lazy(void);
 void __ofono_plugin_cleanup(void);
 
 #include <ofono/modem.h>
@@ -154,6 +201,9 @@ enum ofono_atom_type {
 	OFONO_ATOM_TYPE_SIRI,
 };
 
+/* Number of atom types, keep in sync with the last entry above */
+#define OFONO_ATOM_TYPE_COUNT (OFONO_ATOM_TYPE_SIRI + 1)
+
 enum ofono_atom_watch_condition {
 	OFONO_ATOM_WATCH_CONDITION_REGISTERED,
 	OFONO_ATOM_WATCH_CONDITION_UNREGISTERED
@@ -513,8 +563,9 @@ enum ofono_emulator_slc_condition {
 	OFONO_EMULATOR_SLC_CONDITION_BIND,
 };
 
-void __ofono_emulator_set_indicator_forced(struct ofono_atom *atom,
-						const char *name, int value);
+void __ofono_emulator_update_indicator(struct ofono_modem *modem,
+					const char *name, int value,
+					ofono_bool_t forced);
 void __ofono_emulator_slc_condition(struct ofono_emulator *em,
 					enum ofono_emulator_slc_condition cond);
 
@@ -537,3 +588,19 @@ int __ofono_sim_mnclength_get_mnclength(const char *imsi);
 
 int __ofono_wakelock_init(void);
 void __ofono_wakelock_cleanup(void);
+
+struct rtnl_request;
+
+typedef void (*ofono_rtnl_cb_t)(int error, void *data);
+
+struct rtnl_request *__ofono_rtnl_request_new(const char *interface);
+void __ofono_rtnl_request_free(struct rtnl_request *req);
+int __ofono_rtnl_set_link(struct rtnl_request *req, ofono_bool_t up);
+int __ofono_rtnl_address(struct rtnl_request *req, ofono_bool_t add,
+				const char *address, unsigned char prefix_len);
+int __ofono_rtnl_host_route(struct rtnl_request *req, ofono_bool_t add,
+				const char *destination);
+unsigned int __ofono_rtnl_submit(struct rtnl_request *req,
+					ofono_rtnl_cb_t cb, void *data);
+void __ofono_rtnl_cancel(unsigned int id);
+void __ofono_rtnl_cleanup(void);
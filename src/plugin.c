@@ -30,10 +30,12 @@
 #include "ofono.h"
 
 static GSList *plugins = NULL;
+static gboolean lazy_pending = FALSE;
 
 struct ofono_plugin {
 	void *handle;
 	gboolean active;
+	gboolean pending;
 	struct ofono_plugin_desc *desc;
 };
 
@@ -99,6 +101,30 @@ static gboolean check_plugin(struct ofono_plugin_desc *desc,
 	return TRUE;
 }
 
+static void init_plugin(struct ofono_plugin *plugin)
+{
+	gint64 start;
+	unsigned int elapsed;
+	int err;
+
+	plugin->pending = FALSE;
+
+	start = g_get_monotonic_time();
+	err = plugin->desc->init();
+	elapsed = g_get_monotonic_time() - start;
+
+	DBG("%s %s in %u us", plugin->desc->name,
+			err < 0 ? "failed" : "initialized", elapsed);
+
+	__ofono_startup_mark("plugin %s %s in %u us", plugin->desc->name,
+			err < 0 ? "failed" : "initialized", elapsed);
+
+	if (err < 0)
+		return;
+
+	plugin->active = TRUE;
+}
+
 #include "builtin.h"
 
 int __ofono_plugin_init(const char *pattern, const char *exclude)
@@ -172,10 +198,14 @@ int __ofono_plugin_init(const char *pattern, const char *exclude)
 	for (list = plugins; list; list = list->next) {
 		struct ofono_plugin *plugin = list->data;
 
-		if (plugin->desc->init() < 0)
+		if (plugin->desc->flags & OFONO_PLUGIN_FLAG_LAZY) {
+			DBG("%s deferred", plugin->desc->name);
+			plugin->pending = TRUE;
+			lazy_pending = TRUE;
 			continue;
+		}
 
-		plugin->active = TRUE;
+		init_plugin(plugin);
 	}
 
 	g_strfreev(patterns);
@@ -184,6 +214,25 @@ int __ofono_plugin_init(const char *pattern, const char *exclude)
 	return 0;
 }
 
+void __ofono_plugin_init_lazy(void)
+{
+	GSList *list;
+
+	if (lazy_pending == FALSE)
+		return;
+
+	DBG("");
+
+	lazy_pending = FALSE;
+
+	for (list = plugins; list; list = list->next) {
+		struct ofono_plugin *plugin = list->data;
+
+		if (plugin->pending == TRUE)
+			init_plugin(plugin);
+	}
+}
+
 void __ofono_plugin_cleanup(void)
 {
 	GSList *list;
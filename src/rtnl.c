@@ -0,0 +1,514 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+/*
+ * Interface configuration goes through a single rtnetlink socket that
+ * stays open for the lifetime of the daemon.  All changes belonging to
+ * a request are sent in one go and the kernel processes them in order,
+ * acknowledging each one.  The request completes on the main loop once
+ * every acknowledgement has arrived.
+ */
+
+#define RTNL_REQUEST_SIZE 1024
+#define RTNL_REQUEST_MAX_MSGS 8
+#define RTNL_RECV_SIZE 8192
+
+struct rtnl_request {
+	unsigned int id;
+	int ifindex;
+	unsigned char buf[RTNL_REQUEST_SIZE];
+	size_t len;
+	int ignore[RTNL_REQUEST_MAX_MSGS];	/* errno that is no failure */
+	unsigned int msgs;
+	guint32 seq;
+	unsigned int acked;
+	int error;
+	ofono_rtnl_cb_t cb;
+	void *data;
+};
+
+static int rtnl_fd = -1;
+static guint rtnl_watch;
+static GSList *pending;
+static guint32 rtnl_seq;
+static unsigned int next_id;
+
+static struct rtnl_request *find_request(guint32 seq)
+{
+	GSList *l;
+
+	for (l = pending; l; l = l->next) {
+		struct rtnl_request *req = l->data;
+
+		if (seq - req->seq < req->msgs)
+			return req;
+	}
+
+	return NULL;
+}
+
+static void request_ack(struct rtnl_request *req, guint32 seq, int error)
+{
+	unsigned int index = seq - req->seq;
+
+	if (error != 0 && error != req->ignore[index]) {
+		DBG("message %u of request %u failed: %s", index, req->id,
+							strerror(error));
+
+		if (req->error == 0)
+			req->error = -error;
+	}
+
+	req->acked += 1;
+
+	if (req->acked < req->msgs)
+		return;
+
+	pending = g_slist_remove(pending, req);
+
+	if (req->cb)
+		req->cb(req->error, req->data);
+
+	g_free(req);
+}
+
+static void parse_messages(const unsigned char *buf, size_t len)
+{
+	const struct nlmsghdr *hdr;
+
+	for (hdr = (const void *) buf; NLMSG_OK(hdr, len);
+					hdr = NLMSG_NEXT(hdr, len)) {
+		const struct nlmsgerr *err;
+		struct rtnl_request *req;
+
+		if (hdr->nlmsg_type != NLMSG_ERROR)
+			continue;
+
+		if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+			continue;
+
+		/* Requests that were cancelled are no longer found */
+		req = find_request(hdr->nlmsg_seq);
+		if (req == NULL)
+			continue;
+
+		err = NLMSG_DATA(hdr);
+		request_ack(req, hdr->nlmsg_seq, -err->error);
+	}
+}
+
+static void rtnl_close(void)
+{
+	if (rtnl_watch > 0) {
+		g_source_remove(rtnl_watch);
+		rtnl_watch = 0;
+	}
+
+	if (rtnl_fd >= 0) {
+		close(rtnl_fd);
+		rtnl_fd = -1;
+	}
+}
+
+static void fail_pending(int error)
+{
+	while (pending) {
+		struct rtnl_request *req = pending->data;
+
+		pending = g_slist_delete_link(pending, pending);
+
+		if (req->cb)
+			req->cb(error, req->data);
+
+		g_free(req);
+	}
+}
+
+static gboolean rtnl_event(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	unsigned char buf[RTNL_RECV_SIZE];
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		goto error;
+
+	while ((len = recv(rtnl_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+		parse_messages(buf, len);
+
+	if (len == 0 || (errno != EAGAIN && errno != EINTR))
+		goto error;
+
+	return TRUE;
+
+error:
+	ofono_error("rtnetlink socket failed");
+
+	rtnl_watch = 0;
+	rtnl_close();
+	fail_pending(-EIO);
+
+	return FALSE;
+}
+
+static int rtnl_open(void)
+{
+	struct sockaddr_nl addr;
+	GIOChannel *channel;
+
+	if (rtnl_fd >= 0)
+		return 0;
+
+	rtnl_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+							NETLINK_ROUTE);
+	if (rtnl_fd < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if (bind(rtnl_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		int err = -errno;
+
+		close(rtnl_fd);
+		rtnl_fd = -1;
+		return err;
+	}
+
+	channel = g_io_channel_unix_new(rtnl_fd);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+
+	rtnl_watch = g_io_add_watch(channel,
+				G_IO_IN | G_IO_NVAL | G_IO_HUP | G_IO_ERR,
+				rtnl_event, NULL);
+
+	g_io_channel_unref(channel);
+
+	return 0;
+}
+
+static struct nlmsghdr *request_message(struct rtnl_request *req,
+					guint16 type, guint16 flags,
+					const void *body, size_t size,
+					int ignore)
+{
+	struct nlmsghdr *hdr;
+	size_t len = NLMSG_LENGTH(size);
+
+	if (req->msgs == RTNL_REQUEST_MAX_MSGS ||
+			req->len + NLMSG_ALIGN(len) > sizeof(req->buf))
+		return NULL;
+
+	hdr = (struct nlmsghdr *) (req->buf + req->len);
+	memset(hdr, 0, NLMSG_ALIGN(len));
+
+	hdr->nlmsg_len = len;
+	hdr->nlmsg_type = type;
+	hdr->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	memcpy(NLMSG_DATA(hdr), body, size);
+
+	req->ignore[req->msgs] = ignore;
+	req->msgs += 1;
+	req->len += NLMSG_ALIGN(len);
+
+	return hdr;
+}
+
+static gboolean request_attr(struct rtnl_request *req, struct nlmsghdr *hdr,
+				unsigned short type, const void *data,
+				size_t size)
+{
+	struct rtattr *rta;
+	size_t len = RTA_LENGTH(size);
+
+	if (req->len + RTA_ALIGN(len) > sizeof(req->buf))
+		return FALSE;
+
+	rta = (struct rtattr *) (req->buf + req->len);
+	rta->rta_type = type;
+	rta->rta_len = len;
+	memcpy(RTA_DATA(rta), data, size);
+
+	hdr->nlmsg_len = NLMSG_ALIGN(hdr->nlmsg_len) + RTA_ALIGN(len);
+	req->len += RTA_ALIGN(len);
+
+	return TRUE;
+}
+
+/* Drops the last message again if its attributes did not fit */
+static int request_abort_message(struct rtnl_request *req,
+					struct nlmsghdr *hdr)
+{
+	req->len = (unsigned char *) hdr - req->buf;
+	req->msgs -= 1;
+
+	return -ENOSPC;
+}
+
+static int parse_address(const char *address, int *family, void *addr)
+{
+	if (inet_pton(AF_INET, address, addr) == 1) {
+		*family = AF_INET;
+		return sizeof(struct in_addr);
+	}
+
+	if (inet_pton(AF_INET6, address, addr) == 1) {
+		*family = AF_INET6;
+		return sizeof(struct in6_addr);
+	}
+
+	return -EINVAL;
+}
+
+struct rtnl_request *__ofono_rtnl_request_new(const char *interface)
+{
+	struct rtnl_request *req;
+	int ifindex;
+
+	if (interface == NULL)
+		return NULL;
+
+	ifindex = if_nametoindex(interface);
+	if (ifindex == 0) {
+		DBG("no such interface %s", interface);
+		return NULL;
+	}
+
+	req = g_new0(struct rtnl_request, 1);
+	req->ifindex = ifindex;
+
+	return req;
+}
+
+void __ofono_rtnl_request_free(struct rtnl_request *req)
+{
+	g_free(req);
+}
+
+int __ofono_rtnl_set_link(struct rtnl_request *req, ofono_bool_t up)
+{
+	struct ifinfomsg ifi;
+
+	if (req == NULL)
+		return -EINVAL;
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = req->ifindex;
+	ifi.ifi_flags = up ? IFF_UP : 0;
+	ifi.ifi_change = IFF_UP;
+
+	if (request_message(req, RTM_NEWLINK, 0, &ifi, sizeof(ifi),
+					up ? 0 : ENODEV) == NULL)
+		return -ENOSPC;
+
+	return 0;
+}
+
+int __ofono_rtnl_address(struct rtnl_request *req, ofono_bool_t add,
+				const char *address, unsigned char prefix_len)
+{
+	unsigned char addr[sizeof(struct in6_addr)];
+	struct ifaddrmsg ifa;
+	struct nlmsghdr *hdr;
+	int family;
+	int size;
+
+	if (req == NULL || address == NULL)
+		return -EINVAL;
+
+	size = parse_address(address, &family, addr);
+	if (size < 0)
+		return size;
+
+	if (prefix_len == 0 || prefix_len > size * 8)
+		prefix_len = size * 8;
+
+	memset(&ifa, 0, sizeof(ifa));
+	ifa.ifa_family = family;
+	ifa.ifa_prefixlen = prefix_len;
+	ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+	ifa.ifa_index = req->ifindex;
+
+	/* The network assigned the address, no point in waiting for DAD */
+	if (family == AF_INET6)
+		ifa.ifa_flags = IFA_F_NODAD;
+
+	if (add)
+		hdr = request_message(req, RTM_NEWADDR,
+					NLM_F_CREATE | NLM_F_REPLACE,
+					&ifa, sizeof(ifa), 0);
+	else
+		hdr = request_message(req, RTM_DELADDR, 0, &ifa, sizeof(ifa),
+					EADDRNOTAVAIL);
+
+	if (hdr == NULL)
+		return -ENOSPC;
+
+	if (!request_attr(req, hdr, IFA_LOCAL, addr, size) ||
+			!request_attr(req, hdr, IFA_ADDRESS, addr, size))
+		return request_abort_message(req, hdr);
+
+	return 0;
+}
+
+int __ofono_rtnl_host_route(struct rtnl_request *req, ofono_bool_t add,
+				const char *destination)
+{
+	unsigned char addr[sizeof(struct in6_addr)];
+	guint32 oif;
+	struct rtmsg rtm;
+	struct nlmsghdr *hdr;
+	int family;
+	int size;
+
+	if (req == NULL || destination == NULL)
+		return -EINVAL;
+
+	size = parse_address(destination, &family, addr);
+	if (size < 0)
+		return size;
+
+	memset(&rtm, 0, sizeof(rtm));
+	rtm.rtm_family = family;
+	rtm.rtm_dst_len = size * 8;
+	rtm.rtm_table = RT_TABLE_MAIN;
+	rtm.rtm_protocol = RTPROT_BOOT;
+	rtm.rtm_type = RTN_UNICAST;
+
+	if (add) {
+		rtm.rtm_scope = RT_SCOPE_LINK;
+		hdr = request_message(req, RTM_NEWROUTE,
+					NLM_F_CREATE | NLM_F_REPLACE,
+					&rtm, sizeof(rtm), 0);
+	} else {
+		rtm.rtm_scope = RT_SCOPE_NOWHERE;
+		hdr = request_message(req, RTM_DELROUTE, 0,
+					&rtm, sizeof(rtm), ESRCH);
+	}
+
+	if (hdr == NULL)
+		return -ENOSPC;
+
+	oif = req->ifindex;
+
+	if (!request_attr(req, hdr, RTA_DST, addr, size) ||
+			!request_attr(req, hdr, RTA_OIF, &oif, sizeof(oif)))
+		return request_abort_message(req, hdr);
+
+	return 0;
+}
+
+/*
+ * Sends all changes of the request at once, cb is called with the first
+ * error that occurred once the kernel has processed all of them.  The
+ * request is consumed.  Returns 0 if the request could not be sent, cb
+ * is not called in that case.
+ */
+unsigned int __ofono_rtnl_submit(struct rtnl_request *req,
+					ofono_rtnl_cb_t cb, void *data)
+{
+	struct sockaddr_nl addr;
+	size_t offset;
+	unsigned int i;
+
+	if (req == NULL)
+		return 0;
+
+	if (req->msgs == 0 || rtnl_open() < 0)
+		goto error;
+
+	req->seq = ++rtnl_seq;
+	rtnl_seq += req->msgs - 1;
+
+	for (i = 0, offset = 0; i < req->msgs; i++) {
+		struct nlmsghdr *hdr = (void *) (req->buf + offset);
+
+		hdr->nlmsg_seq = req->seq + i;
+		offset += NLMSG_ALIGN(hdr->nlmsg_len);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if (sendto(rtnl_fd, req->buf, req->len, 0,
+			(struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		ofono_error("rtnetlink send failed: %s (%d)",
+						strerror(errno), errno);
+		goto error;
+	}
+
+	if (++next_id == 0)
+		next_id = 1;
+
+	req->id = next_id;
+	req->cb = cb;
+	req->data = data;
+
+	pending = g_slist_append(pending, req);
+
+	return req->id;
+
+error:
+	g_free(req);
+	return 0;
+}
+
+/* The changes still happen, only the callback is no longer called */
+void __ofono_rtnl_cancel(unsigned int id)
+{
+	GSList *l;
+
+	for (l = pending; l; l = l->next) {
+		struct rtnl_request *req = l->data;
+
+		if (req->id != id)
+			continue;
+
+		req->cb = NULL;
+		return;
+	}
+}
+
+void __ofono_rtnl_cleanup(void)
+{
+	rtnl_close();
+
+	g_slist_free_full(pending, g_free);
+	pending = NULL;
+}
@@ -329,15 +329,19 @@ static void service_number_free(struct service_number *num)
 
 static void call_state_watches(struct ofono_sim *sim)
 {
-	GSList *l;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 	ofono_sim_state_event_cb_t notify;
 
-	for (l = sim->state_watches->items; l; l = l->next) {
-		struct ofono_watchlist_item *item = l->data;
+	__ofono_watchlist_iter_init(sim->state_watches, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 
 		notify(sim->state, item->notify_data);
 	}
+
+	__ofono_watchlist_iter_end(&iter);
 }
 
 static DBusMessage *sim_get_properties(DBusConnection *conn,
@@ -1124,6 +1128,8 @@ static const GDBusMethodTable sim_methods[] = {
 static const GDBusSignalTable sim_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -2577,20 +2583,21 @@ enum ofono_sim_state ofono_sim_get_state(struct ofono_sim *sim)
 	return sim->state;
 }
 
-static void spn_watch_cb(gpointer data, gpointer user_data)
+static inline void spn_watches_notify(struct ofono_sim *sim)
 {
-	struct ofono_watchlist_item *item = data;
-	struct ofono_sim *sim = user_data;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+
+	__ofono_watchlist_iter_init(sim->spn_watches, &iter);
 
-	if (item->notify)
-		((ofono_sim_spn_cb_t) item->notify)(sim->spn, sim->spn_dc,
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		if (item->notify)
+			((ofono_sim_spn_cb_t) item->notify)(sim->spn,
+							sim->spn_dc,
 							item->notify_data);
-}
+	}
 
-static inline void spn_watches_notify(struct ofono_sim *sim)
-{
-	if (sim->spn_watches->items)
-		g_slist_foreach(sim->spn_watches->items, spn_watch_cb, sim);
+	__ofono_watchlist_iter_end(&iter);
 
 	sim->flags &= ~SIM_FLAG_READING_SPN;
 }
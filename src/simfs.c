@@ -224,15 +224,20 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 	for (l = fs->contexts; l; l = l->next) {
 		struct ofono_sim_context *context = l->data;
-		GSList *k;
+		struct ofono_watchlist_iter iter;
+		struct ofono_watchlist_item *item;
 
-		for (k = context->file_watches->items; k; k = k->next) {
-			struct file_watch *w = k->data;
+		__ofono_watchlist_iter_init(context->file_watches, &iter);
+
+		while ((item = __ofono_watchlist_iter_next(&iter))) {
+			struct file_watch *w = (struct file_watch *) item;
 			ofono_sim_file_changed_cb_t notify = w->item.notify;
 
 			if (id == -1 || w->ef == id)
 				notify(w->ef, w->item.notify_data);
 		}
+
+		__ofono_watchlist_iter_end(&iter);
 	}
 
 }
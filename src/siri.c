@@ -211,6 +211,8 @@ static const GDBusMethodTable siri_methods[] = {
 static const GDBusSignalTable siri_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s"}, { "value", "v"})) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
@@ -42,12 +42,20 @@
 #define uninitialized_var(x) x = x
 
 #define MESSAGE_MANAGER_FLAG_CACHED 0x1
-#define MESSAGE_MANAGER_FLAG_TXQ_ACTIVE 0x2
 
 #define SETTINGS_STORE "sms"
 #define SETTINGS_GROUP "Settings"
 
 #define TXQ_MAX_RETRIES 4
+#define TXQ_MAX_RETRY_DELAY 60
+#define TXQ_MAX_PENDING_SUBMITS 8
+
+/* 3GPP 24.011 RP cause and 27.005 CMS error values */
+#define NETWORK_OUT_OF_ORDER 38
+#define TEMPORARY_FAILURE 41
+#define CONGESTION 42
+#define RESOURCES_UNAVAILABLE 47
+#define NO_NETWORK_SERVICE 331
 #define NETWORK_TIMEOUT 332
 
 static gboolean tx_next(gpointer user_data);
@@ -60,6 +68,17 @@ struct sms_handler {
 	int src;
 };
 
+struct tx_queue_stats {
+	unsigned int sent;
+	unsigned int failed;
+	unsigned int retries;
+	guint64 queue_time;	/* usecs, summed over sent messages */
+	guint64 queue_time_max;
+	unsigned int submits;
+	guint64 submit_latency;	/* usecs, summed over all submits */
+	guint64 submit_latency_max;
+};
+
 struct ofono_sms {
 	int flags;
 	DBusMessage *pending;
@@ -69,6 +88,10 @@ struct ofono_sms {
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	struct tx_queue_entry *tx_backoff;	/* entry owning the backoff */
+	unsigned int tx_pending;
+	unsigned int tx_max_pending;
+	struct tx_queue_stats tx_stats;
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
@@ -96,9 +119,11 @@ struct pending_pdu {
 };
 
 struct tx_queue_entry {
+	struct ofono_sms *sms;
 	struct pending_pdu *pdus;
 	unsigned char num_pdus;
 	unsigned char cur_pdu;
+	gboolean in_flight;
 	struct sms_address receiver;
 	struct ofono_uuid uuid;
 	unsigned int retry;
@@ -107,6 +132,30 @@ struct tx_queue_entry {
 	void *data;
 	ofono_destroy_func destroy;
 	unsigned long id;
+	gint64 queued;
+	gint64 submitted;
+};
+
+/*
+ * Which failures are worth retrying, how many times, and how long to
+ * wait before the first retry.  The delay doubles with every attempt
+ * up to TXQ_MAX_RETRY_DELAY.  CMS errors not listed are permanent, a
+ * cms of -1 matches any other kind of failure.
+ */
+struct tx_retry_policy {
+	int cms;
+	unsigned int retries;
+	unsigned int delay;
+};
+
+static const struct tx_retry_policy tx_retry_policies[] = {
+	{ NETWORK_TIMEOUT,		TXQ_MAX_RETRIES,	5 },
+	{ TEMPORARY_FAILURE,		TXQ_MAX_RETRIES,	10 },
+	{ CONGESTION,			TXQ_MAX_RETRIES,	10 },
+	{ RESOURCES_UNAVAILABLE,	TXQ_MAX_RETRIES,	10 },
+	{ NETWORK_OUT_OF_ORDER,		TXQ_MAX_RETRIES,	30 },
+	{ NO_NETWORK_SERVICE,		TXQ_MAX_RETRIES,	30 },
+	{ -1,				TXQ_MAX_RETRIES,	5 },
 };
 
 static gboolean uuid_equal(gconstpointer v1, gconstpointer v2)
@@ -623,8 +672,22 @@ static void sms_tx_queue_remove_entry(struct ofono_sms *sms, GList *entry_list,
 
 	g_queue_delete_link(sms->txq, entry_list);
 
+	if (sms->tx_backoff == entry)
+		sms->tx_backoff = NULL;
+
 	DBG("%p", entry);
 
+	if (tx_state == MESSAGE_STATE_SENT) {
+		gint64 queue_time = g_get_monotonic_time() - entry->queued;
+
+		sms->tx_stats.sent += 1;
+		sms->tx_stats.queue_time += queue_time;
+
+		if (queue_time > (gint64) sms->tx_stats.queue_time_max)
+			sms->tx_stats.queue_time_max = queue_time;
+	} else if (tx_state == MESSAGE_STATE_FAILED)
+		sms->tx_stats.failed += 1;
+
 	if (entry->cb)
 		entry->cb(tx_state == MESSAGE_STATE_SENT, entry->data);
 
@@ -671,18 +734,62 @@ done:
 	tx_queue_entry_destroy(entry);
 }
 
+static const struct tx_retry_policy *tx_retry_policy_find(
+					const struct ofono_error *error)
+{
+	int cms = error->type == OFONO_ERROR_TYPE_CMS ? error->error : -1;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(tx_retry_policies); i++)
+		if (tx_retry_policies[i].cms == cms)
+			return &tx_retry_policies[i];
+
+	return NULL;
+}
+
+/*
+ * Arrange for tx_next() to run if there is anything it could submit.
+ * A pending tx_source is either already that or a retry backoff, in
+ * which case nothing new is submitted until it expires.
+ */
+static void tx_schedule(struct ofono_sms *sms)
+{
+	if (sms->registered == FALSE || sms->tx_source > 0)
+		return;
+
+	if (sms->tx_pending >= sms->tx_max_pending)
+		return;
+
+	/* Each entry has at most one submit in flight */
+	if (g_queue_get_length(sms->txq) <= sms->tx_pending)
+		return;
+
+	sms->tx_source = g_timeout_add(0, tx_next, sms);
+}
+
 static void tx_finished(const struct ofono_error *error, int mr, void *data)
 {
-	struct ofono_sms *sms = data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_queue_entry *entry = data;
+	struct ofono_sms *sms = entry->sms;
 	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
+	const struct tx_retry_policy *policy;
 	enum message_state tx_state;
+	gint64 latency = g_get_monotonic_time() - entry->submitted;
 
 	DBG("tx_finished %p", entry);
 
-	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	entry->in_flight = FALSE;
+	sms->tx_pending -= 1;
+
+	sms->tx_stats.submits += 1;
+	sms->tx_stats.submit_latency += latency;
+
+	if (latency > (gint64) sms->tx_stats.submit_latency_max)
+		sms->tx_stats.submit_latency_max = latency;
 
 	if (ok == FALSE) {
+		unsigned int delay;
+
 		/* Retry again when back in online mode */
 		/* Note this does not increment retry count */
 		if (sms->registered == FALSE)
@@ -690,26 +797,34 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 
 		tx_state = MESSAGE_STATE_FAILED;
 
-		/* Retry done only for Network Timeout failure */
-		if (error->type == OFONO_ERROR_TYPE_CMS &&
-				error->error != NETWORK_TIMEOUT)
+		if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_RETRY))
 			goto next_q;
 
-		if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_RETRY))
+		policy = tx_retry_policy_find(error);
+		if (policy == NULL)
 			goto next_q;
 
 		entry->retry += 1;
 
-		if (entry->retry < TXQ_MAX_RETRIES) {
-			DBG("Sending failed, retry in %d secs",
-					entry->retry * 5);
-			sms->tx_source = g_timeout_add_seconds(entry->retry * 5,
-								tx_next, sms);
-			return;
+		if (entry->retry >= policy->retries) {
+			DBG("Max retries reached, giving up");
+			goto next_q;
 		}
 
-		DBG("Max retries reached, giving up");
-		goto next_q;
+		delay = MIN(policy->delay << (entry->retry - 1),
+				TXQ_MAX_RETRY_DELAY);
+
+		DBG("Sending failed, retry in %u secs", delay);
+
+		sms->tx_stats.retries += 1;
+
+		/* Hold back the whole queue, not just this entry */
+		if (sms->tx_source)
+			g_source_remove(sms->tx_source);
+
+		sms->tx_source = g_timeout_add_seconds(delay, tx_next, sms);
+		sms->tx_backoff = entry;
+		return;
 	}
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS)
@@ -728,47 +843,66 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 							entry->num_pdus);
 
 	if (entry->cur_pdu < entry->num_pdus) {
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms);
 		return;
 	}
 
 	tx_state = MESSAGE_STATE_SENT;
 
 next_q:
-	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
+	sms_tx_queue_remove_entry(sms, g_queue_find(sms->txq, entry),
 					tx_state);
 
-	if (sms->registered == FALSE)
-		return;
-
-	if (g_queue_peek_head(sms->txq)) {
-		DBG("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
-	}
+	tx_schedule(sms);
 }
 
-static gboolean tx_next(gpointer user_data)
+static void tx_submit(struct ofono_sms *sms, struct tx_queue_entry *entry)
 {
-	struct ofono_sms *sms = user_data;
-	int send_mms = 0;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
 	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
+	int send_mms = 0;
 
-	DBG("tx_next: %p", entry);
-
-	sms->tx_source = 0;
-
-	if (sms->registered == FALSE)
-		return FALSE;
+	DBG("tx_submit: %p", entry);
 
 	if (g_queue_get_length(sms->txq) > 1
 			|| (entry->num_pdus - entry->cur_pdu) > 1)
 		send_mms = 1;
 
-	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	entry->in_flight = TRUE;
+	entry->submitted = g_get_monotonic_time();
+	sms->tx_pending += 1;
 
 	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-				send_mms, tx_finished, sms);
+				send_mms, tx_finished, entry);
+}
+
+/*
+ * Submits the next PDU of every queued entry that is not already
+ * waiting for one, oldest first, until the driver's limit of pending
+ * submits is reached.  PDUs of a single entry always go out in order.
+ */
+static gboolean tx_next(gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	GList *l = g_queue_peek_head_link(sms->txq);
+
+	DBG("tx_next: %p", l ? l->data : NULL);
+
+	sms->tx_source = 0;
+	sms->tx_backoff = NULL;
+
+	/*
+	 * The driver may complete a submit before returning, which can
+	 * drop the entry or start a retry backoff.
+	 */
+	while (l && sms->registered && sms->tx_source == 0 &&
+			sms->tx_pending < sms->tx_max_pending) {
+		struct tx_queue_entry *entry = l->data;
+
+		l = l->next;
+
+		if (entry->in_flight == FALSE)
+			tx_submit(sms, entry);
+	}
 
 	return FALSE;
 }
@@ -789,17 +923,7 @@ static void netreg_status_watch(int status, int lac, int ci, int tech,
 		break;
 	}
 
-	if (sms->registered == FALSE)
-		return;
-
-	if (sms->tx_source > 0)
-		return;
-
-	if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-		return;
-
-	if (g_queue_get_length(sms->txq))
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	tx_schedule(sms);
 }
 
 static void netreg_watch(struct ofono_atom *atom,
@@ -866,7 +990,8 @@ static gboolean sms_uuid_from_pdus(const struct pending_pdu *pdu,
 	return TRUE;
 }
 
-static struct tx_queue_entry *tx_queue_entry_new(GSList *msg_list,
+static struct tx_queue_entry *tx_queue_entry_new(struct ofono_sms *sms,
+							GSList *msg_list,
 							unsigned int flags)
 {
 	struct tx_queue_entry *entry;
@@ -890,7 +1015,9 @@ static struct tx_queue_entry *tx_queue_entry_new(GSList *msg_list,
 				sizeof(entry->receiver));
 	}
 
+	entry->sms = sms;
 	entry->flags = flags;
+	entry->queued = g_get_monotonic_time();
 
 	for (l = msg_list; l; l = l->next) {
 		struct pending_pdu *pdu = &entry->pdus[i++];
@@ -1057,6 +1184,67 @@ static DBusMessage *sms_get_messages(DBusConnection *conn, DBusMessage *msg,
 	return reply;
 }
 
+static dbus_uint32_t usecs_to_msecs(guint64 usecs)
+{
+	return MIN(usecs / 1000, G_MAXUINT32);
+}
+
+static DBusMessage *sms_get_queue_statistics(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_sms *sms = data;
+	struct tx_queue_stats *stats = &sms->tx_stats;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_uint32_t value;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = g_queue_get_length(sms->txq);
+	ofono_dbus_dict_append(&dict, "QueueLength", DBUS_TYPE_UINT32, &value);
+
+	ofono_dbus_dict_append(&dict, "PendingSubmits", DBUS_TYPE_UINT32,
+				&sms->tx_pending);
+	ofono_dbus_dict_append(&dict, "MaximumPendingSubmits",
+				DBUS_TYPE_UINT32, &sms->tx_max_pending);
+	ofono_dbus_dict_append(&dict, "SentMessages", DBUS_TYPE_UINT32,
+				&stats->sent);
+	ofono_dbus_dict_append(&dict, "FailedMessages", DBUS_TYPE_UINT32,
+				&stats->failed);
+	ofono_dbus_dict_append(&dict, "Retries", DBUS_TYPE_UINT32,
+				&stats->retries);
+
+	value = stats->sent ? usecs_to_msecs(stats->queue_time / stats->sent)
+				: 0;
+	ofono_dbus_dict_append(&dict, "AverageQueueTime", DBUS_TYPE_UINT32,
+				&value);
+
+	value = usecs_to_msecs(stats->queue_time_max);
+	ofono_dbus_dict_append(&dict, "MaximumQueueTime", DBUS_TYPE_UINT32,
+				&value);
+
+	value = stats->submits ?
+		usecs_to_msecs(stats->submit_latency / stats->submits) : 0;
+	ofono_dbus_dict_append(&dict, "AverageSubmitLatency",
+				DBUS_TYPE_UINT32, &value);
+
+	value = usecs_to_msecs(stats->submit_latency_max);
+	ofono_dbus_dict_append(&dict, "MaximumSubmitLatency",
+				DBUS_TYPE_UINT32, &value);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static gint entry_compare_by_uuid(gconstpointer a, gconstpointer b)
 {
 	const struct tx_queue_entry *entry = a;
@@ -1077,31 +1265,25 @@ int __ofono_sms_txq_cancel(struct ofono_sms *sms, const struct ofono_uuid *uuid)
 
 	entry = l->data;
 
-	if (entry == g_queue_peek_head(sms->txq)) {
-		/*
-		 * Fail if any pdu was already transmitted or if we are
-		 * waiting the answer from driver.
-		 */
-		if (entry->cur_pdu > 0)
-			return -EPERM;
-
-		if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-			return -EPERM;
-		/*
-		 * Make sure we don't call tx_next() if there are no entries
-		 * and that next entry doesn't have to wait a 'retry time'
-		 * from this one.
-		 */
-		if (sms->tx_source) {
-			g_source_remove(sms->tx_source);
-			sms->tx_source = 0;
+	/*
+	 * Fail if any pdu was already transmitted or if we are waiting
+	 * the answer from driver.
+	 */
+	if (entry->cur_pdu > 0 || entry->in_flight)
+		return -EPERM;
 
-			if (g_queue_get_length(sms->txq) > 1)
-				sms->tx_source = g_timeout_add(0, tx_next, sms);
-		}
+	/*
+	 * Make sure the next entry doesn't have to wait a 'retry time'
+	 * from this one.  A backoff armed for another entry stays.
+	 */
+	if (sms->tx_backoff == entry) {
+		g_source_remove(sms->tx_source);
+		sms->tx_source = 0;
+		sms->tx_backoff = NULL;
 	}
 
 	sms_tx_queue_remove_entry(sms, l, MESSAGE_STATE_CANCELLED);
+	tx_schedule(sms);
 
 	return 0;
 }
@@ -1120,12 +1302,17 @@ static const GDBusMethodTable sms_manager_methods[] = {
 	{ GDBUS_METHOD("GetMessages",
 			NULL, GDBUS_ARGS({ "messages", "a(oa{sv})" }),
 			sms_get_messages) },
+	{ GDBUS_METHOD("GetQueueStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			sms_get_queue_statistics) },
 	{ }
 };
 
 static const GDBusSignalTable sms_manager_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("IncomingMessage",
 			GDBUS_ARGS({ "message", "s" }, { "info", "a{sv}" })) },
 	{ GDBUS_SIGNAL("ImmediateMessage",
@@ -1182,15 +1369,17 @@ static void dispatch_app_datagram(struct ofono_sms *sms,
 	struct tm local;
 
 	ofono_sms_datagram_notify_cb_t notify;
+	struct ofono_watchlist_iter iter;
 	struct sms_handler *h;
-	GSList *l;
 	gboolean dispatched = FALSE;
 
 	ts = sms_scts_to_time(scts, &remote);
 	localtime_r(&ts, &local);
 
-	for (l = sms->datagram_handlers->items; l; l = l->next) {
-		h = l->data;
+	__ofono_watchlist_iter_init(sms->datagram_handlers, &iter);
+
+	while ((h = (struct sms_handler *)
+				__ofono_watchlist_iter_next(&iter))) {
 		notify = h->item.notify;
 
 		if (!port_equal(dst, h->dst) || !port_equal(src, h->src))
@@ -1202,6 +1391,8 @@ static void dispatch_app_datagram(struct ofono_sms *sms,
 			h->item.notify_data);
 	}
 
+	__ofono_watchlist_iter_end(&iter);
+
 	if (!dispatched)
 		ofono_info("Datagram with ports [%d,%d] not delivered",
 								dst, src);
@@ -1227,8 +1418,8 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	struct tm local;
 	const char *str = buf;
 	ofono_sms_text_notify_cb_t notify;
+	struct ofono_watchlist_iter witer;
 	struct sms_handler *h;
-	GSList *l;
 
 	if (message == NULL)
 		return;
@@ -1273,13 +1464,17 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	if (cls == SMS_CLASS_0)
 		return;
 
-	for (l = sms->text_handlers->items; l; l = l->next) {
-		h = l->data;
+	__ofono_watchlist_iter_init(sms->text_handlers, &witer);
+
+	while ((h = (struct sms_handler *)
+				__ofono_watchlist_iter_next(&witer))) {
 		notify = h->item.notify;
 
 		notify(str, &remote, &local, message, h->item.notify_data);
 	}
 
+	__ofono_watchlist_iter_end(&witer);
+
 	__ofono_history_sms_received(modem, uuid, str, &remote, &local,
 					message);
 }
@@ -1734,6 +1929,7 @@ static void sms_remove(struct ofono_atom *atom)
 	if (sms->tx_source) {
 		g_source_remove(sms->tx_source);
 		sms->tx_source = 0;
+		sms->tx_backoff = NULL;
 	}
 
 	if (sms->assembly) {
@@ -1803,6 +1999,7 @@ struct ofono_sms *ofono_sms_create(struct ofono_modem *modem,
 	sms->sca.type = 129;
 	sms->ref = 1;
 	sms->txq = g_queue_new();
+	sms->tx_max_pending = 1;
 	sms->messages = g_hash_table_new(uuid_hash, uuid_equal);
 
 	sms->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_SMS,
@@ -1917,7 +2114,7 @@ static void sms_restore_tx_queue(struct ofono_sms *sms)
 		struct tx_queue_entry *txq_entry;
 
 		backup_entry->flags |= OFONO_SMS_SUBMIT_FLAG_REUSE_UUID;
-		txq_entry = tx_queue_entry_new(backup_entry->msg_list,
+		txq_entry = tx_queue_entry_new(sms, backup_entry->msg_list,
 							backup_entry->flags);
 		if (txq_entry == NULL)
 			goto loop_out;
@@ -1951,8 +2148,7 @@ loop_out:
 		g_free(backup_entry);
 	}
 
-	if (g_queue_get_length(sms->txq) > 0)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	tx_schedule(sms);
 
 	g_queue_free(backupq);
 }
@@ -2040,6 +2236,19 @@ void *ofono_sms_get_data(struct ofono_sms *sms)
 	return sms->driver_data;
 }
 
+/*
+ * Lets a driver that can handle several submits at once receive up
+ * to count of them before the first one completes.
+ */
+void ofono_sms_set_max_pending_submits(struct ofono_sms *sms,
+					unsigned int count)
+{
+	if (count == 0)
+		count = 1;
+
+	sms->tx_max_pending = MIN(count, TXQ_MAX_PENDING_SUBMITS);
+}
+
 unsigned short __ofono_sms_get_next_ref(struct ofono_sms *sms)
 {
 	return sms->ref;
@@ -2053,7 +2262,7 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 	struct message *m = NULL;
 	struct tx_queue_entry *entry;
 
-	entry = tx_queue_entry_new(list, flags);
+	entry = tx_queue_entry_new(sms, list, flags);
 	if (entry == NULL)
 		return -ENOMEM;
 
@@ -2081,8 +2290,7 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 
 	g_queue_push_tail(sms->txq, entry);
 
-	if (sms->registered && g_queue_get_length(sms->txq) == 1)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	tx_schedule(sms);
 
 	if (uuid)
 		memcpy(uuid, &entry->uuid, sizeof(*uuid));
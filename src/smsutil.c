@@ -4211,7 +4211,13 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 
 struct cbs_assembly *cbs_assembly_new(void)
 {
-	return g_new0(struct cbs_assembly, 1);
+	struct cbs_assembly *assembly = g_new0(struct cbs_assembly, 1);
+
+	assembly->assembly_index = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+	assembly->recv_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	return assembly;
 }
 
 void cbs_assembly_free(struct cbs_assembly *assembly)
@@ -4231,6 +4237,9 @@ void cbs_assembly_free(struct cbs_assembly *assembly)
 	g_slist_free(assembly->recv_loc);
 	g_slist_free(assembly->recv_cell);
 
+	g_hash_table_destroy(assembly->assembly_index);
+	g_hash_table_destroy(assembly->recv_index);
+
 	g_free(assembly);
 }
 
@@ -4259,15 +4268,22 @@ static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
+/*
+ * Received messages are indexed by serial without the update number, so
+ * that a lookup finds the last update of a message seen in a given scope.
+ */
+static inline gpointer cbs_recv_key(unsigned int serial)
 {
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
+	return GUINT_TO_POINTER(serial & (~0xf));
+}
 
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
+static gboolean cbs_recv_in_scopes(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	unsigned int gs = (GPOINTER_TO_UINT(key) >> 14) & 0x3;
+	unsigned int scopes = GPOINTER_TO_UINT(user_data);
 
-	return 1;
+	return (scopes & (1 << gs)) != 0;
 }
 
 static void cbs_assembly_expire(struct cbs_assembly *assembly,
@@ -4301,9 +4317,12 @@ static void cbs_assembly_expire(struct cbs_assembly *assembly,
 		else
 			assembly->assembly_list = l->next;
 
+		g_hash_table_remove(assembly->assembly_index,
+					GUINT_TO_POINTER(node->serial));
+
 		g_slist_foreach(node->pages, (GFunc) g_free, NULL);
 		g_slist_free(node->pages);
-		g_free(node->pages);
+		g_free(node);
 		tmp = l;
 		l = l->next;
 		g_slist_free_1(tmp);
@@ -4327,11 +4346,13 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 	 * NOTE 4: According to 3GPP TS 23.003 [2] a Service Area consists of
 	 * one cell only.
 	 */
+	unsigned int scopes = 0;
 
 	if (plmn) {
 		lac = TRUE;
 		g_slist_free(assembly->recv_plmn);
 		assembly->recv_plmn = NULL;
+		scopes |= 1 << CBS_GEO_SCOPE_PLMN;
 
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
@@ -4342,6 +4363,7 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 		ci = TRUE;
 		g_slist_free(assembly->recv_loc);
 		assembly->recv_loc = NULL;
+		scopes |= 1 << CBS_GEO_SCOPE_SERVICE_AREA;
 
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
@@ -4350,11 +4372,18 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 	if (ci) {
 		g_slist_free(assembly->recv_cell);
 		assembly->recv_cell = NULL;
+		scopes |= 1 << CBS_GEO_SCOPE_CELL_IMMEDIATE;
+		scopes |= 1 << CBS_GEO_SCOPE_CELL_NORMAL;
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_NORMAL));
 	}
+
+	if (scopes)
+		g_hash_table_foreach_remove(assembly->recv_index,
+						cbs_recv_in_scopes,
+						GUINT_TO_POINTER(scopes));
 }
 
 GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
@@ -4366,8 +4395,8 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	unsigned int new_serial;
 	GSList **recv;
 	GSList *l;
-	GSList *prev;
 	int position;
+	int j;
 
 	new_serial = cbs->gs << 14;
 	new_serial |= cbs->message_code << 4;
@@ -4382,8 +4411,7 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		recv = &assembly->recv_cell;
 
 	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
+	l = g_hash_table_lookup(assembly->recv_index, cbs_recv_key(new_serial));
 
 	/* If we have, is the message newer? */
 	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
@@ -4391,50 +4419,34 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
-
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
 		completed = g_slist_append(NULL, newcbs);
 
-		return completed;
-	}
-
-	prev = NULL;
-	position = 0;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		int j;
-		node = l->data;
-
-		if (new_serial != node->serial)
-			continue;
-
-		if (node->bitmap & (1 << cbs->page))
-			return NULL;
-
-		for (j = 1; j < cbs->page; j++)
-			if (node->bitmap & (1 << j))
-				position += 1;
-
-		goto out;
+		goto received;
 	}
 
-	node = g_new0(struct cbs_assembly_node, 1);
-	node->serial = new_serial;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+	/*
+	 * The serial carries the Message Identifier as well, so repeated
+	 * pages of a message being assembled are found with a single lookup
+	 */
+	node = g_hash_table_lookup(assembly->assembly_index,
+					GUINT_TO_POINTER(new_serial));
+	if (node == NULL) {
+		node = g_new0(struct cbs_assembly_node, 1);
+		node->serial = new_serial;
+
+		assembly->assembly_list =
+			g_slist_prepend(assembly->assembly_list, node);
+		g_hash_table_insert(assembly->assembly_index,
+					GUINT_TO_POINTER(new_serial), node);
+	} else if (node->bitmap & (1 << cbs->page))
+		return NULL;
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	for (j = 1, position = 0; j < cbs->page; j++)
+		if (node->bitmap & (1 << j))
+			position += 1;
 
-out:
 	newcbs = g_new(struct cbs, 1);
 	memcpy(newcbs, cbs, sizeof(struct cbs));
 	node->pages = g_slist_insert(node->pages, newcbs, position);
@@ -4445,17 +4457,24 @@ out:
 
 	completed = node->pages;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
+	g_hash_table_remove(assembly->assembly_index,
+					GUINT_TO_POINTER(new_serial));
+	assembly->assembly_list = g_slist_remove(assembly->assembly_list,
+							node);
 	g_free(node);
-	g_slist_free_1(l);
 
 	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
 				GUINT_TO_POINTER(new_serial));
+
+received:
+	if (l) {
+		l->data = GUINT_TO_POINTER(new_serial);
+		return completed;
+	}
+
 	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
+	g_hash_table_insert(assembly->recv_index, cbs_recv_key(new_serial),
+				*recv);
 
 	return completed;
 }
@@ -4701,6 +4720,50 @@ gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 					cbs_topic_compare) != NULL;
 }
 
+/*
+ * Compiles a list of topic ranges into a bitmap, so that checking a
+ * received page against it does not depend on the number of ranges.
+ * Returns NULL for an empty list, which matches no topic.
+ */
+struct cbs_topic_bitmap *cbs_topic_bitmap_new(GSList *ranges)
+{
+	struct cbs_topic_bitmap *bitmap;
+	GSList *l;
+
+	if (ranges == NULL)
+		return NULL;
+
+	bitmap = g_new0(struct cbs_topic_bitmap, 1);
+
+	for (l = ranges; l; l = l->next) {
+		struct cbs_topic_range *range = l->data;
+		unsigned int topic = range->min;
+
+		/* Fill whole words where possible, single bits otherwise */
+		while (topic <= range->max) {
+			if ((topic % 32) == 0 && topic + 31 <= range->max) {
+				bitmap->bits[topic / 32] = 0xffffffff;
+				topic += 32;
+				continue;
+			}
+
+			bitmap->bits[topic / 32] |= 1U << (topic % 32);
+			topic += 1;
+		}
+	}
+
+	return bitmap;
+}
+
+gboolean cbs_topic_bitmap_test(const struct cbs_topic_bitmap *bitmap,
+				unsigned int topic)
+{
+	if (bitmap == NULL || topic > 0xffff)
+		return FALSE;
+
+	return (bitmap->bits[topic / 32] & (1U << (topic % 32))) != 0;
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data)
 {
 	gboolean udhi;
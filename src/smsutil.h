@@ -412,6 +412,8 @@ struct cbs_assembly {
 	GSList *recv_plmn;
 	GSList *recv_loc;
 	GSList *recv_cell;
+	GHashTable *assembly_index;	/* serial -> assembly node */
+	GHashTable *recv_index;		/* serial w/o update -> link */
 };
 
 struct cbs_topic_range {
@@ -419,6 +421,11 @@ struct cbs_topic_range {
 	unsigned short max;
 };
 
+/* One bit per possible CBS Message Identifier */
+struct cbs_topic_bitmap {
+	guint32 bits[65536 / 32];
+};
+
 struct txq_backup_entry {
 	GSList *msg_list;
 	unsigned char uuid[SMS_MSGID_LEN];
@@ -584,6 +591,9 @@ char *cbs_topic_ranges_to_string(GSList *ranges);
 GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
+struct cbs_topic_bitmap *cbs_topic_bitmap_new(GSList *ranges);
+gboolean cbs_topic_bitmap_test(const struct cbs_topic_bitmap *bitmap,
+				unsigned int topic);
 
 char *ussd_decode(int dcs, int len, const unsigned char *data);
 gboolean ussd_encode(const char *str, long *items_written, unsigned char *pdu);
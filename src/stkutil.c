@@ -26,6 +26,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include <glib.h>
 
@@ -40,6 +41,35 @@ enum stk_data_object_flag {
 	DATAOBJ_FLAG_MINIMUM =		2,
 	DATAOBJ_FLAG_CR =		4,
 	DATAOBJ_FLAG_LIST =		8,
+	DATAOBJ_FLAG_SCRATCH =		16,
+};
+
+/*
+ * Proactive commands are described by one table per command type, listing
+ * the data objects in the order they have to appear and where to store
+ * them.  Offsets are relative to the command, or to a caller provided
+ * scratch area for objects flagged with DATAOBJ_FLAG_SCRATCH.
+ */
+struct dataobj_spec {
+	enum stk_data_object_type type;
+	int flags;
+	size_t offset;
+};
+
+#define COMMAND_OFFSET(field) offsetof(struct stk_command, field)
+
+/*
+ * Objects that only live as long as the command they were parsed for (the
+ * command itself, item and file lists) are carved out of chunks that are
+ * released in one go by stk_command_free.
+ */
+#define STK_ARENA_CHUNK_SIZE 1024
+#define STK_ARENA_ALIGN 8
+
+struct stk_arena {
+	struct stk_arena *next;
+	size_t size;
+	size_t used;
 };
 
 struct stk_file_iter {
@@ -58,6 +88,8 @@ struct stk_tlv_builder {
 };
 
 typedef gboolean (*dataobj_handler)(struct comprehension_tlv_iter *, void *);
+typedef gboolean (*dataobj_list_handler)(struct comprehension_tlv_iter *,
+						void *, struct stk_arena **);
 typedef gboolean (*dataobj_writer)(struct stk_tlv_builder *,
 					const void *, gboolean);
 
@@ -81,6 +113,68 @@ struct gsm_sms_tpdu {
 	if ((text == NULL || text[0] == '\0') && icon_id != 0)	\
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;	\
 
+static void *stk_arena_alloc0(struct stk_arena **arena, size_t len)
+{
+	struct stk_arena *chunk = *arena;
+	void *ptr;
+
+	len = (len + STK_ARENA_ALIGN - 1) & ~(size_t) (STK_ARENA_ALIGN - 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < len) {
+		size_t size = MAX(len, STK_ARENA_CHUNK_SIZE);
+
+		chunk = g_malloc(sizeof(struct stk_arena) + size);
+		chunk->next = *arena;
+		chunk->size = size;
+		chunk->used = 0;
+
+		*arena = chunk;
+	}
+
+	ptr = (unsigned char *) (chunk + 1) + chunk->used;
+	chunk->used += len;
+
+	memset(ptr, 0, len);
+
+	return ptr;
+}
+
+static char *stk_arena_strdup(struct stk_arena **arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ptr = stk_arena_alloc0(arena, len);
+
+	memcpy(ptr, str, len);
+
+	return ptr;
+}
+
+static void stk_arena_free(struct stk_arena *arena)
+{
+	while (arena) {
+		struct stk_arena *next = arena->next;
+
+		g_free(arena);
+		arena = next;
+	}
+}
+
+/* Appends to a list whose nodes live in the arena, tail tracks the end */
+static void stk_arena_list_append(struct stk_arena **arena, GSList **list,
+					GSList **tail, void *data)
+{
+	GSList *node = stk_arena_alloc0(arena, sizeof(GSList));
+
+	node->data = data;
+
+	if (*tail)
+		(*tail)->next = node;
+	else
+		*list = node;
+
+	*tail = node;
+}
+
 static char *decode_text(unsigned char dcs, int len, const unsigned char *data)
 {
 	char *utf8;
@@ -2253,83 +2347,91 @@ static dataobj_handler handler_for_type(enum stk_data_object_type type)
 	}
 }
 
-static void destroy_stk_item(struct stk_item *item)
-{
-	g_free(item->text);
-	g_free(item);
-}
-
 static gboolean parse_item_list(struct comprehension_tlv_iter *iter,
-				void *data)
+				void *data, struct stk_arena **arena)
 {
 	GSList **out = data;
 	unsigned short tag = STK_DATA_OBJECT_TYPE_ITEM;
 	struct comprehension_tlv_iter iter_old;
 	struct stk_item item;
 	GSList *list = NULL;
+	GSList *tail = NULL;
 	unsigned int count = 0;
 	gboolean has_empty = FALSE;
 
 	do {
+		struct stk_item *copy;
+
 		comprehension_tlv_iter_copy(iter, &iter_old);
 		memset(&item, 0, sizeof(item));
 		count++;
 
-		if (parse_dataobj_item(iter, &item) == TRUE) {
-			if (item.id == 0) {
-				has_empty = TRUE;
-				continue;
-			}
+		if (parse_dataobj_item(iter, &item) == FALSE)
+			continue;
 
-			list = g_slist_prepend(list,
-						g_memdup(&item, sizeof(item)));
+		if (item.id == 0) {
+			has_empty = TRUE;
+			continue;
 		}
+
+		/* Items are read-only once parsed, keep them in the arena */
+		copy = stk_arena_alloc0(arena, sizeof(item));
+		copy->id = item.id;
+		copy->text = stk_arena_strdup(arena, item.text);
+		g_free(item.text);
+
+		stk_arena_list_append(arena, &list, &tail, copy);
 	} while (comprehension_tlv_iter_next(iter) == TRUE &&
 			comprehension_tlv_iter_get_tag(iter) == tag);
 
 	comprehension_tlv_iter_copy(&iter_old, iter);
 
 	if (!has_empty) {
-		*out = g_slist_reverse(list);
+		*out = list;
 		return TRUE;
 	}
 
 	if (count == 1)
 		return TRUE;
 
-	g_slist_foreach(list, (GFunc) destroy_stk_item, NULL);
-	g_slist_free(list);
 	return FALSE;
-
 }
 
 static gboolean parse_provisioning_list(struct comprehension_tlv_iter *iter,
-					void *data)
+					void *data, struct stk_arena **arena)
 {
 	GSList **out = data;
 	unsigned short tag = STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF;
 	struct comprehension_tlv_iter iter_old;
 	struct stk_file file;
 	GSList *list = NULL;
+	GSList *tail = NULL;
 
 	do {
+		struct stk_file *copy;
+
 		comprehension_tlv_iter_copy(iter, &iter_old);
 		memset(&file, 0, sizeof(file));
 
 		if (parse_dataobj_provisioning_file_reference(iter, &file)
-									== TRUE)
-			list = g_slist_prepend(list,
-						g_memdup(&file, sizeof(file)));
+								== FALSE)
+			continue;
+
+		copy = stk_arena_alloc0(arena, sizeof(file));
+		memcpy(copy, &file, sizeof(file));
+
+		stk_arena_list_append(arena, &list, &tail, copy);
 	} while (comprehension_tlv_iter_next(iter) == TRUE &&
 			comprehension_tlv_iter_get_tag(iter) == tag);
 
 	comprehension_tlv_iter_copy(&iter_old, iter);
-	*out = g_slist_reverse(list);
+	*out = list;
 
 	return TRUE;
 }
 
-static dataobj_handler list_handler_for_type(enum stk_data_object_type type)
+static dataobj_list_handler list_handler_for_type(
+					enum stk_data_object_type type)
 {
 	switch (type) {
 	case STK_DATA_OBJECT_TYPE_ITEM:
@@ -2341,88 +2443,61 @@ static dataobj_handler list_handler_for_type(enum stk_data_object_type type)
 	}
 }
 
-struct dataobj_handler_entry {
-	enum stk_data_object_type type;
-	int flags;
-	void *data;
-};
-
-static enum stk_command_parse_result parse_dataobj(
+static enum stk_command_parse_result parse_dataobj_scratch(
 					struct comprehension_tlv_iter *iter,
-					enum stk_data_object_type type, ...)
+					struct stk_command *command,
+					const struct dataobj_spec *specs,
+					void *scratch)
 {
-	GSList *entries = NULL;
-	GSList *l;
-	va_list args;
+	const struct dataobj_spec *next = specs;
 	gboolean minimum_set = TRUE;
 	gboolean parse_error = FALSE;
 
-	va_start(args, type);
-
-	while (type != STK_DATA_OBJECT_TYPE_INVALID) {
-		struct dataobj_handler_entry *entry;
-
-		entry = g_new0(struct dataobj_handler_entry, 1);
-
-		entry->type = type;
-		entry->flags = va_arg(args, int);
-		entry->data = va_arg(args, void *);
-
-		type = va_arg(args, enum stk_data_object_type);
-		entries = g_slist_prepend(entries, entry);
-	}
-
-	va_end(args);
-
-	entries = g_slist_reverse(entries);
-
-	l = entries;
 	while (comprehension_tlv_iter_next(iter) == TRUE) {
-		dataobj_handler handler;
-		struct dataobj_handler_entry *entry;
-		GSList *l2;
-
-		for (l2 = l; l2; l2 = l2->next) {
-			entry = l2->data;
-
-			if (comprehension_tlv_iter_get_tag(iter) == entry->type)
+		unsigned short tag = comprehension_tlv_iter_get_tag(iter);
+		const struct dataobj_spec *spec;
+		gboolean ok;
+		void *data;
+
+		for (spec = next; spec->type != STK_DATA_OBJECT_TYPE_INVALID;
+								spec++) {
+			if (tag == spec->type)
 				break;
 
 			/* Can't skip over mandatory objects */
-			if (entry->flags & DATAOBJ_FLAG_MANDATORY) {
-				l2 = NULL;
+			if (spec->flags & DATAOBJ_FLAG_MANDATORY)
 				break;
-			}
 		}
 
-		if (l2 == NULL) {
+		if (tag != spec->type) {
 			if (comprehension_tlv_get_cr(iter) == TRUE)
 				parse_error = TRUE;
 
 			continue;
 		}
 
-		if (entry->flags & DATAOBJ_FLAG_LIST)
-			handler = list_handler_for_type(entry->type);
+		if (spec->flags & DATAOBJ_FLAG_SCRATCH)
+			data = (unsigned char *) scratch + spec->offset;
 		else
-			handler = handler_for_type(entry->type);
+			data = (unsigned char *) command + spec->offset;
 
-		if (handler(iter, entry->data) == FALSE)
+		if (spec->flags & DATAOBJ_FLAG_LIST)
+			ok = list_handler_for_type(spec->type)(iter, data,
+							&command->arena);
+		else
+			ok = handler_for_type(spec->type)(iter, data);
+
+		if (ok == FALSE)
 			parse_error = TRUE;
 
-		l = l2->next;
+		next = spec + 1;
 	}
 
-	for (; l; l = l->next) {
-		struct dataobj_handler_entry *entry = l->data;
-
-		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
+	for (; next->type != STK_DATA_OBJECT_TYPE_INVALID; next++) {
+		if (next->flags & DATAOBJ_FLAG_MANDATORY)
 			minimum_set = FALSE;
 	}
 
-	g_slist_foreach(entries, (GFunc) g_free, NULL);
-	g_slist_free(entries);
-
 	if (minimum_set == FALSE)
 		return STK_PARSE_RESULT_MISSING_VALUE;
 	if (parse_error == TRUE)
@@ -2431,6 +2506,31 @@ static enum stk_command_parse_result parse_dataobj(
 	return STK_PARSE_RESULT_OK;
 }
 
+static enum stk_command_parse_result parse_dataobj(
+					struct comprehension_tlv_iter *iter,
+					struct stk_command *command,
+					const struct dataobj_spec *specs)
+{
+	return parse_dataobj_scratch(iter, command, specs, NULL);
+}
+
+static const struct dataobj_spec display_text_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(display_text.text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(display_text.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+		COMMAND_OFFSET(display_text.immediate_response) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+				COMMAND_OFFSET(display_text.duration) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(display_text.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(display_text.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_display_text(struct stk_command *command)
 {
 	g_free(command->display_text.text);
@@ -2451,26 +2551,28 @@ static enum stk_command_parse_result parse_display_text(
 
 	command->destructor = destroy_display_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->immediate_response,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, display_text_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec get_inkey_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(get_inkey.text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(get_inkey.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+				COMMAND_OFFSET(get_inkey.duration) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(get_inkey.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(get_inkey.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_get_inkey(struct stk_command *command)
 {
 	g_free(command->get_inkey.text);
@@ -2491,24 +2593,31 @@ static enum stk_command_parse_result parse_get_inkey(
 
 	command->destructor = destroy_get_inkey;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, get_inkey_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec get_input_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(get_input.text) },
+	{ STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(get_input.resp_len) },
+	{ STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
+				COMMAND_OFFSET(get_input.default_text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(get_input.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(get_input.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(get_input.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_get_input(struct stk_command *command)
 {
 	g_free(command->get_input.text);
@@ -2530,21 +2639,7 @@ static enum stk_command_parse_result parse_get_input(
 
 	command->destructor = destroy_get_input;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->resp_len,
-				STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
-				&obj->default_text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, get_input_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2564,6 +2659,22 @@ static enum stk_command_parse_result parse_more_time(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec play_tone_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(play_tone.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_TONE, 0,
+				COMMAND_OFFSET(play_tone.tone) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+				COMMAND_OFFSET(play_tone.duration) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(play_tone.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(play_tone.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(play_tone.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_play_tone(struct stk_command *command)
 {
 	g_free(command->play_tone.alpha_id);
@@ -2584,30 +2695,24 @@ static enum stk_command_parse_result parse_play_tone(
 
 	command->destructor = destroy_play_tone;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_TONE, 0,
-				&obj->tone,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, play_tone_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec poll_interval_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_DURATION,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(poll_interval.duration) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_poll_interval(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_poll_interval *obj = &command->poll_interval;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2615,18 +2720,33 @@ static enum stk_command_parse_result parse_poll_interval(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_DURATION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, poll_interval_objs);
+}
+
+static const struct dataobj_spec setup_menu_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(setup_menu.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+		DATAOBJ_FLAG_LIST,
+				COMMAND_OFFSET(setup_menu.items) },
+	{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+				COMMAND_OFFSET(setup_menu.next_act) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(setup_menu.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+				COMMAND_OFFSET(setup_menu.item_icon_id_list) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(setup_menu.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+		COMMAND_OFFSET(setup_menu.item_text_attr_list) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_setup_menu(struct stk_command *command)
 {
 	g_free(command->setup_menu.alpha_id);
-	g_slist_foreach(command->setup_menu.items,
-				(GFunc) destroy_stk_item, NULL);
-	g_slist_free(command->setup_menu.items);
 }
 
 static enum stk_command_parse_result parse_setup_menu(
@@ -2644,36 +2764,40 @@ static enum stk_command_parse_result parse_setup_menu(
 
 	command->destructor = destroy_setup_menu;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_menu_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec select_item_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(select_item.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+		DATAOBJ_FLAG_LIST,
+				COMMAND_OFFSET(select_item.items) },
+	{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+				COMMAND_OFFSET(select_item.next_act) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
+				COMMAND_OFFSET(select_item.item_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(select_item.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+				COMMAND_OFFSET(select_item.item_icon_id_list) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(select_item.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+		COMMAND_OFFSET(select_item.item_text_attr_list) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(select_item.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_select_item(struct stk_command *command)
 {
 	g_free(command->select_item.alpha_id);
-	g_slist_foreach(command->select_item.items,
-				(GFunc) destroy_stk_item, NULL);
-	g_slist_free(command->select_item.items);
 }
 
 static enum stk_command_parse_result parse_select_item(
@@ -2689,27 +2813,7 @@ static enum stk_command_parse_result parse_select_item(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
-			&obj->item_id,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-			&obj->frame_id,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, select_item_objs);
 
 	command->destructor = destroy_select_item;
 
@@ -2721,6 +2825,31 @@ static enum stk_command_parse_result parse_select_item(
 	return status;
 }
 
+struct send_sms_scratch {
+	struct stk_address sc_address;
+	struct gsm_sms_tpdu gsm_tpdu;
+};
+
+#define SCRATCH_OFFSET(field) offsetof(struct send_sms_scratch, field)
+
+static const struct dataobj_spec send_sms_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(send_sms.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ADDRESS, DATAOBJ_FLAG_SCRATCH,
+				SCRATCH_OFFSET(sc_address) },
+	{ STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, DATAOBJ_FLAG_SCRATCH,
+				SCRATCH_OFFSET(gsm_tpdu) },
+	{ STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
+				COMMAND_OFFSET(send_sms.cdma_sms) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(send_sms.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(send_sms.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(send_sms.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_send_sms(struct stk_command *command)
 {
 	g_free(command->send_sms.alpha_id);
@@ -2733,8 +2862,9 @@ static enum stk_command_parse_result parse_send_sms(
 {
 	struct stk_command_send_sms *obj = &command->send_sms;
 	enum stk_command_parse_result status;
-	struct gsm_sms_tpdu gsm_tpdu;
-	struct stk_address sc_address = { 0, NULL };
+	struct send_sms_scratch scratch;
+	struct gsm_sms_tpdu *gsm_tpdu = &scratch.gsm_tpdu;
+	struct stk_address *sc_address = &scratch.sc_address;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2742,22 +2872,8 @@ static enum stk_command_parse_result parse_send_sms(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	memset(&gsm_tpdu, 0, sizeof(gsm_tpdu));
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ADDRESS, 0,
-				&sc_address,
-				STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
-				&gsm_tpdu,
-				STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
-				&obj->cdma_sms,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	memset(&scratch, 0, sizeof(scratch));
+	status = parse_dataobj_scratch(iter, command, send_sms_objs, &scratch);
 
 	command->destructor = destroy_send_sms;
 
@@ -2769,12 +2885,12 @@ static enum stk_command_parse_result parse_send_sms(
 	if (status != STK_PARSE_RESULT_OK)
 		goto out;
 
-	if (gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
+	if (gsm_tpdu->len == 0 && obj->cdma_sms.len == 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	if (gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
+	if (gsm_tpdu->len > 0 && obj->cdma_sms.len > 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2785,7 +2901,7 @@ static enum stk_command_parse_result parse_send_sms(
 
 	/* packing is needed */
 	if (command->qualifier & 0x01) {
-		if (sms_decode_unpacked_stk_pdu(gsm_tpdu.tpdu, gsm_tpdu.len,
+		if (sms_decode_unpacked_stk_pdu(gsm_tpdu->tpdu, gsm_tpdu->len,
 							&obj->gsm_sms) !=
 				TRUE) {
 			status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2795,8 +2911,8 @@ static enum stk_command_parse_result parse_send_sms(
 		goto set_addr;
 	}
 
-	if (sms_decode(gsm_tpdu.tpdu, gsm_tpdu.len, TRUE,
-				gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
+	if (sms_decode(gsm_tpdu->tpdu, gsm_tpdu->len, TRUE,
+				gsm_tpdu->len, &obj->gsm_sms) == FALSE) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2808,24 +2924,39 @@ static enum stk_command_parse_result parse_send_sms(
 	}
 
 set_addr:
-	if (sc_address.number == NULL)
+	if (sc_address->number == NULL)
 		goto out;
 
-	if (strlen(sc_address.number) > 20) {
+	if (strlen(sc_address->number) > 20) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	strcpy(obj->gsm_sms.sc_addr.address, sc_address.number);
-	obj->gsm_sms.sc_addr.numbering_plan = sc_address.ton_npi & 15;
-	obj->gsm_sms.sc_addr.number_type = (sc_address.ton_npi >> 4) & 7;
+	strcpy(obj->gsm_sms.sc_addr.address, sc_address->number);
+	obj->gsm_sms.sc_addr.numbering_plan = sc_address->ton_npi & 15;
+	obj->gsm_sms.sc_addr.number_type = (sc_address->ton_npi >> 4) & 7;
 
 out:
-	g_free(sc_address.number);
+	g_free(sc_address->number);
 
 	return status;
 }
 
+static const struct dataobj_spec send_ss_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(send_ss.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_SS_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(send_ss.ss) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(send_ss.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(send_ss.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(send_ss.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_send_ss(struct stk_command *command)
 {
 	g_free(command->send_ss.alpha_id);
@@ -2835,7 +2966,6 @@ static void destroy_send_ss(struct stk_command *command)
 static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ss *obj = &command->send_ss;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2845,19 +2975,23 @@ static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 
 	command->destructor = destroy_send_ss;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_SS_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ss,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, send_ss_objs);
+}
+
+static const struct dataobj_spec send_ussd_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(send_ussd.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_USSD_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(send_ussd.ussd_string) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(send_ussd.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(send_ussd.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(send_ussd.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_send_ussd(struct stk_command *command)
 {
@@ -2868,7 +3002,6 @@ static enum stk_command_parse_result parse_send_ussd(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ussd *obj = &command->send_ussd;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2878,19 +3011,35 @@ static enum stk_command_parse_result parse_send_ussd(
 
 	command->destructor = destroy_send_ussd;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_USSD_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ussd_string,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, send_ussd_objs);
+}
+
+static const struct dataobj_spec setup_call_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(setup_call.alpha_id_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_ADDRESS,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(setup_call.addr) },
+	{ STK_DATA_OBJECT_TYPE_CCP, 0,
+				COMMAND_OFFSET(setup_call.ccp) },
+	{ STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
+				COMMAND_OFFSET(setup_call.subaddr) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+				COMMAND_OFFSET(setup_call.duration) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(setup_call.icon_id_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		COMMAND_OFFSET(setup_call.alpha_id_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(setup_call.icon_id_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(setup_call.text_attr_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		COMMAND_OFFSET(setup_call.text_attr_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(setup_call.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_setup_call(struct stk_command *command)
 {
@@ -2914,30 +3063,7 @@ static enum stk_command_parse_result parse_setup_call(
 
 	command->destructor = destroy_setup_call;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ADDRESS,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->addr,
-				STK_DATA_OBJECT_TYPE_CCP, 0,
-				&obj->ccp,
-				STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
-				&obj->subaddr,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_call_setup,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_call_setup,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_usr_cfm,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_call_setup,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_call_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id_usr_cfm, obj->icon_id_usr_cfm.id);
 	CHECK_TEXT_AND_ICON(obj->alpha_id_call_setup,
@@ -2946,6 +3072,22 @@ static enum stk_command_parse_result parse_setup_call(
 	return status;
 }
 
+static const struct dataobj_spec refresh_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
+				COMMAND_OFFSET(refresh.file_list) },
+	{ STK_DATA_OBJECT_TYPE_AID, 0,
+				COMMAND_OFFSET(refresh.aid) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(refresh.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(refresh.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(refresh.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(refresh.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_refresh(struct stk_command *command)
 {
 	g_slist_foreach(command->refresh.file_list, (GFunc) g_free, NULL);
@@ -2968,19 +3110,7 @@ static enum stk_command_parse_result parse_refresh(
 
 	command->destructor = destroy_refresh;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
-				&obj->file_list,
-				STK_DATA_OBJECT_TYPE_AID, 0,
-				&obj->aid,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, refresh_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3013,11 +3143,17 @@ static enum stk_command_parse_result parse_provide_local_info(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec setup_event_list_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_EVENT_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(setup_event_list.event_list) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_setup_event_list(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_setup_event_list *obj = &command->setup_event_list;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3025,17 +3161,20 @@ static enum stk_command_parse_result parse_setup_event_list(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_EVENT_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->event_list,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, setup_event_list_objs);
 }
 
+static const struct dataobj_spec perform_card_apdu_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_C_APDU,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(perform_card_apdu.c_apdu) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_perform_card_apdu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_perform_card_apdu *obj = &command->perform_card_apdu;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3044,10 +3183,7 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CARD_READER_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_C_APDU,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->c_apdu,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, perform_card_apdu_objs);
 }
 
 static enum stk_command_parse_result parse_power_off_card(
@@ -3103,13 +3239,29 @@ static enum stk_command_parse_result parse_get_reader_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec timer_mgmt_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TIMER_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(timer_mgmt.timer_id) },
+	{ STK_DATA_OBJECT_TYPE_TIMER_VALUE, 0,
+				COMMAND_OFFSET(timer_mgmt.timer_value) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
+/* Starting a timer requires its value */
+static const struct dataobj_spec timer_start_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TIMER_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(timer_mgmt.timer_id) },
+	{ STK_DATA_OBJECT_TYPE_TIMER_VALUE, DATAOBJ_FLAG_MANDATORY,
+				COMMAND_OFFSET(timer_mgmt.timer_value) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_timer_mgmt(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_timer_mgmt *obj = &command->timer_mgmt;
-	enum stk_data_object_flag value_flags = 0;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3117,15 +3269,23 @@ static enum stk_command_parse_result parse_timer_mgmt(
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if ((command->qualifier & 3) == 0) /* Start a timer */
-		value_flags = DATAOBJ_FLAG_MANDATORY;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TIMER_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->timer_id,
-				STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
-				&obj->timer_value,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+		return parse_dataobj(iter, command, timer_start_objs);
+
+	return parse_dataobj(iter, command, timer_mgmt_objs);
+}
+
+static const struct dataobj_spec setup_idle_mode_text_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(setup_idle_mode_text.text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(setup_idle_mode_text.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		COMMAND_OFFSET(setup_idle_mode_text.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(setup_idle_mode_text.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_setup_idle_mode_text(struct stk_command *command)
 {
@@ -3148,22 +3308,28 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 
 	command->destructor = destroy_setup_idle_mode_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_idle_mode_text_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec run_at_command_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(run_at_command.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_AT_COMMAND,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(run_at_command.at_command) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(run_at_command.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(run_at_command.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(run_at_command.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_run_at_command(struct stk_command *command)
 {
 	g_free(command->run_at_command.alpha_id);
@@ -3185,24 +3351,28 @@ static enum stk_command_parse_result parse_run_at_command(
 
 	command->destructor = destroy_run_at_command;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_AT_COMMAND,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->at_command,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, run_at_command_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec send_dtmf_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(send_dtmf.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_DTMF_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(send_dtmf.dtmf) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(send_dtmf.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(send_dtmf.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(send_dtmf.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_send_dtmf(struct stk_command *command)
 {
 	g_free(command->send_dtmf.alpha_id);
@@ -3224,30 +3394,23 @@ static enum stk_command_parse_result parse_send_dtmf(
 
 	command->destructor = destroy_send_dtmf;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_DTMF_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->dtmf,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, send_dtmf_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec language_notification_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
+		COMMAND_OFFSET(language_notification.language) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_language_notification(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_language_notification *obj =
-					&command->language_notification;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3255,18 +3418,42 @@ static enum stk_command_parse_result parse_language_notification(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
-				&obj->language,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, language_notification_objs);
+}
+
+static const struct dataobj_spec launch_browser_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
+				COMMAND_OFFSET(launch_browser.browser_id) },
+	{ STK_DATA_OBJECT_TYPE_URL,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(launch_browser.url) },
+	{ STK_DATA_OBJECT_TYPE_BEARER, 0,
+				COMMAND_OFFSET(launch_browser.bearer) },
+	{ STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF, DATAOBJ_FLAG_LIST,
+				COMMAND_OFFSET(launch_browser.prov_file_refs) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+		COMMAND_OFFSET(launch_browser.text_gateway_proxy_id) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(launch_browser.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(launch_browser.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(launch_browser.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(launch_browser.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
+				COMMAND_OFFSET(launch_browser.network_name) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+				COMMAND_OFFSET(launch_browser.text_usr) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+				COMMAND_OFFSET(launch_browser.text_passwd) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_launch_browser(struct stk_command *command)
 {
 	g_free(command->launch_browser.url);
 	g_free(command->launch_browser.bearer.array);
-	g_slist_foreach(command->launch_browser.prov_file_refs,
-				(GFunc) g_free, NULL);
-	g_slist_free(command->launch_browser.prov_file_refs);
 	g_free(command->launch_browser.text_gateway_proxy_id);
 	g_free(command->launch_browser.alpha_id);
 	g_free(command->launch_browser.network_name.array);
@@ -3278,7 +3465,6 @@ static enum stk_command_parse_result parse_launch_browser(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_launch_browser *obj = &command->launch_browser;
 
 	if (command->qualifier > 3 || command->qualifier == 1)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3291,35 +3477,38 @@ static enum stk_command_parse_result parse_launch_browser(
 
 	command->destructor = destroy_launch_browser;
 
-	return parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
-				&obj->browser_id,
-				STK_DATA_OBJECT_TYPE_URL,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->url,
-				STK_DATA_OBJECT_TYPE_BEARER, 0,
-				&obj->bearer,
-				STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF,
-				DATAOBJ_FLAG_LIST,
-				&obj->prov_file_refs,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_gateway_proxy_id,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->network_name,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, launch_browser_objs);
+}
+
+static const struct dataobj_spec open_channel_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(open_channel.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(open_channel.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(open_channel.bearer_desc) },
+	{ STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(open_channel.buf_size) },
+	{ STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
+				COMMAND_OFFSET(open_channel.apn) },
+	{ STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
+				COMMAND_OFFSET(open_channel.local_addr) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+				COMMAND_OFFSET(open_channel.text_usr) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+				COMMAND_OFFSET(open_channel.text_passwd) },
+	{ STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
+				COMMAND_OFFSET(open_channel.uti) },
+	{ STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
+				COMMAND_OFFSET(open_channel.data_dest_addr) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(open_channel.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(open_channel.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_open_channel(struct stk_command *command)
 {
@@ -3351,40 +3540,25 @@ static enum stk_command_parse_result parse_open_channel(
 	 * parse the Open Channel data objects related to packet data service
 	 * bearer
 	 */
-	status = parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->bearer_desc,
-				STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->buf_size,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->apn,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->local_addr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->uti,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->data_dest_addr,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, open_channel_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec close_channel_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(close_channel.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(close_channel.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(close_channel.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(close_channel.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_close_channel(struct stk_command *command)
 {
 	g_free(command->close_channel.alpha_id);
@@ -3406,21 +3580,28 @@ static enum stk_command_parse_result parse_close_channel(
 
 	command->destructor = destroy_close_channel;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, close_channel_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec receive_data_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(receive_data.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(receive_data.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(receive_data.data_len) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(receive_data.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(receive_data.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_receive_data(struct stk_command *command)
 {
 	g_free(command->receive_data.alpha_id);
@@ -3442,24 +3623,28 @@ static enum stk_command_parse_result parse_receive_data(
 
 	command->destructor = destroy_receive_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data_len,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, receive_data_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec send_data_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(send_data.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(send_data.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(send_data.data) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(send_data.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(send_data.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_send_data(struct stk_command *command)
 {
 	g_free(command->send_data.alpha_id);
@@ -3485,18 +3670,7 @@ static enum stk_command_parse_result parse_send_data(
 
 	command->destructor = destroy_send_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, send_data_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3516,6 +3690,23 @@ static enum stk_command_parse_result parse_get_channel_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec service_search_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(service_search.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(service_search.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(service_search.serv_search) },
+	{ STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
+				COMMAND_OFFSET(service_search.dev_filter) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(service_search.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(service_search.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_service_search(struct stk_command *command)
 {
 	g_free(command->service_search.alpha_id);
@@ -3527,7 +3718,6 @@ static enum stk_command_parse_result parse_service_search(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_service_search *obj = &command->service_search;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3537,21 +3727,23 @@ static enum stk_command_parse_result parse_service_search(
 
 	command->destructor = destroy_service_search;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_search,
-				STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
-				&obj->dev_filter,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, command, service_search_objs);
+}
+
+static const struct dataobj_spec get_service_info_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(get_service_info.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(get_service_info.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(get_service_info.attr_info) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(get_service_info.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(get_service_info.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
 
 static void destroy_get_service_info(struct stk_command *command)
 {
@@ -3563,7 +3755,6 @@ static enum stk_command_parse_result parse_get_service_info(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_get_service_info *obj = &command->get_service_info;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3573,20 +3764,18 @@ static enum stk_command_parse_result parse_get_service_info(
 
 	command->destructor = destroy_get_service_info;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->attr_info,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, get_service_info_objs);
 }
 
+static const struct dataobj_spec declare_service_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(declare_service.serv_rec) },
+	{ STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
+				COMMAND_OFFSET(declare_service.intf) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_declare_service(struct stk_command *command)
 {
 	g_free(command->declare_service.serv_rec.serv_rec);
@@ -3596,7 +3785,6 @@ static enum stk_command_parse_result parse_declare_service(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_declare_service *obj = &command->declare_service;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3606,19 +3794,24 @@ static enum stk_command_parse_result parse_declare_service(
 
 	command->destructor = destroy_declare_service;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_rec,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->intf,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, declare_service_objs);
 }
 
+static const struct dataobj_spec set_frames_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(set_frames.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
+				COMMAND_OFFSET(set_frames.frame_layout) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(set_frames.frame_id_default) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_set_frames(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_set_frames *obj = &command->set_frames;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3626,14 +3819,7 @@ static enum stk_command_parse_result parse_set_frames(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FRAME_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
-				&obj->frame_layout,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id_default,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, set_frames_objs);
 }
 
 static enum stk_command_parse_result parse_get_frames_status(
@@ -3649,6 +3835,29 @@ static enum stk_command_parse_result parse_get_frames_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec retrieve_mms_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(retrieve_mms.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(retrieve_mms.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(retrieve_mms.mms_ref) },
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(retrieve_mms.mms_rec_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(retrieve_mms.mms_content_id) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID, 0,
+				COMMAND_OFFSET(retrieve_mms.mms_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(retrieve_mms.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(retrieve_mms.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_retrieve_mms(struct stk_command *command)
 {
 	g_free(command->retrieve_mms.alpha_id);
@@ -3672,32 +3881,30 @@ static enum stk_command_parse_result parse_retrieve_mms(
 
 	command->destructor = destroy_retrieve_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_ref,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_rec_files,
-				STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_content_id,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, retrieve_mms_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec submit_mms_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+				COMMAND_OFFSET(submit_mms.alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+				COMMAND_OFFSET(submit_mms.icon_id) },
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(submit_mms.mms_subm_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID, 0,
+				COMMAND_OFFSET(submit_mms.mms_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+				COMMAND_OFFSET(submit_mms.text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(submit_mms.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_submit_mms(struct stk_command *command)
 {
 	g_free(command->submit_mms.alpha_id);
@@ -3721,26 +3928,27 @@ static enum stk_command_parse_result parse_submit_mms(
 
 	command->destructor = destroy_submit_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, submit_mms_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec display_mms_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(display_mms.mms_subm_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(display_mms.mms_id) },
+	{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+				COMMAND_OFFSET(display_mms.imd_resp) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+				COMMAND_OFFSET(display_mms.frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static void destroy_display_mms(struct stk_command *command)
 {
 	g_slist_foreach(command->display_mms.mms_subm_files,
@@ -3752,7 +3960,6 @@ static enum stk_command_parse_result parse_display_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_display_mms *obj = &command->display_mms;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3762,24 +3969,20 @@ static enum stk_command_parse_result parse_display_mms(
 
 	command->destructor = destroy_display_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->imd_resp,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, display_mms_objs);
 }
 
+static const struct dataobj_spec activate_objs[] = {
+	{ STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+				COMMAND_OFFSET(activate.actv_desc) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 },
+};
+
 static enum stk_command_parse_result parse_activate(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_activate *obj = &command->activate;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3787,10 +3990,7 @@ static enum stk_command_parse_result parse_activate(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->actv_desc,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, activate_objs);
 }
 
 static enum stk_command_parse_result parse_command_body(
@@ -3890,6 +4090,7 @@ struct stk_command *stk_command_new_from_pdu(const unsigned char *pdu,
 	struct comprehension_tlv_iter iter;
 	const unsigned char *data;
 	struct stk_command *command;
+	struct stk_arena *arena = NULL;
 
 	ber_tlv_iter_init(&ber, pdu, len);
 
@@ -3918,7 +4119,8 @@ struct stk_command *stk_command_new_from_pdu(const unsigned char *pdu,
 
 	data = comprehension_tlv_iter_get_data(&iter);
 
-	command = g_new0(struct stk_command, 1);
+	command = stk_arena_alloc0(&arena, sizeof(struct stk_command));
+	command->arena = arena;
 
 	command->number = data[0];
 	command->type = data[1];
@@ -3956,7 +4158,8 @@ void stk_command_free(struct stk_command *command)
 	if (command->destructor)
 		command->destructor(command);
 
-	g_free(command);
+	/* The command itself lives in the arena */
+	stk_arena_free(command->arena);
 }
 
 static gboolean stk_tlv_builder_init(struct stk_tlv_builder *iter,
@@ -1404,6 +1404,8 @@ enum stk_command_parse_result {
 	STK_PARSE_RESULT_MISSING_VALUE,
 };
 
+struct stk_arena;
+
 struct stk_command {
 	unsigned char number;
 	unsigned char type;
@@ -1448,6 +1450,7 @@ struct stk_command {
 	};
 
 	void (*destructor)(struct stk_command *command);
+	struct stk_arena *arena;
 };
 
 /* TERMINAL RESPONSEs defined in TS 102.223 Section 6.8 */
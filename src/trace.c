@@ -0,0 +1,743 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+/*
+ * Debug output is recorded in binary form: the format string pointer,
+ * which has to be a literal, plus the raw arguments.  Formatting only
+ * happens when the ring is drained, either by a background thread
+ * writing to syslog or on demand.
+ *
+ * The ring has a single producer, the main loop, and at most one
+ * consumer.  Without a drain thread the main loop is also the only
+ * consumer, and the oldest records are overwritten when the ring is
+ * full.  With one, new records are dropped instead and counted.
+ */
+
+#define TRACE_RING_SIZE (256 * 1024)
+#define TRACE_RECORD_MAX 1024
+#define TRACE_CUT_MARK "..."
+#define TRACE_CUT_MARK_LEN 3
+#define TRACE_DRAIN_INTERVAL 50000	/* usecs */
+
+#define TRACE_ALIGN(x) (((x) + 7) & ~((size_t) 7))
+
+enum trace_arg {
+	TRACE_ARG_INT = 1,
+	TRACE_ARG_DOUBLE,
+	TRACE_ARG_POINTER,
+	TRACE_ARG_STRING,
+};
+
+struct trace_record {
+	guint32 size;		/* header included, 0 means skip to start */
+	guint32 args;		/* bytes of argument data after the header */
+	gint64 time;
+	const char *format;
+};
+
+#define TRACE_HEADER_SIZE TRACE_ALIGN(sizeof(struct trace_record))
+
+struct trace_ring {
+	unsigned char *buf;
+	guint size;
+	volatile gint head;
+	volatile gint tail;
+	volatile gint dropped;
+	gboolean overwrite;
+#ifdef NEED_THREADS
+	GThread *drain;
+	volatile gint draining;
+#endif
+};
+
+struct trace_spec {
+	const char *flags;	/* first character after the '%' */
+	const char *length;	/* length modifier, if any */
+	const char *end;	/* one past the conversion character */
+	int stars;
+	char conv;
+};
+
+static struct trace_ring *ring;
+
+/*
+ * Splits up the conversion following a '%' as far as capturing and
+ * re-formatting the argument needs.
+ */
+static gboolean parse_spec(const char *p, struct trace_spec *spec)
+{
+	spec->flags = p;
+	spec->stars = 0;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+
+	if (*p == '*') {
+		spec->stars += 1;
+		p++;
+	} else
+		while (g_ascii_isdigit(*p))
+			p++;
+
+	if (*p == '.') {
+		p++;
+
+		if (*p == '*') {
+			spec->stars += 1;
+			p++;
+		} else
+			while (g_ascii_isdigit(*p))
+				p++;
+	}
+
+	spec->length = p;
+
+	while (*p && strchr("hlLqjzt", *p))
+		p++;
+
+	if (*p == '\0')
+		return FALSE;
+
+	spec->conv = *p;
+	spec->end = p + 1;
+
+	return TRUE;
+}
+
+static gint64 spec_signed(const struct trace_spec *spec, va_list *ap)
+{
+	const char *l = spec->length;
+
+	if (l[0] == 'l' && l[1] == 'l')
+		return va_arg(*ap, long long);
+
+	switch (l[0]) {
+	case 'l':
+		return va_arg(*ap, long);
+	case 'L':
+	case 'q':
+		return va_arg(*ap, long long);
+	case 'j':
+		return va_arg(*ap, intmax_t);
+	case 'z':
+		return va_arg(*ap, ssize_t);
+	case 't':
+		return va_arg(*ap, ptrdiff_t);
+	}
+
+	return va_arg(*ap, int);
+}
+
+static guint64 spec_unsigned(const struct trace_spec *spec, va_list *ap)
+{
+	const char *l = spec->length;
+
+	if (l[0] == 'l' && l[1] == 'l')
+		return va_arg(*ap, unsigned long long);
+
+	switch (l[0]) {
+	case 'l':
+		return va_arg(*ap, unsigned long);
+	case 'L':
+	case 'q':
+		return va_arg(*ap, unsigned long long);
+	case 'j':
+		return va_arg(*ap, uintmax_t);
+	case 'z':
+		return va_arg(*ap, size_t);
+	case 't':
+		return va_arg(*ap, ptrdiff_t);
+	}
+
+	return va_arg(*ap, unsigned int);
+}
+
+static unsigned char *put_arg(unsigned char *p, unsigned char *end,
+				enum trace_arg type, const void *value,
+				size_t len)
+{
+	if (p == NULL || p + 1 + len > end)
+		return NULL;
+
+	*p++ = type;
+	memcpy(p, value, len);
+
+	return p + len;
+}
+
+static unsigned char *put_string(unsigned char *p, unsigned char *end,
+					const char *str)
+{
+	size_t len = strlen(str);
+	size_t room;
+	gboolean cut = FALSE;
+	guint16 len16;
+
+	if (p == NULL || p + 3 > end)
+		return NULL;
+
+	room = end - p - 3;
+
+	/* Keep as much as fits in the record and mark where it was cut */
+	if (len > room) {
+		if (room <= TRACE_CUT_MARK_LEN)
+			return NULL;
+
+		len = room - TRACE_CUT_MARK_LEN;
+		cut = TRUE;
+	}
+
+	len16 = cut ? len + TRACE_CUT_MARK_LEN : len;
+	*p++ = TRACE_ARG_STRING;
+	memcpy(p, &len16, sizeof(len16));
+	p += sizeof(len16);
+	memcpy(p, str, len);
+	p += len;
+
+	if (cut) {
+		memcpy(p, TRACE_CUT_MARK, TRACE_CUT_MARK_LEN);
+		p += TRACE_CUT_MARK_LEN;
+	}
+
+	return p;
+}
+
+/*
+ * Captures the arguments the format refers to.  Anything the format
+ * parser does not understand ends the capture, the rest of the format
+ * is then output verbatim.
+ */
+static size_t capture_args(const char *format, va_list ap,
+				unsigned char *buf, size_t size)
+{
+	unsigned char *p = buf;
+	unsigned char *end = buf + size;
+	unsigned char *last = buf;
+	const char *f = format;
+	struct trace_spec spec;
+	va_list aq;
+
+	va_copy(aq, ap);
+
+	while ((f = strchr(f, '%')) != NULL && p != NULL) {
+		gint64 i;
+		guint64 u;
+		double d;
+		void *ptr;
+		int star;
+
+		if (f[1] == '%') {
+			f += 2;
+			continue;
+		}
+
+		if (!parse_spec(f + 1, &spec))
+			break;
+
+		last = p;
+
+		f = spec.end;
+
+		for (star = 0; star < spec.stars; star++) {
+			i = va_arg(aq, int);
+			p = put_arg(p, end, TRACE_ARG_INT, &i, sizeof(i));
+		}
+
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			i = spec_signed(&spec, &aq);
+			p = put_arg(p, end, TRACE_ARG_INT, &i, sizeof(i));
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			u = spec_unsigned(&spec, &aq);
+			p = put_arg(p, end, TRACE_ARG_INT, &u, sizeof(u));
+			break;
+		case 'c':
+			i = va_arg(aq, int);
+			p = put_arg(p, end, TRACE_ARG_INT, &i, sizeof(i));
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (spec.length[0] == 'L')
+				d = va_arg(aq, long double);
+			else
+				d = va_arg(aq, double);
+
+			p = put_arg(p, end, TRACE_ARG_DOUBLE, &d, sizeof(d));
+			break;
+		case 's':
+			ptr = va_arg(aq, char *);
+			p = put_string(p, end, ptr ? ptr : "(null)");
+			break;
+		case 'm':
+			p = put_string(p, end, g_strerror(errno));
+			break;
+		case 'p':
+		case 'n':
+			ptr = va_arg(aq, void *);
+			p = put_arg(p, end, TRACE_ARG_POINTER, &ptr,
+					sizeof(ptr));
+			break;
+		default:
+			goto done;
+		}
+	}
+
+done:
+	va_end(aq);
+
+	/* Out of space, drop the arguments that did not fit */
+	if (p == NULL)
+		return last - buf;
+
+	return p - buf;
+}
+
+struct arg_reader {
+	const unsigned char *p;
+	const unsigned char *end;
+};
+
+static gboolean get_arg(struct arg_reader *r, enum trace_arg type,
+				void *value, size_t len)
+{
+	if (r->p + 1 + len > r->end || r->p[0] != type)
+		return FALSE;
+
+	memcpy(value, r->p + 1, len);
+	r->p += 1 + len;
+
+	return TRUE;
+}
+
+static gboolean get_string(struct arg_reader *r, char *buf)
+{
+	guint16 len;
+
+	if (r->p + 3 > r->end || r->p[0] != TRACE_ARG_STRING)
+		return FALSE;
+
+	memcpy(&len, r->p + 1, sizeof(len));
+
+	if (len >= TRACE_RECORD_MAX || r->p + 3 + len > r->end)
+		return FALSE;
+
+	memcpy(buf, r->p + 3, len);
+	buf[len] = '\0';
+	r->p += 3 + len;
+
+	return TRUE;
+}
+
+#define APPEND_SPEC(out, fmt, stars, star, value) do {			\
+	if (stars == 2)							\
+		g_string_append_printf(out, fmt, star[0], star[1], value); \
+	else if (stars == 1)						\
+		g_string_append_printf(out, fmt, star[0], value);	\
+	else								\
+		g_string_append_printf(out, fmt, value);		\
+} while (0)
+
+/*
+ * Formats one conversion from the captured arguments.  The length
+ * modifier is replaced since integers were widened when captured.
+ */
+static gboolean format_spec(GString *out, const struct trace_spec *spec,
+				struct arg_reader *r)
+{
+	char fmt[32];
+	char str[TRACE_RECORD_MAX];
+	size_t n = spec->length - spec->flags;
+	int star[2] = { 0, 0 };
+	int i;
+
+	if (n + 5 > sizeof(fmt))
+		return FALSE;
+
+	for (i = 0; i < spec->stars; i++) {
+		gint64 v;
+
+		if (!get_arg(r, TRACE_ARG_INT, &v, sizeof(v)))
+			return FALSE;
+
+		star[i] = v;
+	}
+
+	fmt[0] = '%';
+	memcpy(fmt + 1, spec->flags, n);
+	n += 1;
+
+	switch (spec->conv) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+	{
+		gint64 v;
+
+		if (!get_arg(r, TRACE_ARG_INT, &v, sizeof(v)))
+			return FALSE;
+
+		fmt[n++] = 'l';
+		fmt[n++] = 'l';
+		fmt[n++] = spec->conv;
+		fmt[n] = '\0';
+		APPEND_SPEC(out, fmt, spec->stars, star, (long long) v);
+		return TRUE;
+	}
+	case 'c':
+	{
+		gint64 v;
+
+		if (!get_arg(r, TRACE_ARG_INT, &v, sizeof(v)))
+			return FALSE;
+
+		fmt[n++] = 'c';
+		fmt[n] = '\0';
+		APPEND_SPEC(out, fmt, spec->stars, star, (int) v);
+		return TRUE;
+	}
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+	{
+		double v;
+
+		if (!get_arg(r, TRACE_ARG_DOUBLE, &v, sizeof(v)))
+			return FALSE;
+
+		fmt[n++] = spec->conv;
+		fmt[n] = '\0';
+		APPEND_SPEC(out, fmt, spec->stars, star, v);
+		return TRUE;
+	}
+	case 's':
+	case 'm':
+		if (!get_string(r, str))
+			return FALSE;
+
+		fmt[n++] = 's';
+		fmt[n] = '\0';
+		APPEND_SPEC(out, fmt, spec->stars, star, str);
+		return TRUE;
+	case 'p':
+	case 'n':
+	{
+		void *v;
+
+		if (!get_arg(r, TRACE_ARG_POINTER, &v, sizeof(v)))
+			return FALSE;
+
+		if (spec->conv == 'n')
+			return TRUE;
+
+		fmt[n++] = 'p';
+		fmt[n] = '\0';
+		APPEND_SPEC(out, fmt, spec->stars, star, v);
+		return TRUE;
+	}
+	}
+
+	return FALSE;
+}
+
+static void format_record(const struct trace_record *rec, GString *out)
+{
+	struct arg_reader r;
+	const char *f = rec->format;
+	struct trace_spec spec;
+
+	r.p = (const unsigned char *) rec + TRACE_HEADER_SIZE;
+	r.end = r.p + rec->args;
+
+	g_string_truncate(out, 0);
+
+	while (*f) {
+		const char *pct = strchr(f, '%');
+
+		if (pct == NULL) {
+			g_string_append(out, f);
+			return;
+		}
+
+		g_string_append_len(out, f, pct - f);
+
+		if (pct[1] == '%') {
+			g_string_append_c(out, '%');
+			f = pct + 2;
+			continue;
+		}
+
+		if (!parse_spec(pct + 1, &spec) ||
+				!format_spec(out, &spec, &r)) {
+			g_string_append(out, pct);
+			return;
+		}
+
+		f = spec.end;
+	}
+}
+
+static inline struct trace_record *ring_record(guint pos)
+{
+	return (struct trace_record *) (ring->buf + (pos & (ring->size - 1)));
+}
+
+/* Only called by the consumer, or the producer when overwriting */
+static guint ring_skip(guint tail)
+{
+	struct trace_record *rec = ring_record(tail);
+
+	if (rec->size == 0)
+		return tail + ring->size - (tail & (ring->size - 1));
+
+	return tail + rec->size;
+}
+
+void __ofono_trace_vrecord(const char *format, va_list ap)
+{
+	unsigned char args[TRACE_RECORD_MAX - TRACE_HEADER_SIZE];
+	struct trace_record *rec;
+	guint head, tail, pos, pad, size;
+	size_t len;
+
+	if (ring == NULL)
+		return;
+
+	len = capture_args(format, ap, args, sizeof(args));
+	size = TRACE_HEADER_SIZE + TRACE_ALIGN(len);
+
+	head = g_atomic_int_get(&ring->head);
+	tail = g_atomic_int_get(&ring->tail);
+	pos = head & (ring->size - 1);
+
+	/* Records never wrap, pad out the end of the buffer if needed */
+	pad = pos + size > ring->size ? ring->size - pos : 0;
+
+	while (ring->size - (head - tail) < pad + size) {
+		if (!ring->overwrite) {
+			g_atomic_int_inc(&ring->dropped);
+			return;
+		}
+
+		tail = ring_skip(tail);
+		g_atomic_int_set(&ring->tail, tail);
+	}
+
+	if (pad) {
+		ring_record(head)->size = 0;
+		head += pad;
+	}
+
+	rec = ring_record(head);
+	rec->size = size;
+	rec->args = len;
+	rec->time = g_get_real_time();
+	rec->format = format;
+	memcpy((unsigned char *) rec + TRACE_HEADER_SIZE, args, len);
+
+	/* Publishes the record to the consumer */
+	g_atomic_int_set(&ring->head, head + size);
+}
+
+void __ofono_trace_record(const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	__ofono_trace_vrecord(format, ap);
+	va_end(ap);
+}
+
+static unsigned int ring_consume(ofono_trace_dump_cb_t cb, void *data)
+{
+	GString *line = g_string_sized_new(256);
+	guint head = g_atomic_int_get(&ring->head);
+	guint tail = g_atomic_int_get(&ring->tail);
+	unsigned int count = 0;
+	gint dropped;
+
+	do {
+		dropped = g_atomic_int_get(&ring->dropped);
+	} while (dropped &&
+		!g_atomic_int_compare_and_exchange(&ring->dropped,
+							dropped, 0));
+
+	if (dropped) {
+		g_string_printf(line, "%d trace records dropped", dropped);
+		cb(g_get_real_time(), line->str, data);
+	}
+
+	while (tail != head) {
+		struct trace_record *rec = ring_record(tail);
+
+		if (rec->size != 0) {
+			format_record(rec, line);
+			cb(rec->time, line->str, data);
+			count += 1;
+		}
+
+		tail = ring_skip(tail);
+		g_atomic_int_set(&ring->tail, tail);
+	}
+
+	g_string_free(line, TRUE);
+
+	return count;
+}
+
+int __ofono_trace_dump(ofono_trace_dump_cb_t cb, void *data)
+{
+	if (ring == NULL)
+		return -ENOENT;
+
+#ifdef NEED_THREADS
+	if (ring->drain)
+		return -EBUSY;
+#endif
+
+	return ring_consume(cb, data);
+}
+
+#ifdef NEED_THREADS
+static void syslog_line(gint64 time, const char *line, void *data)
+{
+	syslog(LOG_DEBUG, "%s", line);
+}
+
+static gpointer drain_thread(gpointer data)
+{
+	while (g_atomic_int_get(&ring->draining)) {
+		if (ring_consume(syslog_line, NULL) == 0)
+			g_usleep(TRACE_DRAIN_INTERVAL);
+	}
+
+	/* Whatever was recorded before the drain was stopped */
+	ring_consume(syslog_line, NULL);
+
+	return NULL;
+}
+#endif
+
+int __ofono_trace_set_drain(ofono_bool_t enable)
+{
+#ifdef NEED_THREADS
+	if (ring == NULL)
+		return -ENOENT;
+
+	if (enable == (ring->drain != NULL))
+		return 0;
+
+	if (enable == FALSE) {
+		g_atomic_int_set(&ring->draining, 0);
+		g_thread_join(ring->drain);
+		ring->drain = NULL;
+		ring->overwrite = TRUE;
+		return 0;
+	}
+
+	ring->overwrite = FALSE;
+	g_atomic_int_set(&ring->draining, 1);
+
+	ring->drain = g_thread_create(drain_thread, NULL, TRUE, NULL);
+	if (ring->drain == NULL) {
+		ring->overwrite = TRUE;
+		return -EIO;
+	}
+
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int __ofono_trace_init(unsigned int size)
+{
+	guint ring_size = TRACE_RECORD_MAX * 4;
+
+	if (ring != NULL)
+		return 0;
+
+	if (size == 0)
+		size = TRACE_RING_SIZE;
+
+	while (ring_size < size && ring_size < (1U << 30))
+		ring_size <<= 1;
+
+	ring = g_try_new0(struct trace_ring, 1);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring->buf = g_try_malloc(ring_size);
+	if (ring->buf == NULL) {
+		g_free(ring);
+		ring = NULL;
+		return -ENOMEM;
+	}
+
+	ring->size = ring_size;
+	ring->overwrite = TRUE;
+
+	return 0;
+}
+
+void __ofono_trace_cleanup(void)
+{
+	if (ring == NULL)
+		return;
+
+	__ofono_trace_set_drain(FALSE);
+
+	g_free(ring->buf);
+	g_free(ring);
+	ring = NULL;
+}
@@ -761,6 +761,8 @@ static const GDBusSignalTable ussd_signals[] = {
 					GDBUS_ARGS({ "message", "s" })) },
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ }
 };
 
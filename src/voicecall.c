@@ -42,16 +42,38 @@
 
 #define MAX_VOICE_CALLS 16
 
+/* Call ids are kept in a 32 bit mask by the modem, see modem.c */
+#define MAX_CALL_ID 32
+#define NUM_CALL_STATUS (CALL_STATUS_DISCONNECTED + 1)
+
 #define VOICECALL_FLAG_SIM_ECC_READY 0x1
 #define VOICECALL_FLAG_STK_MODEM_CALLSETUP 0x2
 
 #define SETTINGS_STORE "voicecall"
 #define SETTINGS_GROUP "Settings"
 
+/* Number of tracepoint records kept for GetEvents */
+#define TRACE_RING_SIZE 64
+/* Latency buckets are powers of two in us, the last one is open ended */
+#define TRACE_HISTOGRAM_BUCKETS 24
+
+#define voicecall_trace(vc, tp, id, callid)				\
+	do {								\
+		if (G_UNLIKELY((vc)->trace != NULL))			\
+			voicecall_trace_record((vc), (tp), (id),	\
+						(callid), 0);		\
+	} while (0)
+
 GSList *g_drivers = NULL;
 
 struct ofono_voicecall {
 	GSList *call_list;
+	struct voicecall *call_index[MAX_CALL_ID];
+	unsigned int num_calls;
+	unsigned int num_with_status[NUM_CALL_STATUS];
+	int emulator_call;
+	int emulator_callsetup;
+	int emulator_callheld;
 	GSList *release_list;
 	GSList *multiparty_list;
 	GHashTable *en_list; /* emergency number list */
@@ -76,11 +98,46 @@ struct ofono_voicecall {
 	ofono_voicecall_cb_t release_queue_done_cb;
 	struct ofono_emulator *pending_em;
 	unsigned int pending_id;
+	unsigned int next_trace_id;
+	struct voicecall_trace *trace;
+};
+
+enum voicecall_tracepoint {
+	VOICECALL_TP_NOTIFY = 0,
+	VOICECALL_TP_DISCONNECTED,
+	VOICECALL_TP_STATE_CHANGED,
+	VOICECALL_TP_CALL_ADDED,
+	VOICECALL_TP_DIAL,
+	VOICECALL_TP_DIAL_CALLBACK,
+};
+
+enum voicecall_metric {
+	VOICECALL_METRIC_NOTIFY_TO_SIGNAL = 0,
+	VOICECALL_METRIC_DIAL_TO_CALLBACK,
+	VOICECALL_METRIC_LAST,
+};
+
+struct voicecall_trace_event {
+	gint64 timestamp;
+	unsigned int trace_id;
+	unsigned int call_id;
+	enum voicecall_tracepoint tp;
+};
+
+struct voicecall_trace {
+	struct voicecall_trace_event events[TRACE_RING_SIZE];
+	unsigned int next_event;
+	unsigned int num_events;
+	unsigned int histogram[VOICECALL_METRIC_LAST][TRACE_HISTOGRAM_BUCKETS];
+	gint64 notify_time;	/* Driver notification being processed */
+	gint64 dial_time;	/* Dial request waiting for the driver */
+	unsigned int dial_id;
 };
 
 struct voicecall {
 	struct ofono_call *call;
 	struct ofono_voicecall *vc;
+	unsigned int trace_id;
 	time_t start_time;
 	time_t detect_time;
 	char *message;
@@ -111,11 +168,6 @@ struct tone_queue_entry {
 	int id;
 };
 
-struct emulator_status {
-	struct ofono_voicecall *vc;
-	int status;
-};
-
 static const char *default_en_list[] = { "911", "112", NULL };
 static const char *default_en_list_no_sim[] = { "119", "118", "999", "110",
 					"08", "000", "120", "122", NULL };
@@ -229,21 +281,160 @@ static const char *time_to_str(const time_t *t)
 	return buf;
 }
 
-static unsigned int voicecalls_num_with_status(struct ofono_voicecall *vc,
-						int status)
+static const char *tracepoint_to_string(enum voicecall_tracepoint tp)
 {
-	GSList *l;
-	struct voicecall *v;
-	int num = 0;
+	switch (tp) {
+	case VOICECALL_TP_NOTIFY:
+		return "notify";
+	case VOICECALL_TP_DISCONNECTED:
+		return "disconnected";
+	case VOICECALL_TP_STATE_CHANGED:
+		return "state-changed";
+	case VOICECALL_TP_CALL_ADDED:
+		return "call-added";
+	case VOICECALL_TP_DIAL:
+		return "dial";
+	case VOICECALL_TP_DIAL_CALLBACK:
+		return "dial-callback";
+	}
 
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
+	return "unknown";
+}
 
-		if (v->call->status == status)
-			num += 1;
+static const char *metric_to_string(enum voicecall_metric metric)
+{
+	switch (metric) {
+	case VOICECALL_METRIC_NOTIFY_TO_SIGNAL:
+		return "NotifyToSignal";
+	case VOICECALL_METRIC_DIAL_TO_CALLBACK:
+		return "DialToCallback";
+	case VOICECALL_METRIC_LAST:
+		break;
+	}
+
+	return "unknown";
+}
+
+static void voicecall_trace_sample(struct voicecall_trace *trace,
+					enum voicecall_metric metric,
+					gint64 latency)
+{
+	unsigned int bucket = 0;
+
+	/* Bucket n holds latencies in [2^(n-1), 2^n) us */
+	while (latency > 0 && bucket < TRACE_HISTOGRAM_BUCKETS - 1) {
+		latency >>= 1;
+		bucket += 1;
+	}
+
+	trace->histogram[metric][bucket] += 1;
+}
+
+static void voicecall_trace_record(struct ofono_voicecall *vc,
+					enum voicecall_tracepoint tp,
+					unsigned int trace_id,
+					unsigned int call_id,
+					gint64 timestamp)
+{
+	struct voicecall_trace *trace = vc->trace;
+	struct voicecall_trace_event *event;
+
+	if (timestamp == 0)
+		timestamp = g_get_monotonic_time();
+
+	event = &trace->events[trace->next_event];
+	event->timestamp = timestamp;
+	event->trace_id = trace_id;
+	event->call_id = call_id;
+	event->tp = tp;
+
+	trace->next_event = (trace->next_event + 1) % TRACE_RING_SIZE;
+
+	if (trace->num_events < TRACE_RING_SIZE)
+		trace->num_events += 1;
+
+	switch (tp) {
+	case VOICECALL_TP_STATE_CHANGED:
+	case VOICECALL_TP_CALL_ADDED:
+		/* Only signals caused by a driver notification count */
+		if (trace->notify_time != 0)
+			voicecall_trace_sample(trace,
+					VOICECALL_METRIC_NOTIFY_TO_SIGNAL,
+					timestamp - trace->notify_time);
+		break;
+	case VOICECALL_TP_DIAL_CALLBACK:
+		if (trace->dial_time != 0)
+			voicecall_trace_sample(trace,
+					VOICECALL_METRIC_DIAL_TO_CALLBACK,
+					timestamp - trace->dial_time);
+
+		trace->dial_time = 0;
+		break;
+	default:
+		break;
 	}
+}
+
+static void voicecall_trace_notify_begin(struct ofono_voicecall *vc)
+{
+	if (G_LIKELY(vc->trace == NULL))
+		return;
+
+	vc->trace->notify_time = g_get_monotonic_time();
+}
+
+static void voicecall_trace_notify_end(struct ofono_voicecall *vc)
+{
+	if (G_LIKELY(vc->trace == NULL))
+		return;
+
+	vc->trace->notify_time = 0;
+}
+
+static void voicecalls_add(struct ofono_voicecall *vc, struct voicecall *v)
+{
+	unsigned int id = v->call->id;
+
+	vc->call_list = g_slist_insert_sorted(vc->call_list, v, call_compare);
+
+	if (id < MAX_CALL_ID)
+		vc->call_index[id] = v;
+
+	vc->num_calls += 1;
+	vc->num_with_status[v->call->status] += 1;
+}
+
+static void voicecalls_remove(struct ofono_voicecall *vc, struct voicecall *v)
+{
+	unsigned int id = v->call->id;
+
+	vc->call_list = g_slist_remove(vc->call_list, v);
+
+	if (id < MAX_CALL_ID && vc->call_index[id] == v)
+		vc->call_index[id] = NULL;
+
+	vc->num_calls -= 1;
+	vc->num_with_status[v->call->status] -= 1;
+}
+
+static struct voicecall *voicecalls_lookup(struct ofono_voicecall *vc,
+						unsigned int id)
+{
+	GSList *l;
+
+	if (id < MAX_CALL_ID)
+		return vc->call_index[id];
+
+	l = g_slist_find_custom(vc->call_list, GUINT_TO_POINTER(id),
+				call_compare_by_id);
+
+	return l ? l->data : NULL;
+}
 
-	return num;
+static unsigned int voicecalls_num_with_status(struct ofono_voicecall *vc,
+						int status)
+{
+	return vc->num_with_status[status];
 }
 
 static unsigned int voicecalls_num_active(struct ofono_voicecall *vc)
@@ -268,35 +459,14 @@ static unsigned int voicecalls_num_connecting(struct ofono_voicecall *vc)
 
 static gboolean voicecalls_have_active(struct ofono_voicecall *vc)
 {
-	GSList *l;
-	struct voicecall *v;
-
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		if (v->call->status == CALL_STATUS_ACTIVE ||
-				v->call->status == CALL_STATUS_DIALING ||
-				v->call->status == CALL_STATUS_ALERTING)
-			return TRUE;
-	}
-
-	return FALSE;
+	return voicecalls_num_active(vc) > 0 ||
+			voicecalls_num_connecting(vc) > 0;
 }
 
 static gboolean voicecalls_have_with_status(struct ofono_voicecall *vc,
 						int status)
 {
-	GSList *l;
-	struct voicecall *v;
-
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		if (v->call->status == status)
-			return TRUE;
-	}
-
-	return FALSE;
+	return voicecalls_num_with_status(vc, status) > 0;
 }
 
 static gboolean voicecalls_have_held(struct ofono_voicecall *vc)
@@ -329,19 +499,12 @@ static void dial_request_finish(struct ofono_voicecall *vc)
 
 static gboolean voicecalls_can_dtmf(struct ofono_voicecall *vc)
 {
-	GSList *l;
-	struct voicecall *v;
-
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		if (v->call->status == CALL_STATUS_ACTIVE)
-			return TRUE;
+	if (voicecalls_have_with_status(vc, CALL_STATUS_ACTIVE))
+		return TRUE;
 
-		/* Connected for 2nd stage dialing */
-		if (v->call->status == CALL_STATUS_ALERTING)
-			return TRUE;
-	}
+	/* Connected for 2nd stage dialing */
+	if (voicecalls_have_with_status(vc, CALL_STATUS_ALERTING))
+		return TRUE;
 
 	return FALSE;
 }
@@ -682,6 +845,8 @@ static const GDBusMethodTable voicecall_methods[] = {
 static const GDBusSignalTable voicecall_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("DisconnectReason",
 					GDBUS_ARGS({ "reason", "s" })) },
 	{ }
@@ -698,6 +863,7 @@ static struct voicecall *voicecall_create(struct ofono_voicecall *vc,
 
 	v->call = call;
 	v->vc = vc;
+	v->trace_id = ++vc->next_trace_id;
 
 	return v;
 }
@@ -755,97 +921,71 @@ static void emulator_set_indicator_forced(struct ofono_voicecall *vc,
 						const char *name, int value)
 {
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
-	struct ofono_atom *atom;
 
-	atom = __ofono_modem_find_atom(modem, OFONO_ATOM_TYPE_EMULATOR_HFP);
-	if (atom)
-		__ofono_emulator_set_indicator_forced(atom, name, value);
+	if (g_str_equal(name, OFONO_EMULATOR_IND_CALLHELD))
+		vc->emulator_callheld = value;
+
+	__ofono_emulator_update_indicator(modem, name, value, TRUE);
 }
 
-static void emulator_call_status_cb(struct ofono_atom *atom, void *data)
+/*
+ * Forget the indicator values last sent, so that the next call to
+ * notify_emulator_call_status sends all of them, e.g. to a new emulator
+ */
+static void emulator_call_status_reset(struct ofono_voicecall *vc)
 {
-	struct emulator_status *s = data;
-
-	ofono_emulator_set_indicator(atom, OFONO_EMULATOR_IND_CALL, s->status);
+	vc->emulator_call = -1;
+	vc->emulator_callsetup = -1;
+	vc->emulator_callheld = -1;
 }
 
-static void emulator_callsetup_status_cb(struct ofono_atom *atom, void *data)
+static void emulator_update_indicator(struct ofono_voicecall *vc,
+					int *last, int value,
+					const char *name)
 {
-	struct emulator_status *s = data;
+	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
 
-	ofono_emulator_set_indicator(atom, OFONO_EMULATOR_IND_CALLSETUP,
-					s->status);
-}
+	if (*last == value)
+		return;
 
-static void emulator_callheld_status_cb(struct ofono_atom *atom, void *data)
-{
-	struct emulator_status *s = data;
+	*last = value;
 
-	ofono_emulator_set_indicator(atom, OFONO_EMULATOR_IND_CALLHELD,
-					s->status);
+	__ofono_emulator_update_indicator(modem, name, value, FALSE);
 }
 
 static void notify_emulator_call_status(struct ofono_voicecall *vc)
 {
-	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
-	gboolean call = FALSE;
-	unsigned int non_mpty = 0;
-	gboolean multiparty = FALSE;
-	gboolean held = FALSE;
-	unsigned int non_mpty_held = 0;
-	gboolean multiparty_held = FALSE;
-	gboolean incoming = FALSE;
-	gboolean dialing = FALSE;
-	gboolean alerting = FALSE;
-	gboolean waiting = FALSE;
+	gboolean call = voicecalls_have_with_status(vc, CALL_STATUS_ACTIVE);
+	gboolean held = voicecalls_have_with_status(vc, CALL_STATUS_HELD);
+	gboolean incoming = voicecalls_have_incoming(vc);
+	gboolean dialing = voicecalls_have_with_status(vc,
+							CALL_STATUS_DIALING);
+	gboolean alerting = voicecalls_have_with_status(vc,
+							CALL_STATUS_ALERTING);
+	gboolean waiting = voicecalls_have_waiting(vc);
+	unsigned int mpty = 0;
+	unsigned int mpty_held = 0;
+	unsigned int non_mpty;
+	unsigned int non_mpty_held;
+	gboolean multiparty;
+	gboolean multiparty_held;
+	int status;
 	GSList *l;
-	struct voicecall *v;
-	struct emulator_status data;
-
-	data.vc = vc;
 
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		switch (v->call->status) {
-		case CALL_STATUS_ACTIVE:
-			call = TRUE;
-			if (g_slist_find_custom(vc->multiparty_list,
-						GINT_TO_POINTER(v->call->id),
-						call_compare_by_id))
-				multiparty = TRUE;
-			else
-				non_mpty++;
-			break;
-
-		case CALL_STATUS_HELD:
-			held = TRUE;
-			if (g_slist_find_custom(vc->multiparty_list,
-						GINT_TO_POINTER(v->call->id),
-						call_compare_by_id))
-				multiparty_held = TRUE;
-			else
-				non_mpty_held++;
-			break;
-
-		case CALL_STATUS_DIALING:
-			dialing = TRUE;
-			break;
-
-		case CALL_STATUS_ALERTING:
-			alerting = TRUE;
-			break;
-
-		case CALL_STATUS_INCOMING:
-			incoming = TRUE;
-			break;
+	for (l = vc->multiparty_list; l; l = l->next) {
+		struct voicecall *v = l->data;
 
-		case CALL_STATUS_WAITING:
-			waiting = TRUE;
-			break;
-		}
+		if (v->call->status == CALL_STATUS_ACTIVE)
+			mpty++;
+		else if (v->call->status == CALL_STATUS_HELD)
+			mpty_held++;
 	}
 
+	multiparty = mpty > 0;
+	multiparty_held = mpty_held > 0;
+	non_mpty = voicecalls_num_active(vc) - mpty;
+	non_mpty_held = voicecalls_num_held(vc) - mpty_held;
+
 	/*
 	 * Perform some basic sanity checks for transitionary states;
 	 * if a transitionary state is detected, then ignore it.  The call
@@ -868,39 +1008,35 @@ static void notify_emulator_call_status(struct ofono_voicecall *vc)
 	if (multiparty && multiparty_held)
 		return;
 
-	data.status = call || held ? OFONO_EMULATOR_CALL_ACTIVE :
-					OFONO_EMULATOR_CALL_INACTIVE;
+	/* Only indicators whose value changed are sent to the emulators */
+	status = call || held ? OFONO_EMULATOR_CALL_ACTIVE :
+				OFONO_EMULATOR_CALL_INACTIVE;
 
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_call_status_cb, &data);
+	emulator_update_indicator(vc, &vc->emulator_call, status,
+					OFONO_EMULATOR_IND_CALL);
 
 	if (incoming)
-		data.status = OFONO_EMULATOR_CALLSETUP_INCOMING;
+		status = OFONO_EMULATOR_CALLSETUP_INCOMING;
 	else if (dialing)
-		data.status = OFONO_EMULATOR_CALLSETUP_OUTGOING;
+		status = OFONO_EMULATOR_CALLSETUP_OUTGOING;
 	else if (alerting)
-		data.status = OFONO_EMULATOR_CALLSETUP_ALERTING;
+		status = OFONO_EMULATOR_CALLSETUP_ALERTING;
 	else if (waiting)
-		data.status = OFONO_EMULATOR_CALLSETUP_INCOMING;
+		status = OFONO_EMULATOR_CALLSETUP_INCOMING;
 	else
-		data.status = OFONO_EMULATOR_CALLSETUP_INACTIVE;
+		status = OFONO_EMULATOR_CALLSETUP_INACTIVE;
 
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_callsetup_status_cb,
-						&data);
+	emulator_update_indicator(vc, &vc->emulator_callsetup, status,
+					OFONO_EMULATOR_IND_CALLSETUP);
 
 	if (held)
-		data.status = call ? OFONO_EMULATOR_CALLHELD_MULTIPLE :
+		status = call ? OFONO_EMULATOR_CALLHELD_MULTIPLE :
 					OFONO_EMULATOR_CALLHELD_ON_HOLD;
 	else
-		data.status = OFONO_EMULATOR_CALLHELD_NONE;
+		status = OFONO_EMULATOR_CALLHELD_NONE;
 
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_callheld_status_cb,
-						&data);
+	emulator_update_indicator(vc, &vc->emulator_callheld, status,
+					OFONO_EMULATOR_IND_CALLHELD);
 }
 
 static void voicecall_set_call_status(struct voicecall *call, int status)
@@ -916,6 +1052,8 @@ static void voicecall_set_call_status(struct voicecall *call, int status)
 	old_status = call->call->status;
 
 	call->call->status = status;
+	call->vc->num_with_status[old_status] -= 1;
+	call->vc->num_with_status[status] += 1;
 
 	status_str = call_status_to_string(status);
 	path = voicecall_build_path(call->vc, call->call);
@@ -925,6 +1063,9 @@ static void voicecall_set_call_status(struct voicecall *call, int status)
 						"State", DBUS_TYPE_STRING,
 						&status_str);
 
+	voicecall_trace(call->vc, VOICECALL_TP_STATE_CHANGED, call->trace_id,
+						call->call->id);
+
 	notify_emulator_call_status(call->vc);
 
 	if (status == CALL_STATUS_ACTIVE &&
@@ -1128,6 +1269,9 @@ static GSList *voicecalls_held_list(struct ofono_voicecall *vc)
 	GSList *r = NULL;
 	struct voicecall *v;
 
+	if (!voicecalls_have_held(vc))
+		return NULL;
+
 	for (l = vc->call_list; l; l = l->next) {
 		v = l->data;
 
@@ -1151,6 +1295,9 @@ static GSList *voicecalls_active_list(struct ofono_voicecall *vc)
 	GSList *r = NULL;
 	struct voicecall *v;
 
+	if (voicecalls_num_active(vc) == 0)
+		return NULL;
+
 	for (l = vc->call_list; l; l = l->next) {
 		v = l->data;
 
@@ -1170,6 +1317,9 @@ struct ofono_call *__ofono_voicecall_find_call_with_status(
 	GSList *l;
 	struct voicecall *v;
 
+	if (!voicecalls_have_with_status(vc, status))
+		return NULL;
+
 	for (l = vc->call_list; l; l = l->next) {
 		v = l->data;
 
@@ -1248,6 +1398,8 @@ static void voicecalls_emit_call_added(struct ofono_voicecall *vc,
 	dbus_message_iter_close_container(&iter, &dict);
 
 	g_dbus_send_message(ofono_dbus_get_connection(), signal);
+
+	voicecall_trace(vc, VOICECALL_TP_CALL_ADDED, v->trace_id, v->call->id);
 }
 
 static void voicecalls_release_queue(struct ofono_voicecall *vc, GSList *calls,
@@ -1454,8 +1606,7 @@ static struct voicecall *dial_handle_result(struct ofono_voicecall *vc,
 	DBG("Registering new call: %d", call->id);
 	voicecall_dbus_register(v);
 
-	vc->call_list = g_slist_insert_sorted(vc->call_list, v,
-				call_compare);
+	voicecalls_add(vc, v);
 
 	*need_to_emit = TRUE;
 
@@ -1479,6 +1630,11 @@ static void manager_dial_callback(const struct ofono_error *error, void *data)
 
 	v = dial_handle_result(vc, error, number, &need_to_emit);
 
+	if (G_UNLIKELY(vc->trace != NULL))
+		voicecall_trace_record(vc, VOICECALL_TP_DIAL_CALLBACK,
+					vc->trace->dial_id,
+					v ? v->call->id : 0, 0);
+
 	if (v) {
 		const char *path = voicecall_build_path(vc, v->call);
 
@@ -1508,7 +1664,7 @@ static int voicecall_dial(struct ofono_voicecall *vc, const char *number,
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
 	struct ofono_phone_number ph;
 
-	if (g_slist_length(vc->call_list) >= MAX_VOICE_CALLS)
+	if (vc->num_calls >= MAX_VOICE_CALLS)
 		return -EPERM;
 
 	if (valid_ussd_string(number, vc->call_list != NULL))
@@ -1571,8 +1727,19 @@ static DBusMessage *manager_dial(DBusConnection *conn,
 
 	vc->pending = dbus_message_ref(msg);
 
+	if (G_UNLIKELY(vc->trace != NULL)) {
+		vc->trace->dial_id = ++vc->next_trace_id;
+		vc->trace->dial_time = g_get_monotonic_time();
+		voicecall_trace_record(vc, VOICECALL_TP_DIAL,
+					vc->trace->dial_id, 0,
+					vc->trace->dial_time);
+	}
+
 	err = voicecall_dial(vc, number, clir, manager_dial_callback, vc);
 
+	if (err < 0 && vc->trace)
+		vc->trace->dial_time = 0;
+
 	if (err >= 0)
 		return NULL;
 
@@ -2181,12 +2348,240 @@ static const GDBusSignalTable manager_signals[] = {
 	{ GDBUS_SIGNAL("BarringActive", GDBUS_ARGS({ "type", "s" })) },
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("CallAdded",
 		GDBUS_ARGS({ "path", "o" }, { "properties", "a{sv}" })) },
 	{ GDBUS_SIGNAL("CallRemoved", GDBUS_ARGS({ "path", "o"})) },
 	{ }
 };
 
+static DBusMessage *trace_get_properties(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_voicecall *vc = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_bool_t enabled = vc->trace != NULL;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	ofono_dbus_dict_append(&dict, "Enabled", DBUS_TYPE_BOOLEAN, &enabled);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static DBusMessage *trace_set_property(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_voicecall *vc = data;
+	const char *path = __ofono_atom_get_path(vc->atom);
+	DBusMessageIter iter;
+	DBusMessageIter var;
+	const char *property;
+	dbus_bool_t enabled;
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_get_basic(&iter, &property);
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_VARIANT)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_recurse(&iter, &var);
+
+	if (g_str_equal(property, "Enabled") == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_BOOLEAN)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_get_basic(&var, &enabled);
+
+	if (enabled == (vc->trace != NULL))
+		return dbus_message_new_method_return(msg);
+
+	if (enabled) {
+		vc->trace = g_new0(struct voicecall_trace, 1);
+	} else {
+		g_free(vc->trace);
+		vc->trace = NULL;
+	}
+
+	g_dbus_send_reply(conn, msg, DBUS_TYPE_INVALID);
+
+	ofono_dbus_signal_property_changed(conn, path,
+						OFONO_VOICECALL_TRACE_INTERFACE,
+						"Enabled", DBUS_TYPE_BOOLEAN,
+						&enabled);
+
+	return NULL;
+}
+
+static DBusMessage *trace_get_events(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_voicecall *vc = data;
+	struct voicecall_trace *trace = vc->trace;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	unsigned int i;
+
+	if (trace == NULL)
+		return __ofono_error_not_available(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ustu)",
+						&array);
+
+	/* Oldest first */
+	for (i = 0; i < trace->num_events; i++) {
+		unsigned int n = (trace->next_event + TRACE_RING_SIZE -
+					trace->num_events + i) %
+					TRACE_RING_SIZE;
+		struct voicecall_trace_event *event = &trace->events[n];
+		const char *tp = tracepoint_to_string(event->tp);
+		dbus_uint64_t timestamp = event->timestamp;
+		DBusMessageIter entry;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32,
+						&event->trace_id);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &tp);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64,
+						&timestamp);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32,
+						&event->call_id);
+		dbus_message_iter_close_container(&array, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *trace_get_histograms(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_voicecall *vc = data;
+	struct voicecall_trace *trace = vc->trace;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	enum voicecall_metric metric;
+	unsigned int i;
+
+	if (trace == NULL)
+		return __ofono_error_not_available(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+						"{sa(tu)}", &dict);
+
+	for (metric = 0; metric < VOICECALL_METRIC_LAST; metric++) {
+		const char *name = metric_to_string(metric);
+		DBusMessageIter entry;
+		DBusMessageIter buckets;
+
+		dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						&name);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+							"(tu)", &buckets);
+
+		for (i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+			dbus_uint64_t lower = i ? 1ULL << (i - 1) : 0;
+			DBusMessageIter bucket;
+
+			if (trace->histogram[metric][i] == 0)
+				continue;
+
+			dbus_message_iter_open_container(&buckets,
+							DBUS_TYPE_STRUCT,
+							NULL, &bucket);
+			dbus_message_iter_append_basic(&bucket,
+							DBUS_TYPE_UINT64,
+							&lower);
+			dbus_message_iter_append_basic(&bucket,
+						DBUS_TYPE_UINT32,
+						&trace->histogram[metric][i]);
+			dbus_message_iter_close_container(&buckets, &bucket);
+		}
+
+		dbus_message_iter_close_container(&entry, &buckets);
+		dbus_message_iter_close_container(&dict, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static DBusMessage *trace_reset(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_voicecall *vc = data;
+
+	if (vc->trace == NULL)
+		return __ofono_error_not_available(msg);
+
+	memset(vc->trace, 0, sizeof(*vc->trace));
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable trace_methods[] = {
+	{ GDBUS_METHOD("GetProperties",
+			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
+			trace_get_properties) },
+	{ GDBUS_METHOD("SetProperty",
+			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
+			NULL, trace_set_property) },
+	{ GDBUS_METHOD("GetEvents",
+			NULL, GDBUS_ARGS({ "events", "a(ustu)" }),
+			trace_get_events) },
+	{ GDBUS_METHOD("GetHistograms",
+			NULL, GDBUS_ARGS({ "histograms", "a{sa(tu)}" }),
+			trace_get_histograms) },
+	{ GDBUS_METHOD("Reset", NULL, NULL, trace_reset) },
+	{ }
+};
+
+static const GDBusSignalTable trace_signals[] = {
+	{ GDBUS_SIGNAL("PropertyChanged",
+			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("PropertiesChanged",
+			GDBUS_ARGS({ "properties", "a{sv}" })) },
+	{ }
+};
+
 void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
 				enum ofono_disconnect_reason reason,
 				const struct ofono_error *error)
@@ -2202,16 +2597,15 @@ void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
 
 	__ofono_modem_callid_release(modem, id);
 
-	l = g_slist_find_custom(vc->call_list, GUINT_TO_POINTER(id),
-				call_compare_by_id);
-
-	if (l == NULL) {
+	call = voicecalls_lookup(vc, id);
+	if (call == NULL) {
 		ofono_error("Plugin notified us of call disconnect for"
 				" unknown call");
 		return;
 	}
 
-	call = l->data;
+	voicecall_trace_notify_begin(vc);
+	voicecall_trace(vc, VOICECALL_TP_DISCONNECTED, call->trace_id, id);
 
 	ts = time(NULL);
 	prev_status = call->call->status;
@@ -2254,16 +2648,18 @@ void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
 
 	voicecalls_emit_call_removed(vc, call);
 
+	voicecalls_remove(vc, call);
+
+	/* Frees call, it must not be used after this */
 	voicecall_dbus_unregister(vc, call);
 
-	vc->call_list = g_slist_remove(vc->call_list, call);
+	voicecall_trace_notify_end(vc);
 }
 
 void ofono_voicecall_notify(struct ofono_voicecall *vc,
 				const struct ofono_call *call)
 {
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
-	GSList *l;
 	struct voicecall *v = NULL;
 	struct ofono_call *newcall;
 
@@ -2272,18 +2668,19 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 			call->id, call->phone_number.number,
 			call->called_number.number, call->name);
 
-	l = g_slist_find_custom(vc->call_list, GUINT_TO_POINTER(call->id),
-				call_compare_by_id);
+	voicecall_trace_notify_begin(vc);
 
-	if (l) {
+	v = voicecalls_lookup(vc, call->id);
+	if (v) {
 		DBG("Found call with id: %d", call->id);
-		voicecall_set_call_status(l->data, call->status);
-		voicecall_set_call_lineid(l->data, &call->phone_number,
+		voicecall_trace(vc, VOICECALL_TP_NOTIFY, v->trace_id, call->id);
+		voicecall_set_call_status(v, call->status);
+		voicecall_set_call_lineid(v, &call->phone_number,
 						call->clip_validity);
-		voicecall_set_call_calledid(l->data, &call->called_number);
-		voicecall_set_call_name(l->data, call->name,
-						call->cnap_validity);
+		voicecall_set_call_calledid(v, &call->called_number);
+		voicecall_set_call_name(v, call->name, call->cnap_validity);
 
+		voicecall_trace_notify_end(vc);
 		return;
 	}
 
@@ -2303,6 +2700,8 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 		goto error;
 	}
 
+	voicecall_trace(vc, VOICECALL_TP_NOTIFY, v->trace_id, call->id);
+
 	if (vc->flags & VOICECALL_FLAG_STK_MODEM_CALLSETUP) {
 		struct dial_request *req = vc->dial_req;
 		const char *phone_number = phone_number_to_string(&req->ph);
@@ -2342,13 +2741,16 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 		goto error;
 	}
 
-	vc->call_list = g_slist_insert_sorted(vc->call_list, v, call_compare);
+	voicecalls_add(vc, v);
 
 	voicecalls_emit_call_added(vc, v);
 
+	voicecall_trace_notify_end(vc);
 	return;
 
 error:
+	voicecall_trace_notify_end(vc);
+
 	if (newcall)
 		g_free(newcall);
 
@@ -2664,25 +3066,13 @@ static void emulator_hfp_unregister(struct ofono_atom *atom)
 	struct ofono_voicecall *vc = __ofono_atom_get_data(atom);
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 
-	struct emulator_status data;
-	data.vc = vc;
-
-	data.status = OFONO_EMULATOR_CALL_INACTIVE;
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_call_status_cb, &data);
-
-	data.status = OFONO_EMULATOR_CALLSETUP_INACTIVE;
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_callsetup_status_cb,
-						&data);
-
-	data.status = OFONO_EMULATOR_CALLHELD_NONE;
-	__ofono_modem_foreach_registered_atom(modem,
-						OFONO_ATOM_TYPE_EMULATOR_HFP,
-						emulator_callheld_status_cb,
-						&data);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_CALL,
+					OFONO_EMULATOR_CALL_INACTIVE, FALSE);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_CALLSETUP,
+					OFONO_EMULATOR_CALLSETUP_INACTIVE,
+					FALSE);
+	__ofono_emulator_update_indicator(modem, OFONO_EMULATOR_IND_CALLHELD,
+					OFONO_EMULATOR_CALLHELD_NONE, FALSE);
 
 	__ofono_modem_foreach_registered_atom(modem,
 						OFONO_ATOM_TYPE_EMULATOR_HFP,
@@ -2786,6 +3176,18 @@ static void voicecall_unregister(struct ofono_atom *atom)
 	g_slist_free(vc->call_list);
 	vc->call_list = NULL;
 
+	memset(vc->call_index, 0, sizeof(vc->call_index));
+	memset(vc->num_with_status, 0, sizeof(vc->num_with_status));
+	vc->num_calls = 0;
+	emulator_call_status_reset(vc);
+
+	ofono_modem_remove_interface(modem, OFONO_VOICECALL_TRACE_INTERFACE);
+	g_dbus_unregister_interface(conn, path,
+					OFONO_VOICECALL_TRACE_INTERFACE);
+
+	g_free(vc->trace);
+	vc->trace = NULL;
+
 	ofono_modem_remove_interface(modem, OFONO_VOICECALL_MANAGER_INTERFACE);
 	g_dbus_unregister_interface(conn, path,
 					OFONO_VOICECALL_MANAGER_INTERFACE);
@@ -2837,6 +3239,7 @@ struct ofono_voicecall *ofono_voicecall_create(struct ofono_modem *modem,
 		return NULL;
 
 	vc->toneq = g_queue_new();
+	emulator_call_status_reset(vc);
 
 	vc->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_VOICECALL,
 						voicecall_remove, vc);
@@ -3567,6 +3970,7 @@ static void emulator_hfp_watch(struct ofono_atom *atom,
 		break;
 	}
 
+	emulator_call_status_reset(vc);
 	notify_emulator_call_status(vc);
 
 	ofono_emulator_add_handler(atom, "A", emulator_ata_cb, vc, NULL);
@@ -3596,6 +4000,16 @@ void ofono_voicecall_register(struct ofono_voicecall *vc)
 
 	ofono_modem_add_interface(modem, OFONO_VOICECALL_MANAGER_INTERFACE);
 
+	if (g_dbus_register_interface(conn, path,
+					OFONO_VOICECALL_TRACE_INTERFACE,
+					trace_methods, trace_signals, NULL,
+					vc, NULL))
+		ofono_modem_add_interface(modem,
+					OFONO_VOICECALL_TRACE_INTERFACE);
+	else
+		ofono_error("Could not create %s interface",
+				OFONO_VOICECALL_TRACE_INTERFACE);
+
 	vc->en_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, NULL);
 
@@ -3654,15 +4068,15 @@ ofono_bool_t __ofono_voicecall_is_busy(struct ofono_voicecall *vc,
 		return vc->call_list != NULL;
 	case OFONO_VOICECALL_INTERACTION_DISCONNECT:
 		/* Only support releasing active calls */
-		if (voicecalls_num_active(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_active(vc) == vc->num_calls)
 			return FALSE;
 
 		return TRUE;
 	case OFONO_VOICECALL_INTERACTION_PUT_ON_HOLD:
-		if (voicecalls_num_active(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_active(vc) == vc->num_calls)
 			return FALSE;
 
-		if (voicecalls_num_held(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_held(vc) == vc->num_calls)
 			return FALSE;
 
 		return TRUE;
@@ -3980,18 +4394,10 @@ static void ssn_mt_forwarded_notify(struct ofono_voicecall *vc,
 static struct voicecall *voicecall_select(struct ofono_voicecall *vc,
 						unsigned int id)
 {
-	if (id != 0) {
-		GSList *l = g_slist_find_custom(vc->call_list,
-						GUINT_TO_POINTER(id),
-						call_compare_by_id);
-
-		if (l == NULL)
-			return NULL;
-
-		return l->data;
-	}
+	if (id != 0)
+		return voicecalls_lookup(vc, id);
 
-	if (g_slist_length(vc->call_list) == 1)
+	if (vc->num_calls == 1)
 		return vc->call_list->data;
 
 	return NULL;
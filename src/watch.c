@@ -26,22 +26,66 @@
 #include <glib.h>
 #include "ofono.h"
 
+#define WATCHLIST_MIN_SLOTS 4
+
 struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
 {
 	struct ofono_watchlist *watchlist;
 
 	watchlist = g_new0(struct ofono_watchlist, 1);
 	watchlist->destroy = destroy;
+	watchlist->index = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	return watchlist;
 }
 
+static void watchlist_compact(struct ofono_watchlist *watchlist)
+{
+	struct ofono_watchlist_item *item;
+	unsigned int i;
+	unsigned int n = 0;
+
+	for (i = 0; i < watchlist->n_slots; i++) {
+		item = watchlist->slots[i];
+
+		if (item == NULL)
+			continue;
+
+		if (i != n) {
+			watchlist->slots[n] = item;
+			g_hash_table_insert(watchlist->index,
+						GUINT_TO_POINTER(item->id),
+						GUINT_TO_POINTER(n));
+		}
+
+		n += 1;
+	}
+
+	watchlist->n_slots = n;
+	watchlist->holes = 0;
+}
+
 unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item)
 {
 	item->id = ++watchlist->next_id;
 
-	watchlist->items = g_slist_prepend(watchlist->items, item);
+	if (watchlist->n_slots == watchlist->alloc) {
+		if (watchlist->holes > 0 && watchlist->walking == 0)
+			watchlist_compact(watchlist);
+	}
+
+	if (watchlist->n_slots == watchlist->alloc) {
+		watchlist->alloc = MAX(watchlist->alloc * 2,
+						WATCHLIST_MIN_SLOTS);
+		watchlist->slots = g_renew(struct ofono_watchlist_item *,
+						watchlist->slots,
+						watchlist->alloc);
+	}
+
+	g_hash_table_insert(watchlist->index, GUINT_TO_POINTER(item->id),
+				GUINT_TO_POINTER(watchlist->n_slots));
+	watchlist->slots[watchlist->n_slots++] = item;
 
 	return item->id;
 }
@@ -50,55 +94,101 @@ gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id)
 {
 	struct ofono_watchlist_item *item;
-	GSList *p;
-	GSList *c;
+	gpointer slot;
+	unsigned int n;
+
+	if (!g_hash_table_lookup_extended(watchlist->index,
+						GUINT_TO_POINTER(id),
+						NULL, &slot))
+		return FALSE;
+
+	n = GPOINTER_TO_UINT(slot);
+	item = watchlist->slots[n];
+
+	g_hash_table_remove(watchlist->index, GUINT_TO_POINTER(id));
+
+	/*
+	 * Clear the slot before calling out, the destroy functions are
+	 * allowed to add or remove other watches.
+	 */
+	if (watchlist->walking == 0 && n == watchlist->n_slots - 1)
+		watchlist->n_slots -= 1;
+	else {
+		watchlist->slots[n] = NULL;
+		watchlist->holes += 1;
+	}
 
-	p = NULL;
-	c = watchlist->items;
+	if (item->destroy)
+		item->destroy(item->notify_data);
 
-	while (c) {
-		item = c->data;
+	if (watchlist->destroy)
+		watchlist->destroy(item);
 
-		if (item->id != id) {
-			p = c;
-			c = c->next;
-			continue;
-		}
+	if (watchlist->walking == 0 &&
+			watchlist->holes * 2 > watchlist->n_slots)
+		watchlist_compact(watchlist);
+
+	return TRUE;
+}
+
+void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
+{
+	struct ofono_watchlist_item *item;
+	unsigned int i;
+
+	for (i = 0; i < watchlist->n_slots; i++) {
+		item = watchlist->slots[i];
 
-		if (p)
-			p->next = c->next;
-		else
-			watchlist->items = c->next;
+		if (item == NULL)
+			continue;
 
 		if (item->destroy)
 			item->destroy(item->notify_data);
 
 		if (watchlist->destroy)
 			watchlist->destroy(item);
-		g_slist_free_1(c);
-
-		return TRUE;
 	}
 
-	return FALSE;
+	g_hash_table_destroy(watchlist->index);
+	g_free(watchlist->slots);
+	g_free(watchlist);
 }
 
-void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
+/*
+ * Walks the items newest first.  Items added during the walk are not
+ * visited, items removed during the walk are skipped.  Every call to
+ * __ofono_watchlist_iter_init must be paired with __ofono_watchlist_iter_end.
+ */
+void __ofono_watchlist_iter_init(struct ofono_watchlist *watchlist,
+					struct ofono_watchlist_iter *iter)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
+	iter->watchlist = watchlist;
+	iter->pos = watchlist->n_slots;
 
-	for (l = watchlist->items; l; l = l->next) {
-		item = l->data;
+	watchlist->walking += 1;
+}
 
-		if (item->destroy)
-			item->destroy(item->notify_data);
+struct ofono_watchlist_item *__ofono_watchlist_iter_next(
+					struct ofono_watchlist_iter *iter)
+{
+	struct ofono_watchlist_item *item;
 
-		if (watchlist->destroy)
-			watchlist->destroy(item);
+	while (iter->pos > 0) {
+		item = iter->watchlist->slots[--iter->pos];
+
+		if (item)
+			return item;
 	}
 
-	g_slist_free(watchlist->items);
-	watchlist->items = NULL;
-	g_free(watchlist);
+	return NULL;
+}
+
+void __ofono_watchlist_iter_end(struct ofono_watchlist_iter *iter)
+{
+	struct ofono_watchlist *watchlist = iter->watchlist;
+
+	watchlist->walking -= 1;
+
+	if (watchlist->walking == 0 && watchlist->holes > 0)
+		watchlist_compact(watchlist);
 }
@@ -0,0 +1,1978 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A fake rild for exercising the ril plugin end to end.  It listens on
+ * the rild socket, answers the requests the rilmodem drivers send from a
+ * small model of a modem (SIM, registration, voice calls) and can play
+ * storms of unsolicited events.  With --benchmark it also drives ofonod
+ * over D-Bus and reports time to SIM ready, time to registered, dial,
+ * incoming call and answer latency, and ofonod CPU time per storm event:
+ *
+ *   fake-rild --benchmark &
+ *   OFONO_RIL_DEVICE=ril ofonod -n -p ril,rildev
+ *
+ * The optional script is a key file:
+ *
+ *   [General]
+ *   Version=9             RIL version reported on connect
+ *   Latency=2             default response latency in ms
+ *   RegistrationDelay=100 ms from radio on to registered
+ *   AlertDelay=50         ms from dial to alerting
+ *   ConnectDelay=100      ms from alerting to active
+ *   Imsi=001010123456789
+ *   Imei=...  Baseband=...  Operator=long,short,numeric
+ *
+ *   [Latency]             per request latency, by request number
+ *   28=20
+ *
+ *   [Errors]              per request error code, by request number
+ *   98=6
+ *
+ *   [SIM]                 transparent EFs, by file id, as hex
+ *   6FAD=00000002
+ *
+ *   [SIMRecords]          linear fixed EFs, one hex record per entry
+ *   6F40=FFFF...;FFFF...
+ *
+ *   [Storm signal]        Type is signal, calls or datacalls; the storm
+ *   Type=signal           starts Delay ms after registration, or in
+ *   Count=1000            turn after the call tests with --benchmark
+ *   Interval=1
+ *   Delay=0
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <gdbus.h>
+
+#include "parcel.h"
+#include "ril_constants.h"
+
+#define OFONO_SERVICE	"org.ofono"
+
+#define OFONO_MANAGER_INTERFACE		OFONO_SERVICE ".Manager"
+#define OFONO_MODEM_INTERFACE		OFONO_SERVICE ".Modem"
+#define OFONO_SIM_INTERFACE		OFONO_SERVICE ".SimManager"
+#define OFONO_NETREG_INTERFACE		OFONO_SERVICE ".NetworkRegistration"
+#define OFONO_VCMANAGER_INTERFACE	OFONO_SERVICE ".VoiceCallManager"
+#define OFONO_CALL_INTERFACE		OFONO_SERVICE ".VoiceCall"
+
+#define RILD_SOCKET		"/dev/socket/rild"
+#define MAX_MESSAGE_SIZE	8192
+
+/* Time without traffic after which a storm is considered handled */
+#define QUIET_TIME		200
+
+/* Call states, as in RIL_CallState */
+enum call_state {
+	CALL_ACTIVE =		0,
+	CALL_HELD =		1,
+	CALL_DIALING =		2,
+	CALL_ALERTING =		3,
+	CALL_INCOMING =		4,
+	CALL_WAITING =		5,
+};
+
+enum storm_type {
+	STORM_SIGNAL,
+	STORM_CALLS,
+	STORM_DATA_CALLS,
+};
+
+enum bench_state {
+	BENCH_BOOT,
+	BENCH_DIAL,
+	BENCH_INCOMING,
+	BENCH_STORMS,
+	BENCH_DONE,
+};
+
+struct sim_file {
+	unsigned char *data;
+	unsigned int len;
+	unsigned int record_len;
+};
+
+struct fake_call {
+	int id;
+	enum call_state state;
+	gboolean mt;
+	char *number;
+};
+
+struct storm {
+	char *name;
+	enum storm_type type;
+	unsigned int count;
+	unsigned int interval;
+	unsigned int delay;
+	unsigned int sent;
+	guint source;
+	gint64 start;
+	gint64 cpu_start;
+};
+
+struct pending {
+	GByteArray *msg;
+	void (*after)(void);
+	guint source;
+};
+
+/* Script */
+static unsigned int ril_version = 9;
+static unsigned int default_latency = 0;
+static unsigned int registration_delay = 100;
+static unsigned int alert_delay = 50;
+static unsigned int connect_delay = 100;
+static char *imsi;
+static char *imei;
+static char *baseband;
+static char *operator_names[3];
+static GHashTable *latencies;
+static GHashTable *errors;
+static GHashTable *sim_files;
+static GSList *storms;
+
+/* Modem model */
+static int radio_state = RADIO_STATE_OFF;
+static gboolean registered = FALSE;
+static guint registration_source;
+static GSList *calls;
+static int next_call_id = 1;
+static int signal_level;
+
+/* Connection */
+static int server_fd = -1;
+static int client_fd = -1;
+static guint server_watch;
+static guint client_watch;
+static GByteArray *rx_buf;
+static GSList *pending_list;
+static pid_t client_pid;
+static gint64 connect_time;
+static gint64 last_traffic;
+static unsigned int requests_served;
+
+/* Benchmark */
+static DBusConnection *conn;
+static GMainLoop *main_loop;
+static enum bench_state bench_state = BENCH_BOOT;
+static char *modem_path;
+static char *call_path;
+static GSList *current_storm;
+static guint quiet_source;
+static gint64 sim_ready_time;
+static gint64 registered_time;
+static gint64 dial_time;
+static gint64 ring_time;
+static gint64 answer_time;
+
+static gchar *option_socket = NULL;
+static gchar *option_script = NULL;
+static gchar *option_number = NULL;
+static gboolean option_benchmark = FALSE;
+static gboolean option_verbose = FALSE;
+
+static void start_storms(void);
+static gboolean start_scheduled_storm(gpointer user_data);
+
+static double elapsed_ms(gint64 from, gint64 to)
+{
+	return (to - from) / 1000.0;
+}
+
+static gint64 read_cpu_time(pid_t pid)
+{
+	unsigned long utime, stime;
+	char path[64];
+	char buf[1024];
+	char *p;
+	FILE *f;
+	size_t len;
+
+	if (pid <= 0)
+		return -1;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = '\0';
+
+	/* Skip pid and comm, the latter may contain spaces */
+	p = strrchr(buf, ')');
+	if (p == NULL)
+		return -1;
+
+	if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+					"%lu %lu", &utime, &stime) != 2)
+		return -1;
+
+	return (gint64) (utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+static unsigned char *decode_hex(const char *hex, unsigned int *out_len)
+{
+	size_t len = strlen(hex);
+	unsigned char *buf;
+	unsigned int i;
+
+	if (len % 2)
+		return NULL;
+
+	buf = g_malloc(len / 2 + 1);
+
+	for (i = 0; i < len / 2; i++) {
+		int hi = g_ascii_xdigit_value(hex[i * 2]);
+		int lo = g_ascii_xdigit_value(hex[i * 2 + 1]);
+
+		if (hi < 0 || lo < 0) {
+			g_free(buf);
+			return NULL;
+		}
+
+		buf[i] = (hi << 4) | lo;
+	}
+
+	*out_len = len / 2;
+
+	return buf;
+}
+
+static char *encode_hex(const unsigned char *data, unsigned int len)
+{
+	GString *str = g_string_sized_new(len * 2 + 1);
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		g_string_append_printf(str, "%02X", data[i]);
+
+	return g_string_free(str, FALSE);
+}
+
+static void sim_file_free(gpointer data)
+{
+	struct sim_file *file = data;
+
+	g_free(file->data);
+	g_free(file);
+}
+
+static void add_sim_file(const char *fid, char **contents, gboolean records)
+{
+	struct sim_file *file;
+	GByteArray *data;
+	unsigned int record_len = 0;
+	unsigned int len;
+	char *end;
+	int id;
+
+	id = strtol(fid, &end, 16);
+	if (*end != '\0') {
+		g_printerr("Invalid file id %s\n", fid);
+		return;
+	}
+
+	data = g_byte_array_new();
+
+	for (; *contents; contents++) {
+		unsigned char *buf = decode_hex(g_strstrip(*contents), &len);
+
+		if (buf == NULL || (record_len && len != record_len)) {
+			g_printerr("Invalid contents for file %s\n", fid);
+			g_free(buf);
+			g_byte_array_free(data, TRUE);
+			return;
+		}
+
+		record_len = len;
+		g_byte_array_append(data, buf, len);
+		g_free(buf);
+	}
+
+	file = g_new0(struct sim_file, 1);
+	file->len = data->len;
+	file->record_len = records ? record_len : 0;
+	file->data = g_byte_array_free(data, FALSE);
+
+	g_hash_table_replace(sim_files, GINT_TO_POINTER(id), file);
+}
+
+static void add_sim_defaults(void)
+{
+	static const char *defaults[][2] = {
+		{ "2FE2", "98101430121181157002" },
+		{ "6FAD", "00000002" },
+		{ "6F46", "0146616B65FFFFFFFFFFFFFFFFFFFFFFFF" },
+	};
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(defaults); i++) {
+		char *contents[] = { (char *) defaults[i][1], NULL };
+
+		add_sim_file(defaults[i][0], contents, FALSE);
+	}
+}
+
+static void add_storm(const char *name, enum storm_type type,
+				unsigned int count, unsigned int interval,
+				unsigned int delay)
+{
+	struct storm *storm = g_new0(struct storm, 1);
+
+	storm->name = g_strdup(name);
+	storm->type = type;
+	storm->count = count;
+	storm->interval = interval;
+	storm->delay = delay;
+
+	storms = g_slist_append(storms, storm);
+}
+
+static void storm_free(gpointer data)
+{
+	struct storm *storm = data;
+
+	if (storm->source > 0)
+		g_source_remove(storm->source);
+
+	g_free(storm->name);
+	g_free(storm);
+}
+
+static void load_uint(GKeyFile *keyfile, const char *group, const char *key,
+						unsigned int *value)
+{
+	if (g_key_file_has_key(keyfile, group, key, NULL) == FALSE)
+		return;
+
+	*value = g_key_file_get_integer(keyfile, group, key, NULL);
+}
+
+static void load_string(GKeyFile *keyfile, const char *group,
+					const char *key, char **value)
+{
+	char *str = g_key_file_get_string(keyfile, group, key, NULL);
+
+	if (str == NULL)
+		return;
+
+	g_free(*value);
+	*value = str;
+}
+
+static void load_request_table(GKeyFile *keyfile, const char *group,
+							GHashTable *table)
+{
+	char **keys = g_key_file_get_keys(keyfile, group, NULL, NULL);
+	char **key;
+
+	if (keys == NULL)
+		return;
+
+	for (key = keys; *key; key++) {
+		int value = g_key_file_get_integer(keyfile, group, *key, NULL);
+
+		g_hash_table_replace(table, GINT_TO_POINTER(atoi(*key)),
+						GINT_TO_POINTER(value));
+	}
+
+	g_strfreev(keys);
+}
+
+static void load_sim_files(GKeyFile *keyfile, const char *group,
+							gboolean records)
+{
+	char **keys = g_key_file_get_keys(keyfile, group, NULL, NULL);
+	char **key;
+
+	if (keys == NULL)
+		return;
+
+	for (key = keys; *key; key++) {
+		char **contents;
+
+		if (records)
+			contents = g_key_file_get_string_list(keyfile, group,
+							*key, NULL, NULL);
+		else {
+			contents = g_new0(char *, 2);
+			contents[0] = g_key_file_get_string(keyfile, group,
+							*key, NULL);
+		}
+
+		if (contents != NULL && contents[0] != NULL)
+			add_sim_file(*key, contents, records);
+
+		g_strfreev(contents);
+	}
+
+	g_strfreev(keys);
+}
+
+static void load_storm(GKeyFile *keyfile, const char *group)
+{
+	unsigned int count = 100, interval = 10, delay = 0;
+	enum storm_type type;
+	char *str;
+
+	str = g_key_file_get_string(keyfile, group, "Type", NULL);
+
+	if (g_strcmp0(str, "signal") == 0)
+		type = STORM_SIGNAL;
+	else if (g_strcmp0(str, "calls") == 0)
+		type = STORM_CALLS;
+	else if (g_strcmp0(str, "datacalls") == 0)
+		type = STORM_DATA_CALLS;
+	else {
+		g_printerr("Unknown storm type %s in [%s]\n", str, group);
+		g_free(str);
+		return;
+	}
+
+	g_free(str);
+
+	load_uint(keyfile, group, "Count", &count);
+	load_uint(keyfile, group, "Interval", &interval);
+	load_uint(keyfile, group, "Delay", &delay);
+
+	add_storm(group + strlen("Storm "), type, count, interval, delay);
+}
+
+static gboolean load_script(const char *filename)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	char **groups;
+	char **group;
+	char *str = NULL;
+
+	keyfile = g_key_file_new();
+
+	if (g_key_file_load_from_file(keyfile, filename, 0, &error) == FALSE) {
+		g_printerr("%s: %s\n", filename, error->message);
+		g_error_free(error);
+		g_key_file_free(keyfile);
+		return FALSE;
+	}
+
+	load_uint(keyfile, "General", "Version", &ril_version);
+	load_uint(keyfile, "General", "Latency", &default_latency);
+	load_uint(keyfile, "General", "RegistrationDelay",
+						&registration_delay);
+	load_uint(keyfile, "General", "AlertDelay", &alert_delay);
+	load_uint(keyfile, "General", "ConnectDelay", &connect_delay);
+	load_string(keyfile, "General", "Imsi", &imsi);
+	load_string(keyfile, "General", "Imei", &imei);
+	load_string(keyfile, "General", "Baseband", &baseband);
+	load_string(keyfile, "General", "Operator", &str);
+
+	if (str != NULL) {
+		char **names = g_strsplit(str, ",", 3);
+		unsigned int i;
+
+		for (i = 0; i < 3 && names[i]; i++) {
+			g_free(operator_names[i]);
+			operator_names[i] = g_strdup(names[i]);
+		}
+
+		g_strfreev(names);
+		g_free(str);
+	}
+
+	load_request_table(keyfile, "Latency", latencies);
+	load_request_table(keyfile, "Errors", errors);
+	load_sim_files(keyfile, "SIM", FALSE);
+	load_sim_files(keyfile, "SIMRecords", TRUE);
+
+	groups = g_key_file_get_groups(keyfile, NULL);
+
+	for (group = groups; *group; group++)
+		if (g_str_has_prefix(*group, "Storm "))
+			load_storm(keyfile, *group);
+
+	g_strfreev(groups);
+	g_key_file_free(keyfile);
+
+	return TRUE;
+}
+
+static void write_all(const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t written = write(client_fd, p, len);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			g_printerr("Write to client failed: %s\n",
+							strerror(errno));
+			return;
+		}
+
+		p += written;
+		len -= written;
+	}
+}
+
+static GByteArray *build_message(uint32_t unsolicited, uint32_t id,
+					const uint32_t *error,
+					const struct parcel *rilp)
+{
+	GByteArray *msg = g_byte_array_new();
+	uint32_t len = sizeof(uint32_t) * 2;
+	uint32_t hdr;
+
+	if (error != NULL)
+		len += sizeof(uint32_t);
+
+	if (rilp != NULL)
+		len += rilp->size;
+
+	/* The length is in network order, the rest in host order */
+	hdr = htonl(len);
+	g_byte_array_append(msg, (guint8 *) &hdr, sizeof(hdr));
+	g_byte_array_append(msg, (guint8 *) &unsolicited, sizeof(uint32_t));
+	g_byte_array_append(msg, (guint8 *) &id, sizeof(uint32_t));
+
+	if (error != NULL)
+		g_byte_array_append(msg, (guint8 *) error, sizeof(uint32_t));
+
+	if (rilp != NULL)
+		g_byte_array_append(msg, (guint8 *) rilp->data, rilp->size);
+
+	return msg;
+}
+
+static void send_unsol(uint32_t id, struct parcel *rilp)
+{
+	GByteArray *msg;
+
+	if (client_fd < 0)
+		return;
+
+	msg = build_message(1, id, NULL, rilp);
+	write_all(msg->data, msg->len);
+	g_byte_array_free(msg, TRUE);
+
+	last_traffic = g_get_monotonic_time();
+}
+
+static void send_unsol_ints(uint32_t id, unsigned int count, ...)
+{
+	struct parcel rilp;
+	va_list ap;
+
+	parcel_init(&rilp);
+	parcel_w_int32(&rilp, count);
+
+	va_start(ap, count);
+
+	while (count--)
+		parcel_w_int32(&rilp, va_arg(ap, int));
+
+	va_end(ap);
+
+	send_unsol(id, &rilp);
+	parcel_free(&rilp);
+}
+
+static void send_call_state_changed(void)
+{
+	send_unsol(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL);
+}
+
+static void send_signal_strength(void)
+{
+	struct parcel rilp;
+
+	/* Alternate the level so that every event is a change */
+	signal_level = signal_level == 12 ? 20 : 12;
+
+	parcel_init(&rilp);
+
+	/* GW signal strength and bit error rate */
+	parcel_w_int32(&rilp, signal_level);
+	parcel_w_int32(&rilp, 99);
+
+	/* CDMA and EVDO are not reported */
+	parcel_w_int32(&rilp, -1);
+	parcel_w_int32(&rilp, -1);
+	parcel_w_int32(&rilp, -1);
+	parcel_w_int32(&rilp, -1);
+	parcel_w_int32(&rilp, -1);
+
+	/* LTE, all unknown */
+	parcel_w_int32(&rilp, 99);
+	parcel_w_int32(&rilp, INT32_MAX);
+	parcel_w_int32(&rilp, INT32_MAX);
+	parcel_w_int32(&rilp, INT32_MAX);
+	parcel_w_int32(&rilp, INT32_MAX);
+
+	send_unsol(RIL_UNSOL_SIGNAL_STRENGTH, &rilp);
+	parcel_free(&rilp);
+}
+
+static void send_data_call_list(void)
+{
+	send_unsol_ints(RIL_UNSOL_DATA_CALL_LIST_CHANGED, 1, 0);
+}
+
+static gboolean send_pending(gpointer user_data)
+{
+	struct pending *pending = user_data;
+
+	pending->source = 0;
+	pending_list = g_slist_remove(pending_list, pending);
+
+	if (client_fd >= 0) {
+		write_all(pending->msg->data, pending->msg->len);
+		last_traffic = g_get_monotonic_time();
+
+		if (pending->after)
+			pending->after();
+	}
+
+	g_byte_array_free(pending->msg, TRUE);
+	g_free(pending);
+
+	return FALSE;
+}
+
+static void pending_free(gpointer data)
+{
+	struct pending *pending = data;
+
+	if (pending->source > 0)
+		g_source_remove(pending->source);
+
+	g_byte_array_free(pending->msg, TRUE);
+	g_free(pending);
+}
+
+static void queue_response(uint32_t req, uint32_t serial, uint32_t error,
+				struct parcel *rilp, void (*after)(void))
+{
+	struct pending *pending;
+	gpointer value;
+	unsigned int latency = default_latency;
+
+	if (g_hash_table_lookup_extended(latencies, GINT_TO_POINTER(req),
+							NULL, &value))
+		latency = GPOINTER_TO_INT(value);
+
+	pending = g_new0(struct pending, 1);
+	pending->msg = build_message(0, serial, &error, rilp);
+	pending->after = after;
+
+	if (latency == 0) {
+		pending_list = g_slist_prepend(pending_list, pending);
+		send_pending(pending);
+		return;
+	}
+
+	pending->source = g_timeout_add(latency, send_pending, pending);
+	pending_list = g_slist_prepend(pending_list, pending);
+}
+
+static void write_sim_status(struct parcel *rilp)
+{
+	parcel_w_int32(rilp, RIL_CARDSTATE_PRESENT);
+	parcel_w_int32(rilp, RIL_PINSTATE_UNKNOWN);
+	parcel_w_int32(rilp, 0);	/* gsm_umts_index */
+	parcel_w_int32(rilp, -1);	/* cdma_index */
+	parcel_w_int32(rilp, -1);	/* ims_index */
+	parcel_w_int32(rilp, 1);	/* num_apps */
+
+	parcel_w_int32(rilp, RIL_APPTYPE_SIM);
+	parcel_w_int32(rilp, RIL_APPSTATE_READY);
+	parcel_w_int32(rilp, RIL_PERSOSUBSTATE_READY);
+	parcel_w_string(rilp, NULL);	/* aid */
+	parcel_w_string(rilp, NULL);	/* label */
+	parcel_w_int32(rilp, 0);	/* pin1_replaced */
+	parcel_w_int32(rilp, RIL_PINSTATE_DISABLED);
+	parcel_w_int32(rilp, RIL_PINSTATE_DISABLED);
+}
+
+/*
+ * Records are numbered from 1, and the offset is checked against the
+ * file before anyone computes a length from it.
+ */
+static gboolean sim_io_offset(struct sim_file *file, gboolean binary,
+					int p1, int p2, unsigned int *offset)
+{
+	if (binary) {
+		if (p1 < 0 || p1 > 0xff || p2 < 0 || p2 > 0xff)
+			return FALSE;
+
+		*offset = (p1 << 8) | p2;
+	} else {
+		if (p1 < 1 || file->record_len == 0)
+			return FALSE;
+
+		if ((unsigned int) p1 > file->len / file->record_len)
+			return FALSE;
+
+		*offset = (p1 - 1) * file->record_len;
+	}
+
+	return *offset <= file->len;
+}
+
+static void sim_io(struct parcel *req, struct parcel *rsp)
+{
+	struct sim_file *file;
+	int command, fileid, p1, p2, p3;
+	unsigned int offset, len;
+	int sw1 = 0x90, sw2 = 0x00;
+	char *response = NULL;
+	char *path, *data;
+
+	command = parcel_r_int32(req);
+	fileid = parcel_r_int32(req);
+	path = parcel_r_string(req);
+	p1 = parcel_r_int32(req);
+	p2 = parcel_r_int32(req);
+	p3 = parcel_r_int32(req);
+	data = parcel_r_string(req);
+
+	file = g_hash_table_lookup(sim_files, GINT_TO_POINTER(fileid));
+	if (file == NULL) {
+		sw1 = 0x94;
+		sw2 = 0x04;
+		goto done;
+	}
+
+	switch (command) {
+	case 0xC0: {	/* GET RESPONSE, in the 2G format */
+		unsigned char header[15] = {
+			0x00, 0x00, file->len >> 8, file->len & 0xff,
+			fileid >> 8, fileid & 0xff, 0x04, 0x00,
+			0x00, 0xff, 0x44, 0x01, 0x02,
+			file->record_len ? 0x01 : 0x00, file->record_len,
+		};
+
+		response = encode_hex(header, sizeof(header));
+		break;
+	}
+	case 0xB0:	/* READ BINARY */
+	case 0xB2:	/* READ RECORD */
+		if (sim_io_offset(file, command == 0xB0, p1, p2,
+							&offset) == FALSE) {
+			sw1 = 0x6B;
+			break;
+		}
+
+		len = p3 ? (unsigned int) p3 : file->len - offset;
+
+		if (len > file->len - offset) {
+			sw1 = 0x6B;
+			break;
+		}
+
+		response = encode_hex(file->data + offset, len);
+		break;
+	case 0xD6:	/* UPDATE BINARY */
+	case 0xDC: {	/* UPDATE RECORD */
+		unsigned char *buf;
+
+		if (sim_io_offset(file, command == 0xD6, p1, p2,
+							&offset) == FALSE) {
+			sw1 = 0x6B;
+			break;
+		}
+
+		buf = data ? decode_hex(data, &len) : NULL;
+
+		if (buf == NULL || len > file->len - offset)
+			sw1 = 0x6B;
+		else
+			memcpy(file->data + offset, buf, len);
+
+		g_free(buf);
+		break;
+	}
+	default:
+		sw1 = 0x6D;
+		break;
+	}
+
+done:
+	if (option_verbose)
+		g_print("SIM IO %02X %04X %s (%d,%d,%d) -> %02X %02X\n",
+				command, fileid, path, p1, p2, p3, sw1, sw2);
+
+	parcel_w_int32(rsp, sw1);
+	parcel_w_int32(rsp, sw2);
+	parcel_w_string(rsp, response);
+
+	g_free(response);
+	g_free(path);
+	g_free(data);
+}
+
+static void write_reg_state(struct parcel *rilp, gboolean data)
+{
+	const char *status;
+
+	if (radio_state != RADIO_STATE_ON)
+		status = "0";
+	else if (registered)
+		status = "1";
+	else
+		status = "2";
+
+	parcel_w_int32(rilp, data ? 6 : 4);
+	parcel_w_string(rilp, status);
+	parcel_w_string(rilp, "1f40");
+	parcel_w_string(rilp, "0000d1ff");
+	parcel_w_string(rilp, "3");
+
+	if (data) {
+		parcel_w_string(rilp, NULL);
+		parcel_w_string(rilp, "1");
+	}
+}
+
+static void write_calls(struct parcel *rilp)
+{
+	GSList *l;
+
+	parcel_w_int32(rilp, g_slist_length(calls));
+
+	for (l = calls; l; l = l->next) {
+		struct fake_call *call = l->data;
+
+		parcel_w_int32(rilp, call->state);
+		parcel_w_int32(rilp, call->id);
+		parcel_w_int32(rilp, 129);	/* toa */
+		parcel_w_int32(rilp, 0);	/* isMpty */
+		parcel_w_int32(rilp, call->mt);
+		parcel_w_int32(rilp, 0);	/* als */
+		parcel_w_int32(rilp, 1);	/* isVoice */
+		parcel_w_int32(rilp, 0);	/* isVoicePrivacy */
+		parcel_w_string(rilp, call->number);
+		parcel_w_int32(rilp, 0);	/* numberPresentation */
+		parcel_w_string(rilp, NULL);
+		parcel_w_int32(rilp, 0);	/* namePresentation */
+		parcel_w_int32(rilp, 0);	/* uusInfo */
+	}
+}
+
+static void call_free(gpointer data)
+{
+	struct fake_call *call = data;
+
+	g_free(call->number);
+	g_free(call);
+}
+
+static struct fake_call *add_call(const char *number, enum call_state state,
+							gboolean mt)
+{
+	struct fake_call *call = g_new0(struct fake_call, 1);
+
+	call->id = next_call_id++;
+	call->state = state;
+	call->mt = mt;
+	call->number = g_strdup(number);
+
+	calls = g_slist_append(calls, call);
+
+	return call;
+}
+
+static struct fake_call *find_call(enum call_state state)
+{
+	GSList *l;
+
+	for (l = calls; l; l = l->next) {
+		struct fake_call *call = l->data;
+
+		if (call->state == state)
+			return call;
+	}
+
+	return NULL;
+}
+
+static void remove_calls(gboolean (*match)(struct fake_call *call, int id),
+								int id)
+{
+	GSList *l = calls;
+
+	while (l) {
+		struct fake_call *call = l->data;
+
+		l = l->next;
+
+		if (match(call, id) == FALSE)
+			continue;
+
+		calls = g_slist_remove(calls, call);
+		call_free(call);
+	}
+}
+
+static gboolean match_id(struct fake_call *call, int id)
+{
+	return call->id == id;
+}
+
+static gboolean match_background(struct fake_call *call, int id)
+{
+	return call->state == CALL_HELD || call->state == CALL_INCOMING ||
+					call->state == CALL_WAITING;
+}
+
+static gboolean match_foreground(struct fake_call *call, int id)
+{
+	return call->state == CALL_ACTIVE || call->state == CALL_DIALING ||
+					call->state == CALL_ALERTING;
+}
+
+static gboolean call_connect(gpointer user_data)
+{
+	struct fake_call *call = find_call(CALL_ALERTING);
+
+	if (call != NULL) {
+		call->state = CALL_ACTIVE;
+		send_call_state_changed();
+	}
+
+	return FALSE;
+}
+
+static gboolean call_alert(gpointer user_data)
+{
+	struct fake_call *call = find_call(CALL_DIALING);
+
+	if (call != NULL) {
+		call->state = CALL_ALERTING;
+		send_call_state_changed();
+		g_timeout_add(connect_delay, call_connect, NULL);
+	}
+
+	return FALSE;
+}
+
+static void dial_sent(void)
+{
+	send_call_state_changed();
+	g_timeout_add(alert_delay, call_alert, NULL);
+}
+
+static gboolean network_registered(gpointer user_data)
+{
+	GSList *l;
+
+	registration_source = 0;
+	registered = TRUE;
+
+	send_unsol(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, NULL);
+
+	if (option_benchmark)
+		return FALSE;
+
+	for (l = storms; l; l = l->next) {
+		struct storm *storm = l->data;
+
+		storm->source = g_timeout_add(storm->delay,
+						start_scheduled_storm, storm);
+	}
+
+	return FALSE;
+}
+
+static void send_radio_state(void)
+{
+	struct parcel rilp;
+
+	parcel_init(&rilp);
+	parcel_w_int32(&rilp, radio_state);
+	send_unsol(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, &rilp);
+	parcel_free(&rilp);
+
+	if (radio_state == RADIO_STATE_ON && registered == FALSE &&
+						registration_source == 0)
+		registration_source = g_timeout_add(registration_delay,
+						network_registered, NULL);
+}
+
+static void handle_request(const unsigned char *buf, size_t len)
+{
+	struct parcel req, rsp;
+	uint32_t id, serial, error = RIL_E_SUCCESS;
+	void (*after)(void) = NULL;
+	gpointer value;
+
+	if (len < sizeof(uint32_t) * 2)
+		return;
+
+	memcpy(&id, buf, sizeof(id));
+	memcpy(&serial, buf + sizeof(id), sizeof(serial));
+
+	req.data = (char *) buf + sizeof(id) + sizeof(serial);
+	req.offset = 0;
+	req.size = len - sizeof(id) - sizeof(serial);
+	req.capacity = req.size;
+	req.malformed = 0;
+
+	requests_served += 1;
+	last_traffic = g_get_monotonic_time();
+
+	if (option_verbose)
+		g_print("%8.3f ms request %u serial %u\n",
+				elapsed_ms(connect_time, last_traffic),
+				id, serial);
+
+	parcel_init(&rsp);
+
+	switch (id) {
+	case RIL_REQUEST_GET_SIM_STATUS:
+		write_sim_status(&rsp);
+		break;
+	case RIL_REQUEST_GET_IMSI:
+		parcel_w_string(&rsp, imsi);
+		break;
+	case RIL_REQUEST_SIM_IO:
+		sim_io(&req, &rsp);
+		break;
+	case RIL_REQUEST_RADIO_POWER:
+		parcel_r_int32(&req);
+		radio_state = parcel_r_int32(&req) ?
+					RADIO_STATE_ON : RADIO_STATE_OFF;
+
+		if (radio_state == RADIO_STATE_OFF) {
+			registered = FALSE;
+
+			if (registration_source > 0) {
+				g_source_remove(registration_source);
+				registration_source = 0;
+			}
+		}
+
+		after = send_radio_state;
+		break;
+	case RIL_REQUEST_VOICE_REGISTRATION_STATE:
+		write_reg_state(&rsp, FALSE);
+		break;
+	case RIL_REQUEST_DATA_REGISTRATION_STATE:
+		write_reg_state(&rsp, TRUE);
+		break;
+	case RIL_REQUEST_OPERATOR:
+		parcel_w_int32(&rsp, 3);
+		parcel_w_string(&rsp, registered ? operator_names[0] : NULL);
+		parcel_w_string(&rsp, registered ? operator_names[1] : NULL);
+		parcel_w_string(&rsp, registered ? operator_names[2] : NULL);
+		break;
+	case RIL_REQUEST_SIGNAL_STRENGTH:
+		parcel_w_int32(&rsp, 20);
+		parcel_w_int32(&rsp, 99);
+		parcel_w_int32(&rsp, -1);
+		parcel_w_int32(&rsp, -1);
+		parcel_w_int32(&rsp, -1);
+		parcel_w_int32(&rsp, -1);
+		parcel_w_int32(&rsp, -1);
+		break;
+	case RIL_REQUEST_GET_IMEI:
+	case RIL_REQUEST_GET_IMEISV:
+		parcel_w_string(&rsp, imei);
+		break;
+	case RIL_REQUEST_BASEBAND_VERSION:
+		parcel_w_string(&rsp, baseband);
+		break;
+	case RIL_REQUEST_DEVICE_IDENTITY:
+		parcel_w_int32(&rsp, 4);
+		parcel_w_string(&rsp, imei);
+		parcel_w_string(&rsp, "00");
+		parcel_w_string(&rsp, NULL);
+		parcel_w_string(&rsp, NULL);
+		break;
+	case RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE:
+	case RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE:
+	case RIL_REQUEST_GET_MUTE:
+		parcel_w_int32(&rsp, 1);
+		parcel_w_int32(&rsp, 0);
+		break;
+	case RIL_REQUEST_GET_SMSC_ADDRESS:
+		parcel_w_string(&rsp, "\"+15550000000\",145");
+		break;
+	case RIL_REQUEST_GET_CURRENT_CALLS:
+		write_calls(&rsp);
+		break;
+	case RIL_REQUEST_DIAL: {
+		char *number = parcel_r_string(&req);
+
+		add_call(number, CALL_DIALING, FALSE);
+		g_free(number);
+
+		after = dial_sent;
+		break;
+	}
+	case RIL_REQUEST_ANSWER: {
+		struct fake_call *call = find_call(CALL_INCOMING);
+
+		if (call == NULL) {
+			error = RIL_E_GENERIC_FAILURE;
+			break;
+		}
+
+		call->state = CALL_ACTIVE;
+		after = send_call_state_changed;
+		break;
+	}
+	case RIL_REQUEST_HANGUP:
+		parcel_r_int32(&req);
+		remove_calls(match_id, parcel_r_int32(&req));
+		after = send_call_state_changed;
+		break;
+	case RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND:
+		remove_calls(match_background, 0);
+		after = send_call_state_changed;
+		break;
+	case RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND:
+		remove_calls(match_foreground, 0);
+		after = send_call_state_changed;
+		break;
+	case RIL_REQUEST_LAST_CALL_FAIL_CAUSE:
+		parcel_w_int32(&rsp, 1);
+		parcel_w_int32(&rsp, 16);	/* normal clearing */
+		break;
+	case RIL_REQUEST_DATA_CALL_LIST:
+		parcel_w_int32(&rsp, ril_version);
+		parcel_w_int32(&rsp, 0);
+		break;
+	case RIL_REQUEST_SET_MUTE:
+	case RIL_REQUEST_SCREEN_STATE:
+	case RIL_REQUEST_SET_SUPP_SVC_NOTIFICATION:
+	case RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC:
+	case RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE:
+	case RIL_REQUEST_SET_INITIAL_ATTACH_APN:
+	case RIL_REQUEST_SET_UICC_SUBSCRIPTION:
+	case RIL_REQUEST_ALLOW_DATA:
+		break;
+	default:
+		error = RIL_E_REQUEST_NOT_SUPPORTED;
+		break;
+	}
+
+	if (g_hash_table_lookup_extended(errors, GINT_TO_POINTER(id),
+							NULL, &value)) {
+		error = GPOINTER_TO_INT(value);
+		after = NULL;
+	}
+
+	if (error != RIL_E_SUCCESS) {
+		parcel_free(&rsp);
+		parcel_init(&rsp);
+	}
+
+	queue_response(id, serial, error, &rsp, after);
+	parcel_free(&rsp);
+}
+
+static void client_disconnected(void)
+{
+	GSList *l;
+
+	g_print("Client disconnected after %u requests\n", requests_served);
+
+	if (client_watch > 0) {
+		g_source_remove(client_watch);
+		client_watch = 0;
+	}
+
+	if (registration_source > 0) {
+		g_source_remove(registration_source);
+		registration_source = 0;
+	}
+
+	close(client_fd);
+	client_fd = -1;
+
+	g_slist_free_full(pending_list, pending_free);
+	pending_list = NULL;
+
+	g_slist_free_full(calls, call_free);
+	calls = NULL;
+
+	for (l = storms; l; l = l->next) {
+		struct storm *storm = l->data;
+
+		if (storm->source > 0) {
+			g_source_remove(storm->source);
+			storm->source = 0;
+		}
+	}
+
+	g_byte_array_set_size(rx_buf, 0);
+
+	radio_state = RADIO_STATE_OFF;
+	registered = FALSE;
+}
+
+static gboolean client_event(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	unsigned char buf[4096];
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		client_watch = 0;
+		client_disconnected();
+		return FALSE;
+	}
+
+	len = read(client_fd, buf, sizeof(buf));
+	if (len <= 0) {
+		client_watch = 0;
+		client_disconnected();
+		return FALSE;
+	}
+
+	g_byte_array_append(rx_buf, buf, len);
+
+	while (rx_buf->len >= sizeof(uint32_t)) {
+		uint32_t msg_len;
+
+		memcpy(&msg_len, rx_buf->data, sizeof(msg_len));
+		msg_len = ntohl(msg_len);
+
+		if (msg_len > MAX_MESSAGE_SIZE) {
+			g_printerr("Request too large: %u\n", msg_len);
+			client_watch = 0;
+			client_disconnected();
+			return FALSE;
+		}
+
+		if (rx_buf->len < msg_len + sizeof(uint32_t))
+			break;
+
+		handle_request(rx_buf->data + sizeof(uint32_t), msg_len);
+
+		/* Handling may have dropped the connection */
+		if (client_fd < 0)
+			return FALSE;
+
+		g_byte_array_remove_range(rx_buf, 0,
+					msg_len + sizeof(uint32_t));
+	}
+
+	return TRUE;
+}
+
+static gboolean server_event(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	GIOChannel *io;
+	int fd;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		server_watch = 0;
+		return FALSE;
+	}
+
+	fd = accept(server_fd, NULL, NULL);
+	if (fd < 0)
+		return TRUE;
+
+	if (client_fd >= 0) {
+		g_printerr("Rejecting second client\n");
+		close(fd);
+		return TRUE;
+	}
+
+	client_fd = fd;
+	connect_time = g_get_monotonic_time();
+	last_traffic = connect_time;
+	requests_served = 0;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+		client_pid = cred.pid;
+
+	g_print("Client %d connected\n", (int) client_pid);
+
+	io = g_io_channel_unix_new(fd);
+	client_watch = g_io_add_watch(io,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				client_event, NULL);
+	g_io_channel_unref(io);
+
+	send_unsol_ints(RIL_UNSOL_RIL_CONNECTED, 1, ril_version);
+	send_radio_state();
+
+	return TRUE;
+}
+
+static gboolean create_server(const char *path)
+{
+	struct sockaddr_un addr;
+	GIOChannel *io;
+
+	server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (server_fd < 0) {
+		perror("Can't create socket");
+		return FALSE;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	unlink(path);
+
+	if (bind(server_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+			listen(server_fd, 1) < 0) {
+		fprintf(stderr, "Can't listen on %s: %s\n", path,
+							strerror(errno));
+		close(server_fd);
+		server_fd = -1;
+		return FALSE;
+	}
+
+	io = g_io_channel_unix_new(server_fd);
+	server_watch = g_io_add_watch(io,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				server_event, NULL);
+	g_io_channel_unref(io);
+
+	g_print("Listening on %s\n", path);
+
+	return TRUE;
+}
+
+static gboolean send_storm_event(gpointer user_data)
+{
+	struct storm *storm = user_data;
+
+	switch (storm->type) {
+	case STORM_SIGNAL:
+		send_signal_strength();
+		break;
+	case STORM_CALLS:
+		send_call_state_changed();
+		break;
+	case STORM_DATA_CALLS:
+		send_data_call_list();
+		break;
+	}
+
+	storm->sent += 1;
+
+	if (storm->sent < storm->count)
+		return TRUE;
+
+	storm->source = 0;
+
+	return FALSE;
+}
+
+static void report_storm(struct storm *storm, gint64 end)
+{
+	gint64 cpu = read_cpu_time(client_pid);
+
+	g_print("Storm %-12s %5u events in %8.1f ms", storm->name,
+				storm->count, elapsed_ms(storm->start, end));
+
+	if (cpu >= 0 && storm->cpu_start >= 0)
+		g_print(", %.1f us CPU per event",
+				(double) (cpu - storm->cpu_start) /
+							storm->count);
+
+	g_print("\n");
+}
+
+static gboolean check_storm_done(gpointer user_data)
+{
+	struct storm *storm = current_storm->data;
+	gint64 now = g_get_monotonic_time();
+
+	if (storm->source > 0 || now - last_traffic < QUIET_TIME * 1000)
+		return TRUE;
+
+	quiet_source = 0;
+
+	report_storm(storm, last_traffic);
+
+	current_storm = current_storm->next;
+	start_storms();
+
+	return FALSE;
+}
+
+static void storm_begin(struct storm *storm)
+{
+	storm->sent = 0;
+	storm->start = g_get_monotonic_time();
+	storm->cpu_start = read_cpu_time(client_pid);
+	storm->source = g_timeout_add(storm->interval, send_storm_event,
+								storm);
+}
+
+static void start_storms(void)
+{
+	if (current_storm == NULL) {
+		bench_state = BENCH_DONE;
+		g_main_loop_quit(main_loop);
+		return;
+	}
+
+	storm_begin(current_storm->data);
+	quiet_source = g_timeout_add(QUIET_TIME / 4, check_storm_done, NULL);
+}
+
+static gboolean start_scheduled_storm(gpointer user_data)
+{
+	struct storm *storm = user_data;
+
+	if (client_fd >= 0)
+		storm_begin(storm);
+	else
+		storm->source = 0;
+
+	return FALSE;
+}
+
+static void free_reply(DBusPendingCall *call, void *user_data)
+{
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	DBusError err;
+
+	dbus_error_init(&err);
+
+	if (dbus_set_error_from_message(&err, reply) == TRUE) {
+		g_printerr("%s: %s\n", err.name, err.message);
+		dbus_error_free(&err);
+	}
+
+	dbus_message_unref(reply);
+}
+
+static int call_method(const char *path, const char *interface,
+				const char *method,
+				DBusPendingCallNotifyFunction notify,
+				int first, ...)
+{
+	DBusMessage *msg;
+	DBusPendingCall *call;
+	va_list args;
+
+	msg = dbus_message_new_method_call(OFONO_SERVICE, path,
+							interface, method);
+	if (msg == NULL)
+		return -ENOMEM;
+
+	dbus_message_set_auto_start(msg, FALSE);
+
+	va_start(args, first);
+	dbus_message_append_args_valist(msg, first, args);
+	va_end(args);
+
+	if (dbus_connection_send_with_reply(conn, msg, &call, -1) == FALSE) {
+		dbus_message_unref(msg);
+		return -EIO;
+	}
+
+	dbus_message_unref(msg);
+
+	if (call == NULL)
+		return -EINVAL;
+
+	dbus_pending_call_set_notify(call, notify ? notify : free_reply,
+								NULL, NULL);
+	dbus_pending_call_unref(call);
+
+	return 0;
+}
+
+static void set_modem_property(const char *key, dbus_bool_t value,
+				DBusPendingCallNotifyFunction notify)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter, variant;
+	DBusPendingCall *call;
+
+	msg = dbus_message_new_method_call(OFONO_SERVICE, modem_path,
+					OFONO_MODEM_INTERFACE, "SetProperty");
+	if (msg == NULL)
+		return;
+
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT,
+				DBUS_TYPE_BOOLEAN_AS_STRING, &variant);
+	dbus_message_iter_append_basic(&variant, DBUS_TYPE_BOOLEAN, &value);
+	dbus_message_iter_close_container(&iter, &variant);
+
+	if (dbus_connection_send_with_reply(conn, msg, &call, -1) == TRUE &&
+								call) {
+		dbus_pending_call_set_notify(call, notify ? notify : free_reply,
+								NULL, NULL);
+		dbus_pending_call_unref(call);
+	}
+
+	dbus_message_unref(msg);
+}
+
+static gboolean get_changed_string(DBusMessage *msg, const char **name,
+							const char **value)
+{
+	DBusMessageIter iter, variant;
+
+	if (dbus_message_iter_init(msg, &iter) == FALSE ||
+			dbus_message_iter_get_arg_type(&iter) !=
+							DBUS_TYPE_STRING)
+		return FALSE;
+
+	dbus_message_iter_get_basic(&iter, name);
+	dbus_message_iter_next(&iter);
+	dbus_message_iter_recurse(&iter, &variant);
+
+	if (dbus_message_iter_get_arg_type(&variant) != DBUS_TYPE_STRING)
+		return FALSE;
+
+	dbus_message_iter_get_basic(&variant, value);
+
+	return TRUE;
+}
+
+static void powered_reply(DBusPendingCall *call, void *user_data)
+{
+	free_reply(call, user_data);
+
+	set_modem_property("Online", TRUE, NULL);
+}
+
+static void use_modem(const char *path)
+{
+	if (modem_path != NULL || g_str_has_prefix(path, "/ril") == FALSE)
+		return;
+
+	g_print("Using modem %s\n", path);
+
+	modem_path = g_strdup(path);
+	set_modem_property("Powered", TRUE, powered_reply);
+}
+
+static void get_modems_reply(DBusPendingCall *call, void *user_data)
+{
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	DBusMessageIter iter, list;
+
+	if (dbus_message_iter_init(reply, &iter) == FALSE ||
+			dbus_message_iter_get_arg_type(&iter) !=
+							DBUS_TYPE_ARRAY)
+		goto done;
+
+	dbus_message_iter_recurse(&iter, &list);
+
+	while (dbus_message_iter_get_arg_type(&list) == DBUS_TYPE_STRUCT) {
+		DBusMessageIter entry;
+		const char *path;
+
+		dbus_message_iter_recurse(&list, &entry);
+		dbus_message_iter_get_basic(&entry, &path);
+
+		use_modem(path);
+
+		dbus_message_iter_next(&list);
+	}
+
+done:
+	dbus_message_unref(reply);
+}
+
+static gboolean modem_added(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *path;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
+						DBUS_TYPE_INVALID) == TRUE)
+		use_modem(path);
+
+	return TRUE;
+}
+
+static void start_dial(void)
+{
+	const char *number = option_number;
+	const char *hide = "default";
+
+	bench_state = BENCH_DIAL;
+	dial_time = g_get_monotonic_time();
+
+	call_method(modem_path, OFONO_VCMANAGER_INTERFACE, "Dial", NULL,
+				DBUS_TYPE_STRING, &number,
+				DBUS_TYPE_STRING, &hide, DBUS_TYPE_INVALID);
+}
+
+static gboolean delayed_dial(gpointer user_data)
+{
+	start_dial();
+
+	return FALSE;
+}
+
+static void start_incoming(void)
+{
+	bench_state = BENCH_INCOMING;
+	ring_time = g_get_monotonic_time();
+
+	add_call(option_number, CALL_INCOMING, TRUE);
+	send_call_state_changed();
+	send_unsol(RIL_UNSOL_CALL_RING, NULL);
+}
+
+static gboolean sim_changed(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *name, *value;
+
+	if (get_changed_string(msg, &name, &value) == FALSE)
+		return TRUE;
+
+	if (g_str_equal(name, "SubscriberIdentity") && sim_ready_time == 0)
+		sim_ready_time = g_get_monotonic_time();
+
+	return TRUE;
+}
+
+static gboolean netreg_changed(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *name, *value;
+
+	if (get_changed_string(msg, &name, &value) == FALSE)
+		return TRUE;
+
+	if (g_str_equal(name, "Status") == FALSE || registered_time != 0)
+		return TRUE;
+
+	if (g_str_equal(value, "registered") == FALSE &&
+				g_str_equal(value, "roaming") == FALSE)
+		return TRUE;
+
+	registered_time = g_get_monotonic_time();
+
+	/* Let the post registration queries settle first */
+	g_timeout_add(QUIET_TIME, delayed_dial, NULL);
+
+	return TRUE;
+}
+
+static gboolean call_added(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *path;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
+						DBUS_TYPE_INVALID) == FALSE)
+		return TRUE;
+
+	g_free(call_path);
+	call_path = g_strdup(path);
+
+	if (bench_state != BENCH_INCOMING)
+		return TRUE;
+
+	g_print("Incoming call latency: %8.1f ms\n",
+			elapsed_ms(ring_time, g_get_monotonic_time()));
+
+	answer_time = g_get_monotonic_time();
+	call_method(call_path, OFONO_CALL_INTERFACE, "Answer", NULL,
+							DBUS_TYPE_INVALID);
+
+	return TRUE;
+}
+
+static gboolean call_removed(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	g_free(call_path);
+	call_path = NULL;
+
+	switch (bench_state) {
+	case BENCH_DIAL:
+		start_incoming();
+		break;
+	case BENCH_INCOMING:
+		bench_state = BENCH_STORMS;
+		current_storm = storms;
+		start_storms();
+		break;
+	default:
+		break;
+	}
+
+	return TRUE;
+}
+
+static gboolean call_changed(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *name, *value;
+	gint64 now = g_get_monotonic_time();
+
+	if (get_changed_string(msg, &name, &value) == FALSE)
+		return TRUE;
+
+	if (g_str_equal(name, "State") == FALSE ||
+				g_str_equal(value, "active") == FALSE)
+		return TRUE;
+
+	if (bench_state == BENCH_DIAL)
+		g_print("Dial latency:          %8.1f ms (%u ms modelled)\n",
+				elapsed_ms(dial_time, now),
+				alert_delay + connect_delay);
+	else if (bench_state == BENCH_INCOMING)
+		g_print("Answer latency:        %8.1f ms\n",
+				elapsed_ms(answer_time, now));
+	else
+		return TRUE;
+
+	call_method(modem_path, OFONO_VCMANAGER_INTERFACE, "HangupAll", NULL,
+							DBUS_TYPE_INVALID);
+
+	return TRUE;
+}
+
+static void ofono_connect(DBusConnection *conn, void *user_data)
+{
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_MANAGER_INTERFACE, "ModemAdded",
+				modem_added, NULL, NULL);
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_SIM_INTERFACE, "PropertyChanged",
+				sim_changed, NULL, NULL);
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_NETREG_INTERFACE, "PropertyChanged",
+				netreg_changed, NULL, NULL);
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_VCMANAGER_INTERFACE, "CallAdded",
+				call_added, NULL, NULL);
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_VCMANAGER_INTERFACE, "CallRemoved",
+				call_removed, NULL, NULL);
+	g_dbus_add_signal_watch(conn, OFONO_SERVICE, NULL,
+				OFONO_CALL_INTERFACE, "PropertyChanged",
+				call_changed, NULL, NULL);
+
+	call_method("/", OFONO_MANAGER_INTERFACE, "GetModems",
+				get_modems_reply, DBUS_TYPE_INVALID);
+}
+
+static void ofono_disconnect(DBusConnection *conn, void *user_data)
+{
+	g_dbus_remove_all_watches(conn);
+
+	if (bench_state != BENCH_DONE) {
+		g_printerr("oFono went away\n");
+		g_main_loop_quit(main_loop);
+	}
+}
+
+static void print_boot_report(void)
+{
+	if (sim_ready_time)
+		g_print("Time to SIM ready:     %8.1f ms\n",
+				elapsed_ms(connect_time, sim_ready_time));
+
+	if (registered_time)
+		g_print("Time to registered:    %8.1f ms (%u ms modelled)\n",
+				elapsed_ms(connect_time, registered_time),
+				registration_delay);
+}
+
+static volatile sig_atomic_t __terminated = 0;
+
+static void sig_term(int sig)
+{
+	if (__terminated > 0)
+		return;
+
+	__terminated = 1;
+
+	g_main_loop_quit(main_loop);
+}
+
+static GOptionEntry options[] = {
+	{ "socket", 's', 0, G_OPTION_ARG_STRING, &option_socket,
+				"Socket to listen on", "PATH" },
+	{ "script", 'c', 0, G_OPTION_ARG_FILENAME, &option_script,
+				"Scenario to play", "FILE" },
+	{ "benchmark", 'b', 0, G_OPTION_ARG_NONE, &option_benchmark,
+				"Drive ofonod over D-Bus and report timings" },
+	{ "number", 'n', 0, G_OPTION_ARG_STRING, &option_number,
+				"Number to dial and to call from", "NUMBER" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &option_verbose,
+				"Print every request" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	DBusError err;
+	struct sigaction sa;
+	int ret = 0;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+		} else
+			g_printerr("An unknown error occurred\n");
+		exit(1);
+	}
+
+	g_option_context_free(context);
+
+	if (option_number == NULL)
+		option_number = g_strdup("5551234");
+
+	latencies = g_hash_table_new(g_direct_hash, g_direct_equal);
+	errors = g_hash_table_new(g_direct_hash, g_direct_equal);
+	sim_files = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, sim_file_free);
+
+	imsi = g_strdup("001010123456789");
+	imei = g_strdup("123456789012347");
+	baseband = g_strdup("fake-rild");
+	operator_names[0] = g_strdup("Fake Operator");
+	operator_names[1] = g_strdup("Fake");
+	operator_names[2] = g_strdup("00101");
+
+	add_sim_defaults();
+
+	if (option_script != NULL && load_script(option_script) == FALSE)
+		exit(1);
+
+	if (option_benchmark && storms == NULL) {
+		add_storm("signal", STORM_SIGNAL, 1000, 1, 0);
+		add_storm("calls", STORM_CALLS, 200, 5, 0);
+		add_storm("datacalls", STORM_DATA_CALLS, 200, 5, 0);
+	}
+
+	main_loop = g_main_loop_new(NULL, FALSE);
+	rx_buf = g_byte_array_new();
+
+	if (create_server(option_socket ? option_socket : RILD_SOCKET)
+								== FALSE)
+		exit(1);
+
+	if (option_benchmark) {
+		dbus_error_init(&err);
+
+		conn = g_dbus_setup_bus(DBUS_BUS_SYSTEM, NULL, &err);
+		if (conn == NULL) {
+			if (dbus_error_is_set(&err) == TRUE) {
+				fprintf(stderr, "%s\n", err.message);
+				dbus_error_free(&err);
+			} else
+				fprintf(stderr, "Can't register with "
+							"system bus\n");
+			exit(1);
+		}
+
+		g_dbus_add_service_watch(conn, OFONO_SERVICE,
+				ofono_connect, ofono_disconnect, NULL, NULL);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_term;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	g_main_loop_run(main_loop);
+
+	if (option_benchmark) {
+		print_boot_report();
+
+		if (bench_state != BENCH_DONE)
+			ret = 1;
+
+		g_dbus_remove_all_watches(conn);
+		dbus_connection_unref(conn);
+	}
+
+	if (client_fd >= 0)
+		client_disconnected();
+
+	if (server_watch > 0)
+		g_source_remove(server_watch);
+
+	if (quiet_source > 0)
+		g_source_remove(quiet_source);
+
+	close(server_fd);
+	unlink(option_socket ? option_socket : RILD_SOCKET);
+
+	g_slist_free_full(storms, storm_free);
+	g_hash_table_destroy(sim_files);
+	g_hash_table_destroy(errors);
+	g_hash_table_destroy(latencies);
+	g_byte_array_free(rx_buf, TRUE);
+
+	g_free(imsi);
+	g_free(imei);
+	g_free(baseband);
+	g_free(operator_names[0]);
+	g_free(operator_names[1]);
+	g_free(operator_names[2]);
+	g_free(modem_path);
+	g_free(call_path);
+	g_free(option_socket);
+	g_free(option_script);
+	g_free(option_number);
+
+	g_main_loop_unref(main_loop);
+
+	return ret;
+}
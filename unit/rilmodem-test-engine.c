@@ -78,6 +78,7 @@ static gboolean on_rx_data(GIOChannel *chan, GIOCondition cond, gpointer data)
 	struct engine_data *ed = data;
 	GIOStatus status;
 	gsize rbytes;
+	gsize offset = 0;
 	gchar *buf;
 	const struct rilmodem_test_step *step;
 
@@ -91,16 +92,29 @@ static gboolean on_rx_data(GIOChannel *chan, GIOCondition cond, gpointer data)
 								&rbytes, NULL);
 	g_assert(status == G_IO_STATUS_NORMAL);
 
-	/* Check this is the expected step */
-	step = &ed->rtd.steps[ed->step_i];
-	g_assert(step->type == TST_EVENT_RECEIVE);
+	/*
+	 * Requests queued back to back by the driver can arrive in a single
+	 * read: match them against consecutive receive steps.
+	 */
+	while (offset < rbytes) {
+		/* Check this is the expected step */
+		g_assert(ed->step_i < ed->rtd.num_steps);
 
-	g_assert(rbytes == step->parcel_size);
+		step = &ed->rtd.steps[ed->step_i];
+		g_assert(step->type == TST_EVENT_RECEIVE);
 
-	/* validate received parcel */
-	g_assert(!memcmp(buf, step->parcel_data, rbytes));
+		g_assert(rbytes - offset >= step->parcel_size);
 
-	rilmodem_test_engine_next_step(ed);
+		/* validate received parcel */
+		g_assert(!memcmp(buf + offset, step->parcel_data,
+							step->parcel_size));
+
+		offset += step->parcel_size;
+
+		rilmodem_test_engine_next_step(ed);
+	}
+
+	g_free(buf);
 
 	return TRUE;
 }
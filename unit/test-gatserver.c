@@ -0,0 +1,324 @@
+/*
+ *
+ *  AT server library with GLib integration
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatserver.h"
+
+/*
+ * A minimal HFP audio gateway, laid out like the handlers in
+ * gatchat/test-server.c, driven over a socketpair.
+ */
+struct hfp_session {
+	GAtServer *server;
+	int fd;
+	GString *rx;
+	int callsetup;
+};
+
+static void cind_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *cmd, gpointer user)
+{
+	struct hfp_session *s = user;
+	char buf[64];
+
+	switch (type) {
+	case G_AT_SERVER_REQUEST_TYPE_QUERY:
+		snprintf(buf, sizeof(buf), "+CIND: 1,0,%d,0,5,0,5",
+				s->callsetup);
+		g_at_server_send_info(server, buf, TRUE);
+		break;
+	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
+		g_at_server_send_info(server, "+CIND: (\"service\",(0,1)),"
+					"(\"call\",(0,1)),"
+					"(\"callsetup\",(0-3)),"
+					"(\"callheld\",(0-2)),"
+					"(\"signal\",(0-5)),"
+					"(\"roam\",(0,1)),"
+					"(\"battchg\",(0-5))", TRUE);
+		break;
+	default:
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+		return;
+	}
+
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+}
+
+static void clcc_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *cmd, gpointer user)
+{
+	struct hfp_session *s = user;
+
+	if (type != G_AT_SERVER_REQUEST_TYPE_COMMAND_ONLY) {
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+		return;
+	}
+
+	if (s->callsetup)
+		g_at_server_send_info(server,
+				"+CLCC: 1,1,4,0,0,\"+15551234567\",145",
+				TRUE);
+
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+}
+
+static void set_ok_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *cmd, gpointer user)
+{
+	if (type != G_AT_SERVER_REQUEST_TYPE_SET) {
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+		return;
+	}
+
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+}
+
+static void brsf_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *cmd, gpointer user)
+{
+	GAtResultIter iter;
+	int features;
+
+	if (type != G_AT_SERVER_REQUEST_TYPE_SET)
+		goto error;
+
+	g_at_result_iter_init(&iter, cmd);
+	g_at_result_iter_next(&iter, "");
+
+	if (!g_at_result_iter_next_number(&iter, &features))
+		goto error;
+
+	g_at_server_send_info(server, "+BRSF: 871", TRUE);
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+	return;
+
+error:
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+}
+
+static void session_start(struct hfp_session *s)
+{
+	GIOChannel *io;
+	int sv[2];
+
+	memset(s, 0, sizeof(*s));
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	s->server = g_at_server_new(io);
+	g_assert(s->server);
+	g_io_channel_unref(io);
+
+	g_at_server_set_echo(s->server, FALSE);
+
+	g_at_server_register(s->server, "+BRSF", brsf_cb, s, NULL);
+	g_at_server_register(s->server, "+CIND", cind_cb, s, NULL);
+	g_at_server_register(s->server, "+CMER", set_ok_cb, s, NULL);
+	g_at_server_register(s->server, "+CLCC", clcc_cb, s, NULL);
+	g_at_server_register(s->server, "+BIA", set_ok_cb, s, NULL);
+	g_at_server_register(s->server, "+CMEE", set_ok_cb, s, NULL);
+
+	s->fd = sv[1];
+	s->rx = g_string_sized_new(256);
+}
+
+static void session_stop(struct hfp_session *s)
+{
+	g_at_server_unref(s->server);
+	close(s->fd);
+	g_string_free(s->rx, TRUE);
+}
+
+static gboolean response_complete(GString *rx)
+{
+	return g_str_has_suffix(rx->str, "\r\nOK\r\n") ||
+		g_str_has_suffix(rx->str, "\r\nERROR\r\n");
+}
+
+static const char *session_send(struct hfp_session *s, const char *cmd)
+{
+	char buf[512];
+	ssize_t len = strlen(cmd);
+
+	g_assert(write(s->fd, cmd, len) == len);
+	g_string_truncate(s->rx, 0);
+
+	while (!response_complete(s->rx)) {
+		g_main_context_iteration(NULL, TRUE);
+
+		len = recv(s->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len > 0)
+			g_string_append_len(s->rx, buf, len);
+	}
+
+	return s->rx->str;
+}
+
+struct session_step {
+	const char *command;
+	const char *response;
+};
+
+/* Service level connection followed by an incoming call */
+static const struct session_step hfp_script[] = {
+	{ "AT+BRSF=127\r",	"\r\n+BRSF: 871\r\n\r\nOK\r\n" },
+	{ "AT+CIND=?\r",	"\r\n+CIND: (\"service\",(0,1)),"
+				"(\"call\",(0,1)),(\"callsetup\",(0-3)),"
+				"(\"callheld\",(0-2)),(\"signal\",(0-5)),"
+				"(\"roam\",(0,1)),(\"battchg\",(0-5))\r\n"
+				"\r\nOK\r\n" },
+	{ "AT+CIND?\r",		"\r\n+CIND: 1,0,0,0,5,0,5\r\n\r\nOK\r\n" },
+	{ "AT+CMER=3,0,0,1\r",	"\r\nOK\r\n" },
+	{ "AT+CMEE=1\r",	"\r\nOK\r\n" },
+	{ "AT+BIA=1,1,1,1,1,1,1\r", "\r\nOK\r\n" },
+	{ "AT+CLCC\r",		"\r\nOK\r\n" },
+	{ "AT+CIND?\r",		"\r\n+CIND: 1,0,1,0,5,0,5\r\n\r\nOK\r\n" },
+	{ "AT+CLCC\r",		"\r\n+CLCC: 1,1,4,0,0,\"+15551234567\",145"
+				"\r\n\r\nOK\r\n" },
+	{ "AT+BIA=0,1,1,0,0,0,0;+CIND?\r",
+				"\r\n+CIND: 1,0,1,0,5,0,5\r\n\r\nOK\r\n" },
+};
+
+static void run_script(struct hfp_session *s)
+{
+	unsigned int i;
+
+	s->callsetup = 0;
+
+	for (i = 0; i < G_N_ELEMENTS(hfp_script); i++) {
+		const char *rsp = session_send(s, hfp_script[i].command);
+
+		g_assert_cmpstr(rsp, ==, hfp_script[i].response);
+
+		/* The AG reports an incoming call after the first CLCC */
+		if (i == 6)
+			s->callsetup = 1;
+	}
+}
+
+static void test_hfp_session(void)
+{
+	struct hfp_session s;
+
+	session_start(&s);
+	run_script(&s);
+	session_stop(&s);
+}
+
+static void test_command_lookup(void)
+{
+	struct hfp_session s;
+
+	session_start(&s);
+
+	/* Prefixes are matched case insensitively */
+	g_assert_cmpstr(session_send(&s, "at+cind?\r"), ==,
+			"\r\n+CIND: 1,0,0,0,5,0,5\r\n\r\nOK\r\n");
+
+	/* Whitespace outside of strings and S5 are stripped */
+	g_assert_cmpstr(session_send(&s, "  AT + CMER = 3,0,0,1\r"), ==,
+			"\r\nOK\r\n");
+	g_assert_cmpstr(session_send(&s, "AT+CLCX\bC\r"), ==,
+			"\r\nOK\r\n");
+
+	/* A prefix of a registered command is not a command */
+	g_assert_cmpstr(session_send(&s, "AT+CIN?\r"), ==, "\r\nERROR\r\n");
+	g_assert_cmpstr(session_send(&s, "AT+CINDX?\r"), ==,
+			"\r\nERROR\r\n");
+	g_assert_cmpstr(session_send(&s, "AT+BRSF\r"), ==, "\r\nERROR\r\n");
+
+	/* Basic commands registered by the server itself */
+	g_assert_cmpstr(session_send(&s, "ATS3?\r"), ==,
+			"\r\n013\r\n\r\nOK\r\n");
+
+	/* A/ repeats the last command line */
+	g_assert_cmpstr(session_send(&s, "AT+BRSF=1\r"), ==,
+			"\r\n+BRSF: 871\r\n\r\nOK\r\n");
+	g_assert_cmpstr(session_send(&s, "A/"), ==,
+			"\r\n+BRSF: 871\r\n\r\nOK\r\n");
+
+	/* Unregistering leaves the rest of the trie intact */
+	g_assert(g_at_server_unregister(s.server, "+CIND"));
+	g_assert(!g_at_server_unregister(s.server, "+CIND"));
+	g_assert(!g_at_server_unregister(s.server, "+CI"));
+
+	g_assert_cmpstr(session_send(&s, "AT+CIND?\r"), ==,
+			"\r\nERROR\r\n");
+	g_assert_cmpstr(session_send(&s, "AT+CMEE=1\r"), ==, "\r\nOK\r\n");
+
+	g_assert(g_at_server_register(s.server, "+CIND", cind_cb, &s, NULL));
+	g_assert_cmpstr(session_send(&s, "AT+CIND?\r"), ==,
+			"\r\n+CIND: 1,0,0,0,5,0,5\r\n\r\nOK\r\n");
+
+	session_stop(&s);
+}
+
+static void test_hfp_benchmark(void)
+{
+	static const unsigned int rounds = 2000;
+	struct hfp_session s;
+	unsigned int i;
+	gint64 start;
+	double elapsed;
+
+	session_start(&s);
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < rounds; i++)
+		run_script(&s);
+
+	elapsed = g_get_monotonic_time() - start;
+
+	session_stop(&s);
+
+	g_test_minimized_result(elapsed * 1000 /
+				(rounds * G_N_ELEMENTS(hfp_script)),
+				"%.1f ns per command",
+				elapsed * 1000 /
+				(rounds * G_N_ELEMENTS(hfp_script)));
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgatserver/hfp_session", test_hfp_session);
+	g_test_add_func("/testgatserver/command_lookup",
+					test_command_lookup);
+
+	if (g_test_perf())
+		g_test_add_func("/testgatserver/hfp_benchmark",
+					test_hfp_benchmark);
+
+	return g_test_run();
+}
@@ -0,0 +1,411 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "historylog.h"
+
+#define TEST_CAPACITY 8192
+
+/* Size of the file header, records start right after it */
+#define TEST_HEADER_SIZE 24
+
+static const char *peers[] = { "+15551230001", "+15551230002", "+1555123003" };
+
+struct collect {
+	guint64 seq[64];
+	gint64 time[64];
+	unsigned int n;
+};
+
+static char *test_path(void)
+{
+	char dir[] = "/tmp/historylog-XXXXXX";
+
+	g_assert(mkdtemp(dir) != NULL);
+
+	return g_build_filename(dir, "history", NULL);
+}
+
+static void test_cleanup(char *path)
+{
+	char *dir = g_path_get_dirname(path);
+
+	unlink(path);
+	rmdir(dir);
+	g_free(dir);
+	g_free(path);
+}
+
+static void collect_cb(const struct history_log_record *record, void *data)
+{
+	struct collect *c = data;
+
+	g_assert(c->n < G_N_ELEMENTS(c->seq));
+
+	c->seq[c->n] = record->seq;
+	c->time[c->n] = record->time;
+	c->n += 1;
+}
+
+static void make_uuid(unsigned char *uuid, unsigned int i)
+{
+	memset(uuid, 0xa5, HISTORY_LOG_UUID_LEN);
+	uuid[0] = i;
+	uuid[1] = i >> 8;
+}
+
+/* Records two seconds apart, cycling over the peers and types */
+static void fill(struct history_log *log, unsigned int count)
+{
+	unsigned char uuid[HISTORY_LOG_UUID_LEN];
+	struct history_log_record record;
+	char text[32];
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		memset(&record, 0, sizeof(record));
+		record.time = 1000 + i * 2;
+		record.type = HISTORY_LOG_TYPE_CALL + i % 4;
+		record.peer = peers[i % G_N_ELEMENTS(peers)];
+
+		if (record.type >= HISTORY_LOG_TYPE_INCOMING_MESSAGE) {
+			make_uuid(uuid, i);
+			record.uuid = uuid;
+			snprintf(text, sizeof(text), "message %u", i);
+			record.text = text;
+		}
+
+		g_assert(history_log_append(log, &record));
+		g_assert(record.seq == i + 1);
+	}
+}
+
+static void test_query(void)
+{
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, TEST_CAPACITY);
+	struct history_log_filter filter;
+	struct history_log_cursor cursor;
+	struct collect c;
+	gboolean more;
+	unsigned int i;
+
+	g_assert(log);
+	fill(log, 30);
+	g_assert_cmpuint(history_log_count(log), ==, 30);
+
+	/* Page through everything, newest first */
+	memset(&filter, 0, sizeof(filter));
+	memset(&cursor, 0, sizeof(cursor));
+	memset(&c, 0, sizeof(c));
+
+	g_assert_cmpuint(history_log_query(log, &filter, &cursor, 12, &more,
+						collect_cb, &c), ==, 12);
+	g_assert(more);
+	g_assert_cmpuint(history_log_query(log, &filter, &cursor, 12, &more,
+						collect_cb, &c), ==, 12);
+	g_assert(more);
+	g_assert_cmpuint(history_log_query(log, &filter, &cursor, 12, &more,
+						collect_cb, &c), ==, 6);
+	g_assert(!more);
+
+	for (i = 0; i < 30; i++)
+		g_assert(c.seq[i] == 30 - i);
+
+	/* Peer and time range */
+	filter.peer = peers[1];
+	filter.since = 1010;
+	filter.until = 1040;
+	memset(&cursor, 0, sizeof(cursor));
+	memset(&c, 0, sizeof(c));
+
+	history_log_query(log, &filter, &cursor, 64, &more, collect_cb, &c);
+	g_assert(!more);
+	g_assert_cmpuint(c.n, ==, 5);
+
+	for (i = 0; i < c.n; i++) {
+		g_assert(c.time[i] >= 1010 && c.time[i] <= 1040);
+		g_assert((c.seq[i] - 1) % G_N_ELEMENTS(peers) == 1);
+	}
+
+	/* Type mask across two pages */
+	memset(&filter, 0, sizeof(filter));
+	filter.types = HISTORY_LOG_TYPE_MASK(HISTORY_LOG_TYPE_MISSED_CALL);
+	memset(&cursor, 0, sizeof(cursor));
+	memset(&c, 0, sizeof(c));
+
+	history_log_query(log, &filter, &cursor, 7, &more, collect_cb, &c);
+	g_assert(more);
+	history_log_query(log, &filter, &cursor, 7, &more, collect_cb, &c);
+	g_assert(!more);
+	g_assert_cmpuint(c.n, ==, 8);
+
+	filter.peer = "+10000000000";
+	memset(&cursor, 0, sizeof(cursor));
+	g_assert_cmpuint(history_log_query(log, &filter, &cursor, 7, &more,
+						collect_cb, &c), ==, 0);
+
+	history_log_close(log);
+	test_cleanup(path);
+}
+
+static void test_status(void)
+{
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, TEST_CAPACITY);
+	unsigned char uuid[HISTORY_LOG_UUID_LEN];
+	struct history_log_record record;
+
+	g_assert(log);
+	fill(log, 8);
+
+	make_uuid(uuid, 3);
+	g_assert(history_log_find(log, uuid, &record));
+	g_assert(record.seq == 4);
+	g_assert(record.type == HISTORY_LOG_TYPE_OUTGOING_MESSAGE);
+	g_assert_cmpstr(record.text, ==, "message 3");
+	g_assert(record.status == 0);
+
+	g_assert(history_log_set_status(log, uuid, 4));
+
+	/* Calls carry no UUID */
+	make_uuid(uuid, 4);
+	g_assert(!history_log_find(log, uuid, &record));
+	g_assert(!history_log_set_status(log, uuid, 4));
+
+	history_log_close(log);
+
+	/* Everything survives a reopen, including the status update */
+	log = history_log_open(path, TEST_CAPACITY);
+	g_assert(log);
+	g_assert_cmpuint(history_log_count(log), ==, 8);
+
+	make_uuid(uuid, 3);
+	g_assert(history_log_find(log, uuid, &record));
+	g_assert(record.status == 4);
+	g_assert_cmpstr(record.peer, ==, peers[0]);
+
+	/* Sequence numbers carry on where they left off */
+	memset(&record, 0, sizeof(record));
+	record.time = 5000;
+	record.type = HISTORY_LOG_TYPE_CALL;
+	g_assert(history_log_append(log, &record));
+	g_assert(record.seq == 9);
+
+	history_log_close(log);
+	test_cleanup(path);
+}
+
+static void test_compaction(void)
+{
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, TEST_CAPACITY);
+	struct history_log_filter filter;
+	struct history_log_cursor cursor;
+	struct history_log_record record;
+	unsigned char uuid[HISTORY_LOG_UUID_LEN];
+	struct collect c;
+	gboolean more;
+	unsigned int i;
+
+	g_assert(log);
+
+	for (i = 0; i < 1000; i++) {
+		memset(&record, 0, sizeof(record));
+		record.time = i;
+		record.type = HISTORY_LOG_TYPE_INCOMING_MESSAGE;
+		record.peer = peers[i % G_N_ELEMENTS(peers)];
+		record.text = "The quick brown fox jumps over the lazy dog";
+		make_uuid(uuid, i);
+		record.uuid = uuid;
+
+		g_assert(history_log_append(log, &record));
+		g_assert(history_log_used(log) <= history_log_capacity(log));
+	}
+
+	g_assert_cmpuint(history_log_count(log), <, 1000);
+
+	/* The newest records are kept, the oldest ones are gone */
+	make_uuid(uuid, 999);
+	g_assert(history_log_find(log, uuid, &record));
+	g_assert(record.seq == 1000);
+
+	make_uuid(uuid, 0);
+	g_assert(!history_log_find(log, uuid, &record));
+
+	memset(&filter, 0, sizeof(filter));
+	filter.peer = peers[0];
+	memset(&cursor, 0, sizeof(cursor));
+	memset(&c, 0, sizeof(c));
+
+	history_log_query(log, &filter, &cursor, 1, &more, collect_cb, &c);
+	g_assert(more);
+	g_assert(c.time[0] == 999);
+
+	i = history_log_count(log);
+	history_log_close(log);
+
+	log = history_log_open(path, TEST_CAPACITY);
+	g_assert(log);
+	g_assert_cmpuint(history_log_count(log), ==, i);
+
+	/* Too large to ever fit */
+	memset(&record, 0, sizeof(record));
+	record.text = g_strnfill(TEST_CAPACITY / 2, 'x');
+	g_assert(!history_log_append(log, &record));
+	g_free((char *) record.text);
+
+	history_log_close(log);
+	test_cleanup(path);
+}
+
+static void test_truncated(void)
+{
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, TEST_CAPACITY);
+	struct history_log_record record;
+	size_t used;
+	FILE *f;
+
+	g_assert(log);
+	fill(log, 3);
+	used = history_log_used(log);
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_CALL;
+	record.peer = peers[0];
+	g_assert(history_log_append(log, &record));
+	history_log_close(log);
+
+	/* Scribble over the last record, as a crash during append might */
+	f = fopen(path, "r+b");
+	g_assert(f);
+	g_assert(fseek(f, TEST_HEADER_SIZE + used, SEEK_SET) == 0);
+	fputs("garbage", f);
+	fclose(f);
+
+	log = history_log_open(path, TEST_CAPACITY);
+	g_assert(log);
+	g_assert_cmpuint(history_log_count(log), ==, 3);
+	g_assert(history_log_used(log) == used);
+
+	/* The sequence number of the dropped record is not reused */
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_CALL;
+	g_assert(history_log_append(log, &record));
+	g_assert(record.seq == 5);
+
+	history_log_close(log);
+	test_cleanup(path);
+}
+
+static void test_bad_type(void)
+{
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, TEST_CAPACITY);
+	struct history_log_record record;
+	size_t used;
+	FILE *f;
+
+	g_assert(log);
+	fill(log, 3);
+	used = history_log_used(log);
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_OUTGOING_MESSAGE + 1;
+	record.peer = peers[0];
+	g_assert(!history_log_append(log, &record));
+
+	record.type = HISTORY_LOG_TYPE_CALL;
+	g_assert(history_log_append(log, &record));
+	history_log_close(log);
+
+	/* The type follows the first 32 bytes of the record */
+	f = fopen(path, "r+b");
+	g_assert(f);
+	g_assert(fseek(f, TEST_HEADER_SIZE + used + 32, SEEK_SET) == 0);
+	fputc(0xff, f);
+	fclose(f);
+
+	log = history_log_open(path, TEST_CAPACITY);
+	g_assert(log);
+	g_assert_cmpuint(history_log_count(log), ==, 3);
+
+	history_log_close(log);
+	test_cleanup(path);
+}
+
+static void test_append_benchmark(void)
+{
+	static const unsigned int rounds = 200000;
+	char *path = test_path();
+	struct history_log *log = history_log_open(path, 1024 * 1024);
+	struct history_log_record record;
+	unsigned int i;
+	gint64 start;
+	double elapsed;
+
+	g_assert(log);
+
+	memset(&record, 0, sizeof(record));
+	record.type = HISTORY_LOG_TYPE_CALL;
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < rounds; i++) {
+		record.time = i;
+		record.peer = peers[i % G_N_ELEMENTS(peers)];
+		history_log_append(log, &record);
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+
+	history_log_close(log);
+	test_cleanup(path);
+
+	g_test_minimized_result(elapsed * 1000 / rounds,
+				"%.1f ns per append", elapsed * 1000 / rounds);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhistorylog/query", test_query);
+	g_test_add_func("/testhistorylog/status", test_status);
+	g_test_add_func("/testhistorylog/compaction", test_compaction);
+	g_test_add_func("/testhistorylog/truncated", test_truncated);
+	g_test_add_func("/testhistorylog/bad_type", test_bad_type);
+
+	if (g_test_perf())
+		g_test_add_func("/testhistorylog/append_benchmark",
+					test_append_benchmark);
+
+	return g_test_run();
+}
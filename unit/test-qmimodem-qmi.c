@@ -0,0 +1,614 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+
+#define TEST_CLIENT_ID 0x05
+#define TEST_MESSAGE 0x0020
+#define TEST_INDICATION 0x0024
+#define TEST_OTHER_INDICATION 0x0025
+
+/*
+ * The fake modem owns one end of a stream socketpair and speaks raw QMUX
+ * on it, the device under test owns the other end.
+ */
+struct fake_modem {
+	int fd;
+	struct qmi_device *device;
+	struct qmi_service *service;
+	unsigned int replies;
+};
+
+struct fake_request {
+	uint8_t service;
+	uint8_t client;
+	uint16_t tid;
+	uint16_t message;
+};
+
+static void fake_modem_init(struct fake_modem *fake)
+{
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	memset(fake, 0, sizeof(*fake));
+	fake->fd = sv[1];
+	fake->device = qmi_device_new(sv[0]);
+	g_assert(fake->device);
+
+	qmi_device_set_close_on_unref(fake->device, true);
+}
+
+static void fake_modem_cleanup(struct fake_modem *fake)
+{
+	qmi_service_unref(fake->service);
+	qmi_device_unref(fake->device);
+	close(fake->fd);
+}
+
+static void iterate(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static bool fake_readable(struct fake_modem *fake, int timeout)
+{
+	struct pollfd pfd = { .fd = fake->fd, .events = POLLIN };
+
+	return poll(&pfd, 1, timeout) > 0;
+}
+
+static void fake_read(struct fake_modem *fake, void *buf, size_t len)
+{
+	size_t offset = 0;
+
+	while (offset < len) {
+		ssize_t r;
+
+		while (!fake_readable(fake, 10))
+			iterate();
+
+		r = read(fake->fd, buf + offset, len - offset);
+		g_assert(r > 0);
+
+		offset += r;
+	}
+}
+
+static void fake_read_request_tlvs(struct fake_modem *fake,
+				struct fake_request *req, GByteArray *tlvs)
+{
+	unsigned char buf[65536];
+	uint16_t len;
+	unsigned int offset;
+
+	fake_read(fake, buf, 3);
+	g_assert(buf[0] == 0x01);
+
+	len = buf[1] | (buf[2] << 8);
+	fake_read(fake, buf + 3, len - 2);
+
+	req->service = buf[4];
+	req->client = buf[5];
+
+	if (req->service == QMI_SERVICE_CONTROL) {
+		req->tid = buf[7];
+		req->message = buf[8] | (buf[9] << 8);
+		offset = 12;
+	} else {
+		req->tid = buf[7] | (buf[8] << 8);
+		req->message = buf[9] | (buf[10] << 8);
+		offset = 13;
+	}
+
+	if (tlvs)
+		g_byte_array_append(tlvs, buf + offset, len + 1 - offset);
+}
+
+static void fake_read_request(struct fake_modem *fake,
+					struct fake_request *req)
+{
+	fake_read_request_tlvs(fake, req, NULL);
+}
+
+static void append_uint16(GByteArray *frame, uint16_t value)
+{
+	guint8 le[2] = { value & 0xff, value >> 8 };
+
+	g_byte_array_append(frame, le, 2);
+}
+
+static void append_tlv(GByteArray *frame, uint8_t type,
+					const void *data, uint16_t len)
+{
+	g_byte_array_append(frame, &type, 1);
+	append_uint16(frame, len);
+	g_byte_array_append(frame, data, len);
+}
+
+static void append_result(GByteArray *frame)
+{
+	static const guint8 success[4] = { 0x00, 0x00, 0x00, 0x00 };
+
+	append_tlv(frame, 0x02, success, sizeof(success));
+}
+
+/* Appends a complete QMUX frame of the given message type to the stream */
+static void append_message(GByteArray *stream, const struct fake_request *req,
+				guint8 type, const GByteArray *tlvs)
+{
+	GByteArray *frame = g_byte_array_new();
+	guint8 mux[6] = { 0x01, 0x00, 0x00, 0x80, req->service, req->client };
+
+	g_byte_array_append(frame, mux, sizeof(mux));
+
+	if (req->service == QMI_SERVICE_CONTROL) {
+		guint8 tid = req->tid;
+
+		g_byte_array_append(frame, &type, 1);
+		g_byte_array_append(frame, &tid, 1);
+	} else {
+		g_byte_array_append(frame, &type, 1);
+		append_uint16(frame, req->tid);
+	}
+
+	append_uint16(frame, req->message);
+	append_uint16(frame, tlvs->len);
+	g_byte_array_append(frame, tlvs->data, tlvs->len);
+
+	frame->data[1] = (frame->len - 1) & 0xff;
+	frame->data[2] = (frame->len - 1) >> 8;
+
+	g_byte_array_append(stream, frame->data, frame->len);
+	g_byte_array_free(frame, TRUE);
+}
+
+static void append_response(GByteArray *stream, const struct fake_request *req,
+				const GByteArray *tlvs)
+{
+	guint8 type = req->service == QMI_SERVICE_CONTROL ? 0x01 : 0x02;
+
+	append_message(stream, req, type, tlvs);
+}
+
+static void append_indication(GByteArray *stream, uint16_t message,
+				const GByteArray *tlvs)
+{
+	struct fake_request ind = {
+		.service = QMI_SERVICE_NAS,
+		.client = TEST_CLIENT_ID,
+		.tid = 0,
+		.message = message,
+	};
+
+	append_message(stream, &ind, 0x04, tlvs);
+}
+
+/* Writes the stream in chunks, letting the device read after each one */
+static void fake_write(struct fake_modem *fake, const GByteArray *stream,
+							size_t chunk)
+{
+	size_t offset;
+
+	for (offset = 0; offset < stream->len; offset += chunk) {
+		size_t len = MIN(chunk, stream->len - offset);
+
+		g_assert(write(fake->fd, stream->data + offset, len) ==
+								(ssize_t) len);
+		iterate();
+	}
+}
+
+static void discover_cb(uint8_t count, const struct qmi_version *list,
+							void *user_data)
+{
+	unsigned int *found = user_data;
+
+	*found = count;
+}
+
+static void reply_discover(struct fake_modem *fake, GByteArray *stream)
+{
+	static const guint8 services[] = {
+		3,
+		QMI_SERVICE_CONTROL, 0x01, 0x00, 0x05, 0x00,
+		QMI_SERVICE_DMS, 0x01, 0x00, 0x03, 0x00,
+		QMI_SERVICE_NAS, 0x01, 0x00, 0x04, 0x00,
+	};
+	struct fake_request req;
+	GByteArray *tlvs = g_byte_array_new();
+
+	fake_read_request(fake, &req);
+	g_assert(req.service == QMI_SERVICE_CONTROL);
+	g_assert(req.message == QMI_CTL_GET_VERSION_INFO);
+
+	append_result(tlvs);
+	append_tlv(tlvs, 0x01, services, sizeof(services));
+	append_response(stream, &req, tlvs);
+
+	g_byte_array_free(tlvs, TRUE);
+}
+
+static void service_create_cb(struct qmi_service *service, void *user_data)
+{
+	struct fake_modem *fake = user_data;
+
+	fake->service = qmi_service_ref(service);
+}
+
+static void fake_modem_create_service(struct fake_modem *fake)
+{
+	GByteArray *stream = g_byte_array_new();
+	GByteArray *tlvs = g_byte_array_new();
+	const guint8 client_id[2] = { QMI_SERVICE_NAS, TEST_CLIENT_ID };
+	struct fake_request req;
+
+	g_assert(qmi_service_create(fake->device, QMI_SERVICE_NAS,
+					service_create_cb, fake, NULL));
+
+	reply_discover(fake, stream);
+	fake_write(fake, stream, stream->len);
+
+	fake_read_request(fake, &req);
+	g_assert(req.message == QMI_CTL_GET_CLIENT_ID);
+
+	append_result(tlvs);
+	append_tlv(tlvs, 0x01, client_id, sizeof(client_id));
+
+	g_byte_array_set_size(stream, 0);
+	append_response(stream, &req, tlvs);
+	fake_write(fake, stream, stream->len);
+
+	g_assert(fake->service);
+
+	g_byte_array_free(tlvs, TRUE);
+	g_byte_array_free(stream, TRUE);
+}
+
+static void test_discover_split(gconstpointer data)
+{
+	size_t chunk = GPOINTER_TO_UINT(data);
+	struct fake_modem fake;
+	GByteArray *stream = g_byte_array_new();
+	unsigned int found = 0;
+
+	fake_modem_init(&fake);
+
+	g_assert(qmi_device_discover(fake.device, discover_cb, &found, NULL));
+
+	reply_discover(&fake, stream);
+	fake_write(&fake, stream, chunk);
+
+	g_assert(found == 2);
+
+	g_byte_array_free(stream, TRUE);
+	fake_modem_cleanup(&fake);
+}
+
+static void test_resync(void)
+{
+	static const guint8 garbage[] = { 0x00, 0x42, 0x01, 0x00, 0x7f };
+	struct fake_modem fake;
+	GByteArray *stream = g_byte_array_new();
+	unsigned int found = 0;
+
+	fake_modem_init(&fake);
+
+	g_assert(qmi_device_discover(fake.device, discover_cb, &found, NULL));
+
+	g_byte_array_append(stream, garbage, sizeof(garbage));
+	reply_discover(&fake, stream);
+	fake_write(&fake, stream, 7);
+
+	g_assert(found == 2);
+
+	g_byte_array_free(stream, TRUE);
+	fake_modem_cleanup(&fake);
+}
+
+static void send_cb(struct qmi_result *result, void *user_data)
+{
+	struct fake_modem *fake = user_data;
+	uint16_t value;
+
+	g_assert(!qmi_result_set_error(result, NULL));
+	g_assert(qmi_result_get_uint16(result, 0x10, &value));
+
+	/* Every reply carries the service transaction id it answers */
+	g_assert(value >= 256);
+
+	fake->replies++;
+}
+
+/*
+ * Sends count requests, answers them in reverse order in a single stream
+ * written in chunk sized pieces and returns the time it took in us.
+ */
+static gint64 run_requests(struct fake_modem *fake, unsigned int count,
+								size_t chunk)
+{
+	struct fake_request *reqs = g_new0(struct fake_request, count);
+	GByteArray *stream = g_byte_array_new();
+	GByteArray *tlvs = g_byte_array_new();
+	gint64 start;
+	unsigned int i;
+
+	fake->replies = 0;
+
+	for (i = 0; i < count; i++)
+		g_assert(qmi_service_send(fake->service, TEST_MESSAGE, NULL,
+						send_cb, fake, NULL) != 0);
+
+	for (i = 0; i < count; i++) {
+		fake_read_request(fake, &reqs[i]);
+		g_assert(reqs[i].service == QMI_SERVICE_NAS);
+		g_assert(reqs[i].client == TEST_CLIENT_ID);
+	}
+
+	for (i = count; i > 0; i--) {
+		const struct fake_request *req = &reqs[i - 1];
+		guint8 tid[2] = { req->tid & 0xff, req->tid >> 8 };
+
+		g_byte_array_set_size(tlvs, 0);
+		append_result(tlvs);
+		append_tlv(tlvs, 0x10, tid, sizeof(tid));
+		append_response(stream, req, tlvs);
+	}
+
+	start = g_get_monotonic_time();
+
+	fake_write(fake, stream, chunk);
+
+	g_assert(fake->replies == count);
+
+	g_byte_array_free(tlvs, TRUE);
+	g_byte_array_free(stream, TRUE);
+	g_free(reqs);
+
+	return g_get_monotonic_time() - start;
+}
+
+static void test_out_of_order(void)
+{
+	struct fake_modem fake;
+
+	fake_modem_init(&fake);
+	fake_modem_create_service(&fake);
+
+	/* Chunks deliberately do not line up with frame boundaries */
+	run_requests(&fake, 64, 13);
+
+	fake_modem_cleanup(&fake);
+}
+
+static void test_cancel(void)
+{
+	struct fake_modem fake;
+	struct fake_request req;
+	uint16_t id;
+
+	fake_modem_init(&fake);
+	fake_modem_create_service(&fake);
+
+	id = qmi_service_send(fake.service, TEST_MESSAGE, NULL,
+						send_cb, &fake, NULL);
+	g_assert(id != 0);
+
+	fake_read_request(&fake, &req);
+	g_assert(req.tid == id);
+
+	g_assert(qmi_service_cancel(fake.service, id));
+	g_assert(!qmi_service_cancel(fake.service, id));
+
+	fake_modem_cleanup(&fake);
+}
+
+static void test_param(void)
+{
+	struct fake_modem fake;
+	struct fake_request req;
+	struct qmi_param *param;
+	GByteArray *expected = g_byte_array_new();
+	GByteArray *tlvs = g_byte_array_new();
+	guint8 value[300];
+	unsigned int i;
+
+	fake_modem_init(&fake);
+	fake_modem_create_service(&fake);
+
+	for (i = 0; i < sizeof(value); i++)
+		value[i] = i;
+
+	param = qmi_param_new();
+	g_assert(param);
+
+	/* Enough TLVs of growing size to force several buffer expansions */
+	for (i = 1; i <= 40; i++) {
+		g_assert(qmi_param_append(param, 0x10 + i, i * 7, value));
+		append_tlv(expected, 0x10 + i, value, i * 7);
+	}
+
+	g_assert(qmi_param_append_uint8(param, 0x01, 0x12));
+	append_tlv(expected, 0x01, value + 0x12, 1);
+
+	g_assert(qmi_param_append_uint16(param, 0x02, 0x0302));
+	append_tlv(expected, 0x02, value + 2, 2);
+
+	g_assert(qmi_param_append_uint32(param, 0x03, 0x07060504));
+	append_tlv(expected, 0x03, value + 4, 4);
+
+	/* Empty TLVs are silently skipped, a missing type is refused */
+	g_assert(qmi_param_append(param, 0x04, 0, NULL));
+	g_assert(!qmi_param_append(param, 0x00, 1, value));
+
+	g_assert(qmi_service_send(fake.service, TEST_MESSAGE, param,
+						NULL, NULL, NULL) != 0);
+
+	fake_read_request_tlvs(&fake, &req, tlvs);
+	g_assert(req.message == TEST_MESSAGE);
+	g_assert(tlvs->len == expected->len);
+	g_assert(!memcmp(tlvs->data, expected->data, expected->len));
+
+	g_byte_array_free(tlvs, TRUE);
+	g_byte_array_free(expected, TRUE);
+	fake_modem_cleanup(&fake);
+}
+
+struct indication_data {
+	unsigned int count;
+	uint16_t last;
+};
+
+static void indication_cb(struct qmi_result *result, void *user_data)
+{
+	struct indication_data *data = user_data;
+	uint16_t value;
+	uint8_t byte;
+
+	/* Late types are looked up first, then an early and a missing one */
+	g_assert(qmi_result_get_uint16(result, 0x30, &value));
+	g_assert(value == 0x3030);
+
+	g_assert(qmi_result_get_uint8(result, 0x10, &byte));
+	g_assert(byte == 0x01);
+
+	g_assert(!qmi_result_get_uint8(result, 0x20, &byte));
+
+	/* Repeated types resolve to their first occurrence */
+	g_assert(qmi_result_get_uint16(result, 0x11, &value));
+	g_assert(value == 0x0101);
+
+	data->count++;
+	data->last = value;
+}
+
+static void test_indication(void)
+{
+	struct fake_modem fake;
+	struct indication_data first = { 0, 0 };
+	struct indication_data second = { 0, 0 };
+	struct indication_data other = { 0, 0 };
+	GByteArray *stream = g_byte_array_new();
+	GByteArray *tlvs = g_byte_array_new();
+	guint8 byte = 0x01;
+	guint8 word[2];
+	uint16_t id;
+	unsigned int i;
+
+	fake_modem_init(&fake);
+	fake_modem_create_service(&fake);
+
+	g_assert(qmi_service_register(fake.service, TEST_INDICATION,
+					indication_cb, &first, NULL) != 0);
+	id = qmi_service_register(fake.service, TEST_INDICATION,
+					indication_cb, &second, NULL);
+	g_assert(id != 0);
+	g_assert(qmi_service_register(fake.service, TEST_OTHER_INDICATION,
+					indication_cb, &other, NULL) != 0);
+
+	append_tlv(tlvs, 0x10, &byte, 1);
+
+	for (i = 0; i < 4; i++) {
+		word[0] = word[1] = i + 1;
+		append_tlv(tlvs, 0x11, word, 2);
+	}
+
+	word[0] = word[1] = 0x30;
+	append_tlv(tlvs, 0x30, word, 2);
+
+	append_indication(stream, TEST_INDICATION, tlvs);
+	append_indication(stream, TEST_OTHER_INDICATION, tlvs);
+	append_indication(stream, TEST_MESSAGE, tlvs);
+	fake_write(&fake, stream, stream->len);
+
+	g_assert(first.count == 1 && first.last == 0x0101);
+	g_assert(second.count == 1);
+	g_assert(other.count == 1);
+
+	g_assert(qmi_service_unregister(fake.service, id));
+	g_assert(!qmi_service_unregister(fake.service, id));
+
+	fake_write(&fake, stream, stream->len);
+
+	g_assert(first.count == 2);
+	g_assert(second.count == 1);
+	g_assert(other.count == 2);
+
+	g_byte_array_free(tlvs, TRUE);
+	g_byte_array_free(stream, TRUE);
+	fake_modem_cleanup(&fake);
+}
+
+static void test_benchmark(void)
+{
+	static const unsigned int counts[] = { 16, 256, 4096 };
+	struct fake_modem fake;
+	unsigned int i;
+
+	fake_modem_init(&fake);
+	fake_modem_create_service(&fake);
+
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		gint64 elapsed = run_requests(&fake, counts[i], 4096);
+
+		g_test_minimized_result((double) elapsed / counts[i],
+				"%u outstanding requests: %.2f us per response",
+				counts[i], (double) elapsed / counts[i]);
+	}
+
+	fake_modem_cleanup(&fake);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/testqmi/discover/whole",
+				GUINT_TO_POINTER(65536), test_discover_split);
+	g_test_add_data_func("/testqmi/discover/bytewise",
+				GUINT_TO_POINTER(1), test_discover_split);
+	g_test_add_data_func("/testqmi/discover/split",
+				GUINT_TO_POINTER(5), test_discover_split);
+	g_test_add_func("/testqmi/resync", test_resync);
+	g_test_add_func("/testqmi/out_of_order", test_out_of_order);
+	g_test_add_func("/testqmi/cancel", test_cancel);
+	g_test_add_func("/testqmi/param", test_param);
+	g_test_add_func("/testqmi/indication", test_indication);
+
+	if (g_test_perf())
+		g_test_add_func("/testqmi/benchmark", test_benchmark);
+
+	return g_test_run();
+}
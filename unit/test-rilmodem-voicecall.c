@@ -0,0 +1,496 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2016 Canonical Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <ofono.h>
+#include <ofono/modem.h>
+#include <ofono/types.h>
+#include <ofono/voicecall.h>
+#include <gril.h>
+
+#include "drivers/rilmodem/rilutil.h"
+#include "common.h"
+#include "ril_constants.h"
+#include "rilmodem-test-engine.h"
+
+/*
+ * Upper bound for the time between a call state change reported by the
+ * modem and the driver notifying the core. The driver used to wait for a
+ * fixed 300 ms before polling the call list, so this also guards against
+ * reintroducing such a delay.
+ */
+#define MAX_STATE_CHANGE_LATENCY_US (300 * 1000)
+
+static const struct ofono_voicecall_driver *vcdriver;
+
+/* Declarations && Re-implementations of core functions. */
+void ril_voicecall_exit(void);
+void ril_voicecall_init(void);
+
+struct ofono_voicecall {
+	void *driver_data;
+	GRil *ril;
+	struct engine_data *engined;
+	gint64 event_time;
+};
+
+int ofono_voicecall_driver_register(const struct ofono_voicecall_driver *d)
+{
+	if (vcdriver == NULL)
+		vcdriver = d;
+
+	return 0;
+}
+
+void ofono_voicecall_driver_unregister(const struct ofono_voicecall_driver *d)
+{
+	vcdriver = NULL;
+}
+
+void ofono_voicecall_set_data(struct ofono_voicecall *vc, void *data)
+{
+	vc->driver_data = data;
+}
+
+void *ofono_voicecall_get_data(struct ofono_voicecall *vc)
+{
+	return vc->driver_data;
+}
+
+struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
+						enum ofono_atom_type type)
+{
+	return NULL;
+}
+
+void *__ofono_atom_get_data(struct ofono_atom *atom)
+{
+	return NULL;
+}
+
+const char *ofono_sim_get_imsi(struct ofono_sim *sim)
+{
+	return NULL;
+}
+
+void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
+				enum ofono_disconnect_reason reason,
+				const struct ofono_error *error)
+{
+	g_assert_not_reached();
+}
+
+void ofono_voicecall_ssn_mo_notify(struct ofono_voicecall *vc, unsigned int id,
+					int code, int index)
+{
+	g_assert_not_reached();
+}
+
+void ofono_voicecall_ssn_mt_notify(struct ofono_voicecall *vc, unsigned int id,
+					int code, int index,
+					const struct ofono_phone_number *ph)
+{
+	g_assert_not_reached();
+}
+
+OFONO_EVENT_CALL_ARG_1(ofono_voicecall_register, struct ofono_voicecall *)
+OFONO_EVENT_CALL_ARG_2(ofono_voicecall_notify, struct ofono_voicecall *,
+						const struct ofono_call *)
+
+/*
+ * As all our architectures are little-endian except for
+ * PowerPC, and the Binder wire-format differs slightly
+ * depending on endian-ness, the following guards against test
+ * failures when run on PowerPC.
+ */
+#if BYTE_ORDER == LITTLE_ENDIAN
+
+/* REQUEST_GET_CURRENT_CALLS, seq 1 */
+static const char parcel_req_get_current_calls_1_2[] = {
+	0x00, 0x00, 0x00, 0x08, 0x09, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00
+};
+
+/* REQUEST_SET_SUPP_SVC_NOTIFICATION, seq 2, {1} */
+static const char parcel_req_set_supp_svc_notif_1_3[] = {
+	0x00, 0x00, 0x00, 0x10, 0x3E, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00
+};
+
+/* Response, no errors, no calls */
+static const char parcel_rsp_get_current_calls_1_4[] = {
+	0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* Response, no errors */
+static const char parcel_rsp_set_supp_svc_notif_1_5[] = {
+	0x00, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00
+};
+
+/* UNSOL_RESPONSE_CALL_STATE_CHANGED */
+static const unsigned char parcel_unsol_call_state_changed[] = {
+	0x00, 0x00, 0x00, 0x08, 0x01, 0x00, 0x00, 0x00, 0xE9, 0x03, 0x00, 0x00
+};
+
+static void call_state_changed_1_6(gpointer data)
+{
+	struct ofono_voicecall *vc = data;
+
+	vc->event_time = g_get_monotonic_time();
+
+	rilmodem_test_engine_write_socket(vc->engined,
+					parcel_unsol_call_state_changed,
+					sizeof(parcel_unsol_call_state_changed));
+
+	rilmodem_test_engine_next_step(vc->engined);
+}
+
+/* REQUEST_GET_CURRENT_CALLS, seq 3 */
+static const char parcel_req_get_current_calls_1_7[] = {
+	0x00, 0x00, 0x00, 0x08, 0x09, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00
+};
+
+/*
+ * Response, no errors,
+ * {[id=1,status=4,type=1,number=12345,name=(null)]}
+ */
+static const char parcel_rsp_get_current_calls_1_8[] = {
+	0x00, 0x00, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x31, 0x00, 0x32, 0x00,
+	0x33, 0x00, 0x34, 0x00, 0x35, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void check_state_change_latency(struct ofono_voicecall *vc)
+{
+	gint64 latency = g_get_monotonic_time() - vc->event_time;
+
+	if (g_test_verbose())
+		g_print("call state change latency: %" G_GINT64_FORMAT
+							" us\n", latency);
+
+	g_assert(latency < MAX_STATE_CHANGE_LATENCY_US);
+}
+
+static void voicecall_notify_check_1_9(struct ofono_voicecall *vc,
+					const struct ofono_call *call)
+{
+	g_assert(call->id == 1);
+	g_assert(call->status == CALL_STATUS_INCOMING);
+	g_assert(call->type == 1);
+	g_assert(!strcmp(call->phone_number.number, "12345"));
+
+	check_state_change_latency(vc);
+}
+
+/*
+ * --- TEST 1 ---
+ * Step 1: Driver calls ofono_voicecall_register
+ * Step 2: Driver sends REQUEST_GET_CURRENT_CALLS
+ * Step 3: Driver sends REQUEST_SET_SUPP_SVC_NOTIFICATION
+ * Step 4: Harness answers with empty call list
+ * Step 5: Harness answers SET_SUPP_SVC_NOTIFICATION with no error
+ * Step 6: Harness sends UNSOL_RESPONSE_CALL_STATE_CHANGED
+ * Step 7: Driver sends REQUEST_GET_CURRENT_CALLS right away
+ * Step 8: Harness answers with an incoming call
+ * Step 9: Driver calls ofono_voicecall_notify, checking latency from step 6
+ */
+static const struct rilmodem_test_step steps_test_1[] = {
+	{
+		.type = TST_EVENT_CALL,
+		.call_func = (void (*)(void)) ofono_voicecall_register,
+		.check_func = NULL
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_1_2,
+		.parcel_size = sizeof(parcel_req_get_current_calls_1_2)
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_set_supp_svc_notif_1_3,
+		.parcel_size = sizeof(parcel_req_set_supp_svc_notif_1_3)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_get_current_calls_1_4,
+		.parcel_size = sizeof(parcel_rsp_get_current_calls_1_4)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_set_supp_svc_notif_1_5,
+		.parcel_size = sizeof(parcel_rsp_set_supp_svc_notif_1_5)
+	},
+	{
+		.type = TST_ACTION_CALL,
+		.call_action = call_state_changed_1_6,
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_1_7,
+		.parcel_size = sizeof(parcel_req_get_current_calls_1_7)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_get_current_calls_1_8,
+		.parcel_size = sizeof(parcel_rsp_get_current_calls_1_8)
+	},
+	{
+		.type = TST_EVENT_CALL,
+		.call_func = (void (*)(void)) ofono_voicecall_notify,
+		.check_func = (void (*)(void)) voicecall_notify_check_1_9
+	},
+};
+
+struct rilmodem_test_data test_1 = {
+	.steps = steps_test_1,
+	.num_steps = G_N_ELEMENTS(steps_test_1)
+};
+
+static void call_state_changed_storm_2_6(gpointer data)
+{
+	struct ofono_voicecall *vc = data;
+	int i;
+
+	vc->event_time = g_get_monotonic_time();
+
+	for (i = 0; i < 3; i++)
+		rilmodem_test_engine_write_socket(vc->engined,
+					parcel_unsol_call_state_changed,
+					sizeof(parcel_unsol_call_state_changed));
+
+	rilmodem_test_engine_next_step(vc->engined);
+}
+
+/* Response, no errors, no calls */
+static const char parcel_rsp_get_current_calls_2_8[] = {
+	0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* REQUEST_GET_CURRENT_CALLS, seq 4 */
+static const char parcel_req_get_current_calls_2_9[] = {
+	0x00, 0x00, 0x00, 0x08, 0x09, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00
+};
+
+/*
+ * Response, no errors,
+ * {[id=1,status=4,type=1,number=12345,name=(null)]}
+ */
+static const char parcel_rsp_get_current_calls_2_10[] = {
+	0x00, 0x00, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x31, 0x00, 0x32, 0x00,
+	0x33, 0x00, 0x34, 0x00, 0x35, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void call_state_changed_2_12(gpointer data)
+{
+	struct ofono_voicecall *vc = data;
+
+	rilmodem_test_engine_write_socket(vc->engined,
+					parcel_unsol_call_state_changed,
+					sizeof(parcel_unsol_call_state_changed));
+
+	rilmodem_test_engine_next_step(vc->engined);
+}
+
+/* REQUEST_GET_CURRENT_CALLS, seq 5 */
+static const char parcel_req_get_current_calls_2_13[] = {
+	0x00, 0x00, 0x00, 0x08, 0x09, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00
+};
+
+/*
+ * --- TEST 2 ---
+ * Steps 1-5: Same as in test 1
+ * Step 6: Harness sends three UNSOL_RESPONSE_CALL_STATE_CHANGED at once
+ * Step 7: Driver sends a single REQUEST_GET_CURRENT_CALLS
+ * Step 8: Harness answers with an (unchanged) empty call list
+ * Step 9: Driver sends one more REQUEST_GET_CURRENT_CALLS for the events
+ *         that arrived while the first one was in flight
+ * Step 10: Harness answers with an incoming call
+ * Step 11: Driver calls ofono_voicecall_notify, checking latency from step 6
+ * Step 12: Harness sends UNSOL_RESPONSE_CALL_STATE_CHANGED
+ * Step 13: Driver sends REQUEST_GET_CURRENT_CALLS with the next serial,
+ *          proving no stale poll was left queued
+ */
+static const struct rilmodem_test_step steps_test_2[] = {
+	{
+		.type = TST_EVENT_CALL,
+		.call_func = (void (*)(void)) ofono_voicecall_register,
+		.check_func = NULL
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_1_2,
+		.parcel_size = sizeof(parcel_req_get_current_calls_1_2)
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_set_supp_svc_notif_1_3,
+		.parcel_size = sizeof(parcel_req_set_supp_svc_notif_1_3)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_get_current_calls_1_4,
+		.parcel_size = sizeof(parcel_rsp_get_current_calls_1_4)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_set_supp_svc_notif_1_5,
+		.parcel_size = sizeof(parcel_rsp_set_supp_svc_notif_1_5)
+	},
+	{
+		.type = TST_ACTION_CALL,
+		.call_action = call_state_changed_storm_2_6,
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_1_7,
+		.parcel_size = sizeof(parcel_req_get_current_calls_1_7)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_get_current_calls_2_8,
+		.parcel_size = sizeof(parcel_rsp_get_current_calls_2_8)
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_2_9,
+		.parcel_size = sizeof(parcel_req_get_current_calls_2_9)
+	},
+	{
+		.type = TST_ACTION_SEND,
+		.parcel_data = parcel_rsp_get_current_calls_2_10,
+		.parcel_size = sizeof(parcel_rsp_get_current_calls_2_10)
+	},
+	{
+		.type = TST_EVENT_CALL,
+		.call_func = (void (*)(void)) ofono_voicecall_notify,
+		.check_func = (void (*)(void)) voicecall_notify_check_1_9
+	},
+	{
+		.type = TST_ACTION_CALL,
+		.call_action = call_state_changed_2_12,
+	},
+	{
+		.type = TST_EVENT_RECEIVE,
+		.parcel_data = parcel_req_get_current_calls_2_13,
+		.parcel_size = sizeof(parcel_req_get_current_calls_2_13)
+	},
+};
+
+struct rilmodem_test_data test_2 = {
+	.steps = steps_test_2,
+	.num_steps = G_N_ELEMENTS(steps_test_2)
+};
+
+static void server_connect_cb(gpointer data)
+{
+	struct ofono_voicecall *vc = data;
+	struct ril_voicecall_driver_data vc_drv_data = { vc->ril, NULL };
+	int retval;
+
+	/*
+	 * The driver registers the atom from an idle callback, which is the
+	 * first event test steps must start from.
+	 */
+	retval = vcdriver->probe(vc, OFONO_RIL_VENDOR_AOSP, &vc_drv_data);
+	g_assert(retval == 0);
+}
+
+/*
+ * This unit test:
+ *  - does some test data setup
+ *  - configures a dummy server socket
+ *  - creates a new gril client instance
+ *    - triggers a connect to the dummy
+ *      server socket
+ *  - starts the test engine
+ */
+static void test_function(gconstpointer data)
+{
+	const struct rilmodem_test_data *test_data = data;
+	struct ofono_voicecall *vc;
+
+	ril_voicecall_init();
+
+	vc = g_malloc0(sizeof(*vc));
+
+	vc->engined = rilmodem_test_engine_create(&server_connect_cb,
+							test_data, vc);
+
+	vc->ril = g_ril_new(rilmodem_test_engine_get_socket_name(vc->engined),
+							OFONO_RIL_VENDOR_AOSP);
+	g_assert(vc->ril != NULL);
+
+	/* Perform test */
+	rilmodem_test_engine_start(vc->engined);
+
+	vcdriver->remove(vc);
+	g_ril_unref(vc->ril);
+
+	rilmodem_test_engine_remove(vc->engined);
+	g_free(vc);
+
+	ril_voicecall_exit();
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+/*
+ * As all our architectures are little-endian except for
+ * PowerPC, and the Binder wire-format differs slightly
+ * depending on endian-ness, the following guards against test
+ * failures when run on PowerPC.
+ */
+#if BYTE_ORDER == LITTLE_ENDIAN
+	g_test_add_data_func("/test-rilmodem-voicecall/1", &test_1,
+								test_function);
+	g_test_add_data_func("/test-rilmodem-voicecall/2", &test_2,
+								test_function);
+#endif
+	return g_test_run();
+}
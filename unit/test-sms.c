@@ -1631,6 +1631,177 @@ static void test_range_minimizer(void)
 	}
 }
 
+/* Topic strings stop at 999, so larger identifiers are listed directly */
+static GSList *topic_ranges(const struct cbs_topic_range *ranges)
+{
+	GSList *r = NULL;
+
+	for (; ranges->max; ranges++)
+		r = g_slist_prepend(r, g_memdup(ranges, sizeof(*ranges)));
+
+	return g_slist_reverse(r);
+}
+
+static const struct cbs_topic_range filter1[] = {
+	{ 0, 20 }, { 33, 33 }, { 50, 60 }, { 4352, 4356 }, { 0, 0 }
+};
+
+static const struct cbs_topic_range filter2[] = {
+	{ 0, 65535 }, { 0, 0 }
+};
+
+static const struct cbs_topic_range filter3[] = {
+	{ 31, 32 }, { 63, 64 }, { 65535, 65535 }, { 0, 0 }
+};
+
+static const struct cbs_topic_range etws_filter[] = {
+	{ 4352, 4355 }, { 0, 0 }
+};
+
+static const struct cbs_topic_range benchmark_filter[] = {
+	{ 0, 999 }, { 4400, 4500 }, { 50000, 50000 }, { 0, 0 }
+};
+
+static void test_cbs_topic_bitmap(void)
+{
+	static const struct cbs_topic_range *filters[] = {
+		filter1, filter2, filter3, NULL
+	};
+	int i;
+
+	g_assert(cbs_topic_bitmap_new(NULL) == NULL);
+	g_assert(!cbs_topic_bitmap_test(NULL, 4352));
+
+	for (i = 0; filters[i]; i++) {
+		GSList *r = topic_ranges(filters[i]);
+		struct cbs_topic_bitmap *bitmap;
+		unsigned int topic;
+
+		g_assert(r != NULL);
+
+		bitmap = cbs_topic_bitmap_new(r);
+		g_assert(bitmap);
+
+		for (topic = 0; topic <= 0xffff; topic++)
+			g_assert(cbs_topic_bitmap_test(bitmap, topic) ==
+					cbs_topic_in_range(topic, r));
+
+		g_assert(!cbs_topic_bitmap_test(bitmap, 0x10000));
+
+		g_free(bitmap);
+		g_slist_foreach(r, (GFunc)g_free, NULL);
+		g_slist_free(r);
+	}
+}
+
+#define CBS_REPLAY_PAGES 3
+
+/*
+ * Feeds the captured pages of cbs1 as CBS_REPLAY_PAGES page messages on
+ * count topics starting at ETWS earthquake, the way a network repeats an
+ * emergency broadcast: every page is sent repeat times, interleaved with
+ * the pages of the other topics.  Topics found in the filter are dropped
+ * before assembly, like SIM data download topics are.
+ */
+static unsigned int cbs_replay(struct cbs_assembly *assembly,
+				const struct cbs_topic_bitmap *filter,
+				unsigned int count, unsigned int repeat)
+{
+	unsigned char *decoded_pdu;
+	long pdu_len;
+	struct cbs page;
+	unsigned int completed = 0;
+	unsigned int r, p, t;
+
+	decoded_pdu = decode_hex(cbs1, -1, &pdu_len, 0);
+	g_assert(cbs_decode(decoded_pdu, pdu_len, &page));
+	g_free(decoded_pdu);
+
+	page.max_pages = CBS_REPLAY_PAGES;
+
+	for (r = 0; r < repeat; r++) {
+		for (p = 1; p <= CBS_REPLAY_PAGES; p++) {
+			for (t = 0; t < count; t++) {
+				GSList *l;
+
+				page.message_identifier = 4352 + t;
+				page.page = p;
+
+				if (cbs_topic_bitmap_test(filter,
+						page.message_identifier))
+					continue;
+
+				l = cbs_assembly_add_page(assembly, &page);
+				if (l == NULL)
+					continue;
+
+				g_assert(g_slist_length(l) ==
+							CBS_REPLAY_PAGES);
+				completed += 1;
+
+				g_slist_foreach(l, (GFunc)g_free, NULL);
+				g_slist_free(l);
+			}
+		}
+	}
+
+	return completed;
+}
+
+static void test_cbs_replay(void)
+{
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	GSList *r = topic_ranges(etws_filter);
+	struct cbs_topic_bitmap *filter = cbs_topic_bitmap_new(r);
+
+	/* Repeated pages complete each message exactly once */
+	g_assert(cbs_replay(assembly, NULL, 64, 4) == 64);
+	g_assert(assembly->assembly_list == NULL);
+	g_assert(g_slist_length(assembly->recv_cell) == 64);
+
+	/* Until the location changes, repeats are not new anymore */
+	g_assert(cbs_replay(assembly, NULL, 64, 1) == 0);
+
+	cbs_assembly_location_changed(assembly, FALSE, FALSE, TRUE);
+	g_assert(assembly->recv_cell == NULL);
+
+	g_assert(cbs_replay(assembly, filter, 64, 2) == 60);
+
+	cbs_assembly_free(assembly);
+	g_free(filter);
+	g_slist_foreach(r, (GFunc)g_free, NULL);
+	g_slist_free(r);
+}
+
+static void test_cbs_replay_benchmark(void)
+{
+	static const unsigned int topics[] = { 16, 256, 4096 };
+	GSList *r = topic_ranges(benchmark_filter);
+	struct cbs_topic_bitmap *filter = cbs_topic_bitmap_new(r);
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(topics); i++) {
+		struct cbs_assembly *assembly = cbs_assembly_new();
+		unsigned int pages = topics[i] * CBS_REPLAY_PAGES * 8;
+		gint64 start = g_get_monotonic_time();
+		double elapsed;
+
+		cbs_replay(assembly, filter, topics[i], 8);
+
+		elapsed = g_get_monotonic_time() - start;
+
+		g_test_minimized_result(elapsed / pages,
+					"%u topics: %.3f us per page",
+					topics[i], elapsed / pages);
+
+		cbs_assembly_free(assembly);
+	}
+
+	g_free(filter);
+	g_slist_foreach(r, (GFunc)g_free, NULL);
+	g_slist_free(r);
+}
+
 static void test_sr_assembly(void)
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1890,6 +2061,12 @@ int main(int argc, char **argv)
 			test_cbs_padding_character);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/CBS Topic Bitmap", test_cbs_topic_bitmap);
+	g_test_add_func("/testsms/CBS Replay", test_cbs_replay);
+
+	if (g_test_perf())
+		g_test_add_func("/testsms/CBS Replay Benchmark",
+					test_cbs_replay_benchmark);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
 
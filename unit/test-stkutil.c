@@ -22273,6 +22273,72 @@ static void test_img_to_xpm(gconstpointer data)
 	g_free(xpm);
 }
 
+struct benchmark_pdu {
+	const unsigned char *pdu;
+	unsigned int pdu_len;
+};
+
+/* The largest captured PDU of each command type plus typical menus */
+static const struct benchmark_pdu benchmark_pdus[] = {
+	{ display_text_111, sizeof(display_text_111) },
+	{ display_text_311, sizeof(display_text_311) },
+	{ get_inkey_161, sizeof(get_inkey_161) },
+	{ get_input_521, sizeof(get_input_521) },
+	{ play_tone_119, sizeof(play_tone_119) },
+	{ setup_menu_111, sizeof(setup_menu_111) },
+	{ setup_menu_123, sizeof(setup_menu_123) },
+	{ select_item_111, sizeof(select_item_111) },
+	{ select_item_151, sizeof(select_item_151) },
+	{ send_sms_161, sizeof(send_sms_161) },
+	{ send_ss_151, sizeof(send_ss_151) },
+	{ send_ussd_161, sizeof(send_ussd_161) },
+	{ setup_call_1101, sizeof(setup_call_1101) },
+	{ refresh_121, sizeof(refresh_121) },
+	{ setup_event_list_121, sizeof(setup_event_list_121) },
+	{ perform_card_apdu_125, sizeof(perform_card_apdu_125) },
+	{ timer_mgmt_221, sizeof(timer_mgmt_221) },
+	{ setup_idle_mode_text_171, sizeof(setup_idle_mode_text_171) },
+	{ run_at_command_411, sizeof(run_at_command_411) },
+	{ send_dtmf_311, sizeof(send_dtmf_311) },
+	{ launch_browser_311, sizeof(launch_browser_311) },
+	{ open_channel_511, sizeof(open_channel_511) },
+	{ send_data_121, sizeof(send_data_121) },
+};
+
+static void test_parse_benchmark(void)
+{
+	static const unsigned int rounds = 2000;
+	unsigned int i, j;
+	unsigned long bytes = 0;
+	gint64 start;
+	double elapsed;
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < G_N_ELEMENTS(benchmark_pdus); j++) {
+			const struct benchmark_pdu *b = &benchmark_pdus[j];
+			struct stk_command *command;
+
+			command = stk_command_new_from_pdu(b->pdu, b->pdu_len);
+			g_assert(command);
+			g_assert(command->status == STK_PARSE_RESULT_OK);
+
+			stk_command_free(command);
+			bytes += b->pdu_len;
+		}
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+
+	g_test_minimized_result(elapsed * 1000 /
+				(rounds * G_N_ELEMENTS(benchmark_pdus)),
+				"%.1f ns per command, %.1f MB/s",
+				elapsed * 1000 /
+				(rounds * G_N_ELEMENTS(benchmark_pdus)),
+				bytes / elapsed);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -24385,5 +24451,9 @@ int main(int argc, char **argv)
 	g_test_add_data_func("/teststk/IMG to XPM Test 6",
 				&xpm_test_6, test_img_to_xpm);
 
+	if (g_test_perf())
+		g_test_add_func("/teststk/Parse Benchmark",
+					test_parse_benchmark);
+
 	return g_test_run();
 }
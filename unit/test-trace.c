@@ -0,0 +1,155 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "ofono.h"
+
+/*
+ * Each format is recorded, dumped and then compared against what
+ * printf makes of the same arguments.
+ */
+#define CHECK(fmt, ...)						\
+do {								\
+	char *expected = g_strdup_printf(fmt, __VA_ARGS__);	\
+	GSList *lines = NULL;					\
+								\
+	__ofono_trace_record(fmt, __VA_ARGS__);			\
+	g_assert(__ofono_trace_dump(collect_line, &lines) == 1);\
+	g_assert_cmpstr(lines->data, ==, expected);		\
+								\
+	g_slist_free_full(lines, g_free);			\
+	g_free(expected);					\
+} while (0)
+
+static void collect_line(gint64 time, const char *line, void *data)
+{
+	GSList **lines = data;
+
+	*lines = g_slist_append(*lines, g_strdup(line));
+}
+
+static void test_format(void)
+{
+	char *long_string = g_strnfill(300, 'a');
+	GSList *lines = NULL;
+
+	g_assert(__ofono_trace_init(0) == 0);
+	g_assert(__ofono_trace_active());
+
+	CHECK("plain %d %i", -42, 7);
+	CHECK("unsigned %u %x %X %o", 42U, 0xbeefU, 0xcafeU, 8U);
+	CHECK("long %ld %lu %lld %llu", -1L, 2UL, -3LL, 4ULL);
+	CHECK("size %zu %zd", (size_t) 1 << 20, (ssize_t) -5);
+	CHECK("short %hd %hhu", -1, 255);
+	CHECK("char %c%c", 'o', 'k');
+	CHECK("double %f %.2e %g", 1.5, 12345.678, 0.25);
+	CHECK("string %s %-8s|%8s|", "at", "ril", "qmi");
+	CHECK("star %*d|%-*.*s|", 5, 3, 6, 2, "truncate");
+	CHECK("percent %d%%", 100);
+	CHECK("null %s", (char *) NULL);
+	CHECK("pointer %p", (void *) &lines);
+
+	/* Strings are cut short to keep records bounded */
+	__ofono_trace_record("long %s", long_string);
+	g_assert(__ofono_trace_dump(collect_line, &lines) == 1);
+	g_assert_cmpuint(strlen(lines->data), ==, strlen("long ") + 255);
+	g_slist_free_full(lines, g_free);
+	g_free(long_string);
+
+	__ofono_trace_cleanup();
+	g_assert(!__ofono_trace_active());
+}
+
+static void test_overwrite(void)
+{
+	GSList *lines = NULL;
+	GSList *l;
+	unsigned int first;
+	unsigned int i;
+
+	/* Rounded up to the smallest ring possible */
+	g_assert(__ofono_trace_init(1) == 0);
+
+	for (i = 0; i < 10000; i++)
+		__ofono_trace_record("record %u of %s", i, "many");
+
+	g_assert(__ofono_trace_dump(collect_line, &lines) > 0);
+
+	/* The newest records survive, in order and without gaps */
+	g_assert(sscanf(lines->data, "record %u", &first) == 1);
+	g_assert_cmpuint(first, >, 0);
+
+	for (l = lines, i = first; l; l = l->next, i++) {
+		char *expected = g_strdup_printf("record %u of many", i);
+
+		g_assert_cmpstr(l->data, ==, expected);
+		g_free(expected);
+	}
+
+	g_assert_cmpuint(i, ==, 10000);
+	g_slist_free_full(lines, g_free);
+
+	/* Dumping empties the ring */
+	g_assert(__ofono_trace_dump(collect_line, &lines) == 0);
+
+	__ofono_trace_cleanup();
+}
+
+static void test_record_benchmark(void)
+{
+	static const unsigned int rounds = 1000000;
+	gint64 start;
+	double elapsed;
+	unsigned int i;
+
+	g_assert(__ofono_trace_init(0) == 0);
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < rounds; i++)
+		__ofono_trace_record("%s: request %u token %d", "rild", i, 5);
+
+	elapsed = g_get_monotonic_time() - start;
+
+	__ofono_trace_cleanup();
+
+	g_test_minimized_result(elapsed * 1000 / rounds,
+				"%.1f ns per record", elapsed * 1000 / rounds);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testtrace/format", test_format);
+	g_test_add_func("/testtrace/overwrite", test_overwrite);
+
+	if (g_test_perf())
+		g_test_add_func("/testtrace/record_benchmark",
+					test_record_benchmark);
+
+	return g_test_run();
+}
@@ -0,0 +1,345 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "ofono.h"
+
+#define N_WATCHES 64
+
+struct test_watch {
+	struct ofono_watchlist_item item;
+	unsigned int index;
+};
+
+struct dispatch_data {
+	struct ofono_watchlist *watchlist;
+	unsigned int ids[N_WATCHES];
+	unsigned int calls[N_WATCHES];
+	unsigned int destroyed;
+	unsigned int added;
+};
+
+static void destroy_watch(gpointer data)
+{
+	g_free(data);
+}
+
+static void notify_data_destroy(gpointer user_data)
+{
+	struct dispatch_data *dd = user_data;
+
+	dd->destroyed += 1;
+}
+
+static unsigned int add_watch(struct dispatch_data *dd, unsigned int index,
+					void *notify)
+{
+	struct test_watch *watch = g_new0(struct test_watch, 1);
+
+	watch->index = index;
+	watch->item.notify = notify;
+	watch->item.notify_data = dd;
+	watch->item.destroy = notify_data_destroy;
+
+	return __ofono_watchlist_add_item(dd->watchlist, &watch->item);
+}
+
+static unsigned int dispatch(struct dispatch_data *dd)
+{
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+	unsigned int visited = 0;
+
+	__ofono_watchlist_iter_init(dd->watchlist, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		void (*notify)(struct test_watch *, struct dispatch_data *);
+
+		notify = item->notify;
+		notify((struct test_watch *) item, dd);
+		visited += 1;
+	}
+
+	__ofono_watchlist_iter_end(&iter);
+
+	return visited;
+}
+
+/* Looks an item up the way the dispatchers see it */
+static struct ofono_watchlist_item *find_item(struct dispatch_data *dd,
+						unsigned int id)
+{
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+
+	__ofono_watchlist_iter_init(dd->watchlist, &iter);
+
+	while ((item = __ofono_watchlist_iter_next(&iter)))
+		if (item->id == id)
+			break;
+
+	__ofono_watchlist_iter_end(&iter);
+
+	return item;
+}
+
+static void count_notify(struct test_watch *watch, struct dispatch_data *dd)
+{
+	dd->calls[watch->index] += 1;
+}
+
+static void test_basic(void)
+{
+	struct dispatch_data dd;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+	unsigned int i;
+
+	memset(&dd, 0, sizeof(dd));
+	dd.watchlist = __ofono_watchlist_new(destroy_watch);
+
+	for (i = 0; i < N_WATCHES; i++) {
+		dd.ids[i] = add_watch(&dd, i, count_notify);
+		g_assert(dd.ids[i] == i + 1);
+	}
+
+	/* Newest watches are notified first */
+	__ofono_watchlist_iter_init(dd.watchlist, &iter);
+
+	for (i = N_WATCHES; i > 0; i--) {
+		item = __ofono_watchlist_iter_next(&iter);
+		g_assert(item);
+		g_assert(item->id == dd.ids[i - 1]);
+	}
+
+	g_assert(__ofono_watchlist_iter_next(&iter) == NULL);
+	__ofono_watchlist_iter_end(&iter);
+
+	for (i = 0; i < N_WATCHES; i++) {
+		item = find_item(&dd, dd.ids[i]);
+		g_assert(item);
+		g_assert(((struct test_watch *) item)->index == i);
+	}
+
+	for (i = 0; i < N_WATCHES; i += 2)
+		g_assert(__ofono_watchlist_remove_item(dd.watchlist,
+							dd.ids[i]));
+
+	g_assert(dd.destroyed == N_WATCHES / 2);
+	g_assert(!__ofono_watchlist_remove_item(dd.watchlist, dd.ids[0]));
+	g_assert(find_item(&dd, dd.ids[0]) == NULL);
+
+	/* Lookups must survive the compaction triggered above */
+	for (i = 1; i < N_WATCHES; i += 2) {
+		item = find_item(&dd, dd.ids[i]);
+		g_assert(item);
+		g_assert(((struct test_watch *) item)->index == i);
+	}
+
+	g_assert(dispatch(&dd) == N_WATCHES / 2);
+
+	for (i = 0; i < N_WATCHES; i++)
+		g_assert(dd.calls[i] == i % 2);
+
+	__ofono_watchlist_free(dd.watchlist);
+	g_assert(dd.destroyed == N_WATCHES);
+}
+
+static void remove_self_notify(struct test_watch *watch,
+					struct dispatch_data *dd)
+{
+	dd->calls[watch->index] += 1;
+
+	g_assert(__ofono_watchlist_remove_item(dd->watchlist,
+						dd->ids[watch->index]));
+}
+
+static void test_remove_self(void)
+{
+	struct dispatch_data dd;
+	unsigned int i;
+
+	memset(&dd, 0, sizeof(dd));
+	dd.watchlist = __ofono_watchlist_new(destroy_watch);
+
+	for (i = 0; i < N_WATCHES; i++)
+		dd.ids[i] = add_watch(&dd, i, remove_self_notify);
+
+	g_assert(dispatch(&dd) == N_WATCHES);
+	g_assert(dd.destroyed == N_WATCHES);
+	g_assert(dispatch(&dd) == 0);
+
+	for (i = 0; i < N_WATCHES; i++)
+		g_assert(dd.calls[i] == 1);
+
+	__ofono_watchlist_free(dd.watchlist);
+	g_assert(dd.destroyed == N_WATCHES);
+}
+
+static void remove_others_notify(struct test_watch *watch,
+					struct dispatch_data *dd)
+{
+	unsigned int i;
+
+	dd->calls[watch->index] += 1;
+
+	/* Drop every older watch that shares our parity */
+	for (i = watch->index % 2; i < watch->index; i += 2)
+		__ofono_watchlist_remove_item(dd->watchlist, dd->ids[i]);
+}
+
+static void test_remove_others(void)
+{
+	struct dispatch_data dd;
+	unsigned int i;
+
+	memset(&dd, 0, sizeof(dd));
+	dd.watchlist = __ofono_watchlist_new(destroy_watch);
+
+	for (i = 0; i < N_WATCHES; i++)
+		dd.ids[i] = add_watch(&dd, i, remove_others_notify);
+
+	dispatch(&dd);
+
+	/*
+	 * Watch N_WATCHES - 1 removes all older watches of the same
+	 * parity, N_WATCHES - 2 then removes the rest.  Nothing removed
+	 * may be notified afterwards.
+	 */
+	g_assert(dd.calls[N_WATCHES - 1] == 1);
+	g_assert(dd.calls[N_WATCHES - 2] == 1);
+
+	for (i = 0; i < N_WATCHES - 2; i++)
+		g_assert(dd.calls[i] == 0);
+
+	g_assert(dd.destroyed == N_WATCHES - 2);
+	g_assert(dispatch(&dd) == 2);
+
+	__ofono_watchlist_free(dd.watchlist);
+	g_assert(dd.destroyed == N_WATCHES);
+}
+
+static void add_notify(struct test_watch *watch, struct dispatch_data *dd)
+{
+	unsigned int index;
+
+	dd->calls[watch->index] += 1;
+
+	if (dd->added == N_WATCHES)
+		return;
+
+	index = dd->added++;
+	dd->ids[index] = add_watch(dd, index, count_notify);
+}
+
+static void test_add_during_dispatch(void)
+{
+	struct dispatch_data dd;
+	unsigned int i;
+
+	memset(&dd, 0, sizeof(dd));
+	dd.watchlist = __ofono_watchlist_new(destroy_watch);
+
+	for (i = 0; i < 4; i++) {
+		struct test_watch *watch = g_new0(struct test_watch, 1);
+
+		watch->index = i;
+		watch->item.notify = add_notify;
+		watch->item.notify_data = &dd;
+		__ofono_watchlist_add_item(dd.watchlist, &watch->item);
+	}
+
+	/* Watches added from a callback are not part of the current walk */
+	g_assert(dispatch(&dd) == 4);
+	g_assert(dd.added == 4);
+
+	while (dd.added < N_WATCHES)
+		dispatch(&dd);
+
+	/* Ids stay unique and resolvable after the slot array has grown */
+	for (i = 0; i < N_WATCHES; i++) {
+		struct ofono_watchlist_item *item;
+
+		item = find_item(&dd, dd.ids[i]);
+		g_assert(item);
+		g_assert(item->notify == count_notify);
+	}
+
+	__ofono_watchlist_free(dd.watchlist);
+	g_assert(dd.destroyed == N_WATCHES);
+}
+
+static void nested_notify(struct test_watch *watch, struct dispatch_data *dd)
+{
+	dd->calls[watch->index] += 1;
+
+	if (watch->index != N_WATCHES - 1)
+		return;
+
+	/* Remove itself and the oldest watch, then walk again */
+	__ofono_watchlist_remove_item(dd->watchlist, dd->ids[watch->index]);
+	__ofono_watchlist_remove_item(dd->watchlist, dd->ids[0]);
+	dispatch(dd);
+}
+
+static void test_nested_dispatch(void)
+{
+	struct dispatch_data dd;
+	unsigned int i;
+
+	memset(&dd, 0, sizeof(dd));
+	dd.watchlist = __ofono_watchlist_new(destroy_watch);
+
+	for (i = 0; i < N_WATCHES; i++)
+		dd.ids[i] = add_watch(&dd, i, nested_notify);
+
+	dispatch(&dd);
+
+	g_assert(dd.calls[N_WATCHES - 1] == 1);
+	g_assert(dd.calls[0] == 0);
+
+	for (i = 1; i < N_WATCHES - 1; i++)
+		g_assert(dd.calls[i] == 2);
+
+	g_assert(dd.destroyed == 2);
+	g_assert(dispatch(&dd) == N_WATCHES - 2);
+
+	__ofono_watchlist_free(dd.watchlist);
+	g_assert(dd.destroyed == N_WATCHES);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testwatch/basic", test_basic);
+	g_test_add_func("/testwatch/remove_self", test_remove_self);
+	g_test_add_func("/testwatch/remove_others", test_remove_others);
+	g_test_add_func("/testwatch/add_during_dispatch",
+					test_add_during_dispatch);
+	g_test_add_func("/testwatch/nested_dispatch", test_nested_dispatch);
+
+	return g_test_run();
+}